@@ -147,6 +147,7 @@ useless_free_options =				\
   --name=virInterfaceProtocolDefFree		\
   --name=virJSONValueFree			\
   --name=virLastErrFreeData			\
+  --name=virLXCStatsFree                        \
   --name=virNetMessageFree                      \
   --name=virNetServerMDNSFree                   \
   --name=virNetServerMDNSEntryFree              \
@@ -166,6 +167,7 @@ useless_free_options =				\
   --name=virObjectUnref                         \
   --name=virObjectFreeCallback                  \
   --name=virPCIDeviceFree                       \
+  --name=virRelayFree                           \
   --name=virSecretDefFree			\
   --name=virStorageEncryptionFree		\
   --name=virStorageEncryptionSecretFree		\
@@ -813,6 +813,7 @@ virCapabilitiesFormatXML(virCapsPtr caps)
     size_t i, j, k;
     char host_uuid[VIR_UUID_STRING_BUFLEN];
 
+    virBufferScratchAcquire(&buf);
     virBufferAddLit(&buf, "<capabilities>\n\n");
     virBufferAdjustIndent(&buf, 2);
     virBufferAddLit(&buf, "<host>\n");
@@ -994,7 +995,7 @@ virCapabilitiesFormatXML(virCapsPtr caps)
         return NULL;
     }
 
-    return virBufferContentAndReset(&buf);
+    return virBufferScratchContentAndReset(&buf);
 }
 
 /* get the maximum ID of cpus in the host */
@@ -53,6 +53,7 @@
 #include "device_conf.h"
 #include "virtpm.h"
 #include "virstring.h"
+#include "vircrypto.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -1273,10 +1274,25 @@ virDomainDiskSourceDefClear(virDomainDiskSourceDefPtr def)
 }
 
 
+/* Drop one owner of a device definition which may be shared by
+ * several domain definitions.  Returns true if the caller held the
+ * last reference and has to free the device.  */
+static bool
+virDomainDeviceDefUnref(int *refs)
+{
+    if (*refs > 1) {
+        (*refs)--;
+        return false;
+    }
+
+    return true;
+}
+
+
 void
 virDomainDiskDefFree(virDomainDiskDefPtr def)
 {
-    if (!def)
+    if (!def || !virDomainDeviceDefUnref(&def->refs))
         return;
 
     virDomainDiskSourceDefClear(&def->src);
@@ -1450,7 +1466,7 @@ virDomainDiskSetFormat(virDomainDiskDefPtr def, int format)
 
 void virDomainControllerDefFree(virDomainControllerDefPtr def)
 {
-    if (!def)
+    if (!def || !virDomainDeviceDefUnref(&def->refs))
         return;
 
     virDomainDeviceInfoClear(&def->info);
@@ -1498,7 +1514,7 @@ virDomainActualNetDefFree(virDomainActualNetDefPtr def)
 
 void virDomainNetDefFree(virDomainNetDefPtr def)
 {
-    if (!def)
+    if (!def || !virDomainDeviceDefUnref(&def->refs))
         return;
 
     VIR_FREE(def->model);
@@ -1601,6 +1617,7 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
         return -1;
 
     virDomainChrSourceDefClear(dest);
+    dest->type = src->type;
 
     switch (src->type) {
     case VIR_DOMAIN_CHR_TYPE_PTY:
@@ -1631,15 +1648,28 @@ virDomainChrSourceDefCopy(virDomainChrSourceDefPtr dest,
 
         if (VIR_STRDUP(dest->data.tcp.service, src->data.tcp.service) < 0)
             return -1;
+
+        dest->data.tcp.listen = src->data.tcp.listen;
+        dest->data.tcp.protocol = src->data.tcp.protocol;
         break;
 
     case VIR_DOMAIN_CHR_TYPE_UNIX:
         if (VIR_STRDUP(dest->data.nix.path, src->data.nix.path) < 0)
             return -1;
+
+        dest->data.nix.listen = src->data.nix.listen;
         break;
-    }
 
-    dest->type = src->type;
+    case VIR_DOMAIN_CHR_TYPE_SPICEVMC:
+        dest->data.spicevmc = src->data.spicevmc;
+        break;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEPORT:
+        if (VIR_STRDUP(dest->data.spiceport.channel,
+                       src->data.spiceport.channel) < 0)
+            return -1;
+        break;
+    }
 
     return 0;
 }
@@ -2722,13 +2752,18 @@ virDomainDeviceInfoCopy(virDomainDeviceInfoPtr dst,
     /* first a shallow copy of *everything* */
     *dst = *src;
 
-    /* then redo the two fields that are pointers */
+    /* then redo the fields that are pointers */
     dst->alias = NULL;
     dst->romfile = NULL;
+    if (src->type == VIR_DOMAIN_DEVICE_ADDRESS_TYPE_USB)
+        dst->addr.usb.port = NULL;
 
     if (VIR_STRDUP(dst->alias, src->alias) < 0 ||
         VIR_STRDUP(dst->romfile, src->romfile) < 0)
         return -1;
+    if (src->type == VIR_DOMAIN_DEVICE_ADDRESS_TYPE_USB &&
+        VIR_STRDUP(dst->addr.usb.port, src->addr.usb.port) < 0)
+        return -1;
     return 0;
 }
 
@@ -11256,6 +11291,74 @@ virDomainDefMaybeAddHostdevSCSIcontroller(virDomainDefPtr def)
     return 0;
 }
 
+/*
+ * Collect the element children of the <devices> elements of @root in a
+ * single walk, so that each type of device need not be looked up with
+ * XPath separately.
+ */
+static int
+virDomainDefCollectDeviceNodes(xmlNodePtr root,
+                               xmlNodePtr **devnodes,
+                               size_t *ndevnodes)
+{
+    xmlNodePtr devices;
+    xmlNodePtr cur;
+
+    for (devices = root->children; devices; devices = devices->next) {
+        if (devices->type != XML_ELEMENT_NODE || devices->ns ||
+            !xmlStrEqual(devices->name, BAD_CAST "devices"))
+            continue;
+
+        for (cur = devices->children; cur; cur = cur->next) {
+            if (cur->type != XML_ELEMENT_NODE || cur->ns)
+                continue;
+
+            if (VIR_APPEND_ELEMENT_COPY(*devnodes, *ndevnodes, cur) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Select the devices named @name among @devnodes, in document order.
+ * Returns the number of devices found in which case @nodes is set (and
+ * must be freed), or -1 on error, like virXPathNodeSet().
+ */
+static int
+virDomainDefGetDeviceNodes(xmlNodePtr *devnodes,
+                           size_t ndevnodes,
+                           const char *name,
+                           xmlNodePtr **nodes)
+{
+    size_t i;
+    int n = 0;
+
+    *nodes = NULL;
+
+    for (i = 0; i < ndevnodes; i++) {
+        if (xmlStrEqual(devnodes[i]->name, BAD_CAST name))
+            n++;
+    }
+
+    if (!n)
+        return 0;
+
+    if (VIR_ALLOC_N(*nodes, n) < 0)
+        return -1;
+
+    n = 0;
+    for (i = 0; i < ndevnodes; i++) {
+        if (xmlStrEqual(devnodes[i]->name, BAD_CAST name))
+            (*nodes)[n++] = devnodes[i];
+    }
+
+    return n;
+}
+
+
 static virDomainDefPtr
 virDomainDefParseXML(xmlDocPtr xml,
                      xmlNodePtr root,
@@ -11266,6 +11369,8 @@ virDomainDefParseXML(xmlDocPtr xml,
                      unsigned int flags)
 {
     xmlNodePtr *nodes = NULL, node = NULL;
+    xmlNodePtr *devnodes = NULL;
+    size_t ndevnodes = 0;
     char *tmp = NULL;
     size_t i;
     int n;
@@ -12255,8 +12360,12 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     def->emulator = virXPathString("string(./devices/emulator[1])", ctxt);
 
+    if (virDomainDefCollectDeviceNodes(ctxt->node, &devnodes, &ndevnodes) < 0)
+        goto error;
+
     /* analysis of the disk devices */
-    if ((n = virXPathNodeSet("./devices/disk", ctxt, &nodes)) < 0)
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "disk", &nodes)) < 0)
         goto error;
 
     if (n && VIR_ALLOC_N(def->disks, n) < 0)
@@ -12278,7 +12387,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the controller devices */
-    if ((n = virXPathNodeSet("./devices/controller", ctxt, &nodes)) < 0)
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "controller", &nodes)) < 0)
         goto error;
 
     if (n && VIR_ALLOC_N(def->controllers, n) < 0)
@@ -12328,7 +12438,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the resource leases */
-    if ((n = virXPathNodeSet("./devices/lease", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "lease", &nodes)) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        "%s", _("cannot extract device leases"));
         goto error;
@@ -12345,7 +12456,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the filesystems */
-    if ((n = virXPathNodeSet("./devices/filesystem", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "filesystem", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->fss, n) < 0)
@@ -12361,7 +12473,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the network devices */
-    if ((n = virXPathNodeSet("./devices/interface", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "interface", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->nets, n) < 0)
@@ -12390,7 +12503,8 @@ virDomainDefParseXML(xmlDocPtr xml,
 
 
     /* analysis of the smartcard devices */
-    if ((n = virXPathNodeSet("./devices/smartcard", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "smartcard", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->smartcards, n) < 0)
@@ -12408,7 +12522,8 @@ virDomainDefParseXML(xmlDocPtr xml,
 
 
     /* analysis of the character devices */
-    if ((n = virXPathNodeSet("./devices/parallel", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "parallel", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->parallels, n) < 0)
@@ -12436,7 +12551,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/serial", ctxt, &nodes)) < 0)
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "serial", &nodes)) < 0)
         goto error;
 
     if (n && VIR_ALLOC_N(def->serials, n) < 0)
@@ -12464,7 +12580,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/console", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "console", &nodes)) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        "%s", _("cannot extract console devices"));
         goto error;
@@ -12486,7 +12603,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/channel", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "channel", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->channels, n) < 0)
@@ -12527,7 +12645,8 @@ virDomainDefParseXML(xmlDocPtr xml,
 
 
     /* analysis of the input devices */
-    if ((n = virXPathNodeSet("./devices/input", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "input", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->inputs, n) < 0)
@@ -12569,7 +12688,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the graphics devices */
-    if ((n = virXPathNodeSet("./devices/graphics", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "graphics", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->graphics, n) < 0)
@@ -12605,7 +12725,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the sound devices */
-    if ((n = virXPathNodeSet("./devices/sound", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "sound", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->sounds, n) < 0)
@@ -12622,7 +12743,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the video devices */
-    if ((n = virXPathNodeSet("./devices/video", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "video", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->videos, n) < 0)
@@ -12679,7 +12801,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the host devices */
-    if ((n = virXPathNodeSet("./devices/hostdev", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "hostdev", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_REALLOC_N(def->hostdevs, def->nhostdevs + n) < 0)
@@ -12709,7 +12832,8 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     /* analysis of the watchdog devices */
     def->watchdog = NULL;
-    if ((n = virXPathNodeSet("./devices/watchdog", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "watchdog", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12729,7 +12853,8 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     /* analysis of the memballoon devices */
     def->memballoon = NULL;
-    if ((n = virXPathNodeSet("./devices/memballoon", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "memballoon", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12748,7 +12873,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* Parse the RNG device */
-    if ((n = virXPathNodeSet("./devices/rng", ctxt, &nodes)) < 0)
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "rng", &nodes)) < 0)
         goto error;
 
     if (n > 1) {
@@ -12765,7 +12891,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* Parse the TPM devices */
-    if ((n = virXPathNodeSet("./devices/tpm", ctxt, &nodes)) < 0)
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "tpm", &nodes)) < 0)
         goto error;
 
     if (n > 1) {
@@ -12780,7 +12907,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
     VIR_FREE(nodes);
 
-    if ((n = virXPathNodeSet("./devices/nvram", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "nvram", &nodes)) < 0) {
         goto error;
     }
 
@@ -12798,7 +12926,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     }
 
     /* analysis of the hub devices */
-    if ((n = virXPathNodeSet("./devices/hub", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "hub", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->hubs, n) < 0)
@@ -12821,7 +12950,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the redirected devices */
-    if ((n = virXPathNodeSet("./devices/redirdev", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "redirdev", &nodes)) < 0) {
         goto error;
     }
     if (n && VIR_ALLOC_N(def->redirdevs, n) < 0)
@@ -12845,7 +12975,8 @@ virDomainDefParseXML(xmlDocPtr xml,
     VIR_FREE(nodes);
 
     /* analysis of the redirection filter rules */
-    if ((n = virXPathNodeSet("./devices/redirfilter", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "redirfilter", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12866,7 +12997,8 @@ virDomainDefParseXML(xmlDocPtr xml,
 
     /* analysis of the panic devices */
     def->panic = NULL;
-    if ((n = virXPathNodeSet("./devices/panic", ctxt, &nodes)) < 0) {
+    if ((n = virDomainDefGetDeviceNodes(devnodes, ndevnodes,
+                                        "panic", &nodes)) < 0) {
         goto error;
     }
     if (n > 1) {
@@ -12883,6 +13015,7 @@ virDomainDefParseXML(xmlDocPtr xml,
         def->panic = panic;
         VIR_FREE(nodes);
     }
+    VIR_FREE(devnodes);
 
 
     /* analysis of the user namespace mapping */
@@ -12994,6 +13127,7 @@ virDomainDefParseXML(xmlDocPtr xml,
  error:
     VIR_FREE(tmp);
     VIR_FREE(nodes);
+    VIR_FREE(devnodes);
     virHashFree(bootHash);
     virDomainDefFree(def);
     return NULL;
@@ -17870,12 +18004,16 @@ char *
 virDomainDefFormat(virDomainDefPtr def, unsigned int flags)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *xml;
 
     virCheckFlags(DUMPXML_FLAGS, NULL);
+    virBufferScratchAcquire(&buf);
     if (virDomainDefFormatInternal(def, flags, &buf) < 0)
         return NULL;
 
-    return virBufferContentAndReset(&buf);
+    if (!(xml = virBufferScratchContentAndReset(&buf)))
+        virReportOOMError();
+    return xml;
 }
 
 
@@ -17885,10 +18023,12 @@ virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
                    unsigned int flags)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *xml;
     int state;
     int reason;
     size_t i;
 
+    virBufferScratchAcquire(&buf);
     state = virDomainObjGetState(obj, &reason);
     virBufferAsprintf(&buf, "<domstatus state='%s' reason='%s' pid='%lld'>\n",
                       virDomainStateTypeToString(state),
@@ -17912,10 +18052,11 @@ virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
     virBufferAdjustIndent(&buf, -2);
     virBufferAddLit(&buf, "</domstatus>\n");
 
-    if (virBufferError(&buf))
+    if (virBufferError(&buf) ||
+        !(xml = virBufferScratchContentAndReset(&buf)))
         goto no_memory;
 
-    return virBufferContentAndReset(&buf);
+    return xml;
 
  no_memory:
     virReportOOMError();
@@ -18664,34 +18805,1561 @@ virDomainDiskDefForeachPath(virDomainDiskDefPtr disk,
 }
 
 
-/* Copy src into a new definition; with the quality of the copy
- * depending on the migratable flag (false for transitions between
- * persistent and active, true for transitions across save files or
- * snapshots).  */
-virDomainDefPtr
-virDomainDefCopy(virDomainDefPtr src,
-                 virCapsPtr caps,
-                 virDomainXMLOptionPtr xmlopt,
-                 bool migratable)
+/*
+ * Native deep copy of domain definitions.
+ *
+ * Formatting a definition to XML and parsing it back used to be the
+ * only way to copy it, which is expensive for large guests and is
+ * done on every start, save and snapshot.  The helpers below clone the
+ * structures directly instead.  The result is the definition the
+ * round trip in virDomainDefCopyXML() would yield for a non-migratable
+ * copy: live-only state that is never parsed back from inactive XML
+ * (aliases, generated names, auto-allocated ports, dynamic labels,
+ * ...) is dropped here too.  Definitions which cannot be cloned this
+ * way are reported by virDomainDefCanClone().
+ */
+
+static int
+virDomainDeviceInfoClone(virDomainDeviceInfoPtr dst,
+                         const virDomainDeviceInfo *src)
 {
-    char *xml;
-    virDomainDefPtr ret;
-    unsigned int write_flags = VIR_DOMAIN_XML_WRITE_FLAGS;
-    unsigned int read_flags = VIR_DOMAIN_XML_READ_FLAGS;
+    *dst = *src;
 
-    if (migratable)
-        write_flags |= VIR_DOMAIN_XML_INACTIVE | VIR_DOMAIN_XML_MIGRATABLE;
+    /* aliases are assigned on startup and never parsed as inactive */
+    dst->alias = NULL;
+    dst->romfile = NULL;
+    if (src->type == VIR_DOMAIN_DEVICE_ADDRESS_TYPE_USB)
+        dst->addr.usb.port = NULL;
 
-    /* Easiest to clone via a round-trip through XML.  */
-    if (!(xml = virDomainDefFormat(src, write_flags)))
+    if (VIR_STRDUP(dst->romfile, src->romfile) < 0)
+        return -1;
+    if (src->type == VIR_DOMAIN_DEVICE_ADDRESS_TYPE_USB &&
+        VIR_STRDUP(dst->addr.usb.port, src->addr.usb.port) < 0)
+        return -1;
+    return 0;
+}
+
+
+/* Mirrors the labels virSecurityLabelDefFormat() skips */
+static bool
+virSecurityLabelDefIsFormatted(const virSecurityLabelDef *def)
+{
+    if (def->type == VIR_DOMAIN_SECLABEL_DEFAULT)
+        return false;
+
+    if (STREQ_NULLABLE(def->model, "dac") && def->implicit)
+        return false;
+
+    return true;
+}
+
+
+static virSecurityLabelDefPtr
+virSecurityLabelDefClone(const virSecurityLabelDef *src)
+{
+    virSecurityLabelDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
         return NULL;
 
-    ret = virDomainDefParseString(xml, caps, xmlopt, -1, read_flags);
+    def->type = src->type;
+    def->norelabel = src->norelabel;
 
-    VIR_FREE(xml);
-    return ret;
+    if (VIR_STRDUP(def->model, src->model) < 0)
+        goto error;
+
+    if (def->type == VIR_DOMAIN_SECLABEL_NONE) {
+        def->norelabel = true;
+        return def;
+    }
+
+    /* Only static labels survive; dynamic labels and the image label
+     * are generated again on startup. */
+    if (def->type == VIR_DOMAIN_SECLABEL_STATIC &&
+        VIR_STRDUP(def->label, src->label) < 0)
+        goto error;
+
+    if (def->type == VIR_DOMAIN_SECLABEL_DYNAMIC &&
+        VIR_STRDUP(def->baselabel, src->baselabel) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virSecurityLabelDefFree(def);
+    return NULL;
+}
+
+
+static int
+virSecurityDeviceLabelDefsClone(virSecurityDeviceLabelDefPtr **dst,
+                                size_t *ndst,
+                                virSecurityDeviceLabelDefPtr *src,
+                                size_t nsrc,
+                                bool inactive)
+{
+    virSecurityDeviceLabelDefPtr seclabel = NULL;
+    size_t i;
+
+    for (i = 0; i < nsrc; i++) {
+        /* Inactive XML omits overrides which do not change anything */
+        if (inactive && !src[i]->label && !src[i]->norelabel)
+            continue;
+
+        if (VIR_ALLOC(seclabel) < 0)
+            goto error;
+
+        /* labelskip is live-only and replaces the relabel attribute */
+        seclabel->norelabel = src[i]->labelskip ? false : src[i]->norelabel;
+
+        if (VIR_STRDUP(seclabel->model, src[i]->model) < 0 ||
+            VIR_STRDUP(seclabel->label, src[i]->label) < 0 ||
+            VIR_APPEND_ELEMENT(*dst, *ndst, seclabel) < 0)
+            goto error;
+    }
+
+    return 0;
+
+ error:
+    virSecurityDeviceLabelDefFree(seclabel);
+    return -1;
+}
+
+
+static int
+virDomainChrSourceDefClone(virDomainChrSourceDefPtr dst,
+                           const virDomainChrSourceDef *src)
+{
+    if (virDomainChrSourceDefCopy(dst, (virDomainChrSourceDefPtr) src) < 0)
+        return -1;
+
+    /* pty paths are allocated by the hypervisor */
+    if (dst->type == VIR_DOMAIN_CHR_TYPE_PTY)
+        VIR_FREE(dst->data.file.path);
+
+    return 0;
+}
+
+
+static int
+virDomainDiskSourceDefClone(virDomainDiskSourceDefPtr dst,
+                            const virDomainDiskSourceDef *src,
+                            bool inactive)
+{
+    dst->type = src->type;
+    dst->protocol = src->protocol;
+    dst->format = src->format;
+
+    if (VIR_STRDUP(dst->path, src->path) < 0 ||
+        VIR_STRDUP(dst->driverName, src->driverName) < 0 ||
+        VIR_STRDUP(dst->auth.username, src->auth.username) < 0)
+        return -1;
+
+    if (src->auth.secretType == VIR_DOMAIN_DISK_SECRET_TYPE_USAGE) {
+        if (VIR_STRDUP(dst->auth.secret.usage, src->auth.secret.usage) < 0)
+            return -1;
+    } else {
+        memcpy(dst->auth.secret.uuid, src->auth.secret.uuid,
+               sizeof(dst->auth.secret.uuid));
+    }
+    dst->auth.secretType = src->auth.secretType;
+
+    if (src->nhosts) {
+        if (!(dst->hosts = virDomainDiskHostDefCopy(src->nhosts, src->hosts)))
+            return -1;
+        dst->nhosts = src->nhosts;
+    }
+
+    if (src->srcpool) {
+        /* the volume and pool types are looked up again on startup */
+        if (VIR_ALLOC(dst->srcpool) < 0 ||
+            VIR_STRDUP(dst->srcpool->pool, src->srcpool->pool) < 0 ||
+            VIR_STRDUP(dst->srcpool->volume, src->srcpool->volume) < 0)
+            return -1;
+        dst->srcpool->mode = src->srcpool->mode;
+    }
+
+    if (src->encryption &&
+        !(dst->encryption = virStorageEncryptionCopy(src->encryption)))
+        return -1;
+
+    return virSecurityDeviceLabelDefsClone(&dst->seclabels, &dst->nseclabels,
+                                           src->seclabels, src->nseclabels,
+                                           inactive);
+}
+
+
+static virDomainDiskDefPtr
+virDomainDiskDefClone(const virDomainDiskDef *src,
+                      bool inactive)
+{
+    virDomainDiskDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    /* first a shallow copy of everything, then redo the pointers */
+    *def = *src;
+    def->refs = 0;
+    memset(&def->src, 0, sizeof(def->src));
+    memset(&def->info, 0, sizeof(def->info));
+    def->dst = NULL;
+    def->serial = NULL;
+    def->wwn = NULL;
+    def->vendor = NULL;
+    def->product = NULL;
+
+    /* the backing chain and block job state are live-only */
+    def->backingChain = NULL;
+    def->mirror = NULL;
+    def->mirrorFormat = 0;
+    def->mirroring = false;
+
+    if (virDomainDiskSourceDefClone(&def->src, &src->src, inactive) < 0 ||
+        VIR_STRDUP(def->dst, src->dst) < 0 ||
+        VIR_STRDUP(def->serial, src->serial) < 0 ||
+        VIR_STRDUP(def->wwn, src->wwn) < 0 ||
+        VIR_STRDUP(def->vendor, src->vendor) < 0 ||
+        VIR_STRDUP(def->product, src->product) < 0 ||
+        virDomainDeviceInfoClone(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(def);
+    return NULL;
+}
+
+
+static virDomainControllerDefPtr
+virDomainControllerDefClone(const virDomainControllerDef *src)
+{
+    virDomainControllerDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->refs = 0;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0) {
+        virDomainControllerDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainFSDefPtr
+virDomainFSDefClone(const virDomainFSDef *src)
+{
+    virDomainFSDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    memset(&def->info, 0, sizeof(def->info));
+    def->src = NULL;
+    def->dst = NULL;
+
+    if (VIR_STRDUP(def->src, src->src) < 0 ||
+        VIR_STRDUP(def->dst, src->dst) < 0 ||
+        virDomainDeviceInfoClone(&def->info, &src->info) < 0) {
+        virDomainFSDefFree(def);
+        return NULL;
+    }
+
+    return def;
 }
 
+
+static virDomainNetDefPtr
+virDomainNetDefClone(const virDomainNetDef *src)
+{
+    virDomainNetDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+    def->mac = src->mac;
+    def->driver = src->driver;
+    def->tune = src->tune;
+    def->linkstate = src->linkstate;
+
+    switch (src->type) {
+    case VIR_DOMAIN_NET_TYPE_ETHERNET:
+        if (VIR_STRDUP(def->data.ethernet.dev, src->data.ethernet.dev) < 0 ||
+            VIR_STRDUP(def->data.ethernet.ipaddr, src->data.ethernet.ipaddr) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_SERVER:
+    case VIR_DOMAIN_NET_TYPE_CLIENT:
+    case VIR_DOMAIN_NET_TYPE_MCAST:
+        if (VIR_STRDUP(def->data.socket.address, src->data.socket.address) < 0)
+            goto error;
+        def->data.socket.port = src->data.socket.port;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_NETWORK:
+        /* the actual device is allocated again on startup */
+        if (VIR_STRDUP(def->data.network.name, src->data.network.name) < 0 ||
+            VIR_STRDUP(def->data.network.portgroup,
+                       src->data.network.portgroup) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_BRIDGE:
+        if (VIR_STRDUP(def->data.bridge.brname, src->data.bridge.brname) < 0 ||
+            VIR_STRDUP(def->data.bridge.ipaddr, src->data.bridge.ipaddr) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_INTERNAL:
+        if (VIR_STRDUP(def->data.internal.name, src->data.internal.name) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_DIRECT:
+        if (VIR_STRDUP(def->data.direct.linkdev, src->data.direct.linkdev) < 0)
+            goto error;
+        def->data.direct.mode = src->data.direct.mode;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_HOSTDEV:
+        /* rejected by virDomainDefCanClone */
+    case VIR_DOMAIN_NET_TYPE_USER:
+    case VIR_DOMAIN_NET_TYPE_LAST:
+        break;
+    }
+
+    /* Generated and macvtap device names are live-only */
+    if (src->ifname &&
+        src->type != VIR_DOMAIN_NET_TYPE_DIRECT &&
+        !STRPREFIX(src->ifname, VIR_NET_GENERATED_PREFIX) &&
+        VIR_STRDUP(def->ifname, src->ifname) < 0)
+        goto error;
+
+    if (src->virtPortProfile) {
+        if (VIR_ALLOC(def->virtPortProfile) < 0)
+            goto error;
+        *def->virtPortProfile = *src->virtPortProfile;
+    }
+
+    if (src->filterparams) {
+        if (!(def->filterparams = virNWFilterHashTableCreate(0)) ||
+            virNWFilterHashTablePutAll(src->filterparams,
+                                       def->filterparams) < 0)
+            goto error;
+    }
+
+    if (VIR_STRDUP(def->model, src->model) < 0 ||
+        VIR_STRDUP(def->script, src->script) < 0 ||
+        VIR_STRDUP(def->filter, src->filter) < 0 ||
+        virNetDevBandwidthCopy(&def->bandwidth, src->bandwidth) < 0 ||
+        virNetDevVlanCopy(&def->vlan, &src->vlan) < 0 ||
+        virDomainDeviceInfoClone(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainNetDefFree(def);
+    return NULL;
+}
+
+
+static virDomainSmartcardDefPtr
+virDomainSmartcardDefClone(const virDomainSmartcardDef *src)
+{
+    virDomainSmartcardDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+
+    switch (src->type) {
+    case VIR_DOMAIN_SMARTCARD_TYPE_HOST_CERTIFICATES:
+        for (i = 0; i < VIR_DOMAIN_SMARTCARD_NUM_CERTIFICATES; i++) {
+            if (VIR_STRDUP(def->data.cert.file[i],
+                           src->data.cert.file[i]) < 0)
+                goto error;
+        }
+        if (VIR_STRDUP(def->data.cert.database, src->data.cert.database) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_SMARTCARD_TYPE_PASSTHROUGH:
+        if (virDomainChrSourceDefClone(&def->data.passthru,
+                                       &src->data.passthru) < 0)
+            goto error;
+        break;
+    }
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainSmartcardDefFree(def);
+    return NULL;
+}
+
+
+static virDomainChrDefPtr
+virDomainChrDefClone(const virDomainChrDef *src,
+                     bool inactive)
+{
+    virDomainChrDefPtr def;
+
+    if (!(def = virDomainChrDefNew()))
+        return NULL;
+
+    def->deviceType = src->deviceType;
+    def->targetTypeAttr = src->targetTypeAttr;
+    def->targetType = src->targetType;
+
+    if (src->deviceType == VIR_DOMAIN_CHR_DEVICE_TYPE_CHANNEL &&
+        src->targetType == VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_GUESTFWD) {
+        if (src->target.addr) {
+            if (VIR_ALLOC(def->target.addr) < 0)
+                goto error;
+            *def->target.addr = *src->target.addr;
+        }
+    } else if (src->deviceType == VIR_DOMAIN_CHR_DEVICE_TYPE_CHANNEL &&
+               src->targetType == VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO) {
+        if (VIR_STRDUP(def->target.name, src->target.name) < 0)
+            goto error;
+    } else {
+        def->target.port = src->target.port;
+    }
+
+    if (virDomainChrSourceDefClone(&def->source, &src->source) < 0 ||
+        virDomainDeviceInfoClone(&def->info, &src->info) < 0 ||
+        virSecurityDeviceLabelDefsClone(&def->seclabels, &def->nseclabels,
+                                        src->seclabels, src->nseclabels,
+                                        inactive) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainChrDefFree(def);
+    return NULL;
+}
+
+
+static virDomainInputDefPtr
+virDomainInputDefClone(const virDomainInputDef *src)
+{
+    virDomainInputDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    memset(&def->info, 0, sizeof(def->info));
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0) {
+        virDomainInputDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainSoundDefPtr
+virDomainSoundDefClone(const virDomainSoundDef *src)
+{
+    virDomainSoundDefPtr def;
+    virDomainSoundCodecDefPtr codec = NULL;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+
+    for (i = 0; i < src->ncodecs; i++) {
+        if (VIR_ALLOC(codec) < 0)
+            goto error;
+        *codec = *src->codecs[i];
+        if (VIR_APPEND_ELEMENT(def->codecs, def->ncodecs, codec) < 0)
+            goto error;
+    }
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainSoundCodecDefFree(codec);
+    virDomainSoundDefFree(def);
+    return NULL;
+}
+
+
+static virDomainVideoDefPtr
+virDomainVideoDefClone(const virDomainVideoDef *src)
+{
+    virDomainVideoDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    memset(&def->info, 0, sizeof(def->info));
+    def->accel = NULL;
+
+    if (src->accel) {
+        if (VIR_ALLOC(def->accel) < 0)
+            goto error;
+        *def->accel = *src->accel;
+    }
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainVideoDefFree(def);
+    return NULL;
+}
+
+
+static virDomainGraphicsDefPtr
+virDomainGraphicsDefClone(const virDomainGraphicsDef *src)
+{
+    virDomainGraphicsDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+
+    switch ((enum virDomainGraphicsType) src->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        def->data.vnc = src->data.vnc;
+        def->data.vnc.keymap = NULL;
+        def->data.vnc.socket = NULL;
+        def->data.vnc.auth.passwd = NULL;
+        if (def->data.vnc.socket) {
+            /* neither port is formatted for a UNIX socket */
+            def->data.vnc.port = 0;
+            def->data.vnc.websocket = 0;
+            def->data.vnc.autoport = true;
+        } else if (def->data.vnc.autoport) {
+            def->data.vnc.port = 0;
+        }
+
+        if (VIR_STRDUP(def->data.vnc.keymap, src->data.vnc.keymap) < 0 ||
+            VIR_STRDUP(def->data.vnc.socket, src->data.vnc.socket) < 0 ||
+            VIR_STRDUP(def->data.vnc.auth.passwd,
+                       src->data.vnc.auth.passwd) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+        def->data.sdl.fullscreen = src->data.sdl.fullscreen;
+        if (VIR_STRDUP(def->data.sdl.display, src->data.sdl.display) < 0 ||
+            VIR_STRDUP(def->data.sdl.xauth, src->data.sdl.xauth) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+        def->data.rdp = src->data.rdp;
+        if (def->data.rdp.autoport)
+            def->data.rdp.port = 0;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+        def->data.desktop.fullscreen = src->data.desktop.fullscreen;
+        if (VIR_STRDUP(def->data.desktop.display,
+                       src->data.desktop.display) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        def->data.spice = src->data.spice;
+        def->data.spice.keymap = NULL;
+        def->data.spice.auth.passwd = NULL;
+        if (def->data.spice.autoport) {
+            def->data.spice.port = 0;
+            def->data.spice.tlsPort = 0;
+        }
+
+        if (VIR_STRDUP(def->data.spice.keymap, src->data.spice.keymap) < 0 ||
+            VIR_STRDUP(def->data.spice.auth.passwd,
+                       src->data.spice.auth.passwd) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+        break;
+    }
+
+    if (src->nListens) {
+        if (VIR_ALLOC_N(def->listens, src->nListens) < 0)
+            goto error;
+        def->nListens = src->nListens;
+    }
+
+    for (i = 0; i < src->nListens; i++) {
+        virDomainGraphicsListenDefPtr listenDef = &def->listens[i];
+
+        listenDef->type = src->listens[i].type;
+
+        /* the address of a network listen is resolved on startup */
+        if (listenDef->type == VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_ADDRESS &&
+            VIR_STRDUP(listenDef->address, src->listens[i].address) < 0)
+            goto error;
+
+        if (listenDef->type == VIR_DOMAIN_GRAPHICS_LISTEN_TYPE_NETWORK &&
+            VIR_STRDUP(listenDef->network, src->listens[i].network) < 0)
+            goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainGraphicsDefFree(def);
+    return NULL;
+}
+
+
+static virDomainHubDefPtr
+virDomainHubDefClone(const virDomainHubDef *src)
+{
+    virDomainHubDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0) {
+        virDomainHubDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainRedirdevDefPtr
+virDomainRedirdevDefClone(const virDomainRedirdevDef *src)
+{
+    virDomainRedirdevDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->bus = src->bus;
+
+    if (virDomainChrSourceDefClone(&def->source.chr, &src->source.chr) < 0 ||
+        virDomainDeviceInfoClone(&def->info, &src->info) < 0) {
+        virDomainRedirdevDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainRedirFilterDefPtr
+virDomainRedirFilterDefClone(const virDomainRedirFilterDef *src)
+{
+    virDomainRedirFilterDefPtr def;
+    virDomainRedirFilterUsbDevDefPtr usbdev = NULL;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    for (i = 0; i < src->nusbdevs; i++) {
+        if (VIR_ALLOC(usbdev) < 0)
+            goto error;
+        *usbdev = *src->usbdevs[i];
+        if (VIR_APPEND_ELEMENT(def->usbdevs, def->nusbdevs, usbdev) < 0)
+            goto error;
+    }
+
+    return def;
+
+ error:
+    VIR_FREE(usbdev);
+    virDomainRedirFilterDefFree(def);
+    return NULL;
+}
+
+
+static virDomainLeaseDefPtr
+virDomainLeaseDefClone(const virDomainLeaseDef *src)
+{
+    virDomainLeaseDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->offset = src->offset;
+
+    if (VIR_STRDUP(def->lockspace, src->lockspace) < 0 ||
+        VIR_STRDUP(def->key, src->key) < 0 ||
+        VIR_STRDUP(def->path, src->path) < 0) {
+        virDomainLeaseDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainTPMDefPtr
+virDomainTPMDefClone(const virDomainTPMDef *src)
+{
+    virDomainTPMDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->type = src->type;
+    def->model = src->model;
+
+    switch (src->type) {
+    case VIR_DOMAIN_TPM_TYPE_PASSTHROUGH:
+        def->data.passthrough.source.type =
+            src->data.passthrough.source.type;
+        if (VIR_STRDUP(def->data.passthrough.source.data.file.path,
+                       src->data.passthrough.source.data.file.path) < 0)
+            goto error;
+        break;
+    case VIR_DOMAIN_TPM_TYPE_LAST:
+        break;
+    }
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainTPMDefFree(def);
+    return NULL;
+}
+
+
+static virDomainRNGDefPtr
+virDomainRNGDefClone(const virDomainRNGDef *src)
+{
+    virDomainRNGDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->model = src->model;
+    def->backend = src->backend;
+    def->rate = src->rate;
+    def->period = src->period;
+
+    switch ((enum virDomainRNGBackend) src->backend) {
+    case VIR_DOMAIN_RNG_BACKEND_RANDOM:
+        if (VIR_STRDUP(def->source.file, src->source.file) < 0)
+            goto error;
+        break;
+    case VIR_DOMAIN_RNG_BACKEND_EGD:
+        if (src->source.chardev &&
+            (VIR_ALLOC(def->source.chardev) < 0 ||
+             virDomainChrSourceDefClone(def->source.chardev,
+                                        src->source.chardev) < 0))
+            goto error;
+        break;
+    case VIR_DOMAIN_RNG_BACKEND_LAST:
+        break;
+    }
+
+    if (virDomainDeviceInfoClone(&def->info, &src->info) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainRNGDefFree(def);
+    return NULL;
+}
+
+
+/* Devices which consist of nothing but scalars and their device info */
+#define VIR_DOMAIN_SIMPLE_DEVICE_CLONE(name, type, freefunc)            \
+    static type##Ptr                                                    \
+    name(const type *src)                                               \
+    {                                                                   \
+        type##Ptr def;                                                  \
+                                                                        \
+        if (VIR_ALLOC(def) < 0)                                         \
+            return NULL;                                                \
+                                                                        \
+        *def = *src;                                                    \
+        memset(&def->info, 0, sizeof(def->info));                       \
+                                                                        \
+        if (virDomainDeviceInfoClone(&def->info, &src->info) < 0) {     \
+            freefunc(def);                                              \
+            return NULL;                                                \
+        }                                                               \
+                                                                        \
+        return def;                                                     \
+    }
+
+VIR_DOMAIN_SIMPLE_DEVICE_CLONE(virDomainWatchdogDefClone,
+                               virDomainWatchdogDef,
+                               virDomainWatchdogDefFree)
+VIR_DOMAIN_SIMPLE_DEVICE_CLONE(virDomainMemballoonDefClone,
+                               virDomainMemballoonDef,
+                               virDomainMemballoonDefFree)
+VIR_DOMAIN_SIMPLE_DEVICE_CLONE(virDomainNVRAMDefClone,
+                               virDomainNVRAMDef,
+                               virDomainNVRAMDefFree)
+VIR_DOMAIN_SIMPLE_DEVICE_CLONE(virDomainPanicDefClone,
+                               virDomainPanicDef,
+                               virDomainPanicDefFree)
+
+#undef VIR_DOMAIN_SIMPLE_DEVICE_CLONE
+
+
+static int
+virDomainDefCloneCputune(virDomainDefPtr def,
+                         const virDomainDef *src)
+{
+    virDomainVcpuPinDefPtr vcpupin = NULL;
+    size_t i;
+
+    def->cputune.shares = src->cputune.shares;
+    def->cputune.sharesSpecified = src->cputune.sharesSpecified;
+    def->cputune.period = src->cputune.period;
+    def->cputune.quota = src->cputune.quota;
+    def->cputune.emulator_period = src->cputune.emulator_period;
+    def->cputune.emulator_quota = src->cputune.emulator_quota;
+
+    /* A cpuset is ignored with automatic placement and a full one is
+     * not worth keeping. */
+    if (src->placement_mode != VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO &&
+        src->cpumask && !virBitmapIsAllSet(src->cpumask) &&
+        !(def->cpumask = virBitmapNewCopy(src->cpumask)))
+        return -1;
+
+    /* Explicit pinning of online vCPUs goes first, followed by the
+     * vCPUs which inherit the <vcpu> cpuset, the same order the
+     * parser creates them in. */
+    for (i = 0; i < src->cputune.nvcpupin; i++) {
+        virDomainVcpuPinDefPtr pin = src->cputune.vcpupin[i];
+
+        if (pin->vcpuid >= src->vcpus ||
+            (src->cpumask && virBitmapEqual(src->cpumask, pin->cpumask)))
+            continue;
+
+        if (VIR_ALLOC(vcpupin) < 0 ||
+            !(vcpupin->cpumask = virBitmapNewCopy(pin->cpumask)))
+            goto error;
+        vcpupin->vcpuid = pin->vcpuid;
+
+        if (VIR_APPEND_ELEMENT(def->cputune.vcpupin,
+                               def->cputune.nvcpupin, vcpupin) < 0)
+            goto error;
+    }
+
+    for (i = 0; def->cpumask && i < src->vcpus; i++) {
+        if (virDomainVcpuPinIsDuplicate(def->cputune.vcpupin,
+                                        def->cputune.nvcpupin, i))
+            continue;
+
+        if (VIR_ALLOC(vcpupin) < 0 ||
+            !(vcpupin->cpumask = virBitmapNewCopy(def->cpumask)))
+            goto error;
+        vcpupin->vcpuid = i;
+
+        if (VIR_APPEND_ELEMENT(def->cputune.vcpupin,
+                               def->cputune.nvcpupin, vcpupin) < 0)
+            goto error;
+    }
+
+    if (src->cputune.emulatorpin &&
+        src->placement_mode != VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO) {
+        if (VIR_ALLOC(def->cputune.emulatorpin) < 0 ||
+            !(def->cputune.emulatorpin->cpumask =
+              virBitmapNewCopy(src->cputune.emulatorpin->cpumask)))
+            return -1;
+        def->cputune.emulatorpin->vcpuid = src->cputune.emulatorpin->vcpuid;
+    }
+
+    return 0;
+
+ error:
+    virDomainVcpuPinDefFree(vcpupin);
+    return -1;
+}
+
+
+static int
+virDomainDefCloneOS(virDomainOSDefPtr os,
+                    const virDomainOSDef *src)
+{
+    size_t i;
+
+    os->arch = src->arch;
+    os->nBootDevs = src->nBootDevs;
+    memcpy(os->bootDevs, src->bootDevs, sizeof(os->bootDevs));
+    os->bootmenu = src->bootmenu;
+    os->smbios_mode = src->smbios_mode;
+    os->bios = src->bios;
+
+    if (VIR_STRDUP(os->type, src->type) < 0 ||
+        VIR_STRDUP(os->machine, src->machine) < 0 ||
+        VIR_STRDUP(os->init, src->init) < 0 ||
+        VIR_STRDUP(os->kernel, src->kernel) < 0 ||
+        VIR_STRDUP(os->initrd, src->initrd) < 0 ||
+        VIR_STRDUP(os->cmdline, src->cmdline) < 0 ||
+        VIR_STRDUP(os->dtb, src->dtb) < 0 ||
+        VIR_STRDUP(os->root, src->root) < 0 ||
+        VIR_STRDUP(os->loader, src->loader) < 0 ||
+        VIR_STRDUP(os->bootloader, src->bootloader) < 0)
+        return -1;
+
+    if (src->bootloader &&
+        VIR_STRDUP(os->bootloaderArgs, src->bootloaderArgs) < 0)
+        return -1;
+
+    if (src->initargv) {
+        for (i = 0; src->initargv[i]; i++)
+            ;
+        if (VIR_ALLOC_N(os->initargv, i + 1) < 0)
+            return -1;
+        for (i = 0; src->initargv[i]; i++) {
+            if (VIR_STRDUP(os->initargv[i], src->initargv[i]) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDefCloneClock(virDomainClockDefPtr clock,
+                       const virDomainClockDef *src)
+{
+    virDomainTimerDefPtr timer = NULL;
+    size_t i;
+
+    clock->offset = src->offset;
+
+    switch (src->offset) {
+    case VIR_DOMAIN_CLOCK_OFFSET_TIMEZONE:
+        if (VIR_STRDUP(clock->data.timezone, src->data.timezone) < 0)
+            return -1;
+        break;
+
+    case VIR_DOMAIN_CLOCK_OFFSET_VARIABLE:
+        clock->data.variable.adjustment = src->data.variable.adjustment;
+        clock->data.variable.basis = src->data.variable.basis;
+        /* the base date of the running guest is internal only */
+        break;
+
+    default:
+        clock->data = src->data;
+        break;
+    }
+
+    for (i = 0; i < src->ntimers; i++) {
+        if (VIR_ALLOC(timer) < 0)
+            return -1;
+        *timer = *src->timers[i];
+        if (VIR_APPEND_ELEMENT(clock->timers, clock->ntimers, timer) < 0) {
+            VIR_FREE(timer);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDefCloneTunables(virDomainDefPtr def,
+                          const virDomainDef *src)
+{
+    size_t i;
+
+    def->blkio.weight = src->blkio.weight;
+    def->mem = src->mem;
+    def->vcpus = src->vcpus;
+    def->maxvcpus = src->maxvcpus;
+    def->placement_mode = src->placement_mode;
+
+    /* Devices without any tunable set are not formatted */
+    for (i = 0; i < src->blkio.ndevices; i++) {
+        virBlkioDevicePtr dev = &src->blkio.devices[i];
+        virBlkioDevicePtr copy;
+
+        if (!dev->weight && !dev->riops && !dev->wiops &&
+            !dev->rbps && !dev->wbps)
+            continue;
+
+        if (VIR_EXPAND_N(def->blkio.devices, def->blkio.ndevices, 1) < 0)
+            return -1;
+        copy = &def->blkio.devices[def->blkio.ndevices - 1];
+        *copy = *dev;
+        copy->path = NULL;
+        if (VIR_STRDUP(copy->path, dev->path) < 0)
+            return -1;
+    }
+
+    if (virDomainDefCloneCputune(def, src) < 0)
+        return -1;
+
+    def->numatune.memory.mode = src->numatune.memory.mode;
+    def->numatune.memory.placement_mode = src->numatune.memory.placement_mode;
+    if (src->numatune.memory.nodemask &&
+        src->numatune.memory.placement_mode !=
+        VIR_NUMA_TUNE_MEM_PLACEMENT_MODE_AUTO &&
+        !(def->numatune.memory.nodemask =
+          virBitmapNewCopy(src->numatune.memory.nodemask)))
+        return -1;
+
+    if (src->resource) {
+        if (VIR_ALLOC(def->resource) < 0 ||
+            VIR_STRDUP(def->resource->partition, src->resource->partition) < 0)
+            return -1;
+    }
+
+    if (src->idmap.nuidmap) {
+        if (VIR_ALLOC_N(def->idmap.uidmap, src->idmap.nuidmap) < 0)
+            return -1;
+        memcpy(def->idmap.uidmap, src->idmap.uidmap,
+               src->idmap.nuidmap * sizeof(*src->idmap.uidmap));
+        def->idmap.nuidmap = src->idmap.nuidmap;
+    }
+
+    if (src->idmap.ngidmap) {
+        if (VIR_ALLOC_N(def->idmap.gidmap, src->idmap.ngidmap) < 0)
+            return -1;
+        memcpy(def->idmap.gidmap, src->idmap.gidmap,
+               src->idmap.ngidmap * sizeof(*src->idmap.gidmap));
+        def->idmap.ngidmap = src->idmap.ngidmap;
+    }
+
+    return 0;
+}
+
+
+/* For hvm guests a serial type console is formatted as an alias of the
+ * matching serial port, which the parser then takes over as is. */
+static int
+virDomainDefCloneConsoles(virDomainDefPtr def,
+                          const virDomainDef *src,
+                          bool inactive)
+{
+    size_t nconsoles = src->nconsoles;
+    bool hvm = STREQ(src->os.type, "hvm");
+    size_t i;
+
+    if (hvm && nconsoles == 0 && src->nserials > 0)
+        nconsoles = 1;
+
+    if (nconsoles && VIR_ALLOC_N(def->consoles, nconsoles) < 0)
+        return -1;
+
+    for (i = 0; i < nconsoles; i++) {
+        virDomainChrDefPtr console;
+
+        if (hvm && i < src->nserials &&
+            (i >= src->nconsoles ||
+             src->consoles[i]->targetType == VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_SERIAL ||
+             src->consoles[i]->targetType == VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_NONE)) {
+            if (!(console = virDomainChrDefClone(src->serials[i], inactive)))
+                return -1;
+            console->deviceType = VIR_DOMAIN_CHR_DEVICE_TYPE_CONSOLE;
+            console->targetTypeAttr = true;
+            console->targetType = VIR_DOMAIN_CHR_CONSOLE_TARGET_TYPE_SERIAL;
+        } else if (!(console = virDomainChrDefClone(src->consoles[i],
+                                                    inactive))) {
+            return -1;
+        }
+
+        def->consoles[def->nconsoles++] = console;
+    }
+
+    return 0;
+}
+
+
+#define VIR_DOMAIN_DEF_CLONE_DEVICES(field, nfield, clone, ...)          \
+    do {                                                                \
+        if (src->nfield &&                                              \
+            VIR_ALLOC_N(def->field, src->nfield) < 0)                   \
+            goto error;                                                 \
+        for (i = 0; i < src->nfield; i++) {                             \
+            if (!(def->field[i] = clone(src->field[i], ##__VA_ARGS__))) \
+                goto error;                                             \
+            def->nfield++;                                              \
+        }                                                               \
+    } while (0)
+
+
+/**
+ * virDomainDefCanClone:
+ * @def: domain definition
+ *
+ * Returns true if @def can be copied by virDomainDefClone().  Host
+ * devices, whose entries may live inside network interfaces, sysinfo
+ * and driver-specific namespace data are only copied through XML.
+ */
+bool
+virDomainDefCanClone(const virDomainDef *def)
+{
+    size_t i;
+
+    if (def->nhostdevs || def->sysinfo || def->namespaceData)
+        return false;
+
+    for (i = 0; i < def->nnets; i++) {
+        if (def->nets[i]->type == VIR_DOMAIN_NET_TYPE_HOSTDEV)
+            return false;
+    }
+
+    /* The parser fills in the model of a lone seclabel from host
+     * capabilities, which are not available here. */
+    for (i = 0; i < def->nseclabels; i++) {
+        if (!virSecurityLabelDefIsFormatted(def->seclabels[i]))
+            continue;
+        if (!def->seclabels[i]->model ||
+            STREQ(def->seclabels[i]->model, "none"))
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * virDomainDefClone:
+ * @src: domain definition
+ *
+ * Make a deep copy of @src without going through XML.  The copy is
+ * an inactive definition, exactly as virDomainDefCopy() with
+ * @migratable set to false would return it.  Fails if
+ * virDomainDefCanClone() returns false for @src.
+ *
+ * Returns the new definition, or NULL on error.
+ */
+virDomainDefPtr
+virDomainDefClone(const virDomainDef *src)
+{
+    virDomainDefPtr def;
+    bool inactive = src->id == -1;
+    size_t i;
+
+    if (!virDomainDefCanClone(src)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("domain definition cannot be cloned directly"));
+        return NULL;
+    }
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->virtType = src->virtType;
+    def->id = -1;
+    memcpy(def->uuid, src->uuid, VIR_UUID_BUFLEN);
+
+    def->onReboot = src->onReboot;
+    def->onPoweroff = src->onPoweroff;
+    def->onCrash = src->onCrash;
+    def->onLockFailure = src->onLockFailure;
+    def->pm = src->pm;
+
+    memcpy(def->features, src->features, sizeof(def->features));
+    def->apic_eoi = src->apic_eoi;
+    memcpy(def->hyperv_features, src->hyperv_features,
+           sizeof(def->hyperv_features));
+    def->hyperv_spinlocks = src->hyperv_spinlocks;
+
+    if (VIR_STRDUP(def->name, src->name) < 0 ||
+        VIR_STRDUP(def->title, src->title) < 0 ||
+        VIR_STRDUP(def->description, src->description) < 0 ||
+        VIR_STRDUP(def->emulator, src->emulator) < 0 ||
+        virDomainDefCloneTunables(def, src) < 0 ||
+        virDomainDefCloneOS(&def->os, &src->os) < 0 ||
+        virDomainDefCloneClock(&def->clock, &src->clock) < 0)
+        goto error;
+
+    VIR_DOMAIN_DEF_CLONE_DEVICES(graphics, ngraphics,
+                                 virDomainGraphicsDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(disks, ndisks,
+                                 virDomainDiskDefClone, inactive);
+
+    /* Keep the order the parser would give the controllers */
+    if (src->ncontrollers &&
+        VIR_ALLOC_N(def->controllers, src->ncontrollers) < 0)
+        goto error;
+    for (i = 0; i < src->ncontrollers; i++) {
+        virDomainControllerDefPtr controller;
+
+        if (!(controller = virDomainControllerDefClone(src->controllers[i])))
+            goto error;
+        virDomainControllerInsertPreAlloced(def, controller);
+    }
+
+    VIR_DOMAIN_DEF_CLONE_DEVICES(fss, nfss,
+                                 virDomainFSDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(nets, nnets,
+                                 virDomainNetDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(inputs, ninputs,
+                                 virDomainInputDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(sounds, nsounds,
+                                 virDomainSoundDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(videos, nvideos,
+                                 virDomainVideoDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(redirdevs, nredirdevs,
+                                 virDomainRedirdevDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(smartcards, nsmartcards,
+                                 virDomainSmartcardDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(serials, nserials,
+                                 virDomainChrDefClone, inactive);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(parallels, nparallels,
+                                 virDomainChrDefClone, inactive);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(channels, nchannels,
+                                 virDomainChrDefClone, inactive);
+    if (virDomainDefCloneConsoles(def, src, inactive) < 0)
+        goto error;
+    VIR_DOMAIN_DEF_CLONE_DEVICES(leases, nleases,
+                                 virDomainLeaseDefClone);
+    VIR_DOMAIN_DEF_CLONE_DEVICES(hubs, nhubs,
+                                 virDomainHubDefClone);
+
+    for (i = 0; i < src->nseclabels; i++) {
+        virSecurityLabelDefPtr seclabel;
+
+        if (!virSecurityLabelDefIsFormatted(src->seclabels[i]))
+            continue;
+
+        if (!(seclabel = virSecurityLabelDefClone(src->seclabels[i])))
+            goto error;
+        if (VIR_APPEND_ELEMENT(def->seclabels, def->nseclabels, seclabel) < 0) {
+            virSecurityLabelDefFree(seclabel);
+            goto error;
+        }
+    }
+
+    if ((src->watchdog &&
+         !(def->watchdog = virDomainWatchdogDefClone(src->watchdog))) ||
+        (src->memballoon &&
+         !(def->memballoon = virDomainMemballoonDefClone(src->memballoon))) ||
+        (src->nvram &&
+         !(def->nvram = virDomainNVRAMDefClone(src->nvram))) ||
+        (src->tpm &&
+         !(def->tpm = virDomainTPMDefClone(src->tpm))) ||
+        (src->cpu &&
+         !(def->cpu = virCPUDefCopy(src->cpu))) ||
+        (src->redirfilter &&
+         !(def->redirfilter = virDomainRedirFilterDefClone(src->redirfilter))) ||
+        (src->rng &&
+         !(def->rng = virDomainRNGDefClone(src->rng))) ||
+        (src->panic &&
+         !(def->panic = virDomainPanicDefClone(src->panic))))
+        goto error;
+
+    if (src->metadata &&
+        !(def->metadata = xmlCopyNode(src->metadata, 1))) {
+        virReportOOMError();
+        goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainDefFree(def);
+    return NULL;
+}
+
+#undef VIR_DOMAIN_DEF_CLONE_DEVICES
+
+
+/* Copy src into a new definition by a round-trip through XML; with
+ * the quality of the copy depending on the migratable flag (false for
+ * transitions between persistent and active, true for transitions
+ * across save files or snapshots).  This is the reference behaviour
+ * virDomainDefClone() has to match.  */
+virDomainDefPtr
+virDomainDefCopyXML(virDomainDefPtr src,
+                    virCapsPtr caps,
+                    virDomainXMLOptionPtr xmlopt,
+                    bool migratable)
+{
+    char *xml;
+    virDomainDefPtr ret;
+    unsigned int write_flags = VIR_DOMAIN_XML_WRITE_FLAGS;
+    unsigned int read_flags = VIR_DOMAIN_XML_READ_FLAGS;
+
+    if (migratable)
+        write_flags |= VIR_DOMAIN_XML_INACTIVE | VIR_DOMAIN_XML_MIGRATABLE;
+
+    if (!(xml = virDomainDefFormat(src, write_flags)))
+        return NULL;
+
+    ret = virDomainDefParseString(xml, caps, xmlopt, -1, read_flags);
+
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+/* Copy src into a new definition; with the quality of the copy
+ * depending on the migratable flag (false for transitions between
+ * persistent and active, true for transitions across save files or
+ * snapshots).  Non-migratable copies are cloned directly whenever
+ * possible.  */
+virDomainDefPtr
+virDomainDefCopy(virDomainDefPtr src,
+                 virCapsPtr caps,
+                 virDomainXMLOptionPtr xmlopt,
+                 bool migratable)
+{
+    if (!migratable && virDomainDefCanClone(src))
+        return virDomainDefClone(src);
+
+    return virDomainDefCopyXML(src, caps, xmlopt, migratable);
+}
+
+/* A pool of device definitions shared between domain definitions which
+ * are never modified in place, such as the ones saved with snapshots.
+ * Identical devices are recognized by a digest of their XML and replaced
+ * by a single reference counted instance, so memory grows with the
+ * number of distinct devices rather than with the number of definitions.
+ * virDomainDefCopy() and virDomainDefClone() always give the copy its own
+ * devices, which is where a definition holding shared devices is copied
+ * before anything gets to modify it.  */
+struct _virDomainDeviceDefPool {
+    virHashTablePtr devices; /* XML digest -> virDomainDeviceDefPtr */
+};
+
+
+static void
+virDomainDeviceDefPoolDataFree(void *payload,
+                               const void *name ATTRIBUTE_UNUSED)
+{
+    virDomainDeviceDefFree(payload);
+}
+
+
+virDomainDeviceDefPoolPtr
+virDomainDeviceDefPoolNew(void)
+{
+    virDomainDeviceDefPoolPtr pool;
+
+    if (VIR_ALLOC(pool) < 0)
+        return NULL;
+
+    if (!(pool->devices = virHashCreate(32, virDomainDeviceDefPoolDataFree))) {
+        VIR_FREE(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+
+void
+virDomainDeviceDefPoolFree(virDomainDeviceDefPoolPtr pool)
+{
+    if (!pool)
+        return;
+
+    virHashFree(pool->devices);
+    VIR_FREE(pool);
+}
+
+
+static int *
+virDomainDeviceDefPoolRefs(const virDomainDeviceDef *dev)
+{
+    switch ((virDomainDeviceType) dev->type) {
+    case VIR_DOMAIN_DEVICE_DISK:
+        return &dev->data.disk->refs;
+    case VIR_DOMAIN_DEVICE_CONTROLLER:
+        return &dev->data.controller->refs;
+    case VIR_DOMAIN_DEVICE_NET:
+        return &dev->data.net->refs;
+    default:
+        return NULL;
+    }
+}
+
+
+/*
+ * Look up the device of @dev in @pool and take a reference on the
+ * matching entry, adding @dev to the pool if there is none.  Returns
+ * the pool entry, whose device the caller has to use instead of its
+ * own if they differ, or NULL on error.
+ */
+static virDomainDeviceDefPtr
+virDomainDeviceDefPoolShareOne(virDomainDeviceDefPoolPtr pool,
+                               virDomainDeviceDefPtr dev)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virDomainDeviceDefPtr entry = NULL;
+    unsigned int flags = VIR_DOMAIN_XML_SECURE;
+    char *xml = NULL;
+    char *digest = NULL;
+    int *refs;
+    int rc = -1;
+
+    switch ((virDomainDeviceType) dev->type) {
+    case VIR_DOMAIN_DEVICE_DISK:
+        rc = virDomainDiskDefFormat(&buf, dev->data.disk, flags);
+        break;
+    case VIR_DOMAIN_DEVICE_CONTROLLER:
+        rc = virDomainControllerDefFormat(&buf, dev->data.controller, flags);
+        break;
+    case VIR_DOMAIN_DEVICE_NET:
+        rc = virDomainNetDefFormat(&buf, dev->data.net, flags);
+        break;
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("device type '%s' cannot be shared"),
+                       virDomainDeviceTypeToString(dev->type));
+        break;
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    if (virBufferError(&buf)) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    xml = virBufferContentAndReset(&buf);
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, xml, &digest) < 0)
+        goto cleanup;
+
+    if ((entry = virHashLookup(pool->devices, digest))) {
+        refs = virDomainDeviceDefPoolRefs(entry);
+        /* the device may already be the shared one */
+        if (refs != virDomainDeviceDefPoolRefs(dev))
+            (*refs)++;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC(entry) < 0)
+        goto cleanup;
+    *entry = *dev;
+
+    if (virHashAddEntry(pool->devices, digest, entry) < 0) {
+        VIR_FREE(entry);
+        goto cleanup;
+    }
+
+    /* one reference for the pool, one for the definition */
+    refs = virDomainDeviceDefPoolRefs(entry);
+    *refs = *refs ? *refs + 1 : 2;
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(xml);
+    VIR_FREE(digest);
+    return entry;
+}
+
+
+/**
+ * virDomainDeviceDefPoolShare:
+ * @pool: pool of shared devices
+ * @def: domain definition
+ *
+ * Replace disks, controllers and interfaces of @def by the identical
+ * devices from @pool, adding those which are not there yet.  From then
+ * on @def must not be modified in place, and has to be copied instead.
+ *
+ * Returns 0 on success, -1 on error, in which case @def may hold some
+ * shared devices.
+ */
+int
+virDomainDeviceDefPoolShare(virDomainDeviceDefPoolPtr pool,
+                            virDomainDefPtr def)
+{
+    virDomainDeviceDef dev;
+    virDomainDeviceDefPtr entry;
+    size_t i;
+
+    for (i = 0; i < def->ndisks; i++) {
+        dev.type = VIR_DOMAIN_DEVICE_DISK;
+        dev.data.disk = def->disks[i];
+        if (!(entry = virDomainDeviceDefPoolShareOne(pool, &dev)))
+            return -1;
+        if (entry->data.disk != def->disks[i]) {
+            virDomainDiskDefFree(def->disks[i]);
+            def->disks[i] = entry->data.disk;
+        }
+    }
+
+    for (i = 0; i < def->ncontrollers; i++) {
+        dev.type = VIR_DOMAIN_DEVICE_CONTROLLER;
+        dev.data.controller = def->controllers[i];
+        if (!(entry = virDomainDeviceDefPoolShareOne(pool, &dev)))
+            return -1;
+        if (entry->data.controller != def->controllers[i]) {
+            virDomainControllerDefFree(def->controllers[i]);
+            def->controllers[i] = entry->data.controller;
+        }
+    }
+
+    for (i = 0; i < def->nnets; i++) {
+        /* hostdev interfaces are referenced from def->hostdevs too */
+        if (def->nets[i]->type == VIR_DOMAIN_NET_TYPE_HOSTDEV)
+            continue;
+
+        dev.type = VIR_DOMAIN_DEVICE_NET;
+        dev.data.net = def->nets[i];
+        if (!(entry = virDomainDeviceDefPoolShareOne(pool, &dev)))
+            return -1;
+        if (entry->data.net != def->nets[i]) {
+            virDomainNetDefFree(def->nets[i]);
+            def->nets[i] = entry->data.net;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDeviceDefPoolIsUnused(const void *payload,
+                               const void *name ATTRIBUTE_UNUSED,
+                               const void *data ATTRIBUTE_UNUSED)
+{
+    return *virDomainDeviceDefPoolRefs(payload) <= 1;
+}
+
+
+/* Drop the devices which are no longer used by any definition */
+void
+virDomainDeviceDefPoolPrune(virDomainDeviceDefPoolPtr pool)
+{
+    virHashRemoveSet(pool->devices, virDomainDeviceDefPoolIsUnused, NULL);
+}
+
+
 virDomainDefPtr
 virDomainObjCopyPersistentDef(virDomainObjPtr dom,
                               virCapsPtr caps,
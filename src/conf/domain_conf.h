@@ -784,6 +784,8 @@ struct _virDomainDiskDef {
     int rawio; /* no = 0, yes = 1 */
     int sgio; /* enum virDomainDeviceSGIO */
     int discard; /* enum virDomainDiskDiscard */
+
+    int refs; /* owners when shared through virDomainDeviceDefPool */
 };
 
 
@@ -864,6 +866,8 @@ struct _virDomainControllerDef {
         virDomainPciControllerOpts pciopts;
     } opts;
     virDomainDeviceInfo info;
+
+    int refs; /* owners when shared through virDomainDeviceDefPool */
 };
 
 
@@ -1061,6 +1065,8 @@ struct _virDomainNetDef {
     virNetDevBandwidthPtr bandwidth;
     virNetDevVlan vlan;
     int linkstate;
+
+    int refs; /* owners when shared through virDomainDeviceDefPool */
 };
 
 /* Used for prefix of ifname of any network name generated dynamically
@@ -2368,10 +2374,29 @@ virDomainLiveConfigHelperMethod(virCapsPtr caps,
                                 unsigned int *flags,
                                 virDomainDefPtr *persistentDef);
 
+bool virDomainDefCanClone(const virDomainDef *def)
+    ATTRIBUTE_NONNULL(1);
+virDomainDefPtr virDomainDefClone(const virDomainDef *src)
+    ATTRIBUTE_NONNULL(1);
 virDomainDefPtr virDomainDefCopy(virDomainDefPtr src,
                                  virCapsPtr caps,
                                  virDomainXMLOptionPtr xmlopt,
                                  bool migratable);
+virDomainDefPtr virDomainDefCopyXML(virDomainDefPtr src,
+                                    virCapsPtr caps,
+                                    virDomainXMLOptionPtr xmlopt,
+                                    bool migratable);
+
+typedef struct _virDomainDeviceDefPool virDomainDeviceDefPool;
+typedef virDomainDeviceDefPool *virDomainDeviceDefPoolPtr;
+
+virDomainDeviceDefPoolPtr virDomainDeviceDefPoolNew(void);
+void virDomainDeviceDefPoolFree(virDomainDeviceDefPoolPtr pool);
+int virDomainDeviceDefPoolShare(virDomainDeviceDefPoolPtr pool,
+                                virDomainDefPtr def)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void virDomainDeviceDefPoolPrune(virDomainDeviceDefPoolPtr pool)
+    ATTRIBUTE_NONNULL(1);
 virDomainDefPtr virDomainObjCopyPersistentDef(virDomainObjPtr dom,
                                               virCapsPtr caps,
                                               virDomainXMLOptionPtr xmlopt);
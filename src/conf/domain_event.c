@@ -50,6 +50,8 @@ static virClassPtr virDomainEventDiskChangeClass;
 static virClassPtr virDomainEventTrayChangeClass;
 static virClassPtr virDomainEventBalloonChangeClass;
 static virClassPtr virDomainEventDeviceRemovedClass;
+static virClassPtr virDomainEventNumaChangeClass;
+static virClassPtr virDomainEventStartTimesClass;
 static virClassPtr virDomainEventPMClass;
 static virClassPtr virDomainQemuMonitorEventClass;
 
@@ -65,6 +67,8 @@ static void virDomainEventDiskChangeDispose(void *obj);
 static void virDomainEventTrayChangeDispose(void *obj);
 static void virDomainEventBalloonChangeDispose(void *obj);
 static void virDomainEventDeviceRemovedDispose(void *obj);
+static void virDomainEventNumaChangeDispose(void *obj);
+static void virDomainEventStartTimesDispose(void *obj);
 static void virDomainEventPMDispose(void *obj);
 static void virDomainQemuMonitorEventDispose(void *obj);
 
@@ -184,6 +188,24 @@ struct _virDomainEventDeviceRemoved {
 typedef struct _virDomainEventDeviceRemoved virDomainEventDeviceRemoved;
 typedef virDomainEventDeviceRemoved *virDomainEventDeviceRemovedPtr;
 
+struct _virDomainEventNumaChange {
+    virDomainEvent parent;
+
+    char *oldNodeset;
+    char *newNodeset;
+};
+typedef struct _virDomainEventNumaChange virDomainEventNumaChange;
+typedef virDomainEventNumaChange *virDomainEventNumaChangePtr;
+
+struct _virDomainEventStartTimes {
+    virDomainEvent parent;
+
+    virTypedParameterPtr params;
+    int nparams;
+};
+typedef struct _virDomainEventStartTimes virDomainEventStartTimes;
+typedef virDomainEventStartTimes *virDomainEventStartTimesPtr;
+
 struct _virDomainEventPM {
     virDomainEvent parent;
 
@@ -273,6 +295,18 @@ virDomainEventsOnceInit(void)
                       sizeof(virDomainEventDeviceRemoved),
                       virDomainEventDeviceRemovedDispose)))
         return -1;
+    if (!(virDomainEventNumaChangeClass =
+          virClassNew(virDomainEventClass,
+                      "virDomainEventNumaChange",
+                      sizeof(virDomainEventNumaChange),
+                      virDomainEventNumaChangeDispose)))
+        return -1;
+    if (!(virDomainEventStartTimesClass =
+          virClassNew(virDomainEventClass,
+                      "virDomainEventStartTimes",
+                      sizeof(virDomainEventStartTimes),
+                      virDomainEventStartTimesDispose)))
+        return -1;
     if (!(virDomainEventPMClass =
           virClassNew(virDomainEventClass,
                       "virDomainEventPM",
@@ -378,6 +412,25 @@ virDomainEventDiskChangeDispose(void *obj)
     VIR_FREE(event->devAlias);
 }
 
+static void
+virDomainEventNumaChangeDispose(void *obj)
+{
+    virDomainEventNumaChangePtr event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    VIR_FREE(event->oldNodeset);
+    VIR_FREE(event->newNodeset);
+}
+
+static void
+virDomainEventStartTimesDispose(void *obj)
+{
+    virDomainEventStartTimesPtr event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    virTypedParamsFree(event->params, event->nparams);
+}
+
 static void
 virDomainEventTrayChangeDispose(void *obj)
 {
@@ -1150,6 +1203,99 @@ virDomainEventDeviceRemovedNewFromDom(virDomainPtr dom,
                                           devAlias);
 }
 
+static virObjectEventPtr
+virDomainEventNumaChangeNew(int id,
+                            const char *name,
+                            unsigned char *uuid,
+                            const char *oldNodeset,
+                            const char *newNodeset)
+{
+    virDomainEventNumaChangePtr ev;
+
+    if (virDomainEventsInitialize() < 0)
+        return NULL;
+
+    if (!(ev = virDomainEventNew(virDomainEventNumaChangeClass,
+                                 VIR_DOMAIN_EVENT_ID_NUMA_CHANGE,
+                                 id, name, uuid)))
+        return NULL;
+
+    if (VIR_STRDUP(ev->oldNodeset, oldNodeset) < 0 ||
+        VIR_STRDUP(ev->newNodeset, newNodeset) < 0)
+        goto error;
+
+    return (virObjectEventPtr)ev;
+
+ error:
+    virObjectUnref(ev);
+    return NULL;
+}
+
+virObjectEventPtr
+virDomainEventNumaChangeNewFromObj(virDomainObjPtr obj,
+                                   const char *oldNodeset,
+                                   const char *newNodeset)
+{
+    return virDomainEventNumaChangeNew(obj->def->id, obj->def->name,
+                                       obj->def->uuid, oldNodeset,
+                                       newNodeset);
+}
+
+virObjectEventPtr
+virDomainEventNumaChangeNewFromDom(virDomainPtr dom,
+                                   const char *oldNodeset,
+                                   const char *newNodeset)
+{
+    return virDomainEventNumaChangeNew(dom->id, dom->name, dom->uuid,
+                                       oldNodeset, newNodeset);
+}
+
+/* Takes ownership of @params, even on failure */
+static virObjectEventPtr
+virDomainEventStartTimesNew(int id,
+                            const char *name,
+                            unsigned char *uuid,
+                            virTypedParameterPtr params,
+                            int nparams)
+{
+    virDomainEventStartTimesPtr ev;
+
+    if (virDomainEventsInitialize() < 0)
+        goto error;
+
+    if (!(ev = virDomainEventNew(virDomainEventStartTimesClass,
+                                 VIR_DOMAIN_EVENT_ID_START_TIMES,
+                                 id, name, uuid)))
+        goto error;
+
+    ev->params = params;
+    ev->nparams = nparams;
+
+    return (virObjectEventPtr)ev;
+
+ error:
+    virTypedParamsFree(params, nparams);
+    return NULL;
+}
+
+virObjectEventPtr
+virDomainEventStartTimesNewFromObj(virDomainObjPtr obj,
+                                   virTypedParameterPtr params,
+                                   int nparams)
+{
+    return virDomainEventStartTimesNew(obj->def->id, obj->def->name,
+                                       obj->def->uuid, params, nparams);
+}
+
+virObjectEventPtr
+virDomainEventStartTimesNewFromDom(virDomainPtr dom,
+                                   virTypedParameterPtr params,
+                                   int nparams)
+{
+    return virDomainEventStartTimesNew(dom->id, dom->name, dom->uuid,
+                                       params, nparams);
+}
+
 
 static void
 virDomainEventDispatchDefaultFunc(virConnectPtr conn,
@@ -1340,6 +1486,30 @@ virDomainEventDispatchDefaultFunc(virConnectPtr conn,
             goto cleanup;
         }
 
+    case VIR_DOMAIN_EVENT_ID_NUMA_CHANGE:
+        {
+            virDomainEventNumaChangePtr numaChangeEvent;
+
+            numaChangeEvent = (virDomainEventNumaChangePtr)event;
+            ((virConnectDomainEventNumaChangeCallback)cb)(conn, dom,
+                                                          numaChangeEvent->oldNodeset,
+                                                          numaChangeEvent->newNodeset,
+                                                          cbopaque);
+            goto cleanup;
+        }
+
+    case VIR_DOMAIN_EVENT_ID_START_TIMES:
+        {
+            virDomainEventStartTimesPtr startTimesEvent;
+
+            startTimesEvent = (virDomainEventStartTimesPtr)event;
+            ((virConnectDomainEventStartTimesCallback)cb)(conn, dom,
+                                                          startTimesEvent->params,
+                                                          startTimesEvent->nparams,
+                                                          cbopaque);
+            goto cleanup;
+        }
+
     case VIR_DOMAIN_EVENT_ID_LAST:
         break;
     }
@@ -174,6 +174,24 @@ virObjectEventPtr
 virDomainEventDeviceRemovedNewFromDom(virDomainPtr dom,
                                       const char *devAlias);
 
+virObjectEventPtr
+virDomainEventNumaChangeNewFromObj(virDomainObjPtr obj,
+                                   const char *oldNodeset,
+                                   const char *newNodeset);
+virObjectEventPtr
+virDomainEventNumaChangeNewFromDom(virDomainPtr dom,
+                                   const char *oldNodeset,
+                                   const char *newNodeset);
+
+virObjectEventPtr
+virDomainEventStartTimesNewFromObj(virDomainObjPtr obj,
+                                   virTypedParameterPtr params,
+                                   int nparams);
+virObjectEventPtr
+virDomainEventStartTimesNewFromDom(virDomainPtr dom,
+                                   virTypedParameterPtr params,
+                                   int nparams);
+
 int
 virDomainEventStateRegister(virConnectPtr conn,
                             virObjectEventStatePtr state,
@@ -0,0 +1,185 @@
+/*
+ * domain_start_times.c: timing the phases of starting domains
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Drivers divide starting a domain into phases of their own, listed
+ * by an enum, and record how long each of them took.  The accounting
+ * and the VIR_DOMAIN_EVENT_ID_START_TIMES event are common to them.
+ */
+
+#include <config.h>
+
+#include "domain_start_times.h"
+#include "domain_event.h"
+#include "viralloc.h"
+#include "virbuffer.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "virtypedparam.h"
+
+#define VIR_FROM_THIS VIR_FROM_DOMAIN
+
+
+/**
+ * virDomainStartTimesBegin:
+ * @times: start times of a domain
+ *
+ * Start timing the phases of starting a domain.
+ */
+void
+virDomainStartTimesBegin(virDomainStartTimesPtr times)
+{
+    unsigned long long now;
+
+    memset(times, 0, sizeof(*times));
+    if (virTimeMicrosMonotonicRaw(&now) < 0)
+        return;
+
+    times->begin = now;
+    times->mark = now;
+}
+
+
+/**
+ * virDomainStartTimesMark:
+ * @times: start times of a domain
+ * @phase: phase which just ended
+ * @elapsed: filled with the time accounted to @phase, or NULL
+ *
+ * Account the time elapsed since the previous mark to @phase.  A phase
+ * may be marked several times, its durations add up.
+ *
+ * Returns 0 on success, -1 if the domain is not being started.
+ */
+int
+virDomainStartTimesMark(virDomainStartTimesPtr times,
+                        int phase,
+                        unsigned long long *elapsed)
+{
+    unsigned long long now;
+
+    if (!times->begin ||
+        phase < 0 || phase >= VIR_DOMAIN_START_PHASES_MAX ||
+        virTimeMicrosMonotonicRaw(&now) < 0)
+        return -1;
+
+    times->phases[phase] += now - times->mark;
+    if (elapsed)
+        *elapsed = now - times->mark;
+    times->mark = now;
+    return 0;
+}
+
+
+/**
+ * virDomainStartTimesEnd:
+ * @times: start times of a domain
+ *
+ * Stop timing the start of a domain, which took the time from its
+ * beginning up to the last mark.
+ *
+ * Returns 0 on success, -1 if the domain was not being started.
+ */
+int
+virDomainStartTimesEnd(virDomainStartTimesPtr times)
+{
+    if (!times->begin)
+        return -1;
+
+    times->total = times->mark - times->begin;
+    times->begin = 0;
+    return 0;
+}
+
+
+/**
+ * virDomainStartTimesFormat:
+ * @times: start times of a domain
+ * @nphases: number of phases of the driver
+ * @toString: name of each phase
+ *
+ * Format the duration of each phase for logging.
+ *
+ * Returns " phase=duration" for each phase, or NULL on error.
+ */
+char *
+virDomainStartTimesFormat(virDomainStartTimesPtr times,
+                          size_t nphases,
+                          virDomainStartPhaseTypeToString toString)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    for (i = 0; i < nphases; i++)
+        virBufferAsprintf(&buf, " %s=%llu", toString(i), times->phases[i]);
+
+    if (virBufferError(&buf)) {
+        virBufferFreeAndReset(&buf);
+        virReportOOMError();
+        return NULL;
+    }
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/**
+ * virDomainStartTimesEventNew:
+ * @vm: domain which was started
+ * @times: start times of @vm
+ * @nphases: number of phases of the driver
+ * @toString: name of each phase
+ *
+ * Build the VIR_DOMAIN_EVENT_ID_START_TIMES event reporting the
+ * duration of the start of @vm and of each of its phases.
+ *
+ * Returns the event, or NULL on error.
+ */
+virObjectEventPtr
+virDomainStartTimesEventNew(virDomainObjPtr vm,
+                            virDomainStartTimesPtr times,
+                            size_t nphases,
+                            virDomainStartPhaseTypeToString toString)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+    char *field = NULL;
+    size_t i;
+
+    if (virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                VIR_DOMAIN_START_TIMES_TOTAL,
+                                times->total) < 0)
+        goto error;
+
+    for (i = 0; i < nphases; i++) {
+        if (virAsprintf(&field, VIR_DOMAIN_START_TIMES_PHASE_PREFIX "%s",
+                        toString(i)) < 0 ||
+            virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                    field, times->phases[i]) < 0)
+            goto error;
+        VIR_FREE(field);
+    }
+
+    return virDomainEventStartTimesNewFromObj(vm, params, nparams);
+
+ error:
+    VIR_FREE(field);
+    virTypedParamsFree(params, nparams);
+    return NULL;
+}
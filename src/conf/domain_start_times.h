@@ -0,0 +1,62 @@
+/*
+ * domain_start_times.h: timing the phases of starting domains
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __DOMAIN_START_TIMES_H__
+# define __DOMAIN_START_TIMES_H__
+
+# include "internal.h"
+# include "domain_conf.h"
+# include "object_event.h"
+
+/* Most phases a driver may divide the start of domains into */
+# define VIR_DOMAIN_START_PHASES_MAX 16
+
+/* Name of a phase, as generated by VIR_ENUM_IMPL */
+typedef const char *(*virDomainStartPhaseTypeToString)(int phase);
+
+typedef struct _virDomainStartTimes virDomainStartTimes;
+typedef virDomainStartTimes *virDomainStartTimesPtr;
+struct _virDomainStartTimes {
+    /* Monotonic times in microseconds, begin is 0 unless starting */
+    unsigned long long begin;
+    unsigned long long mark;  /* when the last phase ended */
+
+    /* Durations in microseconds of the current or last start */
+    unsigned long long total;
+    unsigned long long phases[VIR_DOMAIN_START_PHASES_MAX];
+};
+
+void virDomainStartTimesBegin(virDomainStartTimesPtr times);
+int virDomainStartTimesMark(virDomainStartTimesPtr times,
+                            int phase,
+                            unsigned long long *elapsed);
+int virDomainStartTimesEnd(virDomainStartTimesPtr times);
+
+char *virDomainStartTimesFormat(virDomainStartTimesPtr times,
+                                size_t nphases,
+                                virDomainStartPhaseTypeToString toString);
+virObjectEventPtr
+virDomainStartTimesEventNew(virDomainObjPtr vm,
+                            virDomainStartTimesPtr times,
+                            size_t nphases,
+                            virDomainStartPhaseTypeToString toString);
+
+#endif /* __DOMAIN_START_TIMES_H__ */
@@ -88,34 +88,86 @@ virNodeDeviceObjPtr
 virNodeDeviceFindBySysfsPath(virNodeDeviceObjListPtr devs,
                              const char *sysfs_path)
 {
-    size_t i;
+    virNodeDeviceObjPtr dev;
 
-    for (i = 0; i < devs->count; i++) {
-        virNodeDeviceObjLock(devs->objs[i]);
-        if ((devs->objs[i]->def->sysfs_path != NULL) &&
-            (STREQ(devs->objs[i]->def->sysfs_path, sysfs_path))) {
-            return devs->objs[i];
-        }
-        virNodeDeviceObjUnlock(devs->objs[i]);
-    }
+    if ((dev = virHashLookup(devs->bySysfsPath, sysfs_path)))
+        virNodeDeviceObjLock(dev);
 
-    return NULL;
+    return dev;
 }
 
 
 virNodeDeviceObjPtr virNodeDeviceFindByName(virNodeDeviceObjListPtr devs,
                                             const char *name)
 {
+    virNodeDeviceObjPtr dev;
+
+    if ((dev = virHashLookup(devs->byName, name)))
+        virNodeDeviceObjLock(dev);
+
+    return dev;
+}
+
+
+/*
+ * Index @dev of @devs by the name and sysfs path of @def, which is, or
+ * is about to become, the definition of @dev. Should several devices
+ * share a sysfs path, the first one keeps it.
+ */
+static int
+virNodeDeviceObjListIndex(virNodeDeviceObjListPtr devs,
+                          virNodeDeviceObjPtr dev,
+                          virNodeDeviceDefPtr def)
+{
+    if (!devs->byName &&
+        !(devs->byName = virHashCreate(256, NULL)))
+        return -1;
+    if (!devs->bySysfsPath &&
+        !(devs->bySysfsPath = virHashCreate(256, NULL)))
+        return -1;
+
+    if (virHashAddEntry(devs->byName, def->name, dev) < 0)
+        return -1;
+
+    if (def->sysfs_path &&
+        !virHashLookup(devs->bySysfsPath, def->sysfs_path) &&
+        virHashAddEntry(devs->bySysfsPath, def->sysfs_path, dev) < 0) {
+        virHashRemoveEntry(devs->byName, def->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Remove @dev of @devs from the indexes.  Its sysfs path is handed over
+ * to the first other device sharing it, if any.
+ */
+static void
+virNodeDeviceObjListUnindex(virNodeDeviceObjListPtr devs,
+                            virNodeDeviceObjPtr dev)
+{
+    const char *sysfs_path = dev->def->sysfs_path;
     size_t i;
 
+    if (virHashLookup(devs->byName, dev->def->name) == dev)
+        virHashRemoveEntry(devs->byName, dev->def->name);
+
+    if (!sysfs_path ||
+        virHashLookup(devs->bySysfsPath, sysfs_path) != dev)
+        return;
+
     for (i = 0; i < devs->count; i++) {
-        virNodeDeviceObjLock(devs->objs[i]);
-        if (STREQ(devs->objs[i]->def->name, name))
-            return devs->objs[i];
-        virNodeDeviceObjUnlock(devs->objs[i]);
+        virNodeDeviceObjPtr other = devs->objs[i];
+
+        if (other != dev && other->def &&
+            STREQ_NULLABLE(other->def->sysfs_path, sysfs_path) &&
+            virHashUpdateEntry(devs->bySysfsPath, sysfs_path, other) == 0)
+            return;
     }
 
-    return NULL;
+    virHashRemoveEntry(devs->bySysfsPath, sysfs_path);
 }
 
 
@@ -163,6 +215,11 @@ void virNodeDeviceObjListFree(virNodeDeviceObjListPtr devs)
         virNodeDeviceObjFree(devs->objs[i]);
     VIR_FREE(devs->objs);
     devs->count = 0;
+
+    virHashFree(devs->byName);
+    devs->byName = NULL;
+    virHashFree(devs->bySysfsPath);
+    devs->bySysfsPath = NULL;
 }
 
 virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
@@ -171,6 +228,13 @@ virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
     virNodeDeviceObjPtr device;
 
     if ((device = virNodeDeviceFindByName(devs, def->name))) {
+        /* The sysfs path may change along with the definition */
+        virNodeDeviceObjListUnindex(devs, device);
+        if (virNodeDeviceObjListIndex(devs, device, def) < 0) {
+            ignore_value(virNodeDeviceObjListIndex(devs, device, device->def));
+            virNodeDeviceObjUnlock(device);
+            return NULL;
+        }
         virNodeDeviceDefFree(device->def);
         device->def = def;
         return device;
@@ -192,6 +256,13 @@ virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
         virNodeDeviceObjFree(device);
         return NULL;
     }
+
+    if (virNodeDeviceObjListIndex(devs, device, def) < 0) {
+        VIR_DELETE_ELEMENT(devs->objs, devs->count - 1, devs->count);
+        virNodeDeviceObjUnlock(device);
+        virNodeDeviceObjFree(device);
+        return NULL;
+    }
     device->def = def;
 
     return device;
@@ -209,6 +280,7 @@ void virNodeDeviceObjRemove(virNodeDeviceObjListPtr devs,
         virNodeDeviceObjLock(dev);
         if (devs->objs[i] == dev) {
             virNodeDeviceObjUnlock(dev);
+            virNodeDeviceObjListUnindex(devs, dev);
             virNodeDeviceObjFree(devs->objs[i]);
 
             VIR_DELETE_ELEMENT(devs->objs, i, devs->count);
@@ -28,6 +28,7 @@
 # include "internal.h"
 # include "virutil.h"
 # include "virthread.h"
+# include "virhash.h"
 # include "virpci.h"
 
 # include <libxml/tree.h>
@@ -206,6 +207,10 @@ typedef virNodeDeviceObjList *virNodeDeviceObjListPtr;
 struct _virNodeDeviceObjList {
     size_t count;
     virNodeDeviceObjPtr *objs;
+
+    /* Indexes of @objs, created along with the first object */
+    virHashTablePtr byName;		/* name -> object */
+    virHashTablePtr bySysfsPath;	/* sysfs path -> object */
 };
 
 typedef struct _virNodeDeviceDriverState virNodeDeviceDriverState;
@@ -76,6 +76,9 @@ struct _virDomainSnapshotObjList {
     virHashTable *objs;
 
     virDomainSnapshotObj metaroot; /* Special parent of all root snapshots */
+
+    /* devices shared between the domain definitions of snapshots */
+    virDomainDeviceDefPoolPtr devices;
 };
 
 /* Snapshot Def functions */
@@ -755,6 +758,12 @@ virDomainSnapshotObjPtr virDomainSnapshotAssignDef(virDomainSnapshotObjListPtr s
         return NULL;
     }
 
+    /* The definition saved with a snapshot is never modified, and most
+     * of its devices are usually the same as in the other snapshots */
+    if (def->dom &&
+        virDomainDeviceDefPoolShare(snapshots->devices, def->dom) < 0)
+        return NULL;
+
     if (!(snap = virDomainSnapshotObjNew()))
         return NULL;
     snap->def = def;
@@ -784,7 +793,9 @@ virDomainSnapshotObjListNew(void)
     if (VIR_ALLOC(snapshots) < 0)
         return NULL;
     snapshots->objs = virHashCreate(50, virDomainSnapshotObjListDataFree);
-    if (!snapshots->objs) {
+    if (!snapshots->objs ||
+        !(snapshots->devices = virDomainDeviceDefPoolNew())) {
+        virHashFree(snapshots->objs);
         VIR_FREE(snapshots);
         return NULL;
     }
@@ -797,6 +808,7 @@ virDomainSnapshotObjListFree(virDomainSnapshotObjListPtr snapshots)
     if (!snapshots)
         return;
     virHashFree(snapshots->objs);
+    virDomainDeviceDefPoolFree(snapshots->devices);
     VIR_FREE(snapshots);
 }
 
@@ -941,6 +953,7 @@ void virDomainSnapshotObjListRemove(virDomainSnapshotObjListPtr snapshots,
                                     virDomainSnapshotObjPtr snapshot)
 {
     virHashRemoveEntry(snapshots->objs, snapshot->def->name);
+    virDomainDeviceDefPoolPrune(snapshots->devices);
 }
 
 int
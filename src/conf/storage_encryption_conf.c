@@ -67,6 +67,36 @@ virStorageEncryptionFree(virStorageEncryptionPtr enc)
     VIR_FREE(enc);
 }
 
+virStorageEncryptionPtr
+virStorageEncryptionCopy(const virStorageEncryption *src)
+{
+    virStorageEncryptionPtr ret;
+    size_t i;
+
+    if (VIR_ALLOC(ret) < 0)
+        return NULL;
+
+    ret->format = src->format;
+
+    if (src->nsecrets &&
+        VIR_ALLOC_N(ret->secrets, src->nsecrets) < 0)
+        goto error;
+
+    for (i = 0; i < src->nsecrets; i++) {
+        if (VIR_ALLOC(ret->secrets[i]) < 0)
+            goto error;
+        ret->nsecrets++;
+
+        *ret->secrets[i] = *src->secrets[i];
+    }
+
+    return ret;
+
+ error:
+    virStorageEncryptionFree(ret);
+    return NULL;
+}
+
 static virStorageEncryptionSecretPtr
 virStorageEncryptionSecretParse(xmlXPathContextPtr ctxt,
                                 xmlNodePtr node)
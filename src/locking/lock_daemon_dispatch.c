@@ -24,6 +24,7 @@
 
 #include "rpc/virnetserver.h"
 #include "rpc/virnetserverclient.h"
+#include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
 #include "lock_daemon.h"
@@ -429,3 +430,166 @@ virLockSpaceProtocolDispatchCreateLockSpace(virNetServerPtr server ATTRIBUTE_UNU
     virMutexUnlock(&priv->lock);
     return rv;
 }
+
+
+/*
+ * Look up the lockspace and name of each resource of a batch request,
+ * and convert its acquire flags, if @flags is not NULL
+ */
+static int
+virLockSpaceProtocolLookupResources(virLockSpaceProtocolResource *resources,
+                                    size_t nresources,
+                                    virLockSpacePtr **lockspaces,
+                                    const char ***resnames,
+                                    unsigned int **flags)
+{
+    size_t i;
+
+    if (VIR_ALLOC_N(*lockspaces, nresources) < 0 ||
+        VIR_ALLOC_N(*resnames, nresources) < 0 ||
+        (flags && VIR_ALLOC_N(*flags, nresources) < 0))
+        return -1;
+
+    for (i = 0; i < nresources; i++) {
+        if (flags) {
+            if (resources[i].flags &
+                ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+                  VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("unsupported flags (0x%x) for resource %s"),
+                               resources[i].flags, resources[i].name);
+                return -1;
+            }
+
+            if (resources[i].flags &
+                VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
+                (*flags)[i] |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
+            if (resources[i].flags &
+                VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
+                (*flags)[i] |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
+        }
+
+        if (!((*lockspaces)[i] = virLockDaemonFindLockSpace(lockDaemon,
+                                                            resources[i].path))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Lockspace for path %s does not exist"),
+                           resources[i].path);
+            return -1;
+        }
+        (*resnames)[i] = resources[i].name;
+    }
+
+    return 0;
+}
+
+
+static int
+virLockSpaceProtocolDispatchAcquireResources(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolAcquireResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    size_t nresources = args->resources.resources_len;
+    virLockSpacePtr *lockspaces = NULL;
+    const char **resnames = NULL;
+    unsigned int *resflags = NULL;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerPid) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    /* Validate the whole request before acquiring anything */
+    if (virLockSpaceProtocolLookupResources(args->resources.resources_val,
+                                            nresources, &lockspaces,
+                                            &resnames, &resflags) < 0)
+        goto cleanup;
+
+    /* The resources are acquired all together or not at all */
+    if (virLockSpaceAcquireResources(lockspaces, resnames, resflags,
+                                     nresources, priv->ownerPid) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Acquired %zu resources for owner %lld",
+              nresources, (unsigned long long)priv->ownerPid);
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    VIR_FREE(lockspaces);
+    VIR_FREE(resnames);
+    VIR_FREE(resflags);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
+static int
+virLockSpaceProtocolDispatchReleaseResources(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolReleaseResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    size_t nresources = args->resources.resources_len;
+    virLockSpacePtr *lockspaces = NULL;
+    const char **resnames = NULL;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerPid) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    if (virLockSpaceProtocolLookupResources(args->resources.resources_val,
+                                            nresources, &lockspaces,
+                                            &resnames, NULL) < 0)
+        goto cleanup;
+
+    /* Release as much as possible, reporting the first failure */
+    if (virLockSpaceReleaseResources(lockspaces, resnames, nresources,
+                                     priv->ownerPid) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    VIR_FREE(lockspaces);
+    VIR_FREE(resnames);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
@@ -25,10 +25,14 @@
 #include "virconf.h"
 #include "viralloc.h"
 #include "vircrypto.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "viruuid.h"
 #include "virfile.h"
 #include "virerror.h"
+#include "virprocess.h"
+#include "virthread.h"
+#include "virtime.h"
 #include "rpc/virnetclient.h"
 #include "lock_protocol.h"
 #include "configmake.h"
@@ -51,6 +55,9 @@ typedef virLockManagerLockDaemonResource *virLockManagerLockDaemonResourcePtr;
 typedef struct _virLockManagerLockDaemonDriver virLockManagerLockDaemonDriver;
 typedef virLockManagerLockDaemonDriver *virLockManagerLockDaemonDriverPtr;
 
+typedef struct _virLockManagerLockDaemonConnection virLockManagerLockDaemonConnection;
+typedef virLockManagerLockDaemonConnection *virLockManagerLockDaemonConnectionPtr;
+
 struct _virLockManagerLockDaemonResource {
     char *lockspace;
     char *name;
@@ -77,12 +84,28 @@ struct _virLockManagerLockDaemonDriver {
     char *fileLockSpaceDir;
     char *lvmLockSpaceDir;
     char *scsiLockSpaceDir;
+
+    /* Idle connections registered for a lock owner, kept for the next
+     * operation on the same domain; owner key -> connection */
+    virMutex lock;
+    virHashTablePtr connections;
+};
+
+/* A connection to virtlockd registered for one lock owner */
+struct _virLockManagerLockDaemonConnection {
+    virNetClientPtr client;
+    virNetClientProgramPtr program;
+    int counter;
+    pid_t pid;
 };
 
 static virLockManagerLockDaemonDriverPtr driver = NULL;
 
 #define VIRTLOCKD_PATH SBINDIR "/virtlockd"
 
+/* Each idle connection counts against the max_clients of virtlockd */
+#define VIRTLOCKD_MAX_IDLE_CONNECTIONS 16
+
 static const char *
 virLockManagerLockDaemonFindDaemon(void)
 {
@@ -322,6 +345,153 @@ virLockManagerLockDaemonConnect(virLockManagerPtr lock,
 }
 
 
+static void
+virLockManagerLockDaemonConnectionFree(virLockManagerLockDaemonConnectionPtr conn)
+{
+    if (!conn)
+        return;
+
+    virNetClientClose(conn->client);
+    virObjectUnref(conn->client);
+    virObjectUnref(conn->program);
+    VIR_FREE(conn);
+}
+
+
+static void
+virLockManagerLockDaemonConnectionDataFree(void *payload,
+                                           const void *name ATTRIBUTE_UNUSED)
+{
+    virLockManagerLockDaemonConnectionFree(payload);
+}
+
+
+static int
+virLockManagerLockDaemonConnectionIsStale(const void *payload,
+                                          const void *name ATTRIBUTE_UNUSED,
+                                          const void *data ATTRIBUTE_UNUSED)
+{
+    const virLockManagerLockDaemonConnection *conn = payload;
+
+    return virProcessKill(conn->pid, 0) < 0 && errno == ESRCH;
+}
+
+
+static char *
+virLockManagerLockDaemonOwnerKey(virLockManagerLockDaemonPrivatePtr priv)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    char *key;
+
+    virUUIDFormat(priv->uuid, uuidstr);
+    if (virAsprintf(&key, "%s:%lld", uuidstr, (long long)priv->pid) < 0)
+        return NULL;
+
+    return key;
+}
+
+
+/*
+ * Get a connection registered for the owner of @lock.  If @reuse is
+ * true, the connection left by a previous operation on the same owner
+ * is taken if there is one, sparing the connection setup and the
+ * registration round trip.
+ */
+static virLockManagerLockDaemonConnectionPtr
+virLockManagerLockDaemonConnectionGet(virLockManagerPtr lock,
+                                      bool reuse)
+{
+    virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
+    virLockManagerLockDaemonConnectionPtr conn = NULL;
+    char *key;
+
+    if (reuse) {
+        if (!(key = virLockManagerLockDaemonOwnerKey(priv)))
+            return NULL;
+
+        virMutexLock(&driver->lock);
+        conn = virHashSteal(driver->connections, key);
+        virMutexUnlock(&driver->lock);
+        VIR_FREE(key);
+
+        if (conn && virNetClientIsOpen(conn->client))
+            return conn;
+
+        /* virtlockd went away in the meantime */
+        virLockManagerLockDaemonConnectionFree(conn);
+    }
+
+    if (VIR_ALLOC(conn) < 0)
+        return NULL;
+    conn->pid = priv->pid;
+
+    if (!(conn->client = virLockManagerLockDaemonConnect(lock,
+                                                         &conn->program,
+                                                         &conn->counter))) {
+        VIR_FREE(conn);
+        return NULL;
+    }
+
+    return conn;
+}
+
+
+/*
+ * Keep @conn for the next operation on the owner of @lock, unless it
+ * is broken or VIRTLOCKD_MAX_IDLE_CONNECTIONS are kept already.
+ * Connections of owners which have exited are closed.
+ */
+static void
+virLockManagerLockDaemonConnectionPut(virLockManagerPtr lock,
+                                      virLockManagerLockDaemonConnectionPtr conn)
+{
+    virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
+    char *key = NULL;
+
+    if (!conn)
+        return;
+
+    if (!virNetClientIsOpen(conn->client) ||
+        !(key = virLockManagerLockDaemonOwnerKey(priv))) {
+        virLockManagerLockDaemonConnectionFree(conn);
+        return;
+    }
+
+    virMutexLock(&driver->lock);
+    virHashRemoveSet(driver->connections,
+                     virLockManagerLockDaemonConnectionIsStale, NULL);
+    if (virHashSize(driver->connections) >= VIRTLOCKD_MAX_IDLE_CONNECTIONS ||
+        virHashLookup(driver->connections, key) ||
+        virHashAddEntry(driver->connections, key, conn) < 0)
+        virLockManagerLockDaemonConnectionFree(conn);
+    virMutexUnlock(&driver->lock);
+
+    VIR_FREE(key);
+}
+
+
+/*
+ * A connection kept from a previous operation is found closed when
+ * virtlockd went away since.  Replace it with a new one, returning
+ * true if the failed operation is worth retrying.
+ */
+static bool
+virLockManagerLockDaemonConnectionRenew(virLockManagerPtr lock,
+                                        virLockManagerLockDaemonConnectionPtr *conn)
+{
+    if (virNetClientIsOpen((*conn)->client))
+        return false;
+
+    VIR_DEBUG("Connection to virtlockd was closed, reconnecting");
+    virLockManagerLockDaemonConnectionFree(*conn);
+    if (!(*conn = virLockManagerLockDaemonConnectionGet(lock, false)))
+        return false;
+
+    virResetLastError();
+    return true;
+}
+
+
 static int virLockManagerLockDaemonSetupLockspace(const char *path)
 {
     virNetClientPtr client;
@@ -382,6 +552,17 @@ static int virLockManagerLockDaemonInit(unsigned int version,
     driver->requireLeaseForDisks = true;
     driver->autoDiskLease = true;
 
+    if (virMutexInit(&driver->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize mutex"));
+        VIR_FREE(driver);
+        return -1;
+    }
+
+    if (!(driver->connections =
+          virHashCreate(16, virLockManagerLockDaemonConnectionDataFree)))
+        goto error;
+
     if (virLockManagerLockDaemonLoadConfig(configFile) < 0)
         goto error;
 
@@ -411,6 +592,8 @@ static int virLockManagerLockDaemonDeinit(void)
     if (!driver)
         return 0;
 
+    virHashFree(driver->connections);
+    virMutexDestroy(&driver->lock);
     VIR_FREE(driver->fileLockSpaceDir);
     VIR_FREE(driver);
 
@@ -656,15 +839,169 @@ static int virLockManagerLockDaemonAddResource(virLockManagerPtr lock,
 }
 
 
+/* virtlockd predating the batch procedures rejects them as unknown,
+ * which the RPC client reports as unsupported */
+static bool
+virLockManagerLockDaemonBatchUnsupported(void)
+{
+    virErrorPtr err = virGetLastError();
+
+    return err && err->code == VIR_ERR_NO_SUPPORT;
+}
+
+
+static virLockSpaceProtocolResource *
+virLockManagerLockDaemonBatchResources(virLockManagerLockDaemonPrivatePtr priv,
+                                       unsigned int mask)
+{
+    virLockSpaceProtocolResource *resources;
+    size_t i;
+
+    if (VIR_ALLOC_N(resources, priv->nresources) < 0)
+        return NULL;
+
+    for (i = 0; i < priv->nresources; i++) {
+        resources[i].path = priv->resources[i].lockspace;
+        resources[i].name = priv->resources[i].name;
+        resources[i].flags = priv->resources[i].flags & mask;
+    }
+
+    return resources;
+}
+
+
+static int
+virLockManagerLockDaemonAcquireResources(virLockManagerLockDaemonPrivatePtr priv,
+                                         virLockManagerLockDaemonConnectionPtr conn)
+{
+    virLockSpaceProtocolAcquireResourcesArgs batch;
+    size_t i;
+    int rv = -1;
+
+    memset(&batch, 0, sizeof(batch));
+
+    if (!(batch.resources.resources_val =
+          virLockManagerLockDaemonBatchResources(priv, ~0)))
+        return -1;
+    batch.resources.resources_len = priv->nresources;
+
+    if (virNetClientProgramCall(conn->program,
+                                conn->client,
+                                conn->counter++,
+                                VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES,
+                                0, NULL, NULL, NULL,
+                                (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourcesArgs, &batch,
+                                (xdrproc_t)xdr_void, NULL) == 0) {
+        rv = 0;
+        goto cleanup;
+    }
+
+    if (!virLockManagerLockDaemonBatchUnsupported())
+        goto cleanup;
+
+    VIR_DEBUG("Falling back to acquiring resources one by one");
+    virResetLastError();
+
+    for (i = 0; i < priv->nresources; i++) {
+        virLockSpaceProtocolAcquireResourceArgs args;
+
+        memset(&args, 0, sizeof(args));
+
+        if (priv->resources[i].lockspace)
+            args.path = priv->resources[i].lockspace;
+        args.name = priv->resources[i].name;
+        args.flags = priv->resources[i].flags;
+
+        if (virNetClientProgramCall(conn->program,
+                                    conn->client,
+                                    conn->counter++,
+                                    VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCE,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourceArgs, &args,
+                                    (xdrproc_t)xdr_void, NULL) < 0)
+            goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    VIR_FREE(batch.resources.resources_val);
+    return rv;
+}
+
+
+static int
+virLockManagerLockDaemonReleaseResources(virLockManagerLockDaemonPrivatePtr priv,
+                                         virLockManagerLockDaemonConnectionPtr conn)
+{
+    virLockSpaceProtocolReleaseResourcesArgs batch;
+    unsigned int mask = ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+                          VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE);
+    size_t i;
+    int rv = -1;
+
+    memset(&batch, 0, sizeof(batch));
+
+    if (!(batch.resources.resources_val =
+          virLockManagerLockDaemonBatchResources(priv, mask)))
+        return -1;
+    batch.resources.resources_len = priv->nresources;
+
+    if (virNetClientProgramCall(conn->program,
+                                conn->client,
+                                conn->counter++,
+                                VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES,
+                                0, NULL, NULL, NULL,
+                                (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourcesArgs, &batch,
+                                (xdrproc_t)xdr_void, NULL) == 0) {
+        rv = 0;
+        goto cleanup;
+    }
+
+    if (!virLockManagerLockDaemonBatchUnsupported())
+        goto cleanup;
+
+    VIR_DEBUG("Falling back to releasing resources one by one");
+    virResetLastError();
+
+    for (i = 0; i < priv->nresources; i++) {
+        virLockSpaceProtocolReleaseResourceArgs args;
+
+        memset(&args, 0, sizeof(args));
+
+        if (priv->resources[i].lockspace)
+            args.path = priv->resources[i].lockspace;
+        args.name = priv->resources[i].name;
+        args.flags = priv->resources[i].flags & mask;
+
+        if (virNetClientProgramCall(conn->program,
+                                    conn->client,
+                                    conn->counter++,
+                                    VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCE,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourceArgs, &args,
+                                    (xdrproc_t)xdr_void, NULL) < 0)
+            goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    VIR_FREE(batch.resources.resources_val);
+    return rv;
+}
+
+
 static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
                                            const char *state ATTRIBUTE_UNUSED,
                                            unsigned int flags,
                                            virDomainLockFailureAction action ATTRIBUTE_UNUSED,
                                            int *fd)
 {
-    virNetClientPtr client = NULL;
-    virNetClientProgramPtr program = NULL;
-    int counter = 0;
+    virLockManagerLockDaemonConnectionPtr conn = NULL;
+    unsigned long long start = 0;
+    unsigned long long end;
+    bool reuse;
     int rv = -1;
     virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
 
@@ -679,48 +1016,46 @@ static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
         return -1;
     }
 
-    if (!(client = virLockManagerLockDaemonConnect(lock, &program, &counter)))
+    /* The connection of a starting domain is restricted and handed
+     * over to its process, so it must be a new one */
+    reuse = !fd && !(flags & VIR_LOCK_MANAGER_ACQUIRE_RESTRICT);
+
+    ignore_value(virTimeMicrosMonotonicRaw(&start));
+
+    if (!(conn = virLockManagerLockDaemonConnectionGet(lock, reuse)))
         goto cleanup;
 
     if (fd &&
-        (*fd = virNetClientDupFD(client, false)) < 0)
+        (*fd = virNetClientDupFD(conn->client, false)) < 0)
         goto cleanup;
 
-    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY)) {
-        size_t i;
-        for (i = 0; i < priv->nresources; i++) {
-            virLockSpaceProtocolAcquireResourceArgs args;
-
-            memset(&args, 0, sizeof(args));
-
-            if (priv->resources[i].lockspace)
-                args.path = priv->resources[i].lockspace;
-            args.name = priv->resources[i].name;
-            args.flags = priv->resources[i].flags;
-
-            if (virNetClientProgramCall(program,
-                                        client,
-                                        counter++,
-                                        VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCE,
-                                        0, NULL, NULL, NULL,
-                                        (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourceArgs, &args,
-                                        (xdrproc_t)xdr_void, NULL) < 0)
-                goto cleanup;
-        }
-    }
+    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY) &&
+        priv->nresources > 0 &&
+        virLockManagerLockDaemonAcquireResources(priv, conn) < 0 &&
+        (!reuse ||
+         !virLockManagerLockDaemonConnectionRenew(lock, &conn) ||
+         virLockManagerLockDaemonAcquireResources(priv, conn) < 0))
+        goto cleanup;
 
     if ((flags & VIR_LOCK_MANAGER_ACQUIRE_RESTRICT) &&
-        virLockManagerLockDaemonConnectionRestrict(lock, client, program, &counter) < 0)
+        virLockManagerLockDaemonConnectionRestrict(lock, conn->client,
+                                                   conn->program,
+                                                   &conn->counter) < 0)
         goto cleanup;
 
+    if (virTimeMicrosMonotonicRaw(&end) == 0)
+        VIR_DEBUG("Acquired %zu resources for %s in %llu us",
+                  priv->nresources, priv->name, end - start);
+
     rv = 0;
 
  cleanup:
     if (rv != 0 && fd)
         VIR_FORCE_CLOSE(*fd);
-    virNetClientClose(client);
-    virObjectUnref(client);
-    virObjectUnref(program);
+    if (reuse)
+        virLockManagerLockDaemonConnectionPut(lock, conn);
+    else
+        virLockManagerLockDaemonConnectionFree(conn);
 
     return rv;
 }
@@ -729,11 +1064,8 @@ static int virLockManagerLockDaemonRelease(virLockManagerPtr lock,
                                            char **state,
                                            unsigned int flags)
 {
-    virNetClientPtr client = NULL;
-    virNetClientProgramPtr program = NULL;
-    int counter = 0;
+    virLockManagerLockDaemonConnectionPtr conn = NULL;
     int rv = -1;
-    size_t i;
     virLockManagerLockDaemonPrivatePtr priv = lock->privateData;
 
     virCheckFlags(0, -1);
@@ -741,39 +1073,19 @@ static int virLockManagerLockDaemonRelease(virLockManagerPtr lock,
     if (state)
         *state = NULL;
 
-    if (!(client = virLockManagerLockDaemonConnect(lock, &program, &counter)))
+    if (!(conn = virLockManagerLockDaemonConnectionGet(lock, true)))
         goto cleanup;
 
-    for (i = 0; i < priv->nresources; i++) {
-        virLockSpaceProtocolReleaseResourceArgs args;
-
-        memset(&args, 0, sizeof(args));
-
-        if (priv->resources[i].lockspace)
-            args.path = priv->resources[i].lockspace;
-        args.name = priv->resources[i].name;
-        args.flags = priv->resources[i].flags;
-
-        args.flags &=
-            ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
-              VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE);
-
-        if (virNetClientProgramCall(program,
-                                    client,
-                                    counter++,
-                                    VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCE,
-                                    0, NULL, NULL, NULL,
-                                    (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourceArgs, &args,
-                                    (xdrproc_t)xdr_void, NULL) < 0)
-            goto cleanup;
-    }
+    if (priv->nresources > 0 &&
+        virLockManagerLockDaemonReleaseResources(priv, conn) < 0 &&
+        (!virLockManagerLockDaemonConnectionRenew(lock, &conn) ||
+         virLockManagerLockDaemonReleaseResources(priv, conn) < 0))
+        goto cleanup;
 
     rv = 0;
 
  cleanup:
-    virNetClientClose(client);
-    virObjectUnref(client);
-    virObjectUnref(program);
+    virLockManagerLockDaemonConnectionPut(lock, conn);
 
     return rv;
 }
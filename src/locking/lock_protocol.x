@@ -71,6 +71,25 @@ struct virLockSpaceProtocolCreateLockSpaceArgs {
     virLockSpaceProtocolNonNullString path;
 };
 
+/* Upper bound on the number of resources acquired or released at once */
+const VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX = 4096;
+
+struct virLockSpaceProtocolResource {
+    virLockSpaceProtocolNonNullString path;
+    virLockSpaceProtocolNonNullString name;
+    unsigned int flags; /* virLockSpaceProtocolAcquireResourceFlags */
+};
+
+struct virLockSpaceProtocolAcquireResourcesArgs {
+    virLockSpaceProtocolResource resources<VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX>;
+    unsigned int flags;
+};
+
+struct virLockSpaceProtocolReleaseResourcesArgs {
+    virLockSpaceProtocolResource resources<VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX>;
+    unsigned int flags;
+};
+
 
 /* Define the program number, protocol version and procedure numbers here. */
 const VIR_LOCK_SPACE_PROTOCOL_PROGRAM = 0xEA7BEEF;
@@ -149,5 +168,17 @@ enum virLockSpaceProtocolProcedure {
      * @generate: none
      * @acl: none
      */
-    VIR_LOCK_SPACE_PROTOCOL_PROC_CREATE_LOCKSPACE = 8
+    VIR_LOCK_SPACE_PROTOCOL_PROC_CREATE_LOCKSPACE = 8,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES = 9,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES = 10
 };
@@ -21,6 +21,8 @@
 
 #include <config.h>
 
+#include <fcntl.h>
+
 #include "lxc_cgroup.h"
 #include "lxc_container.h"
 #include "virfile.h"
@@ -305,6 +307,203 @@ int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo)
 }
 
 
+/*
+ * The caller must free cpuinfo->cpus, even on error.
+ */
+int virLXCCgroupGetCpuinfo(virLXCCpuinfoPtr cpuinfo)
+{
+    int ret = -1;
+    virCgroupPtr cgroup;
+    char *cpus = NULL;
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    if (virCgroupGetCpusetCpus(cgroup, &cpus) < 0)
+        goto cleanup;
+
+    if (virBitmapParse(cpus, 0, &cpuinfo->cpus, VIR_DOMAIN_CPUMASK_LEN) < 0)
+        goto cleanup;
+
+    if (virCgroupGetCpuacctUsage(cgroup, &cpuinfo->usage) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(cpus);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+/*
+ * Count the tasks of the container, and those which are running or
+ * in uninterruptible sleep, i.e. the ones the load average counts.
+ */
+int virLXCCgroupGetTasks(unsigned int *ntasks, unsigned int *nrunning)
+{
+    int ret = -1;
+    virCgroupPtr cgroup;
+    char *tasksFile = NULL;
+    char *tasks = NULL;
+    char *statFile = NULL;
+    char *stat = NULL;
+    char *cur;
+    char *next;
+    int fd;
+    int len;
+
+    *ntasks = 0;
+    *nrunning = 0;
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    if (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  "tasks", &tasksFile) < 0)
+        goto cleanup;
+
+    if (virFileReadAll(tasksFile, 1024 * 1024, &tasks) < 0)
+        goto cleanup;
+
+    for (cur = tasks; *cur; cur = next) {
+        char *state;
+
+        if ((next = strchr(cur, '\n')))
+            *next++ = '\0';
+        else
+            next = cur + strlen(cur);
+
+        if (!*cur)
+            continue;
+
+        (*ntasks)++;
+
+        /* Tasks exit all the time, just skip those which are gone */
+        VIR_FREE(statFile);
+        VIR_FREE(stat);
+        if (virAsprintf(&statFile, "/proc/%s/stat", cur) < 0)
+            goto cleanup;
+        if ((fd = open(statFile, O_RDONLY)) < 0)
+            continue;
+        len = virFileReadLimFD(fd, 1024, &stat);
+        VIR_FORCE_CLOSE(fd);
+        if (len < 0)
+            continue;
+
+        /* The command name may contain anything, the state follows
+         * its closing parenthesis */
+        if ((state = strrchr(stat, ')')) && state[1] == ' ' &&
+            (state[2] == 'R' || state[2] == 'D'))
+            (*nrunning)++;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(stat);
+    VIR_FREE(statFile);
+    VIR_FREE(tasks);
+    VIR_FREE(tasksFile);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+static int virLXCCgroupParseBlkioStat(virCgroupPtr cgroup,
+                                      const char *key,
+                                      bool bytes,
+                                      virLXCDiskstatPtr *stats,
+                                      size_t *nstats)
+{
+    int ret = -1;
+    char *statFile = NULL;
+    char *str = NULL;
+    char *cur;
+    char *next;
+
+    if (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_BLKIO,
+                                  key, &statFile) < 0)
+        goto cleanup;
+
+    if (virFileReadAll(statFile, 1024 * 1024, &str) < 0)
+        goto cleanup;
+
+    /* Lines look like "8:0 Read 1234", plus a final "Total 5678" */
+    for (cur = str; *cur; cur = next) {
+        unsigned int major, minor;
+        unsigned long long value;
+        char op[16];
+        size_t i;
+
+        if ((next = strchr(cur, '\n')))
+            *next++ = '\0';
+        else
+            next = cur + strlen(cur);
+
+        if (sscanf(cur, "%u:%u %15s %llu", &major, &minor, op, &value) != 4)
+            continue;
+
+        for (i = 0; i < *nstats; i++) {
+            if ((*stats)[i].major == major && (*stats)[i].minor == minor)
+                break;
+        }
+
+        if (i == *nstats) {
+            struct virLXCDiskstat stat = { .major = major, .minor = minor };
+
+            if (VIR_APPEND_ELEMENT(*stats, *nstats, stat) < 0)
+                goto cleanup;
+        }
+
+        if (STREQ(op, "Read")) {
+            if (bytes)
+                (*stats)[i].rd_bytes = value;
+            else
+                (*stats)[i].rd_ios = value;
+        } else if (STREQ(op, "Write")) {
+            if (bytes)
+                (*stats)[i].wr_bytes = value;
+            else
+                (*stats)[i].wr_ios = value;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(str);
+    VIR_FREE(statFile);
+    return ret;
+}
+
+
+/*
+ * Get the I/O done by the container on each block device it used.
+ * The caller must free @stats, even on error.
+ */
+int virLXCCgroupGetDiskstats(virLXCDiskstatPtr *stats, size_t *nstats)
+{
+    int ret = -1;
+    virCgroupPtr cgroup;
+
+    *stats = NULL;
+    *nstats = 0;
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    if (virLXCCgroupParseBlkioStat(cgroup, "blkio.throttle.io_serviced",
+                                   false, stats, nstats) < 0 ||
+        virLXCCgroupParseBlkioStat(cgroup, "blkio.throttle.io_service_bytes",
+                                   true, stats, nstats) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 
 typedef struct _virLXCCgroupDevicePolicy virLXCCgroupDevicePolicy;
 typedef virLXCCgroupDevicePolicy *virLXCCgroupDevicePolicyPtr;
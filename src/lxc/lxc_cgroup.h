@@ -34,6 +34,9 @@ int virLXCCgroupSetup(virDomainDefPtr def,
                       virBitmapPtr nodemask);
 
 int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo);
+int virLXCCgroupGetCpuinfo(virLXCCpuinfoPtr cpuinfo);
+int virLXCCgroupGetTasks(unsigned int *ntasks, unsigned int *nrunning);
+int virLXCCgroupGetDiskstats(virLXCDiskstatPtr *stats, size_t *nstats);
 
 int
 virLXCSetupHostUsbDeviceCgroup(virUSBDevicePtr dev,
@@ -218,6 +218,7 @@ virLXCDriverConfigNew(void)
 
     cfg->securityDefaultConfined = false;
     cfg->securityRequireConfined = false;
+    cfg->autostartParallel = 4;
 
     /* Set the container configuration directory */
     if (VIR_STRDUP(cfg->configDir, LXC_CONFIG_DIR) < 0)
@@ -278,6 +279,9 @@ virLXCLoadDriverConfig(virLXCDriverConfigPtr cfg,
     CHECK_TYPE("security_require_confined", VIR_CONF_LONG);
     if (p) cfg->securityRequireConfined = p->l;
 
+    p = virConfGetValue(conf, "autostart_parallel");
+    CHECK_TYPE("autostart_parallel", VIR_CONF_LONG);
+    if (p) cfg->autostartParallel = MAX(p->l, 1);
 
 #undef CHECK_TYPE
 
@@ -59,6 +59,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "lxc_container.h"
+#include "lxc_fuse.h"
 #include "viralloc.h"
 #include "virnetdevveth.h"
 #include "viruuid.h"
@@ -901,25 +902,38 @@ static int lxcContainerMountBasicFS(bool userns_enabled)
 static int lxcContainerMountProcFuse(virDomainDefPtr def,
                                      const char *stateDir)
 {
-    int ret;
-    char *meminfo_path = NULL;
+    int ret = -1;
+    char *src = NULL;
+    char *dst = NULL;
+    size_t i;
 
-    VIR_DEBUG("Mount /proc/meminfo stateDir=%s", stateDir);
+    VIR_DEBUG("Mount /proc files stateDir=%s", stateDir);
 
-    if ((ret = virAsprintf(&meminfo_path,
-                           "/.oldroot/%s/%s.fuse/meminfo",
-                           stateDir,
-                           def->name)) < 0)
-        return ret;
+    for (i = 0; lxcFuseProcFiles[i]; i++) {
+        if (virAsprintf(&src, "/.oldroot/%s/%s.fuse/%s",
+                        stateDir, def->name, lxcFuseProcFiles[i]) < 0 ||
+            virAsprintf(&dst, "/proc/%s", lxcFuseProcFiles[i]) < 0)
+            goto cleanup;
 
-    if ((ret = mount(meminfo_path, "/proc/meminfo",
-                     NULL, MS_BIND, NULL)) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to mount %s on /proc/meminfo"),
-                             meminfo_path);
+        /* Not every kernel provides all of them */
+        if (!virFileExists(dst)) {
+            VIR_DEBUG("Skipping missing %s", dst);
+        } else if (mount(src, dst, NULL, MS_BIND, NULL) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to mount %s on %s"),
+                                 src, dst);
+            goto cleanup;
+        }
+
+        VIR_FREE(src);
+        VIR_FREE(dst);
     }
 
-    VIR_FREE(meminfo_path);
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(src);
+    VIR_FREE(dst);
     return ret;
 }
 #else
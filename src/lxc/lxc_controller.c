@@ -54,6 +54,7 @@
 #include "lxc_cgroup.h"
 #include "lxc_monitor_protocol.h"
 #include "lxc_fuse.h"
+#include "lxc_stats.h"
 #include "virnetdev.h"
 #include "virnetdevveth.h"
 #include "viralloc.h"
@@ -66,6 +67,7 @@
 #include "virnuma.h"
 #include "virdbus.h"
 #include "rpc/virnetserver.h"
+#include "virrelay.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_LXC
@@ -88,10 +90,8 @@ struct _virLXCControllerConsole {
     int epollWatch;
     int epollFd; /* epoll FD for dealing with EOF */
 
-    size_t fromHostLen;
-    char fromHostBuf[1024];
-    size_t fromContLen;
-    char fromContBuf[1024];
+    virRelayPtr fromHost;
+    virRelayPtr fromCont;
 
     virNetServerPtr server;
 };
@@ -132,6 +132,10 @@ struct _virLXCController {
     virCgroupPtr cgroup;
 
     virLXCFusePtr fuse;
+
+    /* Statistics shared with libvirtd */
+    virLXCStatsPtr stats;
+    int timerStats;
 };
 
 #include "lxc_controller_dispatch.h"
@@ -160,6 +164,7 @@ static virLXCControllerPtr virLXCControllerNew(const char *name)
         goto error;
 
     ctrl->timerShutdown = -1;
+    ctrl->timerStats = -1;
     ctrl->firstClient = true;
 
     if (VIR_STRDUP(ctrl->name, name) < 0)
@@ -234,6 +239,14 @@ static void virLXCControllerConsoleClose(virLXCControllerConsolePtr console)
     if (console->epollWatch != -1)
         virEventRemoveHandle(console->epollWatch);
     VIR_FORCE_CLOSE(console->epollFd);
+
+    if (console->fromHost && console->fromCont)
+        VIR_DEBUG("Console relayed %llu bytes from host, %llu from container",
+                  virRelayGetTotal(console->fromHost),
+                  virRelayGetTotal(console->fromCont));
+    virRelayFree(console->fromHost);
+    virRelayFree(console->fromCont);
+    console->fromHost = console->fromCont = NULL;
 }
 
 
@@ -274,6 +287,9 @@ static void virLXCControllerFree(virLXCControllerPtr ctrl)
 
     if (ctrl->timerShutdown != -1)
         virEventRemoveTimeout(ctrl->timerShutdown);
+    if (ctrl->timerStats != -1)
+        virEventRemoveTimeout(ctrl->timerStats);
+    virLXCStatsFree(ctrl->stats);
 
     virObjectUnref(ctrl->server);
     virLXCControllerFreeFuse(ctrl);
@@ -300,6 +316,10 @@ static int virLXCControllerAddConsole(virLXCControllerPtr ctrl,
 
     ctrl->consoles[ctrl->nconsoles-1].epollFd = -1;
     ctrl->consoles[ctrl->nconsoles-1].epollWatch = -1;
+
+    if (!(ctrl->consoles[ctrl->nconsoles-1].fromHost = virRelayNew()) ||
+        !(ctrl->consoles[ctrl->nconsoles-1].fromCont = virRelayNew()))
+        return -1;
     return 0;
 }
 
@@ -643,37 +663,27 @@ static int virLXCControllerSetupCpuAffinity(virLXCControllerPtr ctrl)
 }
 
 
-static int virLXCControllerGetNumadAdvice(virLXCControllerPtr ctrl,
-                                          virBitmapPtr *mask)
+static int virLXCControllerGetNumaAdvice(virLXCControllerPtr ctrl,
+                                         virBitmapPtr *mask)
 {
     virBitmapPtr nodemask = NULL;
-    char *nodeset = NULL;
-    int ret = -1;
 
-    /* Get the advisory nodeset from numad if 'placement' of
+    /* Get the advisory nodeset if 'placement' of
      * either <vcpu> or <numatune> is 'auto'.
      */
     if ((ctrl->def->placement_mode ==
          VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO) ||
         (ctrl->def->numatune.memory.placement_mode ==
          VIR_NUMA_TUNE_MEM_PLACEMENT_MODE_AUTO)) {
-        nodeset = virNumaGetAutoPlacementAdvice(ctrl->def->vcpus,
-                                                ctrl->def->mem.cur_balloon);
-        if (!nodeset)
-            goto cleanup;
-
-        VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
-
-        if (virBitmapParse(nodeset, 0, &nodemask, VIR_DOMAIN_CPUMASK_LEN) < 0)
-            goto cleanup;
+        if (nodeGetNUMAPlacement(VIR_NUMA_PLACEMENT_POLICY_DEFAULT,
+                                 ctrl->def->vcpus,
+                                 ctrl->def->mem.cur_balloon,
+                                 &nodemask) < 0)
+            return -1;
     }
 
-    ret = 0;
     *mask = nodemask;
-
- cleanup:
-    VIR_FREE(nodeset);
-    return ret;
+    return 0;
 }
 
 
@@ -691,7 +701,7 @@ static int virLXCControllerSetupResourceLimits(virLXCControllerPtr ctrl)
     virBitmapPtr nodemask = NULL;
     int ret = -1;
 
-    if (virLXCControllerGetNumadAdvice(ctrl, &nodemask) < 0 ||
+    if (virLXCControllerGetNumaAdvice(ctrl, &nodemask) < 0 ||
         virNumaSetupMemoryPolicy(ctrl->def->numatune, nodemask) < 0)
         goto cleanup;
 
@@ -708,6 +718,51 @@ static int virLXCControllerSetupResourceLimits(virLXCControllerPtr ctrl)
 }
 
 
+static void virLXCControllerStatsTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
+{
+    virLXCControllerPtr ctrl = opaque;
+    virLXCStatsSample sample;
+
+    if (virLXCStatsSampleCgroup(ctrl->cgroup, &sample) < 0) {
+        VIR_DEBUG("Unable to sample container statistics");
+        virResetLastError();
+        return;
+    }
+
+    virLXCStatsPublish(ctrl->stats, &sample);
+}
+
+
+/**
+ * virLXCControllerSetupStats
+ * @ctrl: the controller state
+ *
+ * Creates the file through which the statistics of the container
+ * cgroup are shared with libvirtd, and arms the timer refreshing them
+ *
+ * Returns 0 on success or -1 in case of error
+ */
+static int virLXCControllerSetupStats(virLXCControllerPtr ctrl)
+{
+    virLXCStatsSample sample;
+
+    if (!(ctrl->stats = virLXCStatsCreate(LXC_STATE_DIR, ctrl->name)))
+        return -1;
+
+    /* Publish right away, libvirtd may query it before the first tick */
+    if (virLXCStatsSampleCgroup(ctrl->cgroup, &sample) == 0)
+        virLXCStatsPublish(ctrl->stats, &sample);
+    virResetLastError();
+
+    if ((ctrl->timerStats = virEventAddTimeout(VIR_LXC_STATS_INTERVAL,
+                                               virLXCControllerStatsTimer,
+                                               ctrl, NULL)) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 static void virLXCControllerClientCloseHook(virNetServerClientPtr client)
 {
     virLXCControllerPtr ctrl = virNetServerClientGetPrivateData(client);
@@ -856,17 +911,17 @@ static void virLXCControllerConsoleUpdateWatch(virLXCControllerConsolePtr consol
 
     /* If host console is open, then we can look to read/write */
     if (!console->hostClosed) {
-        if (console->fromHostLen < sizeof(console->fromHostBuf))
+        if (!virRelayIsFull(console->fromHost))
             hostEvents |= VIR_EVENT_HANDLE_READABLE;
-        if (console->fromContLen)
+        if (virRelayGetLength(console->fromCont))
             hostEvents |= VIR_EVENT_HANDLE_WRITABLE;
     }
 
     /* If cont console is open, then we can look to read/write */
     if (!console->contClosed) {
-        if (console->fromContLen < sizeof(console->fromContBuf))
+        if (!virRelayIsFull(console->fromCont))
             contEvents |= VIR_EVENT_HANDLE_READABLE;
-        if (console->fromHostLen)
+        if (virRelayGetLength(console->fromHost))
             contEvents |= VIR_EVENT_HANDLE_WRITABLE;
     }
 
@@ -879,7 +934,7 @@ static void virLXCControllerConsoleUpdateWatch(virLXCControllerConsolePtr consol
     if (console->hostClosed) {
         /* Must setup an epoll to detect when host becomes accessible again */
         int events = EPOLLIN | EPOLLET;
-        if (console->fromContLen)
+        if (virRelayGetLength(console->fromCont))
             events |= EPOLLOUT;
 
         if (events != console->hostEpoll) {
@@ -917,7 +972,7 @@ static void virLXCControllerConsoleUpdateWatch(virLXCControllerConsolePtr consol
     if (console->contClosed) {
         /* Must setup an epoll to detect when guest becomes accessible again */
         int events = EPOLLIN | EPOLLET;
-        if (console->fromHostLen)
+        if (virRelayGetLength(console->fromHost))
             events |= EPOLLOUT;
 
         if (events != console->contEpoll) {
@@ -963,8 +1018,8 @@ static void virLXCControllerConsoleEPoll(int watch, int fd, int events, void *op
     virMutexLock(&lock);
     VIR_DEBUG("IO event watch=%d fd=%d events=%d fromHost=%zu fromcont=%zu",
               watch, fd, events,
-              console->fromHostLen,
-              console->fromContLen);
+              virRelayGetLength(console->fromHost),
+              virRelayGetLength(console->fromCont));
 
     while (1) {
         struct epoll_event event;
@@ -1010,65 +1065,42 @@ static void virLXCControllerConsoleIO(int watch, int fd, int events, void *opaqu
     virMutexLock(&lock);
     VIR_DEBUG("IO event watch=%d fd=%d events=%d fromHost=%zu fromcont=%zu",
               watch, fd, events,
-              console->fromHostLen,
-              console->fromContLen);
+              virRelayGetLength(console->fromHost),
+              virRelayGetLength(console->fromCont));
     if (events & VIR_EVENT_HANDLE_READABLE) {
-        char *buf;
-        size_t *len;
-        size_t avail;
+        virRelayPtr relay;
         ssize_t done;
-        if (watch == console->hostWatch) {
-            buf = console->fromHostBuf;
-            len = &console->fromHostLen;
-            avail = sizeof(console->fromHostBuf) - *len;
-        } else {
-            buf = console->fromContBuf;
-            len = &console->fromContLen;
-            avail = sizeof(console->fromContBuf) - *len;
-        }
-    reread:
-        done = read(fd, buf + *len, avail);
-        if (done == -1 && errno == EINTR)
-            goto reread;
+        if (watch == console->hostWatch)
+            relay = console->fromHost;
+        else
+            relay = console->fromCont;
+
+        done = virRelayFill(relay, fd);
         if (done == -1 && errno != EAGAIN) {
             virReportSystemError(errno, "%s",
                                  _("Unable to read container pty"));
             goto error;
         }
-        if (done > 0) {
-            *len += done;
-        } else {
+        if (done <= 0)
             VIR_DEBUG("Read fd %d done %d errno %d", fd, (int)done, errno);
-        }
     }
 
     if (events & VIR_EVENT_HANDLE_WRITABLE) {
-        char *buf;
-        size_t *len;
+        virRelayPtr relay;
         ssize_t done;
-        if (watch == console->hostWatch) {
-            buf = console->fromContBuf;
-            len = &console->fromContLen;
-        } else {
-            buf = console->fromHostBuf;
-            len = &console->fromHostLen;
-        }
+        if (watch == console->hostWatch)
+            relay = console->fromCont;
+        else
+            relay = console->fromHost;
 
-    rewrite:
-        done = write(fd, buf, *len);
-        if (done == -1 && errno == EINTR)
-            goto rewrite;
+        done = virRelayFlush(relay, fd);
         if (done == -1 && errno != EAGAIN) {
             virReportSystemError(errno, "%s",
                                  _("Unable to write to container pty"));
             goto error;
         }
-        if (done > 0) {
-            memmove(buf, buf + done, (*len - done));
-            *len -= done;
-        } else {
+        if (done <= 0)
             VIR_DEBUG("Write fd %d done %d errno %d", fd, (int)done, errno);
-        }
     }
 
     if (events & VIR_EVENT_HANDLE_HANGUP) {
@@ -2172,6 +2204,9 @@ virLXCControllerRun(virLXCControllerPtr ctrl)
     if (virLXCControllerSetupResourceLimits(ctrl) < 0)
         goto cleanup;
 
+    if (virLXCControllerSetupStats(ctrl) < 0)
+        goto cleanup;
+
     if (virLXCControllerSetupDevPTS(ctrl) < 0)
         goto cleanup;
 
@@ -26,11 +26,22 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virerror.h"
+#include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_LXC
 
 VIR_LOG_INIT("lxc.lxc_domain");
 
+VIR_ENUM_IMPL(virLXCDomainStartPhase, VIR_LXC_DOMAIN_START_PHASE_LAST,
+              "prepare",
+              "label",
+              "network",
+              "exec",
+              "monitor",
+              "cgroup",
+              "container",
+);
+
 static void *virLXCDomainObjPrivateAlloc(void)
 {
     virLXCDomainObjPrivatePtr priv;
@@ -46,6 +57,7 @@ static void virLXCDomainObjPrivateFree(void *data)
     virLXCDomainObjPrivatePtr priv = data;
 
     virCgroupFree(&priv->cgroup);
+    virLXCStatsFree(priv->stats);
 
     VIR_FREE(priv);
 }
@@ -117,3 +129,79 @@ virDomainDefParserConfig virLXCDriverDomainDefParserConfig = {
     .domainPostParseCallback = virLXCDomainDefPostParse,
     .devicesPostParseCallback = virLXCDomainDeviceDefPostParse,
 };
+
+
+verify(VIR_LXC_DOMAIN_START_PHASE_LAST <= VIR_DOMAIN_START_PHASES_MAX);
+
+/**
+ * virLXCDomainStartTimesBegin:
+ * @vm: domain being started
+ *
+ * Start timing the phases of starting @vm.
+ */
+void
+virLXCDomainStartTimesBegin(virDomainObjPtr vm)
+{
+    virLXCDomainObjPrivatePtr priv = vm->privateData;
+
+    virDomainStartTimesBegin(&priv->startTimes);
+}
+
+
+/**
+ * virLXCDomainStartTimesMark:
+ * @vm: domain being started
+ * @phase: phase which just ended
+ *
+ * Account the time elapsed since the previous mark to @phase.  Does
+ * nothing unless @vm is being started.
+ */
+void
+virLXCDomainStartTimesMark(virDomainObjPtr vm,
+                           virLXCDomainStartPhase phase)
+{
+    virLXCDomainObjPrivatePtr priv = vm->privateData;
+
+    ignore_value(virDomainStartTimesMark(&priv->startTimes, phase, NULL));
+}
+
+
+/**
+ * virLXCDomainStartTimesEnd:
+ * @driver: LXC driver
+ * @vm: domain being started
+ * @success: whether the domain was started
+ *
+ * Stop timing the start of @vm and log the duration of its phases.
+ * If @vm was started, they are also reported by a
+ * VIR_DOMAIN_EVENT_ID_START_TIMES event.
+ */
+void
+virLXCDomainStartTimesEnd(virLXCDriverPtr driver,
+                          virDomainObjPtr vm,
+                          bool success)
+{
+    virLXCDomainObjPrivatePtr priv = vm->privateData;
+    virDomainStartTimesPtr times = &priv->startTimes;
+    virObjectEventPtr event;
+    char *phases;
+
+    if (virDomainStartTimesEnd(times) < 0)
+        return;
+
+    if (!(phases = virDomainStartTimesFormat(times,
+                                             VIR_LXC_DOMAIN_START_PHASE_LAST,
+                                             virLXCDomainStartPhaseTypeToString)))
+        return;
+
+    VIR_INFO("%s domain %s in %llu us:%s",
+             success ? "Started" : "Failed to start",
+             vm->def->name, times->total, phases);
+    VIR_FREE(phases);
+
+    if (success &&
+        (event = virDomainStartTimesEventNew(vm, times,
+                                             VIR_LXC_DOMAIN_START_PHASE_LAST,
+                                             virLXCDomainStartPhaseTypeToString)))
+        virObjectEventStateQueue(driver->domainEventState, event);
+}
@@ -24,10 +24,26 @@
 # define __LXC_DOMAIN_H__
 
 # include "vircgroup.h"
+# include "domain_start_times.h"
 # include "lxc_conf.h"
 # include "lxc_monitor.h"
+# include "lxc_stats.h"
 
 
+/* Phases of virLXCProcessStart whose duration is recorded */
+typedef enum {
+    VIR_LXC_DOMAIN_START_PHASE_PREPARE,   /* root FS, host devices, hooks */
+    VIR_LXC_DOMAIN_START_PHASE_LABEL,     /* labelling domain resources */
+    VIR_LXC_DOMAIN_START_PHASE_NETWORK,   /* creating network interfaces */
+    VIR_LXC_DOMAIN_START_PHASE_EXEC,      /* spawning the controller */
+    VIR_LXC_DOMAIN_START_PHASE_MONITOR,   /* controller setting up the container */
+    VIR_LXC_DOMAIN_START_PHASE_CGROUP,    /* detecting the container cgroup */
+    VIR_LXC_DOMAIN_START_PHASE_CONTAINER, /* waiting for the container init */
+
+    VIR_LXC_DOMAIN_START_PHASE_LAST
+} virLXCDomainStartPhase;
+VIR_ENUM_DECL(virLXCDomainStartPhase)
+
 typedef struct _virLXCDomainObjPrivate virLXCDomainObjPrivate;
 typedef virLXCDomainObjPrivate *virLXCDomainObjPrivatePtr;
 struct _virLXCDomainObjPrivate {
@@ -39,9 +55,21 @@ struct _virLXCDomainObjPrivate {
     pid_t initpid;
 
     virCgroupPtr cgroup;
+
+    /* Statistics published by the controller, may be NULL */
+    virLXCStatsPtr stats;
+
+    virDomainStartTimes startTimes;
 };
 
 extern virDomainXMLPrivateDataCallbacks virLXCDriverPrivateDataCallbacks;
 extern virDomainDefParserConfig virLXCDriverDomainDefParserConfig;
 
+void virLXCDomainStartTimesBegin(virDomainObjPtr vm);
+void virLXCDomainStartTimesMark(virDomainObjPtr vm,
+                                virLXCDomainStartPhase phase);
+void virLXCDomainStartTimesEnd(virLXCDriverPtr driver,
+                               virDomainObjPtr vm,
+                               bool success);
+
 #endif /* __LXC_DOMAIN_H__ */
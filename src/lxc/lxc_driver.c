@@ -566,12 +566,27 @@ static int lxcDomainUndefine(virDomainPtr dom)
     return lxcDomainUndefineFlags(dom, 0);
 }
 
+/*
+ * Get the latest statistics published by the controller of a running
+ * container. Returns false if the caller must read the cgroup instead.
+ */
+static bool
+lxcDomainReadStats(virDomainObjPtr vm,
+                   virLXCStatsSamplePtr sample)
+{
+    virLXCDomainObjPrivatePtr priv = vm->privateData;
+
+    return priv->stats && virLXCStatsRead(priv->stats, sample) == 0;
+}
+
+
 static int lxcDomainGetInfo(virDomainPtr dom,
                             virDomainInfoPtr info)
 {
     virDomainObjPtr vm;
     int ret = -1;
     virLXCDomainObjPrivatePtr priv;
+    virLXCStatsSample sample;
 
     if (!(vm = lxcDomObjFromDomain(dom)))
         goto cleanup;
@@ -586,8 +601,22 @@ static int lxcDomainGetInfo(virDomainPtr dom,
     if (!virDomainObjIsActive(vm)) {
         info->cpuTime = 0;
         info->memory = vm->def->mem.cur_balloon;
+    } else if (lxcDomainReadStats(vm, &sample) && sample.memory) {
+        info->cpuTime = sample.cpuTime;
+        info->memory = sample.memUsage;
     } else {
-        if (virCgroupGetCpuacctUsage(priv->cgroup, &(info->cpuTime)) < 0) {
+        if (!virCgroupHasController(priv->cgroup,
+                                    VIR_CGROUP_CONTROLLER_CPUACCT) &&
+            priv->initpid > 0) {
+            /* Without cpuacct, the best we can do is account the
+             * container's init process */
+            virProcessStatInfo stat;
+
+            if (virProcessGetStatInfo(priv->initpid, 0, &stat) < 0)
+                goto cleanup;
+            info->cpuTime = stat.cpuTime;
+        } else if (virCgroupGetCpuacctUsage(priv->cgroup,
+                                            &(info->cpuTime)) < 0) {
             virReportError(VIR_ERR_OPERATION_FAILED,
                            "%s", _("Cannot read cputime for domain"));
             goto cleanup;
@@ -2256,6 +2285,7 @@ lxcDomainBlockStats(virDomainPtr dom,
     virDomainObjPtr vm;
     virDomainDiskDefPtr disk = NULL;
     virLXCDomainObjPrivatePtr priv;
+    virLXCStatsSample sample;
 
     if (!(vm = lxcDomObjFromDomain(dom)))
         return ret;
@@ -2279,6 +2309,15 @@ lxcDomainBlockStats(virDomainPtr dom,
 
     if (!*path) {
         /* empty path - return entire domain blkstats instead */
+        if (lxcDomainReadStats(vm, &sample) && sample.blkio) {
+            stats->rd_bytes = sample.rdBytes;
+            stats->wr_bytes = sample.wrBytes;
+            stats->rd_req = sample.rdReq;
+            stats->wr_req = sample.wrReq;
+            ret = 0;
+            goto cleanup;
+        }
+
         ret = virCgroupGetBlkioIoServiced(priv->cgroup,
                                           &stats->rd_bytes,
                                           &stats->wr_bytes,
@@ -2326,6 +2365,7 @@ lxcDomainBlockStatsFlags(virDomainPtr dom,
     virLXCDomainObjPrivatePtr priv;
     long long rd_req, rd_bytes, wr_req, wr_bytes;
     virTypedParameterPtr param;
+    virLXCStatsSample sample;
 
     virCheckFlags(VIR_TYPED_PARAM_STRING_OKAY, -1);
 
@@ -2359,11 +2399,16 @@ lxcDomainBlockStatsFlags(virDomainPtr dom,
 
     if (!*path) {
         /* empty path - return entire domain blkstats instead */
-        if (virCgroupGetBlkioIoServiced(priv->cgroup,
-                                        &rd_bytes,
-                                        &wr_bytes,
-                                        &rd_req,
-                                        &wr_req) < 0) {
+        if (lxcDomainReadStats(vm, &sample) && sample.blkio) {
+            rd_bytes = sample.rdBytes;
+            wr_bytes = sample.wrBytes;
+            rd_req = sample.rdReq;
+            wr_req = sample.wrReq;
+        } else if (virCgroupGetBlkioIoServiced(priv->cgroup,
+                                               &rd_bytes,
+                                               &wr_bytes,
+                                               &rd_req,
+                                               &wr_req) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            "%s", _("domain stats query failed"));
             goto cleanup;
@@ -5431,6 +5476,7 @@ lxcDomainMemoryStats(virDomainPtr dom,
     virLXCDomainObjPrivatePtr priv;
     unsigned long long swap_usage;
     unsigned long mem_usage;
+    virLXCStatsSample sample;
 
     virCheckFlags(0, -1);
 
@@ -5448,11 +5494,16 @@ lxcDomainMemoryStats(virDomainPtr dom,
         goto cleanup;
     }
 
-    if (virCgroupGetMemSwapUsage(priv->cgroup, &swap_usage) < 0)
-        goto cleanup;
+    if (lxcDomainReadStats(vm, &sample) && sample.swap && sample.memory) {
+        swap_usage = sample.swapUsage;
+        mem_usage = sample.memUsage;
+    } else {
+        if (virCgroupGetMemSwapUsage(priv->cgroup, &swap_usage) < 0)
+            goto cleanup;
 
-    if (virCgroupGetMemoryUsage(priv->cgroup, &mem_usage) < 0)
-        goto cleanup;
+        if (virCgroupGetMemoryUsage(priv->cgroup, &mem_usage) < 0)
+            goto cleanup;
+    }
 
     ret = 0;
     if (ret < nr_stats) {
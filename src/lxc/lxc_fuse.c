@@ -35,12 +35,77 @@
 #include "virfile.h"
 #include "virbuffer.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_LXC
 
 #if WITH_FUSE
 
-static const char *fuse_meminfo_path = "/meminfo";
+/* How long the generated contents of a file are served, in ms, so
+ * that heavy readers of /proc do not hammer the cgroup filesystem */
+#define LXC_FUSE_CACHE_TTL 1000
+
+/* Fixed point load average computation, as done by the kernel */
+#define LXC_FUSE_FSHIFT 11
+#define LXC_FUSE_FIXED_1 (1 << LXC_FUSE_FSHIFT)
+#define LXC_FUSE_LOAD_FREQ 5000
+
+static const unsigned long lxcProcLoadExp[] = { 1884, 2014, 2037 };
+
+typedef int (*lxcProcGenerateFunc)(virLXCFusePtr fuse,
+                                   const char *hostpath,
+                                   virBufferPtr buf);
+
+static int lxcProcGenerateCpuinfo(virLXCFusePtr fuse, const char *hostpath,
+                                  virBufferPtr buf);
+static int lxcProcGenerateDiskstats(virLXCFusePtr fuse, const char *hostpath,
+                                    virBufferPtr buf);
+static int lxcProcGenerateLoadavg(virLXCFusePtr fuse, const char *hostpath,
+                                  virBufferPtr buf);
+static int lxcProcGenerateMeminfo(virLXCFusePtr fuse, const char *hostpath,
+                                  virBufferPtr buf);
+static int lxcProcGenerateStat(virLXCFusePtr fuse, const char *hostpath,
+                               virBufferPtr buf);
+static int lxcProcGenerateUptime(virLXCFusePtr fuse, const char *hostpath,
+                                 virBufferPtr buf);
+
+const char *lxcFuseProcFiles[] = {
+    "cpuinfo",
+    "diskstats",
+    "loadavg",
+    "meminfo",
+    "stat",
+    "uptime",
+    NULL
+};
+
+/* Indexed like lxcFuseProcFiles */
+static const lxcProcGenerateFunc lxcProcGenerators[] = {
+    lxcProcGenerateCpuinfo,
+    lxcProcGenerateDiskstats,
+    lxcProcGenerateLoadavg,
+    lxcProcGenerateMeminfo,
+    lxcProcGenerateStat,
+    lxcProcGenerateUptime,
+};
+
+verify(ARRAY_CARDINALITY(lxcProcGenerators) + 1 ==
+       ARRAY_CARDINALITY(lxcFuseProcFiles));
+
+static int lxcProcFindFile(const char *path)
+{
+    size_t i;
+
+    if (path[0] != '/')
+        return -1;
+
+    for (i = 0; lxcFuseProcFiles[i]; i++) {
+        if (STREQ(path + 1, lxcFuseProcFiles[i]))
+            return i;
+    }
+
+    return -1;
+}
 
 static int lxcProcGetattr(const char *path, struct stat *stbuf)
 {
@@ -48,7 +113,8 @@ static int lxcProcGetattr(const char *path, struct stat *stbuf)
     char *mempath = NULL;
     struct stat sb;
     struct fuse_context *context = fuse_get_context();
-    virDomainDefPtr def = (virDomainDefPtr)context->private_data;
+    virLXCFusePtr fuse = (virLXCFusePtr)context->private_data;
+    virDomainDefPtr def = fuse->def;
 
     memset(stbuf, 0, sizeof(struct stat));
     if (virAsprintf(&mempath, "/proc/%s", path) < 0)
@@ -59,7 +125,7 @@ static int lxcProcGetattr(const char *path, struct stat *stbuf)
     if (STREQ(path, "/")) {
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 2;
-    } else if (STREQ(path, fuse_meminfo_path)) {
+    } else if (lxcProcFindFile(path) >= 0) {
         if (stat(mempath, &sb) < 0) {
             res = -errno;
             goto cleanup;
@@ -88,20 +154,23 @@ static int lxcProcReaddir(const char *path, void *buf,
                           off_t offset ATTRIBUTE_UNUSED,
                           struct fuse_file_info *fi ATTRIBUTE_UNUSED)
 {
+    size_t i;
+
     if (!STREQ(path, "/"))
         return -ENOENT;
 
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
-    filler(buf, fuse_meminfo_path + 1, NULL, 0);
+    for (i = 0; lxcFuseProcFiles[i]; i++)
+        filler(buf, lxcFuseProcFiles[i], NULL, 0);
 
     return 0;
 }
 
-static int lxcProcOpen(const char *path ATTRIBUTE_UNUSED,
-                       struct fuse_file_info *fi ATTRIBUTE_UNUSED)
+static int lxcProcOpen(const char *path,
+                       struct fuse_file_info *fi)
 {
-    if (!STREQ(path, fuse_meminfo_path))
+    if (lxcProcFindFile(path) < 0)
         return -ENOENT;
 
     if ((fi->flags & 3) != O_RDONLY)
@@ -126,17 +195,15 @@ static int lxcProcHostRead(char *path, char *buf, size_t size, off_t offset)
     return res;
 }
 
-static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
-                              char *buf, size_t size, off_t offset)
+static int lxcProcGenerateMeminfo(virLXCFusePtr fuse, const char *hostpath,
+                                  virBufferPtr new_meminfo)
 {
-    int copied = 0;
     int res;
     FILE *fd = NULL;
     char *line = NULL;
     size_t n;
     struct virLXCMeminfo meminfo;
-    virBuffer buffer = VIR_BUFFER_INITIALIZER;
-    virBufferPtr new_meminfo = &buffer;
+    virDomainDefPtr def = fuse->def;
 
     if (virLXCCgroupGetMeminfo(&meminfo) < 0) {
         virErrorSetErrnoFromLastError();
@@ -150,14 +217,8 @@ static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
         goto cleanup;
     }
 
-    if (fseek(fd, offset, SEEK_SET) < 0) {
-        virReportSystemError(errno, "%s", _("fseek failed"));
-        res = -errno;
-        goto cleanup;
-    }
-
     res = -1;
-    while (copied < size && getline(&line, &n, fd) > 0) {
+    while (getline(&line, &n, fd) > 0) {
         char *ptr = strchr(line, ':');
         if (ptr) {
             *ptr = '\0';
@@ -210,43 +271,418 @@ static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
 
             if (virBufferError(new_meminfo))
                 goto cleanup;
+        }
+    }
+    res = 0;
+
+ cleanup:
+    VIR_FREE(line);
+    VIR_FORCE_FCLOSE(fd);
+    return res;
+}
+
+/*
+ * Keep the description of the CPUs the container may run on only,
+ * numbered from 0 as the container sees them.
+ */
+static int lxcProcGenerateCpuinfo(virLXCFusePtr fuse ATTRIBUTE_UNUSED,
+                                  const char *hostpath,
+                                  virBufferPtr buf)
+{
+    int res = -1;
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t n;
+    struct virLXCCpuinfo cpuinfo = { NULL, 0 };
+    size_t ncpus = 0;
+    bool keep = true;
+
+    if (virLXCCgroupGetCpuinfo(&cpuinfo) < 0) {
+        virErrorSetErrnoFromLastError();
+        res = -errno;
+        goto cleanup;
+    }
+
+    if (!(fd = fopen(hostpath, "r"))) {
+        virReportSystemError(errno, _("Cannot open %s"), hostpath);
+        res = -errno;
+        goto cleanup;
+    }
+
+    while (getline(&line, &n, fd) > 0) {
+        char *ptr;
+        unsigned int cpu;
+
+        if (STRPREFIX(line, "processor") &&
+            (ptr = strchr(line, ':')) &&
+            virStrToLong_ui(ptr + 1, NULL, 10, &cpu) == 0) {
+            bool set = false;
+
+            keep = virBitmapGetBit(cpuinfo.cpus, cpu, &set) == 0 && set;
+            if (keep)
+                virBufferAsprintf(buf, "processor\t: %zu\n", ncpus++);
+            continue;
+        }
 
-            copied += strlen(line);
-            if (copied > size)
-                copied = size;
+        if (keep)
+            virBufferAdd(buf, line, -1);
+    }
+
+    if (virBufferError(buf))
+        goto cleanup;
+
+    res = 0;
+
+ cleanup:
+    VIR_FREE(line);
+    VIR_FORCE_FCLOSE(fd);
+    virBitmapFree(cpuinfo.cpus);
+    return res;
+}
+
+#define LXC_PROC_STAT_FIELDS 10
+
+/*
+ * Keep the lines of the CPUs the container may run on only, numbered
+ * from 0, and make the total "cpu" line their sum.
+ */
+static int lxcProcGenerateStat(virLXCFusePtr fuse ATTRIBUTE_UNUSED,
+                               const char *hostpath,
+                               virBufferPtr buf)
+{
+    int res = -1;
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t n;
+    struct virLXCCpuinfo cpuinfo = { NULL, 0 };
+    unsigned long long total[LXC_PROC_STAT_FIELDS] = { 0 };
+    size_t ntotal = 0;
+    size_t ncpus = 0;
+    virBuffer cpus = VIR_BUFFER_INITIALIZER;
+    virBuffer others = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    if (virLXCCgroupGetCpuinfo(&cpuinfo) < 0) {
+        virErrorSetErrnoFromLastError();
+        res = -errno;
+        goto cleanup;
+    }
+
+    if (!(fd = fopen(hostpath, "r"))) {
+        virReportSystemError(errno, _("Cannot open %s"), hostpath);
+        res = -errno;
+        goto cleanup;
+    }
+
+    while (getline(&line, &n, fd) > 0) {
+        unsigned long long value;
+        unsigned int cpu;
+        char *ptr;
+        bool set = false;
+
+        if (STRPREFIX(line, "cpu ")) {
+            continue;
+        } else if (!STRPREFIX(line, "cpu")) {
+            virBufferAdd(&others, line, -1);
+            continue;
+        }
+
+        if (virStrToLong_ui(line + 3, &ptr, 10, &cpu) < 0 ||
+            virBitmapGetBit(cpuinfo.cpus, cpu, &set) < 0 || !set)
+            continue;
+
+        virBufferAsprintf(&cpus, "cpu%zu", ncpus++);
+        for (i = 0; i < LXC_PROC_STAT_FIELDS; i++) {
+            if (virStrToLong_ull(ptr, &ptr, 10, &value) < 0)
+                break;
+            virBufferAsprintf(&cpus, " %llu", value);
+            total[i] += value;
         }
+        virBufferAddChar(&cpus, '\n');
+        ntotal = MAX(ntotal, i);
     }
-    res = copied;
-    memcpy(buf, virBufferCurrentContent(new_meminfo), copied);
+
+    if (virBufferError(&cpus) || virBufferError(&others))
+        goto cleanup;
+
+    virBufferAddLit(buf, "cpu ");
+    for (i = 0; i < ntotal; i++)
+        virBufferAsprintf(buf, " %llu", total[i]);
+    virBufferAddChar(buf, '\n');
+    virBufferAdd(buf, virBufferCurrentContent(&cpus), -1);
+    virBufferAdd(buf, virBufferCurrentContent(&others), -1);
+
+    if (virBufferError(buf))
+        goto cleanup;
+
+    res = 0;
 
  cleanup:
     VIR_FREE(line);
-    virBufferFreeAndReset(new_meminfo);
     VIR_FORCE_FCLOSE(fd);
+    virBufferFreeAndReset(&cpus);
+    virBufferFreeAndReset(&others);
+    virBitmapFree(cpuinfo.cpus);
     return res;
 }
 
-static int lxcProcRead(const char *path ATTRIBUTE_UNUSED,
-                       char *buf ATTRIBUTE_UNUSED,
-                       size_t size ATTRIBUTE_UNUSED,
-                       off_t offset ATTRIBUTE_UNUSED,
+/*
+ * Age the load averages of the container the way the kernel does
+ * every 5 seconds, using the current number of active tasks for the
+ * periods elapsed since the last update.
+ */
+static void lxcProcUpdateLoad(virLXCFusePtr fuse,
+                              unsigned long long now,
+                              unsigned int nrunning)
+{
+    unsigned long active = nrunning * LXC_FUSE_FIXED_1;
+    unsigned long long periods;
+    size_t i;
+
+    if (now < fuse->loadTime + LXC_FUSE_LOAD_FREQ)
+        return;
+
+    periods = (now - fuse->loadTime) / LXC_FUSE_LOAD_FREQ;
+    fuse->loadTime += periods * LXC_FUSE_LOAD_FREQ;
+
+    /* After an hour the old values do not matter anymore */
+    periods = MIN(periods, 720);
+
+    while (periods--) {
+        for (i = 0; i < ARRAY_CARDINALITY(fuse->loadavg); i++) {
+            fuse->loadavg[i] = (fuse->loadavg[i] * lxcProcLoadExp[i] +
+                                active * (LXC_FUSE_FIXED_1 - lxcProcLoadExp[i]))
+                >> LXC_FUSE_FSHIFT;
+        }
+    }
+}
+
+static int lxcProcGenerateLoadavg(virLXCFusePtr fuse,
+                                  const char *hostpath,
+                                  virBufferPtr buf)
+{
+    unsigned long long now;
+    unsigned int ntasks;
+    unsigned int nrunning;
+    char *host = NULL;
+    char *lastpid;
+    size_t i;
+
+    if (virTimeMillisNow(&now) < 0 ||
+        virLXCCgroupGetTasks(&ntasks, &nrunning) < 0 ||
+        virFileReadAll(hostpath, 1024, &host) < 0) {
+        virErrorSetErrnoFromLastError();
+        return -errno;
+    }
+
+    lxcProcUpdateLoad(fuse, now, nrunning);
+
+    for (i = 0; i < ARRAY_CARDINALITY(fuse->loadavg); i++) {
+        unsigned long load = fuse->loadavg[i] + LXC_FUSE_FIXED_1 / 200;
+
+        virBufferAsprintf(buf, "%lu.%02lu ", load >> LXC_FUSE_FSHIFT,
+                          ((load & (LXC_FUSE_FIXED_1 - 1)) * 100) >>
+                          LXC_FUSE_FSHIFT);
+    }
+
+    /* The last PID used is a host wide value */
+    lastpid = strrchr(host, ' ');
+    virBufferAsprintf(buf, "%u/%u %s", nrunning, ntasks,
+                      lastpid ? lastpid + 1 : "0\n");
+    VIR_FREE(host);
+
+    if (virBufferError(buf))
+        return -ENOMEM;
+
+    return 0;
+}
+
+/*
+ * The uptime stays the host's: the processes of the container keep
+ * their start time relative to the boot of the host in
+ * /proc/<pid>/stat, which ps and top compare with it.  The CPUs of
+ * the container were idle whenever the container was not using them.
+ */
+static int lxcProcGenerateUptime(virLXCFusePtr fuse ATTRIBUTE_UNUSED,
+                                 const char *hostpath,
+                                 virBufferPtr buf)
+{
+    int res = -1;
+    char *host = NULL;
+    char *ptr;
+    unsigned long long secs;
+    unsigned long long centisecs = 0;
+    unsigned long long uptime;
+    unsigned long long idle = 0;
+    struct virLXCCpuinfo cpuinfo = { NULL, 0 };
+    unsigned long long busy;
+
+    if (virFileReadAll(hostpath, 1024, &host) < 0 ||
+        virLXCCgroupGetCpuinfo(&cpuinfo) < 0) {
+        virErrorSetErrnoFromLastError();
+        res = -errno;
+        goto cleanup;
+    }
+
+    if (virStrToLong_ull(host, &ptr, 10, &secs) < 0 ||
+        (*ptr == '.' &&
+         virStrToLong_ull(ptr + 1, &ptr, 10, &centisecs) < 0)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected content of %s"), hostpath);
+        res = -EIO;
+        goto cleanup;
+    }
+
+    uptime = secs * 1000 + centisecs * 10;
+    busy = cpuinfo.usage / (1000 * 1000);
+    if (uptime * virBitmapCountBits(cpuinfo.cpus) > busy)
+        idle = uptime * virBitmapCountBits(cpuinfo.cpus) - busy;
+
+    virBufferAsprintf(buf, "%llu.%02llu %llu.%02llu\n",
+                      uptime / 1000, (uptime % 1000) / 10,
+                      idle / 1000, (idle % 1000) / 10);
+
+    if (virBufferError(buf))
+        goto cleanup;
+
+    res = 0;
+
+ cleanup:
+    VIR_FREE(host);
+    virBitmapFree(cpuinfo.cpus);
+    return res;
+}
+
+/*
+ * Only list the block devices the container did I/O on, with the
+ * counters of its own requests.
+ */
+static int lxcProcGenerateDiskstats(virLXCFusePtr fuse ATTRIBUTE_UNUSED,
+                                    const char *hostpath,
+                                    virBufferPtr buf)
+{
+    int res = -1;
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t n;
+    virLXCDiskstatPtr stats = NULL;
+    size_t nstats = 0;
+    size_t i;
+
+    if (virLXCCgroupGetDiskstats(&stats, &nstats) < 0) {
+        virErrorSetErrnoFromLastError();
+        res = -errno;
+        goto cleanup;
+    }
+
+    if (!(fd = fopen(hostpath, "r"))) {
+        virReportSystemError(errno, _("Cannot open %s"), hostpath);
+        res = -errno;
+        goto cleanup;
+    }
+
+    while (getline(&line, &n, fd) > 0) {
+        unsigned int major, minor;
+        char name[64];
+
+        if (sscanf(line, "%u %u %63s", &major, &minor, name) != 3)
+            continue;
+
+        for (i = 0; i < nstats; i++) {
+            if (stats[i].major == major && stats[i].minor == minor)
+                break;
+        }
+        if (i == nstats)
+            continue;
+
+        virBufferAsprintf(buf, "%4u %7u %s %llu 0 %llu 0 %llu 0 %llu 0 0 0 0\n",
+                          major, minor, name,
+                          stats[i].rd_ios, stats[i].rd_bytes >> 9,
+                          stats[i].wr_ios, stats[i].wr_bytes >> 9);
+    }
+
+    if (virBufferError(buf))
+        goto cleanup;
+
+    res = 0;
+
+ cleanup:
+    VIR_FREE(line);
+    VIR_FORCE_FCLOSE(fd);
+    VIR_FREE(stats);
+    return res;
+}
+
+/*
+ * Serve a read from the cached contents of the file, generating them
+ * again when they are older than LXC_FUSE_CACHE_TTL. Only reads at
+ * the start of the file do so, for a file read in several chunks to
+ * be consistent.
+ */
+static int lxcProcReadCached(virLXCFusePtr fuse, size_t idx,
+                             const char *hostpath,
+                             char *buf, size_t size, off_t offset)
+{
+    virLXCFuseCachePtr cache = &fuse->cache[idx];
+    virBuffer buffer = VIR_BUFFER_INITIALIZER;
+    unsigned long long now;
+    int res;
+
+    if (virTimeMillisNow(&now) < 0) {
+        virErrorSetErrnoFromLastError();
+        return -errno;
+    }
+
+    if (!cache->content ||
+        (offset == 0 && now - cache->stamp >= LXC_FUSE_CACHE_TTL)) {
+        if ((res = lxcProcGenerators[idx](fuse, hostpath, &buffer)) < 0) {
+            virBufferFreeAndReset(&buffer);
+            return res;
+        }
+        if (virBufferError(&buffer)) {
+            virBufferFreeAndReset(&buffer);
+            return -ENOMEM;
+        }
+
+        VIR_FREE(cache->content);
+        cache->len = virBufferUse(&buffer);
+        cache->content = virBufferContentAndReset(&buffer);
+        cache->stamp = now;
+    }
+
+    if (offset >= cache->len)
+        return 0;
+
+    if (size > cache->len - offset)
+        size = cache->len - offset;
+
+    memcpy(buf, cache->content + offset, size);
+    return size;
+}
+
+static int lxcProcRead(const char *path,
+                       char *buf,
+                       size_t size,
+                       off_t offset,
                        struct fuse_file_info *fi ATTRIBUTE_UNUSED)
 {
     int res = -ENOENT;
     char *hostpath = NULL;
     struct fuse_context *context = NULL;
-    virDomainDefPtr def = NULL;
+    virLXCFusePtr fuse = NULL;
+    int idx;
+
+    if ((idx = lxcProcFindFile(path)) < 0)
+        return -ENOENT;
 
     if (virAsprintf(&hostpath, "/proc/%s", path) < 0)
         return -errno;
 
     context = fuse_get_context();
-    def = (virDomainDefPtr)context->private_data;
+    fuse = (virLXCFusePtr)context->private_data;
 
-    if (STREQ(path, fuse_meminfo_path)) {
-        if ((res = lxcProcReadMeminfo(hostpath, def, buf, size, offset)) < 0)
-            res = lxcProcHostRead(hostpath, buf, size, offset);
-    }
+    if ((res = lxcProcReadCached(fuse, idx, hostpath, buf, size, offset)) < 0)
+        res = lxcProcHostRead(hostpath, buf, size, offset);
 
     VIR_FREE(hostpath);
     return res;
@@ -290,6 +726,12 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
 
     fuse->def = def;
 
+    if (VIR_ALLOC_N(fuse->cache, ARRAY_CARDINALITY(lxcProcGenerators)) < 0)
+        goto cleanup2;
+
+    if (virTimeMillisNow(&fuse->loadTime) < 0)
+        goto cleanup2;
+
     if (virMutexInit(&fuse->lock) < 0)
         goto cleanup2;
 
@@ -315,7 +757,7 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
         goto cleanup1;
 
     fuse->fuse = fuse_new(fuse->ch, &args, &lxcProcOper,
-                          sizeof(lxcProcOper), fuse->def);
+                          sizeof(lxcProcOper), fuse);
     if (fuse->fuse == NULL) {
         fuse_unmount(fuse->mountpoint, fuse->ch);
         goto cleanup1;
@@ -330,6 +772,7 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
     VIR_FREE(fuse->mountpoint);
     virMutexDestroy(&fuse->lock);
  cleanup2:
+    VIR_FREE(fuse->cache);
     VIR_FREE(fuse);
     goto cleanup;
 }
@@ -348,6 +791,8 @@ int lxcStartFuse(virLXCFusePtr fuse)
 void lxcFreeFuse(virLXCFusePtr *f)
 {
     virLXCFusePtr fuse = *f;
+    size_t i;
+
     /* lxcFuseRun thread create success */
     if (fuse) {
         /* exit fuse_loop, lxcFuseRun thread may try to destroy
@@ -357,6 +802,9 @@ void lxcFreeFuse(virLXCFusePtr *f)
             fuse_exit(fuse->fuse);
         virMutexUnlock(&fuse->lock);
 
+        for (i = 0; i < ARRAY_CARDINALITY(lxcProcGenerators); i++)
+            VIR_FREE(fuse->cache[i].content);
+        VIR_FREE(fuse->cache);
         VIR_FREE(fuse->mountpoint);
         VIR_FREE(*f);
     }
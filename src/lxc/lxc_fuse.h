@@ -47,6 +47,30 @@ struct virLXCMeminfo {
 };
 typedef struct virLXCMeminfo *virLXCMeminfoPtr;
 
+struct virLXCCpuinfo {
+    virBitmapPtr cpus;          /* CPUs the container may run on */
+    unsigned long long usage;   /* CPU time used, in nanoseconds */
+};
+typedef struct virLXCCpuinfo *virLXCCpuinfoPtr;
+
+struct virLXCDiskstat {
+    unsigned int major;
+    unsigned int minor;
+    unsigned long long rd_ios;
+    unsigned long long rd_bytes;
+    unsigned long long wr_ios;
+    unsigned long long wr_bytes;
+};
+typedef struct virLXCDiskstat *virLXCDiskstatPtr;
+
+/* Generated contents of a file, see LXC_FUSE_CACHE_TTL */
+struct virLXCFuseCache {
+    char *content;
+    size_t len;
+    unsigned long long stamp;
+};
+typedef struct virLXCFuseCache *virLXCFuseCachePtr;
+
 struct virLXCFuse {
     virDomainDefPtr def;
     virThread thread;
@@ -54,9 +78,17 @@ struct virLXCFuse {
     struct fuse *fuse;
     struct fuse_chan *ch;
     virMutex lock;
+
+    /* The fields below are only used from the fuse_loop thread */
+    unsigned long loadavg[3];
+    unsigned long long loadTime;
+    virLXCFuseCachePtr cache;
 };
 typedef struct virLXCFuse *virLXCFusePtr;
 
+/* Files of /proc the fuse filesystem provides, NULL terminated */
+extern const char *lxcFuseProcFiles[];
+
 extern int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def);
 extern int lxcStartFuse(virLXCFusePtr f);
 extern void lxcFreeFuse(virLXCFusePtr *f);
@@ -135,6 +135,28 @@ virLXCProcessReboot(virLXCDriverPtr driver,
 }
 
 
+/*
+ * Map the statistics published by the controller. Failing to do so
+ * only means they are read from the cgroup instead.
+ */
+static void
+virLXCProcessOpenStats(virLXCDriverPtr driver,
+                       virDomainObjPtr vm)
+{
+    virLXCDomainObjPrivatePtr priv = vm->privateData;
+    virLXCDriverConfigPtr cfg = virLXCDriverGetConfig(driver);
+
+    virLXCStatsFree(priv->stats);
+    if (!(priv->stats = virLXCStatsOpen(cfg->stateDir, vm->def->name))) {
+        VIR_WARN("Unable to map statistics of %s, reading its cgroup instead",
+                 vm->def->name);
+        virResetLastError();
+    }
+
+    virObjectUnref(cfg);
+}
+
+
 /**
  * virLXCProcessCleanup:
  * @driver: pointer to driver structure
@@ -210,6 +232,10 @@ static void virLXCProcessCleanup(virLXCDriverPtr driver,
         virCgroupFree(&priv->cgroup);
     }
 
+    virLXCStatsFree(priv->stats);
+    priv->stats = NULL;
+    virLXCStatsDelete(cfg->stateDir, vm->def->name);
+
     /* Get machined to terminate the machine as it may not have cleaned it
      * properly. See https://bugs.freedesktop.org/show_bug.cgi?id=68370 for
      * the bug we are working around here.
@@ -1024,6 +1050,7 @@ int virLXCProcessStart(virConnectPtr conn,
     virLXCDriverConfigPtr cfg = virLXCDriverGetConfig(driver);
     virCgroupPtr selfcgroup;
     int status;
+    bool relabeled = false;
 
     if (virCgroupNewSelf(&selfcgroup) < 0)
         return -1;
@@ -1076,6 +1103,8 @@ int virLXCProcessStart(virConnectPtr conn,
                     cfg->logDir, vm->def->name) < 0)
         return -1;
 
+    virLXCDomainStartTimesBegin(vm);
+
     if (!(caps = virLXCDriverGetCapabilities(driver, false)))
         goto cleanup;
 
@@ -1111,6 +1140,7 @@ int virLXCProcessStart(virConnectPtr conn,
     VIR_DEBUG("Preparing host devices");
     if (virLXCPrepareHostDevices(driver, vm->def) < 0)
         goto cleanup;
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_PREPARE);
 
     /* Here we open all the PTYs we need on the host OS side.
      * The LXC controller will open the guest OS side PTYs
@@ -1139,6 +1169,10 @@ int virLXCProcessStart(virConnectPtr conn,
     if (virSecurityManagerSetAllLabel(driver->securityManager,
                                       vm->def, NULL) < 0)
         goto cleanup;
+    /* Disks labeled before a labeling failure are already restored,
+     * so labels are only restored on failures from now on */
+    relabeled = true;
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_LABEL);
 
     for (i = 0; i < vm->def->nconsoles; i++) {
         char *ttyPath;
@@ -1161,9 +1195,11 @@ int virLXCProcessStart(virConnectPtr conn,
         if (virAsprintf(&vm->def->consoles[i]->info.alias, "console%zu", i) < 0)
             goto cleanup;
     }
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_PREPARE);
 
     if (virLXCProcessSetupInterfaces(conn, vm->def, &nveths, &veths) < 0)
         goto cleanup;
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_NETWORK);
 
     /* Save the configuration for the controller */
     if (virDomainSaveConfig(cfg->stateDir, vm->def) < 0)
@@ -1243,7 +1279,7 @@ int virLXCProcessStart(virConnectPtr conn,
                        _("guest failed to start: %s"), ebuf);
         goto cleanup;
     }
-
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_EXEC);
 
     if (VIR_CLOSE(handshakefds[1]) < 0) {
         virReportSystemError(errno, "%s", _("could not close handshake fd"));
@@ -1276,6 +1312,7 @@ int virLXCProcessStart(virConnectPtr conn,
                                  cfg->stateDir, vm->def->name);
         goto cleanup;
     }
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_MONITOR);
 
     if (virCgroupNewDetectMachine(vm->def->name, "lxc", vm->pid,
                                   vm->def->resource ?
@@ -1291,6 +1328,9 @@ int virLXCProcessStart(virConnectPtr conn,
         goto error;
     }
 
+    virCgroupSetStatsCache(priv->cgroup, true);
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_CGROUP);
+
     priv->stopReason = VIR_DOMAIN_EVENT_STOPPED_FAILED;
     priv->wantReboot = false;
     vm->def->id = vm->pid;
@@ -1311,6 +1351,8 @@ int virLXCProcessStart(virConnectPtr conn,
         goto error;
     }
 
+    virLXCProcessOpenStats(driver, vm);
+
     if (autoDestroy &&
         virCloseCallbacksSet(driver->closeCallbacks, vm,
                              conn, lxcProcessAutoDestroy) < 0)
@@ -1345,6 +1387,7 @@ int virLXCProcessStart(virConnectPtr conn,
         if (hookret < 0)
             goto error;
     }
+    virLXCDomainStartTimesMark(vm, VIR_LXC_DOMAIN_START_PHASE_CONTAINER);
 
     rc = 0;
 
@@ -1372,8 +1415,9 @@ int virLXCProcessStart(virConnectPtr conn,
         }
         virDomainConfVMNWFilterTeardown(vm);
 
-        virSecurityManagerRestoreAllLabel(driver->securityManager,
-                                          vm->def, false);
+        if (relabeled)
+            virSecurityManagerRestoreAllLabel(driver->securityManager,
+                                              vm->def, false);
         virSecurityManagerReleaseLabel(driver->securityManager, vm->def);
         /* Clear out dynamically assigned labels */
         if (vm->def->nseclabels &&
@@ -1392,6 +1436,8 @@ int virLXCProcessStart(virConnectPtr conn,
     virObjectUnref(cfg);
     virObjectUnref(caps);
 
+    virLXCDomainStartTimesEnd(driver, vm, rc == 0);
+
     if (err) {
         virSetError(err);
         virFreeError(err);
@@ -1408,13 +1454,19 @@ int virLXCProcessStart(virConnectPtr conn,
 struct virLXCProcessAutostartData {
     virLXCDriverPtr driver;
     virConnectPtr conn;
+
+    /* Domains to start, with a reference held on each */
+    virDomainObjPtr *vms;
+    size_t nvms;
+
+    virMutex lock;
+    size_t next;    /* index of the next domain to start */
 };
 
 static int
 virLXCProcessAutostartDomain(virDomainObjPtr vm,
-                             void *opaque)
+                             struct virLXCProcessAutostartData *data)
 {
-    const struct virLXCProcessAutostartData *data = opaque;
     int ret = 0;
 
     virObjectLock(vm);
@@ -1443,6 +1495,49 @@ virLXCProcessAutostartDomain(virDomainObjPtr vm,
 }
 
 
+static int
+virLXCProcessAutostartCollect(virDomainObjPtr vm,
+                              void *opaque)
+{
+    struct virLXCProcessAutostartData *data = opaque;
+    int ret = 0;
+
+    virObjectLock(vm);
+    if (vm->autostart &&
+        !virDomainObjIsActive(vm)) {
+        if (VIR_APPEND_ELEMENT(data->vms, data->nvms, vm) < 0)
+            ret = -1;
+        else
+            virObjectRef(vm);
+    }
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
+/*
+ * Start the collected domains one after another, until there are
+ * none left. Several of these run at once.
+ */
+static void
+virLXCProcessAutostartWorker(void *opaque)
+{
+    struct virLXCProcessAutostartData *data = opaque;
+    size_t i;
+
+    while (true) {
+        virMutexLock(&data->lock);
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i >= data->nvms)
+            break;
+
+        virLXCProcessAutostartDomain(data->vms[i], data);
+    }
+}
+
+
 void
 virLXCProcessAutostartAll(virLXCDriverPtr driver)
 {
@@ -1455,11 +1550,64 @@ virLXCProcessAutostartAll(virLXCDriverPtr driver)
     /* Ignoring NULL conn which is mostly harmless here */
 
     struct virLXCProcessAutostartData data = { driver, conn };
+    virLXCDriverConfigPtr cfg = virLXCDriverGetConfig(driver);
+    virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t parallel;
+    unsigned long long start = 0, end = 0;
+    size_t i;
 
-    virDomainObjListForEach(driver->domains,
-                            virLXCProcessAutostartDomain,
-                            &data);
+    /* Containers take long to start while mostly waiting for their
+     * controller, so start them outside of the domain list lock and
+     * several at a time */
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        virObjectUnref(cfg);
+        virObjectUnref(conn);
+        return;
+    }
 
+    if (virDomainObjListForEach(driver->domains,
+                                virLXCProcessAutostartCollect,
+                                &data) < 0)
+        goto cleanup;
+
+    if (!data.nvms)
+        goto cleanup;
+
+    ignore_value(virTimeMillisNow(&start));
+
+    /* This thread autostarts containers too */
+    parallel = MIN(data.nvms, cfg->autostartParallel);
+    if (parallel > 1 && VIR_ALLOC_N(threads, parallel - 1) < 0)
+        goto cleanup;
+
+    for (i = 1; i < parallel; i++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            virLXCProcessAutostartWorker, &data) < 0) {
+            VIR_WARN("Unable to start a thread autostarting containers");
+            break;
+        }
+        nthreads++;
+    }
+
+    virLXCProcessAutostartWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    ignore_value(virTimeMillisNow(&end));
+    VIR_DEBUG("Autostarted %zu domains with %zu threads in %llu ms",
+              data.nvms, nthreads + 1, end - start);
+
+ cleanup:
+    for (i = 0; i < data.nvms; i++)
+        virObjectUnref(data.vms[i]);
+    VIR_FREE(data.vms);
+    VIR_FREE(threads);
+    virMutexDestroy(&data.lock);
+    virObjectUnref(cfg);
     virObjectUnref(conn);
 }
 
@@ -1501,6 +1649,10 @@ virLXCProcessReconnectDomain(virDomainObjPtr vm,
             goto error;
         }
 
+        virCgroupSetStatsCache(priv->cgroup, true);
+
+        virLXCProcessOpenStats(driver, vm);
+
         if (virLXCUpdateActiveUsbHostdevs(driver, vm->def) < 0)
             goto error;
 
@@ -0,0 +1,356 @@
+/*
+ * lxc_stats.c: statistics shared by the LXC controller with libvirtd
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The controller of each container periodically samples the cgroup
+ * of the container into a file of the state directory, which
+ * libvirtd maps, so that statistics queries do not need to read the
+ * cgroup filesystem.
+ *
+ * The file holds a ring of samples.  The controller writes the slot
+ * after the latest sample, then makes it the latest.  Each slot has a
+ * sequence number, odd while the slot is being written, so that
+ * readers need no lock: they copy the latest sample and retry if its
+ * sequence number changed meanwhile.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lxc_statspriv.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_LXC
+
+VIR_LOG_INIT("lxc.lxc_stats");
+
+/* Attempts of a reader racing with the controller */
+#define VIR_LXC_STATS_READ_TRIES 8
+
+/**
+ * virLXCStatsNow:
+ * @now: filled with the current time in milliseconds
+ *
+ * Samples are stamped with the monotonic clock, which is common to
+ * the controller and libvirtd, so that setting the system clock does
+ * not make them look stale or fresh.
+ *
+ * Returns 0 on success, -1 on error with errno set
+ */
+int
+virLXCStatsNow(unsigned long long *now)
+{
+    if (virTimeMicrosMonotonicRaw(now) < 0)
+        return -1;
+
+    *now /= 1000;
+    return 0;
+}
+
+
+static char *
+virLXCStatsPath(const char *stateDir,
+                const char *name)
+{
+    char *path;
+
+    ignore_value(virAsprintf(&path, "%s/%s.stats", stateDir, name));
+    return path;
+}
+
+
+static virLXCStatsPtr
+virLXCStatsMap(const char *stateDir,
+               const char *name,
+               bool create)
+{
+    virLXCStatsPtr stats = NULL;
+    char *path = NULL;
+    void *shm;
+    int fd = -1;
+
+    if (!(path = virLXCStatsPath(stateDir, name)))
+        goto error;
+
+    if ((fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY,
+                   S_IRUSR | S_IWUSR)) < 0) {
+        virReportSystemError(errno, _("Unable to open %s"), path);
+        goto error;
+    }
+
+    if (create && ftruncate(fd, sizeof(virLXCStatsShm)) < 0) {
+        virReportSystemError(errno, _("Unable to resize %s"), path);
+        goto error;
+    }
+
+    /* A controller from an older version may not have written it */
+    if (!create) {
+        struct stat sb;
+
+        if (fstat(fd, &sb) < 0) {
+            virReportSystemError(errno, _("Unable to stat %s"), path);
+            goto error;
+        }
+        if (sb.st_size != sizeof(virLXCStatsShm)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unexpected size of %s"), path);
+            goto error;
+        }
+    }
+
+    if ((shm = mmap(NULL, sizeof(virLXCStatsShm),
+                    create ? PROT_READ | PROT_WRITE : PROT_READ,
+                    MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        virReportSystemError(errno, _("Unable to map %s"), path);
+        goto error;
+    }
+
+    if (VIR_ALLOC(stats) < 0) {
+        munmap(shm, sizeof(virLXCStatsShm));
+        goto error;
+    }
+    stats->shm = shm;
+
+    if (create) {
+        stats->shm->head = -1;
+        stats->shm->size = sizeof(virLXCStatsShm);
+        virAtomicIntSet((int *)&stats->shm->magic, VIR_LXC_STATS_MAGIC);
+    } else if (virAtomicIntGet((int *)&stats->shm->magic) !=
+               VIR_LXC_STATS_MAGIC ||
+               stats->shm->size != sizeof(virLXCStatsShm)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected content of %s"), path);
+        goto error;
+    }
+
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(path);
+    return stats;
+
+ error:
+    virLXCStatsFree(stats);
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(path);
+    return NULL;
+}
+
+
+/**
+ * virLXCStatsCreate:
+ * @stateDir: state directory of the driver
+ * @name: name of the container
+ *
+ * Create the statistics file of the container, for the controller
+ * to publish samples.
+ *
+ * Returns the mapped file, or NULL on error.
+ */
+virLXCStatsPtr
+virLXCStatsCreate(const char *stateDir,
+                  const char *name)
+{
+    return virLXCStatsMap(stateDir, name, true);
+}
+
+
+/**
+ * virLXCStatsOpen:
+ * @stateDir: state directory of the driver
+ * @name: name of the container
+ *
+ * Map the statistics file of the container read only.
+ *
+ * Returns the mapped file, or NULL on error.
+ */
+virLXCStatsPtr
+virLXCStatsOpen(const char *stateDir,
+                const char *name)
+{
+    return virLXCStatsMap(stateDir, name, false);
+}
+
+
+void
+virLXCStatsFree(virLXCStatsPtr stats)
+{
+    if (!stats)
+        return;
+
+    munmap(stats->shm, sizeof(virLXCStatsShm));
+    VIR_FREE(stats);
+}
+
+
+/**
+ * virLXCStatsDelete:
+ * @stateDir: state directory of the driver
+ * @name: name of the container
+ *
+ * Remove the statistics file of a container which stopped.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLXCStatsDelete(const char *stateDir,
+                  const char *name)
+{
+    char *path;
+    int ret = 0;
+
+    if (!(path = virLXCStatsPath(stateDir, name)))
+        return -1;
+
+    if (unlink(path) < 0 && errno != ENOENT) {
+        virReportSystemError(errno, _("Unable to remove %s"), path);
+        ret = -1;
+    }
+
+    VIR_FREE(path);
+    return ret;
+}
+
+
+/**
+ * virLXCStatsSampleCgroup:
+ * @cgroup: cgroup of the container
+ * @sample: filled with the current statistics
+ *
+ * Read the statistics of the container from its cgroup.  Statistics
+ * other than the CPU time which cannot be read are flagged unknown.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLXCStatsSampleCgroup(virCgroupPtr cgroup,
+                        virLXCStatsSamplePtr sample)
+{
+    unsigned long memUsage;
+
+    memset(sample, 0, sizeof(*sample));
+
+    if (virLXCStatsNow(&sample->stamp) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to get current time"));
+        return -1;
+    }
+
+    if (virCgroupGetCpuacctUsage(cgroup, &sample->cpuTime) < 0)
+        return -1;
+
+    if (virCgroupGetMemoryUsage(cgroup, &memUsage) == 0) {
+        sample->memory = true;
+        sample->memUsage = memUsage;
+    }
+
+    if (virCgroupGetMemSwapUsage(cgroup, &sample->swapUsage) == 0)
+        sample->swap = true;
+
+    if (virCgroupHasController(cgroup, VIR_CGROUP_CONTROLLER_BLKIO) &&
+        virCgroupGetBlkioIoServiced(cgroup,
+                                    &sample->rdBytes, &sample->wrBytes,
+                                    &sample->rdReq, &sample->wrReq) == 0)
+        sample->blkio = true;
+
+    virResetLastError();
+    return 0;
+}
+
+
+/**
+ * virLXCStatsPublish:
+ * @stats: file created by virLXCStatsCreate
+ * @sample: statistics to publish
+ *
+ * Make @sample the latest sample of the file.  Only one thread may
+ * publish samples.
+ */
+void
+virLXCStatsPublish(virLXCStatsPtr stats,
+                   const virLXCStatsSample *sample)
+{
+    virLXCStatsShmPtr shm = stats->shm;
+    int head = (shm->head + 1) % VIR_LXC_STATS_SLOTS;
+    virLXCStatsSlot *slot = &shm->slots[head];
+
+    virAtomicIntInc(&slot->seq);
+    slot->sample = *sample;
+    virAtomicIntInc(&slot->seq);
+
+    virAtomicIntSet(&shm->head, head);
+}
+
+
+/**
+ * virLXCStatsRead:
+ * @stats: file opened by virLXCStatsOpen
+ * @sample: filled with the latest sample
+ *
+ * Get the latest sample published by the controller, without
+ * reporting errors.
+ *
+ * Returns 0 on success, -1 if there is no sample younger than
+ * VIR_LXC_STATS_MAX_AGE.
+ */
+int
+virLXCStatsRead(virLXCStatsPtr stats,
+                virLXCStatsSamplePtr sample)
+{
+    virLXCStatsShmPtr shm = stats->shm;
+    unsigned long long now;
+    size_t i;
+
+    for (i = 0; i < VIR_LXC_STATS_READ_TRIES; i++) {
+        int head = virAtomicIntGet(&shm->head);
+        virLXCStatsSlot *slot;
+        int seq;
+
+        if (head < 0 || head >= VIR_LXC_STATS_SLOTS)
+            return -1;
+        slot = &shm->slots[head];
+
+        seq = virAtomicIntGet(&slot->seq);
+        if (seq % 2)
+            continue;
+
+        *sample = slot->sample;
+
+        if (virAtomicIntGet(&slot->seq) != seq)
+            continue;
+
+        if (virLXCStatsNow(&now) < 0 ||
+            now > sample->stamp + VIR_LXC_STATS_MAX_AGE) {
+            VIR_DEBUG("Ignoring stale statistics stamp=%llu now=%llu",
+                      sample->stamp, now);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    VIR_DEBUG("Gave up reading statistics after %zu tries", i);
+    return -1;
+}
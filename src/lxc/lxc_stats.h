@@ -0,0 +1,72 @@
+/*
+ * lxc_stats.h: statistics shared by the LXC controller with libvirtd
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LXC_STATS_H__
+# define __LXC_STATS_H__
+
+# include "internal.h"
+# include "vircgroup.h"
+
+/* How often the controller samples the container cgroup, in ms */
+# define VIR_LXC_STATS_INTERVAL 1000
+
+/* Samples older than this, in ms, are not used */
+# define VIR_LXC_STATS_MAX_AGE (3 * VIR_LXC_STATS_INTERVAL)
+
+typedef struct _virLXCStatsSample virLXCStatsSample;
+typedef virLXCStatsSample *virLXCStatsSamplePtr;
+struct _virLXCStatsSample {
+    unsigned long long stamp;     /* ms, see virLXCStatsNow */
+
+    unsigned long long cpuTime;   /* ns */
+
+    /* Each of these tells whether the following values are known */
+    bool memory;
+    unsigned long long memUsage;  /* KiB */
+    bool swap;
+    unsigned long long swapUsage; /* KiB */
+    bool blkio;
+    long long rdBytes;
+    long long wrBytes;
+    long long rdReq;
+    long long wrReq;
+};
+
+typedef struct _virLXCStats virLXCStats;
+typedef virLXCStats *virLXCStatsPtr;
+
+virLXCStatsPtr virLXCStatsCreate(const char *stateDir,
+                                 const char *name);
+virLXCStatsPtr virLXCStatsOpen(const char *stateDir,
+                               const char *name);
+void virLXCStatsFree(virLXCStatsPtr stats);
+int virLXCStatsDelete(const char *stateDir,
+                      const char *name);
+
+int virLXCStatsNow(unsigned long long *now);
+
+int virLXCStatsSampleCgroup(virCgroupPtr cgroup,
+                            virLXCStatsSamplePtr sample);
+void virLXCStatsPublish(virLXCStatsPtr stats,
+                        const virLXCStatsSample *sample);
+int virLXCStatsRead(virLXCStatsPtr stats,
+                    virLXCStatsSamplePtr sample);
+
+#endif /* __LXC_STATS_H__ */
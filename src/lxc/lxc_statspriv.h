@@ -0,0 +1,54 @@
+/*
+ * lxc_statspriv.h: private declarations for LXC statistics
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __LXC_STATSPRIV_H__
+# define __LXC_STATSPRIV_H__
+
+# include "lxc_stats.h"
+
+/*
+ * This header file should never be used outside unit tests.
+ */
+
+# define VIR_LXC_STATS_MAGIC 0x4c585354 /* "LXST" */
+# define VIR_LXC_STATS_SLOTS 4
+
+typedef struct _virLXCStatsSlot virLXCStatsSlot;
+struct _virLXCStatsSlot {
+    int seq;
+    virLXCStatsSample sample;
+};
+
+/* Layout of the file */
+typedef struct _virLXCStatsShm virLXCStatsShm;
+typedef virLXCStatsShm *virLXCStatsShmPtr;
+struct _virLXCStatsShm {
+    unsigned int magic;
+    unsigned int size;  /* of this struct, to detect layout changes */
+    int head;           /* slot of the latest sample, -1 if none yet */
+    virLXCStatsSlot slots[VIR_LXC_STATS_SLOTS];
+};
+
+struct _virLXCStats {
+    virLXCStatsShmPtr shm;
+};
+
+#endif /* __LXC_STATSPRIV_H__ */
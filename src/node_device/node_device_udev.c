@@ -1497,15 +1497,41 @@ static int nodeStateCleanup(void)
 }
 
 
+/*
+ * Process one udev event, the latest one received for @device.
+ */
+static void udevHandleOneEvent(struct udev_device *device)
+{
+    const char *action = udev_device_get_action(device);
+
+    VIR_DEBUG("udev action: '%s'", action);
+
+    if (STREQ(action, "add") || STREQ(action, "change")) {
+        udevAddOneDevice(device);
+        return;
+    }
+
+    if (STREQ(action, "remove")) {
+        udevRemoveOneDevice(device);
+        return;
+    }
+}
+
+
 static void udevEventHandleCallback(int watch ATTRIBUTE_UNUSED,
                                     int fd,
                                     int events ATTRIBUTE_UNUSED,
                                     void *data ATTRIBUTE_UNUSED)
 {
     struct udev_device *device = NULL;
+    struct udev_device **devices = NULL;
+    struct udev_device **slot;
+    size_t ndevices = 0;
+    virHashTablePtr pending = NULL;
     struct udev_monitor *udev_monitor = DRV_STATE_UDEV_MONITOR(driverState);
-    const char *action = NULL;
+    const char *syspath = NULL;
     int udev_fd = -1;
+    size_t i;
 
     nodeDeviceLock(driverState);
     udev_fd = udev_monitor_get_fd(udev_monitor);
@@ -1515,27 +1541,49 @@ static void udevEventHandleCallback(int watch ATTRIBUTE_UNUSED,
         goto out;
     }
 
-    device = udev_monitor_receive_device(udev_monitor);
-    if (device == NULL) {
-        VIR_ERROR(_("udev_monitor_receive_device returned NULL"));
+    if (VIR_ALLOC_N(devices, UDEV_EVENT_BATCH_MAX) < 0 ||
+        !(pending = virHashCreate(UDEV_EVENT_BATCH_MAX, NULL)))
         goto out;
-    }
 
-    action = udev_device_get_action(device);
-    VIR_DEBUG("udev action: '%s'", action);
+    /* Drain the events queued since the last time around the event
+     * loop, so that bursts such as the creation of many SR-IOV VFs do
+     * not cost a wakeup each. Only the latest event of a device matters,
+     * but it is processed where the first one was queued, so that
+     * parents still come before their children. Any events beyond the
+     * batch leave the socket readable and are handled on the next
+     * tick. */
+    while (ndevices < UDEV_EVENT_BATCH_MAX &&
+           (device = udev_monitor_receive_device(udev_monitor))) {
+        syspath = udev_device_get_syspath(device);
 
-    if (STREQ(action, "add") || STREQ(action, "change")) {
-        udevAddOneDevice(device);
-        goto out;
+        if ((slot = virHashLookup(pending, syspath))) {
+            udev_device_unref(*slot);
+            *slot = device;
+            continue;
+        }
+
+        if (virHashAddEntry(pending, syspath, &devices[ndevices]) < 0) {
+            udev_device_unref(device);
+            goto out;
+        }
+        devices[ndevices++] = device;
     }
 
-    if (STREQ(action, "remove")) {
-        udevRemoveOneDevice(device);
+    if (ndevices == 0) {
+        VIR_ERROR(_("udev_monitor_receive_device returned NULL"));
         goto out;
     }
 
+    VIR_DEBUG("Processing a batch of %zu udev events", ndevices);
+
+    for (i = 0; i < ndevices; i++)
+        udevHandleOneEvent(devices[i]);
+
  out:
-    udev_device_unref(device);
+    for (i = 0; i < ndevices; i++)
+        udev_device_unref(devices[i]);
+    VIR_FREE(devices);
+    virHashFree(pending);
     nodeDeviceUnlock(driverState);
     return;
 }
@@ -26,6 +26,7 @@
 typedef struct _udevPrivate udevPrivate;
 
 #define SYSFS_DATA_SIZE 4096
+#define UDEV_EVENT_BATCH_MAX 256
 #define DRV_STATE_UDEV_MONITOR(ds) (((udevPrivate *)((ds)->privateData))->udev_monitor)
 #define DMI_DEVPATH "/sys/devices/virtual/dmi/id"
 #define DMI_DEVPATH_FALLBACK "/sys/class/dmi/id"
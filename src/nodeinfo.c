@@ -52,9 +52,14 @@
 #include "virtypedparam.h"
 #include "virstring.h"
 #include "virnuma.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("nodeinfo");
+
 #if defined(__FreeBSD__) || defined(__APPLE__)
 static int
 appleFreebsdNodeGetCPUCount(void)
@@ -865,6 +870,59 @@ linuxNodeGetCPUStats(FILE *procstat,
     return ret;
 }
 
+/*
+ * Fill @busy and @total with the jiffies each of the first @ncpus
+ * host CPUs spent doing work and in total since boot.
+ */
+static void
+linuxNodeGetCPUTimes(FILE *procstat,
+                     unsigned long long *busy,
+                     unsigned long long *total,
+                     size_t ncpus)
+{
+    char line[1024];
+    unsigned long long usr, ni, sys, idle, iowait;
+    unsigned long long irq, softirq, steal;
+    unsigned int cpu;
+
+    memset(busy, 0, sizeof(*busy) * ncpus);
+    memset(total, 0, sizeof(*total) * ncpus);
+
+    while (fgets(line, sizeof(line), procstat) != NULL) {
+        if (!STRPREFIX(line, "cpu") || !c_isdigit(line[3]))
+            continue;
+
+        irq = softirq = steal = 0;
+        if (sscanf(line, "cpu%u %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &cpu, &usr, &ni, &sys, &idle, &iowait,
+                   &irq, &softirq, &steal) < 6)
+            continue;
+
+        if (cpu >= ncpus)
+            continue;
+
+        busy[cpu] = usr + ni + sys + irq + softirq + steal;
+        total[cpu] = busy[cpu] + idle + iowait;
+    }
+}
+
+static int
+linuxNodeSampleCPUTimes(unsigned long long *busy,
+                        unsigned long long *total,
+                        size_t ncpus)
+{
+    FILE *procstat;
+
+    if (!(procstat = fopen(PROCSTAT_PATH, "r"))) {
+        virReportSystemError(errno, _("cannot open %s"), PROCSTAT_PATH);
+        return -1;
+    }
+
+    linuxNodeGetCPUTimes(procstat, busy, total, ncpus);
+    VIR_FORCE_FCLOSE(procstat);
+    return 0;
+}
+
 static int
 linuxNodeGetMemoryStats(FILE *meminfo,
                         int cellNum,
@@ -1893,3 +1951,266 @@ nodeGetFreeMemory(void)
 
     return freeMem;
 }
+
+
+#ifdef __linux__
+/* Minimum interval the load of the host CPUs is measured over, in ms */
+# define NODE_NUMA_LOAD_INTERVAL 1000
+
+/* The load of the host CPUs is measured between two calls of
+ * nodeGetNUMALoad, rather than by sleeping in each of them: the CPU
+ * times of the previous measurement and the load it found */
+static virMutex nodeNUMALoadLock;
+static unsigned long long *nodeNUMALoadBusy;
+static unsigned long long *nodeNUMALoadTotal;
+static unsigned int *nodeNUMALoadPercent;
+static unsigned long long nodeNUMALoadStamp;
+
+static int
+nodeNUMALoadOnceInit(void)
+{
+    if (virMutexInit(&nodeNUMALoadLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize NUMA load mutex"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(nodeNUMALoad)
+
+
+/*
+ * Fill @load with the busy time of each of the first @maxcpus host
+ * CPUs in percent, measured since the previous call or, on the first
+ * call, since boot. Calls less than NODE_NUMA_LOAD_INTERVAL apart get
+ * the load of the previous measurement.
+ */
+static int
+nodeGetCPULoad(unsigned int *load,
+               size_t maxcpus)
+{
+    unsigned long long *busy = NULL;
+    unsigned long long *total = NULL;
+    unsigned long long now;
+    size_t cpu;
+    int ret = -1;
+
+    if (nodeNUMALoadInitialize() < 0 ||
+        virTimeMillisNowRaw(&now) < 0)
+        return -1;
+
+    virMutexLock(&nodeNUMALoadLock);
+
+    if (!nodeNUMALoadPercent ||
+        now - nodeNUMALoadStamp >= NODE_NUMA_LOAD_INTERVAL) {
+        if (VIR_ALLOC_N(busy, maxcpus) < 0 ||
+            VIR_ALLOC_N(total, maxcpus) < 0 ||
+            (!nodeNUMALoadPercent &&
+             (VIR_ALLOC_N(nodeNUMALoadBusy, maxcpus) < 0 ||
+              VIR_ALLOC_N(nodeNUMALoadTotal, maxcpus) < 0 ||
+              VIR_ALLOC_N(nodeNUMALoadPercent, maxcpus) < 0)))
+            goto cleanup;
+
+        if (linuxNodeSampleCPUTimes(busy, total, maxcpus) < 0)
+            goto cleanup;
+
+        for (cpu = 0; cpu < maxcpus; cpu++) {
+            unsigned long long dbusy = busy[cpu] - nodeNUMALoadBusy[cpu];
+            unsigned long long dtotal = total[cpu] - nodeNUMALoadTotal[cpu];
+
+            nodeNUMALoadPercent[cpu] = dtotal ? 100 * dbusy / dtotal : 0;
+        }
+
+        VIR_FREE(nodeNUMALoadBusy);
+        VIR_FREE(nodeNUMALoadTotal);
+        nodeNUMALoadBusy = busy;
+        nodeNUMALoadTotal = total;
+        busy = total = NULL;
+        nodeNUMALoadStamp = now;
+    }
+
+    memcpy(load, nodeNUMALoadPercent, sizeof(*load) * maxcpus);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&nodeNUMALoadLock);
+    VIR_FREE(busy);
+    VIR_FREE(total);
+    return ret;
+}
+#endif
+
+
+/**
+ * nodeGetNUMALoad:
+ * @nodes: returns the load of every host NUMA node
+ * @nnodes: returns the number of items in @nodes
+ *
+ * Report free memory, CPU load and the vCPUs libvirt already pinned
+ * for each NUMA node of the host. The CPU load is measured since the
+ * previous call, at least NODE_NUMA_LOAD_INTERVAL ago. Memory-only
+ * nodes are included with zero CPUs.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+nodeGetNUMALoad(virNumaNodeLoadPtr *nodes,
+                size_t *nnodes)
+{
+#ifdef __linux__
+    virNumaNodeLoadPtr ret = NULL;
+    size_t nret = 0;
+    virBitmapPtr *cpumaps = NULL;
+    unsigned int *load = NULL;
+    size_t maxcpus = virNumaGetMaxCPUs();
+    int max_node;
+    int n;
+    size_t i;
+    int rv = -1;
+
+    *nodes = NULL;
+    *nnodes = 0;
+
+    if (!virNumaIsAvailable()) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("NUMA isn't available on this host"));
+        return -1;
+    }
+
+    if ((max_node = virNumaGetMaxNode()) < 0)
+        return -1;
+
+    if (VIR_ALLOC_N(cpumaps, max_node + 1) < 0 ||
+        VIR_ALLOC_N(load, maxcpus) < 0)
+        goto cleanup;
+
+    for (n = 0; n <= max_node; n++) {
+        virNumaNodeLoad node = { .node = n };
+        int ncpus;
+
+        if ((ncpus = virNumaGetNodeCPUs(n, &cpumaps[n])) < 0) {
+            if (ncpus == -2) {
+                virResetLastError();
+                continue;
+            }
+            goto cleanup;
+        }
+
+        if (virNumaGetNodeMemory(n, &node.memTotal, &node.memFree) < 0) {
+            VIR_DEBUG("Skipping NUMA node %d without memory information", n);
+            virResetLastError();
+            continue;
+        }
+
+        node.ncpus = ncpus;
+        node.memTotal >>= 10;
+        node.memFree >>= 10;
+        node.pinned = virNumaPlacementGetPinned(n);
+
+        if (VIR_APPEND_ELEMENT(ret, nret, node) < 0)
+            goto cleanup;
+    }
+
+    if (nodeGetCPULoad(load, maxcpus) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nret; i++) {
+        virBitmapPtr cpumap = cpumaps[ret[i].node];
+        ssize_t cpu = -1;
+
+        while ((cpu = virBitmapNextSetBit(cpumap, cpu)) >= 0 &&
+               cpu < maxcpus)
+            ret[i].load += load[cpu];
+
+        VIR_DEBUG("NUMA node %d: cpus=%u load=%u%% pinned=%u "
+                  "memory=%llu/%llu KiB free",
+                  ret[i].node, ret[i].ncpus, ret[i].load, ret[i].pinned,
+                  ret[i].memFree, ret[i].memTotal);
+    }
+
+    *nodes = ret;
+    *nnodes = nret;
+    ret = NULL;
+    rv = 0;
+
+ cleanup:
+    if (cpumaps) {
+        for (n = 0; n <= max_node; n++)
+            virBitmapFree(cpumaps[n]);
+    }
+    VIR_FREE(cpumaps);
+    VIR_FREE(load);
+    VIR_FREE(ret);
+    return rv;
+#else
+    *nodes = NULL;
+    *nnodes = 0;
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("NUMA load is not available on this platform"));
+    return -1;
+#endif
+}
+
+
+/**
+ * nodeGetNUMAPlacement:
+ * @policy: placement policy, see virNumaPlacementPolicy
+ * @vcpus: number of vCPUs of the guest
+ * @memory: memory of the guest in KiB
+ * @nodeset: returns the nodes the guest should be confined to
+ *
+ * Work out the automatic NUMA placement of a new guest, either by
+ * asking numad or by running the built-in placement engine against
+ * the current host load.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+nodeGetNUMAPlacement(int policy,
+                     unsigned int vcpus,
+                     unsigned long long memory,
+                     virBitmapPtr *nodeset)
+{
+    virNumaNodeLoadPtr nodes = NULL;
+    size_t nnodes = 0;
+    char *str = NULL;
+    int ret = -1;
+
+    *nodeset = NULL;
+
+    if (policy == VIR_NUMA_PLACEMENT_POLICY_NUMAD) {
+        if (!(str = virNumaGetAutoPlacementAdvice(vcpus, memory)))
+            goto cleanup;
+
+        VIR_DEBUG("Nodeset returned from numad: %s", str);
+
+        if (virBitmapParse(str, 0, nodeset, VIR_DOMAIN_CPUMASK_LEN) < 0)
+            goto cleanup;
+    } else {
+        if (nodeGetNUMALoad(&nodes, &nnodes) < 0 ||
+            virNumaPlacementChoose(nodes, nnodes, policy,
+                                   vcpus, memory, nodeset) < 0)
+            goto cleanup;
+
+        if (!(str = virBitmapFormat(*nodeset)))
+            goto cleanup;
+
+        VIR_INFO("NUMA placement policy '%s' chose nodeset %s "
+                 "for %u vCPUs and %llu KiB",
+                 virNumaPlacementPolicyTypeToString(policy),
+                 str, vcpus, memory);
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0) {
+        virBitmapFree(*nodeset);
+        *nodeset = NULL;
+    }
+    VIR_FREE(nodes);
+    VIR_FREE(str);
+    return ret;
+}
@@ -25,6 +25,7 @@
 # define __VIR_NODEINFO_H__
 
 # include "capabilities.h"
+# include "virnuma.h"
 
 int nodeGetInfo(virNodeInfoPtr nodeinfo);
 int nodeCapsInitNUMA(virCapsPtr caps);
@@ -57,4 +58,11 @@ int nodeGetCPUMap(unsigned char **cpumap,
                   unsigned int *online,
                   unsigned int flags);
 
+int nodeGetNUMALoad(virNumaNodeLoadPtr *nodes,
+                    size_t *nnodes);
+int nodeGetNUMAPlacement(int policy,
+                         unsigned int vcpus,
+                         unsigned long long memory,
+                         virBitmapPtr *nodeset);
+
 #endif /* __VIR_NODEINFO_H__*/
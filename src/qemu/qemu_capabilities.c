@@ -24,6 +24,7 @@
 #include <config.h>
 
 #include "qemu_capabilities.h"
+#include "qemu_capspriv.h"
 #include "viralloc.h"
 #include "vircrypto.h"
 #include "virlog.h"
@@ -39,6 +40,7 @@
 #include "virnodesuspend.h"
 #include "qemu_monitor.h"
 #include "virstring.h"
+#include "c-ctype.h"
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -291,6 +293,7 @@ struct _virQEMUCaps {
 struct _virQEMUCapsCache {
     virMutex lock;
     virHashTablePtr binaries;
+    unsigned int generation; /* bumped whenever binaries change */
     char *libDir;
     char *cacheDir;
     uid_t runUid;
@@ -2375,245 +2378,300 @@ int virQEMUCapsProbeQMP(virQEMUCapsPtr qemuCaps,
 
 
 /*
- * Parsing a doc that looks like
+ * The capabilities cache is a plain text file, so that loading it at
+ * startup for every emulator is cheap and does not involve an XML
+ * parser.  It looks like
  *
- * <qemuCaps>
- *   <qemuctime>234235253</qemuctime>
- *   <selfctime>234235253</selfctime>
- *   <usedQMP/>
- *   <flag name='foo'/>
- *   <flag name='bar'/>
- *   ...
- *   <cpu name="pentium3"/>
- *   ...
- *   <machine name="pc-1.0" alias="pc" maxCpus="4"/>
- *   ...
- * </qemuCaps>
+ * qemuCaps 1
+ * qemuctime 234235253
+ * selfctime 234235253
+ * usedQMP
+ * flag foo
+ * flag bar
+ * ...
+ * version 1006000
+ * kvmVersion 0
+ * arch x86_64
+ * cpu pentium3
+ * ...
+ * machine 4 pc-1.0 pc
+ * ...
+ *
+ * where a machine is described by its maximum number of CPUs, its
+ * name and optional alias.  Whitespace and backslashes in names are
+ * written as \xNN.  The version on the first line must be bumped
+ * whenever the meaning of the content changes.
  */
+#define QEMU_CAPS_CACHE_HEADER "qemuCaps 1"
+#define QEMU_CAPS_CACHE_MAX_LEN (1024 * 1024)
+
+static void
+virQEMUCapsFormatCacheString(virBufferPtr buf, const char *str)
+{
+    for (; *str; str++) {
+        if (c_isspace(*str) || *str == '\\')
+            virBufferAsprintf(buf, "\\x%02x", (unsigned char) *str);
+        else
+            virBufferAddChar(buf, *str);
+    }
+}
+
+
+/* Undo virQEMUCapsFormatCacheString() into a new string */
+static char *
+virQEMUCapsParseCacheString(const char *str)
+{
+    char *ret;
+    char *out;
+
+    if (VIR_ALLOC_N(ret, strlen(str) + 1) < 0)
+        return NULL;
+
+    for (out = ret; *str; str++) {
+        if (*str == '\\') {
+            if (str[1] != 'x' ||
+                !c_isxdigit(str[2]) || !c_isxdigit(str[3])) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("malformed escape in QEMU capabilities "
+                                 "cache '%s'"), str);
+                VIR_FREE(ret);
+                return NULL;
+            }
+            *out++ = (virHexToBin(str[2]) << 4) | virHexToBin(str[3]);
+            str += 3;
+        } else {
+            *out++ = *str;
+        }
+    }
+
+    return ret;
+}
+
+
 static int
-virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps, const char *filename,
-                     time_t *qemuctime, time_t *selfctime)
+virQEMUCapsLoadCacheMachine(virQEMUCapsPtr qemuCaps, const char *value)
 {
-    xmlDocPtr doc = NULL;
+    char **fields = NULL;
+    size_t nfields;
+    size_t n = qemuCaps->nmachineTypes;
     int ret = -1;
-    size_t i;
-    int n;
-    xmlNodePtr *nodes = NULL;
-    xmlXPathContextPtr ctxt = NULL;
-    char *str = NULL;
-    long long int l;
 
-    if (!(doc = virXMLParseFile(filename)))
+    if (!(fields = virStringSplit(value, " ", 0)))
         goto cleanup;
+    nfields = virStringListLength(fields);
 
-    if (!(ctxt = xmlXPathNewContext(doc))) {
-        virReportOOMError();
+    if ((nfields != 2 && nfields != 3) ||
+        virStrToLong_ui(fields[0], NULL, 10,
+                        &qemuCaps->machineMaxCpus[n]) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("malformed machine '%s' in QEMU capabilities cache"),
+                       value);
         goto cleanup;
     }
 
-    ctxt->node = xmlDocGetRootElement(doc);
+    if (!(qemuCaps->machineTypes[n] =
+          virQEMUCapsParseCacheString(fields[1])))
+        goto cleanup;
+    qemuCaps->nmachineTypes++;
 
-    if (STRNEQ((const char *)ctxt->node->name, "qemuCaps")) {
-        virReportError(VIR_ERR_XML_ERROR,
-                       _("unexpected root element <%s>, "
-                         "expecting <qemuCaps>"),
-                       ctxt->node->name);
+    if (nfields == 3 &&
+        !(qemuCaps->machineAliases[n] =
+          virQEMUCapsParseCacheString(fields[2])))
         goto cleanup;
-    }
 
-    if (virXPathLongLong("string(./qemuctime)", ctxt, &l) < 0) {
-        virReportError(VIR_ERR_XML_ERROR, "%s",
-                       _("missing qemuctime in QEMU capabilities XML"));
+    ret = 0;
+ cleanup:
+    virStringFreeList(fields);
+    return ret;
+}
+
+
+int
+virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps, const char *filename,
+                     time_t *qemuctime, time_t *selfctime)
+{
+    char *content = NULL;
+    char **lines = NULL;
+    size_t ncpus = 0;
+    size_t nmachines = 0;
+    bool haveQemuctime = false;
+    bool haveSelfctime = false;
+    bool haveVersion = false;
+    bool haveKVMVersion = false;
+    int ret = -1;
+    size_t i;
+    long long l;
+
+    if (virFileReadAll(filename, QEMU_CAPS_CACHE_MAX_LEN, &content) < 0)
         goto cleanup;
-    }
-    *qemuctime = (time_t)l;
 
-    if (virXPathLongLong("string(./selfctime)", ctxt, &l) < 0) {
-        virReportError(VIR_ERR_XML_ERROR, "%s",
-                       _("missing selfctime in QEMU capabilities XML"));
+    if (!(lines = virStringSplit(content, "\n", 0)))
+        goto cleanup;
+
+    if (!lines[0] || STRNEQ(lines[0], QEMU_CAPS_CACHE_HEADER)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unexpected header in QEMU capabilities cache, "
+                         "expecting '%s'"), QEMU_CAPS_CACHE_HEADER);
         goto cleanup;
     }
-    *selfctime = (time_t)l;
 
-    qemuCaps->usedQMP = virXPathBoolean("count(./usedQMP) > 0",
-                                        ctxt) > 0;
+    for (i = 1; lines[i]; i++) {
+        if (STRPREFIX(lines[i], "cpu "))
+            ncpus++;
+        else if (STRPREFIX(lines[i], "machine "))
+            nmachines++;
+    }
 
-    if ((n = virXPathNodeSet("./flag", ctxt, &nodes)) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("failed to parse qemu capabilities flags"));
+    if (VIR_ALLOC_N(qemuCaps->cpuDefinitions, ncpus) < 0 ||
+        VIR_ALLOC_N(qemuCaps->machineTypes, nmachines) < 0 ||
+        VIR_ALLOC_N(qemuCaps->machineAliases, nmachines) < 0 ||
+        VIR_ALLOC_N(qemuCaps->machineMaxCpus, nmachines) < 0)
         goto cleanup;
-    }
-    VIR_DEBUG("Got flags %d", n);
-    if (n > 0) {
-        for (i = 0; i < n; i++) {
-            int flag;
-            if (!(str = virXMLPropString(nodes[i], "name"))) {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("missing flag name in QEMU capabilities cache"));
-                goto cleanup;
-            }
-            flag = virQEMUCapsTypeFromString(str);
+
+    for (i = 1; lines[i]; i++) {
+        char *key = lines[i];
+        char *value = strchr(key, ' ');
+        int rc = 0;
+
+        if (!*key)
+            continue;
+
+        if (value)
+            *value++ = '\0';
+        else
+            value = key + strlen(key);
+
+        if (STREQ(key, "qemuctime")) {
+            rc = virStrToLong_ll(value, NULL, 10, &l);
+            *qemuctime = (time_t)l;
+            haveQemuctime = true;
+        } else if (STREQ(key, "selfctime")) {
+            rc = virStrToLong_ll(value, NULL, 10, &l);
+            *selfctime = (time_t)l;
+            haveSelfctime = true;
+        } else if (STREQ(key, "usedQMP")) {
+            qemuCaps->usedQMP = true;
+        } else if (STREQ(key, "flag")) {
+            int flag = virQEMUCapsTypeFromString(value);
             if (flag < 0) {
                 virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Unknown qemu capabilities flag %s"), str);
+                               _("Unknown qemu capabilities flag %s"), value);
                 goto cleanup;
             }
-            VIR_FREE(str);
             virQEMUCapsSet(qemuCaps, flag);
+        } else if (STREQ(key, "version")) {
+            rc = virStrToLong_ui(value, NULL, 10, &qemuCaps->version);
+            haveVersion = true;
+        } else if (STREQ(key, "kvmVersion")) {
+            rc = virStrToLong_ui(value, NULL, 10, &qemuCaps->kvmVersion);
+            haveKVMVersion = true;
+        } else if (STREQ(key, "arch")) {
+            if (!(qemuCaps->arch = virArchFromString(value))) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("unknown arch %s in QEMU capabilities cache"),
+                               value);
+                goto cleanup;
+            }
+        } else if (STREQ(key, "cpu")) {
+            if (!(qemuCaps->cpuDefinitions[qemuCaps->ncpuDefinitions] =
+                  virQEMUCapsParseCacheString(value)))
+                goto cleanup;
+            qemuCaps->ncpuDefinitions++;
+        } else if (STREQ(key, "machine")) {
+            if (virQEMUCapsLoadCacheMachine(qemuCaps, value) < 0)
+                goto cleanup;
+        } else {
+            rc = -1;
+        }
+
+        if (rc < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("malformed line '%s %s' in QEMU capabilities "
+                             "cache"), key, value);
+            goto cleanup;
         }
     }
-    VIR_FREE(nodes);
 
-    if (virXPathUInt("string(./version)", ctxt, &qemuCaps->version) < 0) {
+    if (!haveQemuctime || !haveSelfctime) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("missing version in QEMU capabilities cache"));
+                       _("missing ctime in QEMU capabilities cache"));
         goto cleanup;
     }
 
-    if (virXPathUInt("string(./kvmVersion)", ctxt, &qemuCaps->kvmVersion) < 0) {
+    if (!haveVersion || !haveKVMVersion) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("missing version in QEMU capabilities cache"));
         goto cleanup;
     }
 
-    if (!(str = virXPathString("string(./arch)", ctxt))) {
+    if (qemuCaps->arch == VIR_ARCH_NONE) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("missing arch in QEMU capabilities cache"));
         goto cleanup;
     }
-    if (!(qemuCaps->arch = virArchFromString(str))) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("unknown arch %s in QEMU capabilities cache"), str);
-        goto cleanup;
-    }
-    VIR_FREE(str);
-
-    if ((n = virXPathNodeSet("./cpu", ctxt, &nodes)) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("failed to parse qemu capabilities cpus"));
-        goto cleanup;
-    }
-    if (n > 0) {
-        qemuCaps->ncpuDefinitions = n;
-        if (VIR_ALLOC_N(qemuCaps->cpuDefinitions,
-                        qemuCaps->ncpuDefinitions) < 0)
-            goto cleanup;
-
-        for (i = 0; i < n; i++) {
-            if (!(qemuCaps->cpuDefinitions[i] = virXMLPropString(nodes[i], "name"))) {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("missing cpu name in QEMU capabilities cache"));
-                goto cleanup;
-            }
-        }
-    }
-    VIR_FREE(nodes);
-
-
-    if ((n = virXPathNodeSet("./machine", ctxt, &nodes)) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("failed to parse qemu capabilities machines"));
-        goto cleanup;
-    }
-    if (n > 0) {
-        qemuCaps->nmachineTypes = n;
-        if (VIR_ALLOC_N(qemuCaps->machineTypes,
-                        qemuCaps->nmachineTypes) < 0 ||
-            VIR_ALLOC_N(qemuCaps->machineAliases,
-                        qemuCaps->nmachineTypes) < 0 ||
-            VIR_ALLOC_N(qemuCaps->machineMaxCpus,
-                        qemuCaps->nmachineTypes) < 0)
-            goto cleanup;
-
-        for (i = 0; i < n; i++) {
-            if (!(qemuCaps->machineTypes[i] = virXMLPropString(nodes[i], "name"))) {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("missing machine name in QEMU capabilities cache"));
-                goto cleanup;
-            }
-            qemuCaps->machineAliases[i] = virXMLPropString(nodes[i], "alias");
-
-            str = virXMLPropString(nodes[i], "maxCpus");
-            if (str &&
-                virStrToLong_ui(str, NULL, 10, &(qemuCaps->machineMaxCpus[i])) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("malformed machine cpu count in QEMU capabilities cache"));
-                goto cleanup;
-            }
-            VIR_FREE(str);
-        }
-    }
-    VIR_FREE(nodes);
 
     ret = 0;
  cleanup:
-    VIR_FREE(str);
-    VIR_FREE(nodes);
-    xmlXPathFreeContext(ctxt);
-    xmlFreeDoc(doc);
+    virStringFreeList(lines);
+    VIR_FREE(content);
     return ret;
 }
 
 
-static int
+int
 virQEMUCapsSaveCache(virQEMUCapsPtr qemuCaps, const char *filename)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
-    const char *xml = NULL;
+    const char *data = NULL;
     int ret = -1;
     size_t i;
 
-    virBufferAddLit(&buf, "<qemuCaps>\n");
-    virBufferAdjustIndent(&buf, 2);
+    virBufferAddLit(&buf, QEMU_CAPS_CACHE_HEADER "\n");
 
-    virBufferAsprintf(&buf, "<qemuctime>%llu</qemuctime>\n",
+    virBufferAsprintf(&buf, "qemuctime %lld\n",
                       (long long)qemuCaps->ctime);
-    virBufferAsprintf(&buf, "<selfctime>%llu</selfctime>\n",
+    virBufferAsprintf(&buf, "selfctime %lld\n",
                       (long long)virGetSelfLastChanged());
 
     if (qemuCaps->usedQMP)
-        virBufferAddLit(&buf, "<usedQMP/>\n");
+        virBufferAddLit(&buf, "usedQMP\n");
 
     for (i = 0; i < QEMU_CAPS_LAST; i++) {
         if (virQEMUCapsGet(qemuCaps, i)) {
-            virBufferAsprintf(&buf, "<flag name='%s'/>\n",
+            virBufferAsprintf(&buf, "flag %s\n",
                               virQEMUCapsTypeToString(i));
         }
     }
 
-    virBufferAsprintf(&buf, "<version>%d</version>\n",
-                      qemuCaps->version);
-
-    virBufferAsprintf(&buf, "<kvmVersion>%d</kvmVersion>\n",
-                      qemuCaps->kvmVersion);
-
-    virBufferAsprintf(&buf, "<arch>%s</arch>\n",
-                      virArchToString(qemuCaps->arch));
+    virBufferAsprintf(&buf, "version %u\n", qemuCaps->version);
+    virBufferAsprintf(&buf, "kvmVersion %u\n", qemuCaps->kvmVersion);
+    virBufferAsprintf(&buf, "arch %s\n", virArchToString(qemuCaps->arch));
 
     for (i = 0; i < qemuCaps->ncpuDefinitions; i++) {
-        virBufferEscapeString(&buf, "<cpu name='%s'/>\n",
-                              qemuCaps->cpuDefinitions[i]);
+        virBufferAddLit(&buf, "cpu ");
+        virQEMUCapsFormatCacheString(&buf, qemuCaps->cpuDefinitions[i]);
+        virBufferAddChar(&buf, '\n');
     }
 
     for (i = 0; i < qemuCaps->nmachineTypes; i++) {
-        virBufferEscapeString(&buf, "<machine name='%s'",
-                              qemuCaps->machineTypes[i]);
-        if (qemuCaps->machineAliases[i])
-            virBufferEscapeString(&buf, " alias='%s'",
-                              qemuCaps->machineAliases[i]);
-        virBufferAsprintf(&buf, " maxCpus='%u'/>\n",
-                          qemuCaps->machineMaxCpus[i]);
+        virBufferAsprintf(&buf, "machine %u ", qemuCaps->machineMaxCpus[i]);
+        virQEMUCapsFormatCacheString(&buf, qemuCaps->machineTypes[i]);
+        if (qemuCaps->machineAliases[i]) {
+            virBufferAddChar(&buf, ' ');
+            virQEMUCapsFormatCacheString(&buf, qemuCaps->machineAliases[i]);
+        }
+        virBufferAddChar(&buf, '\n');
     }
 
-    virBufferAdjustIndent(&buf, -2);
-    virBufferAddLit(&buf, "</qemuCaps>\n");
-
-    if (virBufferError(&buf))
+    if (virBufferError(&buf)) {
+        virBufferFreeAndReset(&buf);
+        virReportOOMError();
         goto cleanup;
+    }
 
-    xml = virBufferContentAndReset(&buf);
+    data = virBufferContentAndReset(&buf);
 
-    if (virFileWriteStr(filename, xml, 0600) < 0) {
+    if (virFileWriteStr(filename, data, 0600) < 0) {
         virReportSystemError(errno,
                              _("Failed to save '%s' for '%s'"),
                              filename, qemuCaps->binary);
@@ -2627,7 +2685,7 @@ virQEMUCapsSaveCache(virQEMUCapsPtr qemuCaps, const char *filename)
 
     ret = 0;
  cleanup:
-    VIR_FREE(xml);
+    VIR_FREE(data);
     return ret;
 }
 
@@ -2636,6 +2694,7 @@ virQEMUCapsRememberCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
 {
     char *capsdir = NULL;
     char *capsfile = NULL;
+    char *oldfile = NULL;
     int ret = -1;
     char *binaryhash = NULL;
 
@@ -2647,7 +2706,7 @@ virQEMUCapsRememberCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
                             &binaryhash) < 0)
         goto cleanup;
 
-    if (virAsprintf(&capsfile, "%s/%s.xml", capsdir, binaryhash) < 0)
+    if (virAsprintf(&capsfile, "%s/%s.caps", capsdir, binaryhash) < 0)
         goto cleanup;
 
     if (virFileMakePath(capsdir) < 0) {
@@ -2660,10 +2719,17 @@ virQEMUCapsRememberCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
     if (virQEMUCapsSaveCache(qemuCaps, capsfile) < 0)
         goto cleanup;
 
+    /* Drop the XML cache written by older versions */
+    if (virAsprintf(&oldfile, "%s/%s.xml", capsdir, binaryhash) < 0)
+        goto cleanup;
+    if (unlink(oldfile) < 0 && errno != ENOENT)
+        VIR_WARN("Unable to remove '%s'", oldfile);
+
     ret = 0;
  cleanup:
     VIR_FREE(binaryhash);
     VIR_FREE(capsfile);
+    VIR_FREE(oldfile);
     VIR_FREE(capsdir);
     return ret;
 }
@@ -2715,7 +2781,7 @@ virQEMUCapsInitCached(virQEMUCapsPtr qemuCaps, const char *cacheDir)
                             &binaryhash) < 0)
         goto cleanup;
 
-    if (virAsprintf(&capsfile, "%s/%s.xml", capsdir, binaryhash) < 0)
+    if (virAsprintf(&capsfile, "%s/%s.caps", capsdir, binaryhash) < 0)
         goto cleanup;
 
     if (virFileMakePath(capsdir) < 0) {
@@ -3342,6 +3408,7 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
         VIR_DEBUG("Cached capabilities %p no longer valid for %s",
                   ret, binary);
         virHashRemoveEntry(cache->binaries, binary);
+        cache->generation++;
         ret = NULL;
     }
     if (!ret) {
@@ -3356,6 +3423,8 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
             if (virHashAddEntry(cache->binaries, binary, ret) < 0) {
                 virObjectUnref(ret);
                 ret = NULL;
+            } else {
+                cache->generation++;
             }
         }
     }
@@ -3366,6 +3435,41 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
 }
 
 
+static int
+virQEMUCapsCacheEntryIsInvalid(const void *payload,
+                               const void *name ATTRIBUTE_UNUSED,
+                               const void *data ATTRIBUTE_UNUSED)
+{
+    return !virQEMUCapsIsValid((virQEMUCapsPtr) payload);
+}
+
+
+/**
+ * virQEMUCapsCacheGetGeneration:
+ * @cache: the capabilities cache
+ *
+ * Drop the capabilities of binaries which changed since they were
+ * probed, which only costs a stat() per binary.
+ *
+ * Returns a counter bumped whenever capabilities are probed or dropped,
+ * so that anything derived from them can tell it is out of date.
+ */
+unsigned int
+virQEMUCapsCacheGetGeneration(virQEMUCapsCachePtr cache)
+{
+    unsigned int ret;
+
+    virMutexLock(&cache->lock);
+    if (virHashRemoveSet(cache->binaries,
+                         virQEMUCapsCacheEntryIsInvalid, NULL) > 0)
+        cache->generation++;
+    ret = cache->generation;
+    virMutexUnlock(&cache->lock);
+
+    return ret;
+}
+
+
 virQEMUCapsPtr
 virQEMUCapsCacheLookupCopy(virQEMUCapsCachePtr cache, const char *binary)
 {
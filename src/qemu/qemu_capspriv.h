@@ -0,0 +1,39 @@
+/*
+ * qemu_capspriv.h: private declarations for QEMU capabilities
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __QEMU_CAPSPRIV_H__
+# define __QEMU_CAPSPRIV_H__
+
+# include "qemu_capabilities.h"
+
+/*
+ * This header file should never be used outside unit tests.
+ */
+
+int virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps,
+                         const char *filename,
+                         time_t *qemuctime,
+                         time_t *selfctime);
+
+int virQEMUCapsSaveCache(virQEMUCapsPtr qemuCaps,
+                         const char *filename);
+
+#endif /* __QEMU_CAPSPRIV_H__ */
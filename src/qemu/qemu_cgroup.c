@@ -722,6 +722,8 @@ qemuInitCgroup(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
+    virCgroupSetStatsCache(priv->cgroup, true);
+
  done:
     ret = 0;
  cleanup:
@@ -756,6 +758,9 @@ qemuConnectCgroup(virQEMUDriverPtr driver,
                                   &priv->cgroup) < 0)
         goto cleanup;
 
+    if (priv->cgroup)
+        virCgroupSetStatsCache(priv->cgroup, true);
+
  done:
     ret = 0;
  cleanup:
@@ -250,11 +250,16 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
 
     cfg->securityDefaultConfined = true;
     cfg->securityRequireConfined = false;
+    cfg->securityLabelThreads = 1;
 
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
     cfg->seccompSandbox = -1;
 
+    cfg->numaPlacementPolicy = VIR_NUMA_PLACEMENT_POLICY_DEFAULT;
+    cfg->numaRebalanceMaxMoves = 1;
+    cfg->numaRebalanceThreshold = 75;
+
     return cfg;
 
  error:
@@ -269,6 +274,7 @@ static void virQEMUDriverConfigDispose(void *obj)
 
 
     virStringFreeList(cfg->cgroupDeviceACL);
+    virStringFreeList(cfg->hostdevPool);
 
     VIR_FREE(cfg->configBaseDir);
     VIR_FREE(cfg->configDir);
@@ -400,6 +406,7 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
 
     GET_VALUE_BOOL("security_default_confined", cfg->securityDefaultConfined);
     GET_VALUE_BOOL("security_require_confined", cfg->securityRequireConfined);
+    GET_VALUE_LONG("security_label_threads", cfg->securityLabelThreads);
 
     GET_VALUE_BOOL("spice_tls", cfg->spiceTLS);
     GET_VALUE_STR("spice_tls_x509_cert_dir", cfg->spiceTLSx509certdir);
@@ -559,6 +566,30 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     GET_VALUE_BOOL("mac_filter", cfg->macFilter);
 
     GET_VALUE_BOOL("relaxed_acs_check", cfg->relaxedACS);
+    GET_VALUE_BOOL("hostdev_parallel_reset", cfg->hostdevParallelReset);
+
+    p = virConfGetValue(conf, "hostdev_pool");
+    CHECK_TYPE("hostdev_pool", VIR_CONF_LIST);
+    if (p) {
+        int len = 0;
+        virConfValuePtr pp;
+        for (pp = p->list; pp; pp = pp->next)
+            len++;
+        if (VIR_ALLOC_N(cfg->hostdevPool, 1+len) < 0)
+            goto cleanup;
+
+        for (i = 0, pp = p->list; pp; ++i, pp = pp->next) {
+            if (pp->type != VIR_CONF_STRING) {
+                virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                               _("hostdev_pool must be a "
+                                 "list of strings"));
+                goto cleanup;
+            }
+            if (VIR_STRDUP(cfg->hostdevPool[i], pp->str) < 0)
+                goto cleanup;
+        }
+        cfg->hostdevPool[i] = NULL;
+    }
     GET_VALUE_BOOL("clear_emulator_capabilities", cfg->clearEmulatorCapabilities);
     GET_VALUE_BOOL("allow_disk_format_probing", cfg->allowDiskFormatProbing);
     GET_VALUE_BOOL("set_process_name", cfg->setProcessName);
@@ -576,6 +607,27 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
 
     GET_VALUE_STR("migration_address", cfg->migrationAddress);
 
+    p = virConfGetValue(conf, "numa_placement_policy");
+    CHECK_TYPE("numa_placement_policy", VIR_CONF_STRING);
+    if (p && p->str &&
+        (cfg->numaPlacementPolicy =
+         virNumaPlacementPolicyTypeFromString(p->str)) < 0) {
+        virReportError(VIR_ERR_CONF_SYNTAX,
+                       _("%s: unknown numa_placement_policy '%s'"),
+                       filename, p->str);
+        goto cleanup;
+    }
+
+    GET_VALUE_LONG("numa_rebalance_interval", cfg->numaRebalanceInterval);
+    GET_VALUE_LONG("numa_rebalance_max_moves", cfg->numaRebalanceMaxMoves);
+    GET_VALUE_LONG("numa_rebalance_threshold", cfg->numaRebalanceThreshold);
+    if (cfg->numaRebalanceThreshold > 100) {
+        virReportError(VIR_ERR_CONF_SYNTAX,
+                       _("%s: numa_rebalance_threshold: must be "
+                         "between 0 and 100"), filename);
+        goto cleanup;
+    }
+
     ret = 0;
 
  cleanup:
@@ -693,6 +745,8 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
         qemuDriverLock(driver);
         virObjectUnref(driver->caps);
         driver->caps = caps;
+        /* Have the XML rebuilt next time it is needed */
+        VIR_FREE(driver->capsXML);
     } else {
         qemuDriverLock(driver);
     }
@@ -702,6 +756,146 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
     return ret;
 }
 
+
+/**
+ * virQEMUDriverGetCapabilitiesXML:
+ * @driver: the QEMU driver
+ *
+ * Get the capabilities XML of the host.  Building and formatting the
+ * capabilities probes the host and looks up all emulators, which is
+ * too costly to be done for every client asking, so the XML is kept in
+ * memory.  It is rebuilt once the capabilities are refreshed, as done
+ * when the driver is reloaded, or once the capabilities cache probed
+ * or dropped any emulator.
+ *
+ * Returns: the XML, to be freed by the caller, or NULL on error
+ */
+char *virQEMUDriverGetCapabilitiesXML(virQEMUDriverPtr driver)
+{
+    virCapsPtr caps = NULL;
+    unsigned int generation;
+    char *xml = NULL;
+    char *ret = NULL;
+
+    generation = virQEMUCapsCacheGetGeneration(driver->qemuCapsCache);
+
+    qemuDriverLock(driver);
+    if (driver->capsXML &&
+        driver->capsXMLGeneration == generation)
+        goto done;
+    qemuDriverUnlock(driver);
+
+    /* The generation was taken first, so that emulators changing
+     * while building get the XML rebuilt on the next call */
+    if (!(caps = virQEMUDriverCreateCapabilities(driver)))
+        return NULL;
+
+    if (!(xml = virCapabilitiesFormatXML(caps))) {
+        virReportOOMError();
+        virObjectUnref(caps);
+        return NULL;
+    }
+
+    VIR_DEBUG("Rebuilt capabilities for generation %u", generation);
+
+    qemuDriverLock(driver);
+    virObjectUnref(driver->caps);
+    driver->caps = caps;
+    VIR_FREE(driver->capsXML);
+    driver->capsXML = xml;
+    driver->capsXMLGeneration = generation;
+
+ done:
+    ignore_value(VIR_STRDUP(ret, driver->capsXML));
+    qemuDriverUnlock(driver);
+    return ret;
+}
+
+
+static int
+virQEMUDriverWriteStartTimes(int fd, void *opaque)
+{
+    const char *str = opaque;
+
+    if (safewrite(fd, str, strlen(str)) < 0)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * virQEMUDriverAddStartTimes:
+ * @driver: the QEMU driver
+ * @names: names of the measured start phases
+ * @times: time taken by each phase, in microseconds
+ * @ntimes: size of @names and @times
+ *
+ * Account the time a domain took to start in the start latency
+ * histograms of @driver, one histogram per phase, and save their
+ * summary to the start-times file of the state directory, one line
+ * per phase, for tools tracking start latency.  The phases must be
+ * the same on every call.  The file is written without holding the
+ * driver lock, so that other driver operations do not wait for it.
+ */
+void virQEMUDriverAddStartTimes(virQEMUDriverPtr driver,
+                                const char *const *names,
+                                const unsigned long long *times,
+                                size_t ntimes)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *path = NULL;
+    char *str = NULL;
+    unsigned long long seq;
+    size_t i;
+
+    qemuDriverLock(driver);
+
+    if (!driver->startTimes) {
+        if (VIR_ALLOC_N(driver->startTimes, ntimes) < 0) {
+            qemuDriverUnlock(driver);
+            goto cleanup;
+        }
+        driver->nstartTimes = ntimes;
+    }
+
+    for (i = 0; i < ntimes && i < driver->nstartTimes; i++) {
+        virHistogramAdd(&driver->startTimes[i], times[i]);
+
+        virBufferAsprintf(&buf, "%s ", names[i]);
+        virHistogramFormat(&buf, &driver->startTimes[i]);
+        virBufferAddLit(&buf, "\n");
+    }
+    seq = ++driver->startTimesSeq;
+
+    qemuDriverUnlock(driver);
+
+    if (virBufferError(&buf)) {
+        virReportOOMError();
+        goto cleanup;
+    }
+    str = virBufferContentAndReset(&buf);
+
+    if (virAsprintf(&path, "%s/start-times", cfg->stateDir) < 0)
+        goto cleanup;
+
+    /* Domains started meanwhile may have saved a newer summary */
+    virMutexLock(&driver->startTimesLock);
+    if (seq > driver->startTimesSaved) {
+        if (virFileRewrite(path, 0644, virQEMUDriverWriteStartTimes, str) < 0)
+            VIR_WARN("Unable to save domain start times");
+        else
+            driver->startTimesSaved = seq;
+    }
+    virMutexUnlock(&driver->startTimesLock);
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(str);
+    VIR_FREE(path);
+    virObjectUnref(cfg);
+}
+
 struct _qemuSharedDeviceEntry {
     size_t ref;
     char **domains; /* array of domain names */
@@ -45,6 +45,7 @@
 # include "qemu_capabilities.h"
 # include "virclosecallbacks.h"
 # include "virhostdev.h"
+# include "virhistogram.h"
 
 # ifdef CPU_SETSIZE /* Linux */
 #  define QEMUD_CPUMASK_LEN CPU_SETSIZE
@@ -133,6 +134,8 @@ struct _virQEMUDriverConfig {
     bool macFilter;
 
     bool relaxedACS;
+    bool hostdevParallelReset;
+    char **hostdevPool;
     bool vncAllowHostAudio;
     bool nogfxAllowHostAudio;
     bool clearEmulatorCapabilities;
@@ -147,6 +150,7 @@ struct _virQEMUDriverConfig {
     char **securityDriverNames;
     bool securityDefaultConfined;
     bool securityRequireConfined;
+    unsigned int securityLabelThreads;
 
     char *saveImageFormat;
     char *dumpImageFormat;
@@ -167,6 +171,13 @@ struct _virQEMUDriverConfig {
     char *migrationAddress;
     int migrationPortMin;
     int migrationPortMax;
+
+    int numaPlacementPolicy; /* virNumaPlacementPolicy */
+
+    /* Periodic NUMA rebalancing of guests with automatic placement */
+    unsigned int numaRebalanceInterval; /* in seconds, 0 disables it */
+    unsigned int numaRebalanceMaxMoves; /* guests moved per interval */
+    unsigned int numaRebalanceThreshold; /* in percent */
 };
 
 /* Main driver state */
@@ -204,6 +215,11 @@ struct _virQEMUDriver {
      */
     virCapsPtr caps;
 
+    /* Require lock. XML formatting of 'caps', and the generation of
+     * 'qemuCapsCache' it was built for */
+    char *capsXML;
+    unsigned int capsXMLGeneration;
+
     /* Immutable pointer, Immutable object */
     virDomainXMLOptionPtr xmlopt;
 
@@ -238,6 +254,23 @@ struct _virQEMUDriver {
 
     /* Immutable pointer, self-clocking APIs */
     virCloseCallbacksPtr closeCallbacks;
+
+    /* NUMA rebalancer state, see qemu_numa.c */
+    int numaRebalanceTimer;
+    virThreadPoolPtr numaRebalancePool;
+    /* Atomic access only */
+    int numaRebalancePending;
+
+    /* Require lock. Start latency histograms of domains, see
+     * virQEMUDriverAddStartTimes */
+    virHistogramPtr startTimes;
+    size_t nstartTimes;
+    unsigned long long startTimesSeq;
+
+    /* Serializes writes of the start-times file, which happen without
+     * the driver lock.  Summary last written, require startTimesLock */
+    virMutex startTimesLock;
+    unsigned long long startTimesSaved;
 };
 
 typedef struct _qemuDomainCmdlineDef qemuDomainCmdlineDef;
@@ -265,6 +298,11 @@ virQEMUDriverConfigPtr virQEMUDriverGetConfig(virQEMUDriverPtr driver);
 virCapsPtr virQEMUDriverCreateCapabilities(virQEMUDriverPtr driver);
 virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
                                         bool refresh);
+char *virQEMUDriverGetCapabilitiesXML(virQEMUDriverPtr driver);
+void virQEMUDriverAddStartTimes(virQEMUDriverPtr driver,
+                                const char *const *names,
+                                const unsigned long long *times,
+                                size_t ntimes);
 
 struct qemuDomainDiskInfo {
     bool removable;
@@ -38,6 +38,11 @@
 #include "virtime.h"
 #include "virstoragefile.h"
 #include "virstring.h"
+#include "virprobe.h"
+
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_qemu_probes.h"
+#endif
 
 #include <sys/time.h>
 #include <fcntl.h>
@@ -71,6 +76,19 @@ VIR_ENUM_IMPL(qemuDomainAsyncJob, QEMU_ASYNC_JOB_LAST,
               "snapshot",
 );
 
+VIR_ENUM_IMPL(qemuDomainStartPhase, QEMU_DOMAIN_START_PHASE_LAST,
+              "prepare",
+              "network",
+              "hostdev",
+              "command-line",
+              "exec",
+              "cgroup",
+              "label",
+              "monitor",
+              "qmp-capabilities",
+              "setup",
+);
+
 
 const char *
 qemuDomainAsyncJobPhaseToString(enum qemuDomainAsyncJob job,
@@ -119,6 +137,151 @@ qemuDomainAsyncJobPhaseFromString(enum qemuDomainAsyncJob job,
 }
 
 
+verify(QEMU_DOMAIN_START_PHASE_LAST <= VIR_DOMAIN_START_PHASES_MAX);
+
+/**
+ * qemuDomainStartTimesBegin:
+ * @vm: domain being started
+ *
+ * Start timing the phases of starting @vm.
+ */
+void
+qemuDomainStartTimesBegin(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    virDomainStartTimesBegin(&priv->startTimes);
+
+    PROBE(QEMU_DOMAIN_START_BEGIN,
+          "vm=%p name=%s", vm, vm->def->name);
+}
+
+
+/**
+ * qemuDomainStartTimesMark:
+ * @vm: domain being started
+ * @phase: phase which just ended
+ *
+ * Account the time elapsed since the previous mark to @phase.  A phase
+ * may be marked several times, its durations add up.  Does nothing
+ * unless @vm is being started.
+ */
+void
+qemuDomainStartTimesMark(virDomainObjPtr vm,
+                         qemuDomainStartPhase phase)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long elapsed;
+
+    if (virDomainStartTimesMark(&priv->startTimes, phase, &elapsed) < 0)
+        return;
+
+    PROBE(QEMU_DOMAIN_START_PHASE,
+          "vm=%p name=%s phase=%s start=%llu elapsed=%llu",
+          vm, vm->def->name, qemuDomainStartPhaseTypeToString(phase),
+          priv->startTimes.mark - elapsed, elapsed);
+}
+
+
+#define MESSAGE_ID_DOMAIN_START_TIMES "4d0c7d51-9b3e-4c8a-a7f2-6e0b1f3c52d9"
+
+/* journald fields carrying the duration of each phase */
+static const char *qemuDomainStartPhaseLogKeys[] = {
+    "LIBVIRT_START_PREPARE_US",
+    "LIBVIRT_START_NETWORK_US",
+    "LIBVIRT_START_HOSTDEV_US",
+    "LIBVIRT_START_COMMAND_LINE_US",
+    "LIBVIRT_START_EXEC_US",
+    "LIBVIRT_START_CGROUP_US",
+    "LIBVIRT_START_LABEL_US",
+    "LIBVIRT_START_MONITOR_US",
+    "LIBVIRT_START_QMP_CAPABILITIES_US",
+    "LIBVIRT_START_SETUP_US",
+};
+verify(ARRAY_CARDINALITY(qemuDomainStartPhaseLogKeys) ==
+       QEMU_DOMAIN_START_PHASE_LAST);
+
+/**
+ * qemuDomainStartTimesEnd:
+ * @driver: qemu driver
+ * @vm: domain being started
+ * @success: whether the domain was started
+ *
+ * Stop timing the start of @vm and log the duration of its phases,
+ * each of them in its own journald field too.  If @vm was started,
+ * the durations are also accounted in the start latency histograms
+ * of @driver and reported by a VIR_DOMAIN_EVENT_ID_START_TIMES event.
+ */
+void
+qemuDomainStartTimesEnd(virQEMUDriverPtr driver,
+                        virDomainObjPtr vm,
+                        bool success)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainStartTimesPtr times = &priv->startTimes;
+    virLogMetadata meta[QEMU_DOMAIN_START_PHASE_LAST + 4];
+    const char *names[QEMU_DOMAIN_START_PHASE_LAST + 1];
+    unsigned long long values[QEMU_DOMAIN_START_PHASE_LAST + 1];
+    virObjectEventPtr event;
+    char *phases = NULL;
+    size_t n = 0;
+    size_t i;
+
+    if (virDomainStartTimesEnd(times) < 0)
+        return;
+
+    PROBE(QEMU_DOMAIN_START_END,
+          "vm=%p name=%s success=%d total=%llu",
+          vm, vm->def->name, success, times->total);
+
+    meta[n].key = "MESSAGE_ID";
+    meta[n].s = MESSAGE_ID_DOMAIN_START_TIMES;
+    meta[n++].iv = 0;
+    meta[n].key = "LIBVIRT_DOMAIN";
+    meta[n].s = vm->def->name;
+    meta[n++].iv = 0;
+    meta[n].key = "LIBVIRT_START_TOTAL_US";
+    meta[n].s = NULL;
+    meta[n++].iv = MIN(times->total, INT_MAX);
+
+    for (i = 0; i < QEMU_DOMAIN_START_PHASE_LAST; i++) {
+        meta[n].key = qemuDomainStartPhaseLogKeys[i];
+        meta[n].s = NULL;
+        meta[n++].iv = MIN(times->phases[i], INT_MAX);
+    }
+    meta[n].key = NULL;
+
+    if (!(phases = virDomainStartTimesFormat(times,
+                                             QEMU_DOMAIN_START_PHASE_LAST,
+                                             qemuDomainStartPhaseTypeToString)))
+        return;
+
+    virLogMessage(&virLogSelf, VIR_LOG_INFO,
+                  __FILE__, __LINE__, __func__,
+                  meta,
+                  "%s domain %s in %llu us:%s",
+                  success ? "Started" : "Failed to start",
+                  vm->def->name, times->total, phases);
+    VIR_FREE(phases);
+
+    if (!success)
+        return;
+
+    for (i = 0; i < QEMU_DOMAIN_START_PHASE_LAST; i++) {
+        names[i] = qemuDomainStartPhaseTypeToString(i);
+        values[i] = times->phases[i];
+    }
+    names[i] = "total";
+    values[i] = times->total;
+    virQEMUDriverAddStartTimes(driver, names, values, i + 1);
+
+    if ((event = virDomainStartTimesEventNew(vm, times,
+                                             QEMU_DOMAIN_START_PHASE_LAST,
+                                             qemuDomainStartPhaseTypeToString)))
+        qemuDomainEventQueue(driver, event);
+}
+
+
 void qemuDomainEventQueue(virQEMUDriverPtr driver,
                           virObjectEventPtr event)
 {
@@ -229,6 +392,7 @@ qemuDomainObjPrivateAlloc(void)
         goto error;
 
     priv->migMaxBandwidth = QEMU_DOMAIN_MIG_BANDWIDTH_MAX;
+    priv->numaLocality = -1;
 
     return priv;
 
@@ -252,6 +416,7 @@ qemuDomainObjPrivateFree(void *data)
     VIR_FREE(priv->vcpupids);
     VIR_FREE(priv->lockState);
     VIR_FREE(priv->origname);
+    virBitmapFree(priv->placementNodeset);
 
     virCondDestroy(&priv->unplugFinished);
     virChrdevFree(priv->devs);
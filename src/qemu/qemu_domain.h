@@ -27,6 +27,7 @@
 # include "virthread.h"
 # include "vircgroup.h"
 # include "domain_conf.h"
+# include "domain_start_times.h"
 # include "snapshot_conf.h"
 # include "qemu_monitor.h"
 # include "qemu_agent.h"
@@ -99,6 +100,23 @@ enum qemuDomainAsyncJob {
 };
 VIR_ENUM_DECL(qemuDomainAsyncJob)
 
+/* Phases of qemuProcessStart whose duration is recorded */
+typedef enum {
+    QEMU_DOMAIN_START_PHASE_PREPARE,      /* devices, labels, log file */
+    QEMU_DOMAIN_START_PHASE_NETWORK,      /* allocating network devices */
+    QEMU_DOMAIN_START_PHASE_HOSTDEV,      /* detaching and resetting hostdevs */
+    QEMU_DOMAIN_START_PHASE_COMMAND_LINE, /* building the command line */
+    QEMU_DOMAIN_START_PHASE_EXEC,         /* spawning QEMU up to handshake */
+    QEMU_DOMAIN_START_PHASE_CGROUP,       /* creating the domain cgroup */
+    QEMU_DOMAIN_START_PHASE_LABEL,        /* labelling domain resources */
+    QEMU_DOMAIN_START_PHASE_MONITOR,      /* waiting for and opening monitor */
+    QEMU_DOMAIN_START_PHASE_QMP_CAPABILITIES, /* negotiating and probing */
+    QEMU_DOMAIN_START_PHASE_SETUP,        /* vCPUs, passwords, balloon... */
+
+    QEMU_DOMAIN_START_PHASE_LAST
+} qemuDomainStartPhase;
+VIR_ENUM_DECL(qemuDomainStartPhase)
+
 struct qemuDomainJobObj {
     virCond cond;                       /* Use to coordinate jobs */
     enum qemuDomainJob active;          /* Currently running job */
@@ -176,6 +194,17 @@ struct _qemuDomainObjPrivate {
     char **qemuDevices; /* NULL-terminated list of devices aliases known to QEMU */
 
     bool hookRun;  /* true if there was a hook run over this domain */
+
+    /* NUMA nodes the vCPUs are accounted on, see virNumaPlacementReserve */
+    virBitmapPtr placementNodeset;
+    unsigned int placementVcpus;
+
+    /* NUMA rebalancer bookkeeping, see qemu_numa.c */
+    unsigned long long numaMoves;
+    unsigned long long numaLastMove; /* in ms since the epoch */
+    int numaLocality; /* in percent, -1 if never sampled */
+
+    virDomainStartTimes startTimes;
 };
 
 typedef enum {
@@ -196,6 +225,13 @@ const char *qemuDomainAsyncJobPhaseToString(enum qemuDomainAsyncJob job,
 int qemuDomainAsyncJobPhaseFromString(enum qemuDomainAsyncJob job,
                                       const char *phase);
 
+void qemuDomainStartTimesBegin(virDomainObjPtr vm);
+void qemuDomainStartTimesMark(virDomainObjPtr vm,
+                              qemuDomainStartPhase phase);
+void qemuDomainStartTimesEnd(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             bool success);
+
 void qemuDomainEventFlush(int timer, void *opaque);
 
 void qemuDomainEventQueue(virQEMUDriverPtr driver,
@@ -53,6 +53,7 @@
 #include "qemu_hostdev.h"
 #include "qemu_hotplug.h"
 #include "qemu_monitor.h"
+#include "qemu_numa.h"
 #include "qemu_process.h"
 #include "qemu_migration.h"
 
@@ -385,6 +386,8 @@ qemuSecurityInit(virQEMUDriverPtr driver)
         mgr = NULL;
     }
 
+    virSecurityManagerSetLabelThreads(stack, cfg->securityLabelThreads);
+
     driver->securityManager = stack;
     virObjectUnref(cfg);
     return 0;
@@ -588,6 +591,13 @@ qemuStateInitialize(bool privileged,
         return -1;
     }
 
+    if (virMutexInit(&qemu_driver->startTimesLock) < 0) {
+        VIR_ERROR(_("cannot initialize mutex"));
+        virMutexDestroy(&qemu_driver->lock);
+        VIR_FREE(qemu_driver);
+        return -1;
+    }
+
     qemu_driver->inhibitCallback = callback;
     qemu_driver->inhibitOpaque = opaque;
 
@@ -698,6 +708,9 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->hostdevMgr = virHostdevManagerGetDefault()))
         goto error;
 
+    if (privileged)
+        qemuPrepareHostdevPool(qemu_driver);
+
     if (!(qemu_driver->sharedDevices = virHashCreate(30, qemuSharedDeviceEntryFree)))
         goto error;
 
@@ -832,6 +845,9 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    if (qemuNumaRebalanceInit(qemu_driver) < 0)
+        goto error;
+
     virObjectUnref(conn);
 
     virNWFilterRegisterCallbackDriver(&qemuCallbackDriver);
@@ -889,7 +905,8 @@ qemuStateReload(void)
     if (!qemu_driver)
         return 0;
 
-    if (!(caps = virQEMUDriverGetCapabilities(qemu_driver, false)))
+    /* Pick up emulators installed since the driver started */
+    if (!(caps = virQEMUDriverGetCapabilities(qemu_driver, true)))
         goto cleanup;
 
     cfg = virQEMUDriverGetConfig(qemu_driver);
@@ -977,10 +994,13 @@ qemuStateCleanup(void)
         return -1;
 
     virNWFilterUnRegisterCallbackDriver(&qemuCallbackDriver);
+    qemuNumaRebalanceShutdown(qemu_driver);
     virObjectUnref(qemu_driver->config);
     virObjectUnref(qemu_driver->hostdevMgr);
     virHashFree(qemu_driver->sharedDevices);
     virObjectUnref(qemu_driver->caps);
+    VIR_FREE(qemu_driver->capsXML);
+    VIR_FREE(qemu_driver->startTimes);
     virQEMUCapsCacheFree(qemu_driver->qemuCapsCache);
 
     virObjectUnref(qemu_driver->domains);
@@ -1005,6 +1025,7 @@ qemuStateCleanup(void)
 
     virLockManagerPluginUnref(qemu_driver->lockManager);
 
+    virMutexDestroy(&qemu_driver->startTimesLock);
     virMutexDestroy(&qemu_driver->lock);
     virThreadPoolFree(qemu_driver->workerPool);
     VIR_FREE(qemu_driver);
@@ -1233,98 +1254,11 @@ qemuConnectGetMaxVcpus(virConnectPtr conn ATTRIBUTE_UNUSED, const char *type)
 
 static char *qemuConnectGetCapabilities(virConnectPtr conn) {
     virQEMUDriverPtr driver = conn->privateData;
-    virCapsPtr caps = NULL;
-    char *xml = NULL;
 
     if (virConnectGetCapabilitiesEnsureACL(conn) < 0)
         return NULL;
 
-    if (!(caps = virQEMUDriverGetCapabilities(driver, true)))
-        goto cleanup;
-
-    if ((xml = virCapabilitiesFormatXML(caps)) == NULL)
-        virReportOOMError();
-    virObjectUnref(caps);
-
- cleanup:
-
-    return xml;
-}
-
-
-static int
-qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
-                   pid_t pid, int tid)
-{
-    char *proc;
-    FILE *pidinfo;
-    unsigned long long usertime, systime;
-    long rss;
-    int cpu;
-    int ret;
-
-    /* In general, we cannot assume pid_t fits in int; but /proc parsing
-     * is specific to Linux where int works fine.  */
-    if (tid)
-        ret = virAsprintf(&proc, "/proc/%d/task/%d/stat", (int) pid, tid);
-    else
-        ret = virAsprintf(&proc, "/proc/%d/stat", (int) pid);
-    if (ret < 0)
-        return -1;
-
-    if (!(pidinfo = fopen(proc, "r"))) {
-        /* VM probably shut down, so fake 0 */
-        if (cpuTime)
-            *cpuTime = 0;
-        if (lastCpu)
-            *lastCpu = 0;
-        if (vm_rss)
-            *vm_rss = 0;
-        VIR_FREE(proc);
-        return 0;
-    }
-    VIR_FREE(proc);
-
-    /* See 'man proc' for information about what all these fields are. We're
-     * only interested in a very few of them */
-    if (fscanf(pidinfo,
-               /* pid -> stime */
-               "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
-               /* cutime -> endcode */
-               "%*d %*d %*d %*d %*d %*d %*u %*u %ld %*u %*u %*u"
-               /* startstack -> processor */
-               "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
-               &usertime, &systime, &rss, &cpu) != 4) {
-        VIR_FORCE_FCLOSE(pidinfo);
-        VIR_WARN("cannot parse process status data");
-        errno = -EINVAL;
-        return -1;
-    }
-
-    /* We got jiffies
-     * We want nanoseconds
-     * _SC_CLK_TCK is jiffies per second
-     * So calulate thus....
-     */
-    if (cpuTime)
-        *cpuTime = 1000ull * 1000ull * 1000ull * (usertime + systime) / (unsigned long long)sysconf(_SC_CLK_TCK);
-    if (lastCpu)
-        *lastCpu = cpu;
-
-    /* We got pages
-     * We want kiloBytes
-     * _SC_PAGESIZE is page size in Bytes
-     * So calculate, but first lower the pagesize so we don't get overflow */
-    if (vm_rss)
-        *vm_rss = rss * (sysconf(_SC_PAGESIZE) >> 10);
-
-
-    VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%d rss=%ld",
-              (int) pid, tid, usertime, systime, cpu, rss);
-
-    VIR_FORCE_FCLOSE(pidinfo);
-
-    return 0;
+    return virQEMUDriverGetCapabilitiesXML(driver);
 }
 
 
@@ -2485,11 +2419,11 @@ static int qemuDomainGetInfo(virDomainPtr dom,
     if (!virDomainObjIsActive(vm)) {
         info->cpuTime = 0;
     } else {
-        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, vm->pid, 0) < 0) {
-            virReportError(VIR_ERR_OPERATION_FAILED, "%s",
-                           _("cannot read cputime for domain"));
+        virProcessStatInfo stat;
+
+        if (virProcessGetStatInfo(vm->pid, 0, &stat) < 0)
             goto cleanup;
-        }
+        info->cpuTime = stat.cpuTime;
     }
 
     info->maxMem = vm->def->mem.max_balloon;
@@ -4840,6 +4774,7 @@ qemuDomainGetVcpus(virDomainPtr dom,
     int v, maxcpu, hostcpus;
     int ret = -1;
     qemuDomainObjPrivatePtr priv;
+    virProcessStatInfoPtr stats = NULL;
 
     if (!(vm = qemuDomObjFromDomain(dom)))
         goto cleanup;
@@ -4870,19 +4805,24 @@ qemuDomainGetVcpus(virDomainPtr dom,
     if (maxinfo >= 1) {
         if (info != NULL) {
             memset(info, 0, sizeof(*info) * maxinfo);
+
+            if (priv->vcpupids != NULL) {
+                if (VIR_ALLOC_N(stats, maxinfo) < 0)
+                    goto cleanup;
+
+                /* Read all vCPU threads in one sweep */
+                if (virProcessGetTasksStatInfo(vm->pid, priv->vcpupids,
+                                               maxinfo, stats) < 0)
+                    goto cleanup;
+            }
+
             for (i = 0; i < maxinfo; i++) {
                 info[i].number = i;
                 info[i].state = VIR_VCPU_RUNNING;
 
-                if (priv->vcpupids != NULL &&
-                    qemuGetProcessInfo(&(info[i].cpuTime),
-                                       &(info[i].cpu),
-                                       NULL,
-                                       vm->pid,
-                                       priv->vcpupids[i]) < 0) {
-                    virReportSystemError(errno, "%s",
-                                         _("cannot get vCPU placement & pCPU time"));
-                    goto cleanup;
+                if (stats) {
+                    info[i].cpuTime = stats[i].cpuTime;
+                    info[i].cpu = stats[i].lastCpu;
                 }
             }
         }
@@ -4919,6 +4859,7 @@ qemuDomainGetVcpus(virDomainPtr dom,
  cleanup:
     if (vm)
         virObjectUnlock(vm);
+    VIR_FREE(stats);
     return ret;
 }
 
@@ -10143,17 +10084,31 @@ qemuDomainMemoryStats(virDomainPtr dom,
         qemuDomainObjExitMonitor(driver, vm);
 
         if (ret >= 0 && ret < nr_stats) {
-            long rss;
-            if (qemuGetProcessInfo(NULL, NULL, &rss, vm->pid, 0) < 0) {
+            virProcessStatInfo stat;
+            if (virProcessGetStatInfo(vm->pid, 0, &stat) < 0) {
                 virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                                _("cannot get RSS for domain"));
             } else {
                 stats[ret].tag = VIR_DOMAIN_MEMORY_STAT_RSS;
-                stats[ret].val = rss;
+                stats[ret].val = stat.vmRSS;
                 ret++;
             }
 
         }
+
+        /* Only domains sampled by the NUMA rebalancer have these */
+        if (ret >= 0 && priv->numaLocality >= 0) {
+            if (ret < nr_stats) {
+                stats[ret].tag = VIR_DOMAIN_MEMORY_STAT_NUMA_MOVES;
+                stats[ret].val = priv->numaMoves;
+                ret++;
+            }
+            if (ret < nr_stats) {
+                stats[ret].tag = VIR_DOMAIN_MEMORY_STAT_NUMA_LOCALITY;
+                stats[ret].val = priv->numaLocality;
+                ret++;
+            }
+        }
     }
 
     if (!qemuDomainObjEndJob(driver, vm))
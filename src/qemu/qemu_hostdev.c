@@ -307,6 +307,47 @@ qemuPrepareHostDevices(virQEMUDriverPtr driver,
     return 0;
 }
 
+/*
+ * Put the PCI devices listed in hostdev_pool in the pool of devices
+ * kept detached and reset between guests. A device which cannot be
+ * pooled is only warned about, it can still be assigned as usual.
+ */
+void
+qemuPrepareHostdevPool(virQEMUDriverPtr driver)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    const char *stub = "pci-stub";
+    char **addr;
+
+    if (cfg->hostdevPool && qemuHostdevHostSupportsPassthroughVFIO())
+        stub = "vfio-pci";
+
+    for (addr = cfg->hostdevPool; addr && *addr; addr++) {
+        virPCIDeviceAddress bdf;
+        virPCIDevicePtr pci = NULL;
+
+        if (virPCIDeviceAddressParse(*addr, &bdf) < 0) {
+            VIR_WARN("Ignoring malformed PCI address '%s' in hostdev_pool",
+                     *addr);
+            continue;
+        }
+
+        if (!(pci = virPCIDeviceNew(bdf.domain, bdf.bus,
+                                    bdf.slot, bdf.function)) ||
+            virPCIDeviceSetStubDriver(pci, stub) < 0 ||
+            virHostdevPCIPoolAdd(driver->hostdevMgr, pci) < 0) {
+            virErrorPtr err = virGetLastError();
+            VIR_WARN("Unable to pool PCI device %s: %s", *addr,
+                     err ? err->message : _("unknown error"));
+            virResetError(err);
+        }
+
+        virPCIDeviceFree(pci);
+    }
+
+    virObjectUnref(cfg);
+}
+
 void
 qemuDomainReAttachHostdevDevices(virQEMUDriverPtr driver,
                                  const char *name,
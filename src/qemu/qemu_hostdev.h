@@ -56,6 +56,7 @@ int qemuPrepareHostDevices(virQEMUDriverPtr driver,
                            virDomainDefPtr def,
                            virQEMUCapsPtr qemuCaps,
                            unsigned int flags);
+void qemuPrepareHostdevPool(virQEMUDriverPtr driver);
 void
 qemuDomainReAttachHostUSBDevices(virQEMUDriverPtr driver,
                                  const char *name,
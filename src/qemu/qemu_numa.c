@@ -0,0 +1,557 @@
+/*
+ * qemu_numa.c: periodic NUMA rebalancing of running guests
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "qemu_numa.h"
+#include "qemu_domain.h"
+#include "nodeinfo.h"
+#include "domain_event.h"
+#include "vircgroup.h"
+#include "virnuma.h"
+#include "viratomic.h"
+#include "virevent.h"
+#include "virthreadpool.h"
+#include "virtime.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virlog.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_numa");
+
+/* A guest which has been moved is left alone for this many intervals */
+#define QEMU_NUMA_REBALANCE_COOLDOWN 10
+
+typedef struct _qemuNumaRebalanceList qemuNumaRebalanceList;
+typedef qemuNumaRebalanceList *qemuNumaRebalanceListPtr;
+struct _qemuNumaRebalanceList {
+    virDomainObjPtr *vms;
+    size_t nvms;
+};
+
+
+static bool
+qemuNumaRebalanceMoveCpus(virDomainDefPtr def)
+{
+    return def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO;
+}
+
+
+static bool
+qemuNumaRebalanceMoveMems(virDomainDefPtr def)
+{
+    return def->numatune.memory.placement_mode ==
+        VIR_NUMA_TUNE_MEM_PLACEMENT_MODE_AUTO &&
+        def->numatune.memory.mode == VIR_DOMAIN_NUMATUNE_MEM_STRICT;
+}
+
+
+/*
+ * Only guests whose nodes were picked by automatic placement are ever
+ * moved; a nodeset, <vcpupin> or <emulatorpin> given by the user is
+ * always honoured.
+ */
+static bool
+qemuNumaRebalanceEligible(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (!virDomainObjIsActive(vm) || !priv->placementNodeset ||
+        !priv->cgroup ||
+        !virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET))
+        return false;
+
+    if (vm->def->cputune.nvcpupin || vm->def->cputune.emulatorpin)
+        return false;
+
+    return qemuNumaRebalanceMoveCpus(vm->def) ||
+        qemuNumaRebalanceMoveMems(vm->def);
+}
+
+
+static bool
+qemuNumaNodeIsSet(virBitmapPtr nodeset, int node)
+{
+    bool result = false;
+
+    if (node < 0 || virBitmapGetBit(nodeset, node, &result) < 0)
+        return false;
+    return result;
+}
+
+
+static virBitmapPtr
+qemuNumaBitmapUnion(virBitmapPtr a, virBitmapPtr b)
+{
+    virBitmapPtr ret;
+    ssize_t pos = -1;
+
+    if (!(ret = virBitmapNew(MAX(virBitmapSize(a), virBitmapSize(b)))))
+        return NULL;
+
+    while ((pos = virBitmapNextSetBit(a, pos)) >= 0)
+        ignore_value(virBitmapSetBit(ret, pos));
+    pos = -1;
+    while ((pos = virBitmapNextSetBit(b, pos)) >= 0)
+        ignore_value(virBitmapSetBit(ret, pos));
+
+    return ret;
+}
+
+
+/*
+ * Add (or take away) @vcpus spread over @nodeset to the pinned count
+ * of @nodes, the same way virNumaPlacementReserve accounts them.
+ */
+static void
+qemuNumaRebalanceAccount(virNumaNodeLoadPtr nodes,
+                         size_t nnodes,
+                         virBitmapPtr nodeset,
+                         unsigned int vcpus,
+                         bool add)
+{
+    size_t count = virBitmapCountBits(nodeset);
+    size_t i;
+    size_t idx = 0;
+    ssize_t node = -1;
+
+    if (count == 0)
+        return;
+
+    while ((node = virBitmapNextSetBit(nodeset, node)) >= 0) {
+        unsigned int share = vcpus / count + (idx++ < vcpus % count);
+
+        for (i = 0; i < nnodes; i++) {
+            if (nodes[i].node != node)
+                continue;
+            if (add)
+                nodes[i].pinned += share;
+            else
+                nodes[i].pinned -= MIN(nodes[i].pinned, share);
+        }
+    }
+}
+
+
+static int
+qemuNumaRebalanceSetCpuset(virCgroupPtr cgroup,
+                           const char *cpus,
+                           const char *mems)
+{
+    if (mems &&
+        (virCgroupSetCpusetMemoryMigrate(cgroup, true) < 0 ||
+         virCgroupSetCpusetMems(cgroup, mems) < 0))
+        return -1;
+
+    if (cpus && virCgroupSetCpusetCpus(cgroup, cpus) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/*
+ * Move the vCPU and emulator threads of @vm and, with memory_migrate
+ * set, the pages it already touched onto @nodeset. The domain cgroup
+ * is widened to cover both the old and the new nodes first, since a
+ * child may never be given more than its parent allows, and narrowed
+ * once every child has been moved.
+ */
+static int
+qemuNumaRebalanceMove(virDomainObjPtr vm,
+                      virCapsPtr caps,
+                      virBitmapPtr nodeset)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virCgroupPtr cgroup_temp = NULL;
+    virBitmapPtr oldCpus = NULL;
+    virBitmapPtr newCpus = NULL;
+    virBitmapPtr wide = NULL;
+    char *cpus = NULL;
+    char *mems = NULL;
+    char *wideCpus = NULL;
+    char *wideMems = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (qemuNumaRebalanceMoveCpus(vm->def)) {
+        if (!(oldCpus = virCapabilitiesGetCpusForNodemask(caps,
+                                                          priv->placementNodeset)) ||
+            !(newCpus = virCapabilitiesGetCpusForNodemask(caps, nodeset)) ||
+            !(wide = qemuNumaBitmapUnion(oldCpus, newCpus)))
+            goto cleanup;
+
+        if (!(cpus = virBitmapFormat(newCpus)) ||
+            !(wideCpus = virBitmapFormat(wide))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("failed to convert cpu mask"));
+            goto cleanup;
+        }
+        virBitmapFree(wide);
+        wide = NULL;
+    }
+
+    if (qemuNumaRebalanceMoveMems(vm->def)) {
+        if (!(wide = qemuNumaBitmapUnion(priv->placementNodeset, nodeset)))
+            goto cleanup;
+
+        if (!(mems = virBitmapFormat(nodeset)) ||
+            !(wideMems = virBitmapFormat(wide))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("failed to convert memory nodemask"));
+            goto cleanup;
+        }
+    }
+
+    if (qemuNumaRebalanceSetCpuset(priv->cgroup, wideCpus, wideMems) < 0)
+        goto cleanup;
+
+    for (i = 0; i < priv->nvcpupids; i++) {
+        if (virCgroupNewVcpu(priv->cgroup, i, false, &cgroup_temp) < 0 ||
+            qemuNumaRebalanceSetCpuset(cgroup_temp, cpus, mems) < 0)
+            goto cleanup;
+        virCgroupFree(&cgroup_temp);
+    }
+
+    if (virCgroupNewEmulator(priv->cgroup, false, &cgroup_temp) < 0 ||
+        qemuNumaRebalanceSetCpuset(cgroup_temp, cpus, mems) < 0 ||
+        qemuNumaRebalanceSetCpuset(priv->cgroup, cpus, mems) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virCgroupFree(&cgroup_temp);
+    virBitmapFree(oldCpus);
+    virBitmapFree(newCpus);
+    virBitmapFree(wide);
+    VIR_FREE(cpus);
+    VIR_FREE(mems);
+    VIR_FREE(wideCpus);
+    VIR_FREE(wideMems);
+    return ret;
+}
+
+
+/*
+ * Check whether @vm is badly placed and, if a better nodeset exists,
+ * move it there. @nodes is the host load sampled at the start of the
+ * pass and is updated to reflect a move.
+ *
+ * Returns 1 if the guest was moved, 0 if it was left alone, -1 on error.
+ */
+static int
+qemuNumaRebalanceDomain(virQEMUDriverPtr driver,
+                        virQEMUDriverConfigPtr cfg,
+                        virCapsPtr caps,
+                        virDomainObjPtr vm,
+                        virNumaNodeLoadPtr nodes,
+                        size_t nnodes)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virNumaNodeLoadPtr candidates = NULL;
+    virNumaPlacementPolicy policy = cfg->numaPlacementPolicy;
+    virBitmapPtr nodeset = NULL;
+    virObjectEventPtr event = NULL;
+    unsigned long long *memory = NULL;
+    size_t nmemory = 0;
+    unsigned long long now;
+    unsigned long long total = 0;
+    unsigned long long local = 0;
+    unsigned long long load = 0;
+    unsigned long long ncpus = 0;
+    char *oldstr = NULL;
+    char *newstr = NULL;
+    size_t i;
+    int ret = -1;
+
+    virObjectLock(vm);
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (!qemuNumaRebalanceEligible(vm)) {
+        ret = 0;
+        goto endjob;
+    }
+
+    if (virTimeMillisNow(&now) < 0)
+        goto endjob;
+
+    if (priv->numaLastMove &&
+        now - priv->numaLastMove <
+        1000ull * cfg->numaRebalanceInterval * QEMU_NUMA_REBALANCE_COOLDOWN) {
+        ret = 0;
+        goto endjob;
+    }
+
+    if (virNumaGetProcessMemory(vm->pid, &memory, &nmemory) < 0)
+        goto endjob;
+
+    for (i = 0; i < nmemory; i++) {
+        total += memory[i];
+        if (qemuNumaNodeIsSet(priv->placementNodeset, i))
+            local += memory[i];
+    }
+    priv->numaLocality = total ? local * 100 / total : 100;
+
+    for (i = 0; i < nnodes; i++) {
+        if (qemuNumaNodeIsSet(priv->placementNodeset, nodes[i].node)) {
+            load += nodes[i].load;
+            ncpus += nodes[i].ncpus;
+        }
+    }
+
+    /* @load is in percent of a single CPU */
+    if (priv->numaLocality >= (int) cfg->numaRebalanceThreshold &&
+        load <= ncpus * cfg->numaRebalanceThreshold) {
+        ret = 0;
+        goto endjob;
+    }
+
+    /* Do not make the guest compete with itself for the nodes it is
+     * already using */
+    if (VIR_ALLOC_N(candidates, nnodes) < 0)
+        goto endjob;
+    memcpy(candidates, nodes, sizeof(*nodes) * nnodes);
+    qemuNumaRebalanceAccount(candidates, nnodes, priv->placementNodeset,
+                             priv->placementVcpus, false);
+    for (i = 0; i < nnodes; i++) {
+        if (candidates[i].node >= 0 && (size_t) candidates[i].node < nmemory)
+            candidates[i].memFree += memory[candidates[i].node];
+    }
+
+    /* numad only gives advice for new guests */
+    if (policy == VIR_NUMA_PLACEMENT_POLICY_NUMAD)
+        policy = VIR_NUMA_PLACEMENT_POLICY_MEMORY_FIRST;
+
+    if (virNumaPlacementChoose(candidates, nnodes, policy, vm->def->vcpus,
+                               vm->def->mem.max_balloon, &nodeset) < 0)
+        goto endjob;
+
+    if (virBitmapEqual(nodeset, priv->placementNodeset)) {
+        ret = 0;
+        goto endjob;
+    }
+
+    if (!(oldstr = virBitmapFormat(priv->placementNodeset)) ||
+        !(newstr = virBitmapFormat(nodeset))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("failed to format nodeset"));
+        goto endjob;
+    }
+
+    if (qemuNumaRebalanceMove(vm, caps, nodeset) < 0)
+        goto endjob;
+
+    VIR_INFO("Moved domain %s from NUMA nodes %s to %s (locality %d%%, "
+             "load %llu%% of %llu CPUs)",
+             vm->def->name, oldstr, newstr, priv->numaLocality,
+             load, ncpus);
+
+    qemuNumaRebalanceAccount(nodes, nnodes, priv->placementNodeset,
+                             priv->placementVcpus, false);
+    virNumaPlacementRelease(priv->placementNodeset, priv->placementVcpus);
+    virBitmapFree(priv->placementNodeset);
+    priv->placementNodeset = nodeset;
+    nodeset = NULL;
+    priv->placementVcpus = 0;
+    if (virNumaPlacementReserve(priv->placementNodeset, vm->def->vcpus) == 0)
+        priv->placementVcpus = vm->def->vcpus;
+    qemuNumaRebalanceAccount(nodes, nnodes, priv->placementNodeset,
+                             priv->placementVcpus, true);
+
+    priv->numaMoves++;
+    priv->numaLastMove = now;
+    event = virDomainEventNumaChangeNewFromObj(vm, oldstr, newstr);
+    ret = 1;
+
+ endjob:
+    if (!qemuDomainObjEndJob(driver, vm))
+        vm = NULL;
+
+ cleanup:
+    if (vm)
+        virObjectUnlock(vm);
+    if (event)
+        qemuDomainEventQueue(driver, event);
+    virBitmapFree(nodeset);
+    VIR_FREE(candidates);
+    VIR_FREE(memory);
+    VIR_FREE(oldstr);
+    VIR_FREE(newstr);
+    return ret;
+}
+
+
+static int
+qemuNumaRebalanceCollect(virDomainObjPtr vm,
+                         void *opaque)
+{
+    qemuNumaRebalanceListPtr list = opaque;
+    int ret = 0;
+
+    virObjectLock(vm);
+    if (qemuNumaRebalanceEligible(vm)) {
+        if (VIR_APPEND_ELEMENT_COPY(list->vms, list->nvms, vm) < 0)
+            ret = -1;
+        else
+            virObjectRef(vm);
+    }
+    virObjectUnlock(vm);
+
+    return ret;
+}
+
+
+static void
+qemuNumaRebalanceWorker(void *data ATTRIBUTE_UNUSED,
+                        void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virCapsPtr caps = NULL;
+    qemuNumaRebalanceList list = { NULL, 0 };
+    virNumaNodeLoadPtr nodes = NULL;
+    size_t nnodes = 0;
+    unsigned int moves = 0;
+    unsigned int failures = 0;
+    size_t i;
+
+    if (virDomainObjListForEach(driver->domains,
+                                qemuNumaRebalanceCollect, &list) < 0) {
+        failures++;
+        goto cleanup;
+    }
+
+    if (list.nvms == 0)
+        goto cleanup;
+
+    if (nodeGetNUMALoad(&nodes, &nnodes) < 0 ||
+        !(caps = virQEMUDriverGetCapabilities(driver, false))) {
+        failures++;
+        goto cleanup;
+    }
+
+    for (i = 0; i < list.nvms && moves < cfg->numaRebalanceMaxMoves; i++) {
+        int rc = qemuNumaRebalanceDomain(driver, cfg, caps, list.vms[i],
+                                         nodes, nnodes);
+        if (rc < 0)
+            failures++;
+        else if (rc > 0)
+            moves++;
+    }
+
+ cleanup:
+    VIR_DEBUG("NUMA rebalance pass checked %zu domains: %u moved, %u failed",
+              list.nvms, moves, failures);
+
+    for (i = 0; i < list.nvms; i++)
+        virObjectUnref(list.vms[i]);
+    VIR_FREE(list.vms);
+    VIR_FREE(nodes);
+    virObjectUnref(caps);
+    virObjectUnref(cfg);
+
+    virAtomicIntSet(&driver->numaRebalancePending, 0);
+}
+
+
+static void
+qemuNumaRebalanceTimer(int timer ATTRIBUTE_UNUSED,
+                       void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+
+    /* A pass still running from the previous tick makes us skip this one */
+    if (!virAtomicIntCompareExchange(&driver->numaRebalancePending, 0, 1))
+        return;
+
+    if (virThreadPoolSendJob(driver->numaRebalancePool, 0, NULL) < 0) {
+        VIR_WARN("Unable to schedule NUMA rebalance pass");
+        virAtomicIntSet(&driver->numaRebalancePending, 0);
+    }
+}
+
+
+/**
+ * qemuNumaRebalanceInit:
+ * @driver: the QEMU driver
+ *
+ * Start periodically moving guests with automatic NUMA placement to
+ * better nodes, if numa_rebalance_interval is set in qemu.conf. Passes
+ * run in a dedicated worker thread so that they never hold up the
+ * event loop or the driver's own worker pool.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuNumaRebalanceInit(virQEMUDriverPtr driver)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    int timer;
+    int ret = -1;
+
+    if (cfg->numaRebalanceInterval == 0 || !virNumaIsAvailable()) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(driver->numaRebalancePool = virThreadPoolNew(0, 1, 0,
+                                                       qemuNumaRebalanceWorker,
+                                                       driver)))
+        goto cleanup;
+
+    if ((timer = virEventAddTimeout(cfg->numaRebalanceInterval * 1000,
+                                    qemuNumaRebalanceTimer,
+                                    driver, NULL)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to register NUMA rebalance timer"));
+        goto cleanup;
+    }
+    driver->numaRebalanceTimer = timer;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/**
+ * qemuNumaRebalanceShutdown:
+ * @driver: the QEMU driver
+ *
+ * Stop the rebalancer, waiting for a pass in progress to finish.
+ */
+void
+qemuNumaRebalanceShutdown(virQEMUDriverPtr driver)
+{
+    if (driver->numaRebalanceTimer > 0) {
+        virEventRemoveTimeout(driver->numaRebalanceTimer);
+        driver->numaRebalanceTimer = 0;
+    }
+
+    virThreadPoolFree(driver->numaRebalancePool);
+    driver->numaRebalancePool = NULL;
+}
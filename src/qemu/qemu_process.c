@@ -1469,12 +1469,16 @@ qemuConnectMonitor(virQEMUDriverPtr driver, virDomainObjPtr vm, int logfd)
     }
 
 
+    /* The domain is unlocked while in the monitor, so the start times
+     * are marked outside of it */
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_MONITOR);
     qemuDomainObjEnterMonitor(driver, vm);
     ret = qemuMonitorSetCapabilities(priv->mon);
     if (ret == 0 &&
         virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MONITOR_JSON))
         ret = virQEMUCapsProbeQMP(priv->qemuCaps, priv->mon);
     qemuDomainObjExitMonitor(driver, vm);
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_QMP_CAPABILITIES);
 
  error:
 
@@ -3128,6 +3132,90 @@ qemuProcessUpdateDevices(virQEMUDriverPtr driver,
     return ret;
 }
 
+/*
+ * Account the vCPUs of @vm on the NUMA nodes it is confined to, either
+ * by automatic placement (@nodemask) or by a static <numatune>, so that
+ * automatic placement of later guests takes them into account.
+ */
+static int
+qemuProcessReserveNUMAPlacement(virDomainObjPtr vm,
+                                virBitmapPtr nodemask)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    if (!nodemask &&
+        vm->def->numatune.memory.placement_mode ==
+        VIR_NUMA_TUNE_MEM_PLACEMENT_MODE_STATIC)
+        nodemask = vm->def->numatune.memory.nodemask;
+
+    if (!nodemask)
+        return 0;
+
+    if (!(priv->placementNodeset = virBitmapNewCopy(nodemask)))
+        return -1;
+
+    if (virNumaPlacementReserve(priv->placementNodeset, vm->def->vcpus) < 0) {
+        virBitmapFree(priv->placementNodeset);
+        priv->placementNodeset = NULL;
+        return -1;
+    }
+    priv->placementVcpus = vm->def->vcpus;
+
+    return 0;
+}
+
+
+static void
+qemuProcessReleaseNUMAPlacement(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    virNumaPlacementRelease(priv->placementNodeset, priv->placementVcpus);
+    virBitmapFree(priv->placementNodeset);
+    priv->placementNodeset = NULL;
+    priv->placementVcpus = 0;
+    priv->numaMoves = 0;
+    priv->numaLastMove = 0;
+    priv->numaLocality = -1;
+}
+
+
+/*
+ * The nodeset chosen by automatic placement is not part of the status
+ * XML, so recover it from the cpuset controller of a running domain.
+ */
+static int
+qemuProcessReconnectNUMAPlacement(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virBitmapPtr nodemask = NULL;
+    char *mems = NULL;
+    int ret = -1;
+
+    if (vm->def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO ||
+        vm->def->numatune.memory.placement_mode ==
+        VIR_NUMA_TUNE_MEM_PLACEMENT_MODE_AUTO) {
+        if (!priv->cgroup ||
+            !virCgroupHasController(priv->cgroup,
+                                    VIR_CGROUP_CONTROLLER_CPUSET) ||
+            virCgroupGetCpusetMems(priv->cgroup, &mems) < 0) {
+            virResetLastError();
+            return 0;
+        }
+
+        if (virBitmapParse(mems, 0, &nodemask, VIR_DOMAIN_CPUMASK_LEN) < 0)
+            goto cleanup;
+    }
+
+    ret = qemuProcessReserveNUMAPlacement(vm, nodemask);
+
+ cleanup:
+    virBitmapFree(nodemask);
+    VIR_FREE(mems);
+    return ret;
+}
+
+
 struct qemuProcessReconnectData {
     virConnectPtr conn;
     virQEMUDriverPtr driver;
@@ -3203,6 +3291,9 @@ qemuProcessReconnect(void *opaque)
     if (qemuConnectCgroup(driver, obj) < 0)
         goto error;
 
+    if (qemuProcessReconnectNUMAPlacement(obj) < 0)
+        goto error;
+
     /* XXX: Need to change as long as lock is introduced for
      * qemu_driver->sharedDevices.
      */
@@ -3623,12 +3714,12 @@ int qemuProcessStart(virConnectPtr conn,
     struct qemuProcessHookData hookData;
     unsigned long cur_balloon;
     size_t i;
-    char *nodeset = NULL;
     virBitmapPtr nodemask = NULL;
     unsigned int stop_flags;
     virQEMUDriverConfigPtr cfg;
     virCapsPtr caps = NULL;
     unsigned int hostdev_flags = 0;
+    virSecurityManagerLabelStats labelStats;
 
     VIR_DEBUG("vm=%p name=%s id=%d pid=%llu",
               vm, vm->def->name, vm->def->id,
@@ -3667,6 +3758,8 @@ int qemuProcessStart(virConnectPtr conn,
         return -1;
     }
 
+    qemuDomainStartTimesBegin(vm);
+
     if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         goto cleanup;
 
@@ -3712,20 +3805,28 @@ int qemuProcessStart(virConnectPtr conn,
      * setting up a network device might create a new hostdev that
      * will need to be setup.
      */
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_PREPARE);
+
     VIR_DEBUG("Preparing network devices");
     if (qemuNetworkPrepareDevices(vm->def) < 0)
        goto cleanup;
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_NETWORK);
+
     /* Must be run before security labelling */
     VIR_DEBUG("Preparing host devices");
     if (!cfg->relaxedACS)
         hostdev_flags |= VIR_HOSTDEV_STRICT_ACS_CHECK;
+    if (cfg->hostdevParallelReset)
+        hostdev_flags |= VIR_HOSTDEV_PARALLEL_RESET;
     if (!migrateFrom)
         hostdev_flags |= VIR_HOSTDEV_COLD_BOOT;
     if (qemuPrepareHostDevices(driver, vm->def, priv->qemuCaps,
                                hostdev_flags) < 0)
         goto cleanup;
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_HOSTDEV);
+
     VIR_DEBUG("Preparing chr devices");
     if (virDomainChrDefForeach(vm->def,
                                true,
@@ -3816,26 +3917,24 @@ int qemuProcessStart(virConnectPtr conn,
         goto cleanup;
 
 
-    /* Get the advisory nodeset from numad if 'placement' of
+    /* Get the advisory nodeset if 'placement' of
      * either <vcpu> or <numatune> is 'auto'.
      */
     if ((vm->def->placement_mode ==
          VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO) ||
         (vm->def->numatune.memory.placement_mode ==
          VIR_NUMA_TUNE_MEM_PLACEMENT_MODE_AUTO)) {
-        nodeset = virNumaGetAutoPlacementAdvice(vm->def->vcpus,
-                                                vm->def->mem.max_balloon);
-        if (!nodeset)
-            goto cleanup;
-
-        VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
-
-        if (virBitmapParse(nodeset, 0, &nodemask,
-                           VIR_DOMAIN_CPUMASK_LEN) < 0)
+        if (nodeGetNUMAPlacement(cfg->numaPlacementPolicy,
+                                 vm->def->vcpus,
+                                 vm->def->mem.max_balloon,
+                                 &nodemask) < 0)
             goto cleanup;
     }
     hookData.nodemask = nodemask;
 
+    if (qemuProcessReserveNUMAPlacement(vm, nodemask) < 0)
+        goto cleanup;
+
     /* "volume" type disk's source must be translated before
      * cgroup and security setting.
      */
@@ -3884,6 +3983,8 @@ int qemuProcessStart(virConnectPtr conn,
             goto cleanup;
     }
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_PREPARE);
+
     VIR_DEBUG("Building emulator command line");
     if (!(cmd = qemuBuildCommandLine(conn, driver, vm->def, priv->monConfig,
                                      priv->monJSON, priv->qemuCaps,
@@ -3891,6 +3992,8 @@ int qemuProcessStart(virConnectPtr conn,
                                      &buildCommandLineCallbacks, false)))
         goto cleanup;
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_COMMAND_LINE);
+
     /* now that we know it is about to start call the hook if present */
     if (virHookPresent(VIR_HOOK_DRIVER_QEMU)) {
         char *xml = qemuDomainDefFormatXML(driver, vm->def, 0);
@@ -4003,6 +4106,8 @@ int qemuProcessStart(virConnectPtr conn,
         goto cleanup;
     }
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_EXEC);
+
     VIR_DEBUG("Setting up domain cgroup (if required)");
     if (qemuSetupCgroup(driver, vm, nodemask) < 0)
         goto cleanup;
@@ -4013,11 +4118,19 @@ int qemuProcessStart(virConnectPtr conn,
         qemuProcessInitCpuAffinity(driver, vm, nodemask) < 0)
         goto cleanup;
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_CGROUP);
+
     VIR_DEBUG("Setting domain security labels");
     if (virSecurityManagerSetAllLabel(driver->securityManager,
                                       vm->def, stdin_path) < 0)
         goto cleanup;
 
+    virSecurityManagerGetLabelStats(driver->securityManager, &labelStats);
+    VIR_DEBUG("Labeled %llu files so far, skipped %llu relabels and "
+              "%llu restores of files shared between guests",
+              labelStats.relabeled, labelStats.relabelSkipped,
+              labelStats.restoreSkipped);
+
     /* Security manager labeled all devices, therefore
      * if any operation from now on fails and we goto cleanup,
      * where virSecurityManagerRestoreAllLabel() is called
@@ -4042,6 +4155,8 @@ int qemuProcessStart(virConnectPtr conn,
             goto cleanup;
     }
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_LABEL);
+
     VIR_DEBUG("Labelling done, completing handshake to child");
     if (virCommandHandshakeNotify(cmd) < 0) {
         goto cleanup;
@@ -4061,6 +4176,8 @@ int qemuProcessStart(virConnectPtr conn,
     if (qemuProcessWaitForMonitor(driver, vm, priv->qemuCaps, pos) < 0)
         goto cleanup;
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_MONITOR);
+
     /* Failure to connect to agent shouldn't be fatal */
     if ((ret = qemuConnectAgent(driver, vm)) < 0) {
         if (ret == -2)
@@ -4191,6 +4308,9 @@ int qemuProcessStart(virConnectPtr conn,
     /* unset reporting errors from qemu log */
     qemuMonitorSetDomainLog(priv->mon, -1);
 
+    qemuDomainStartTimesMark(vm, QEMU_DOMAIN_START_PHASE_SETUP);
+    qemuDomainStartTimesEnd(driver, vm, true);
+
     virCommandFree(cmd);
     VIR_FORCE_CLOSE(logfile);
     virObjectUnref(cfg);
@@ -4202,12 +4322,12 @@ int qemuProcessStart(virConnectPtr conn,
     /* We jump here if we failed to start the VM for any reason, or
      * if we failed to initialize the now running VM. kill it off and
      * pretend we never started it */
-    VIR_FREE(nodeset);
     virBitmapFree(nodemask);
     virCommandFree(cmd);
     VIR_FORCE_CLOSE(logfile);
     if (priv->mon)
         qemuMonitorSetDomainLog(priv->mon, -1);
+    qemuDomainStartTimesEnd(driver, vm, false);
     qemuProcessStop(driver, vm, VIR_DOMAIN_SHUTOFF_FAILED, stop_flags);
     virObjectUnref(cfg);
     virObjectUnref(caps);
@@ -4451,6 +4571,8 @@ void qemuProcessStop(virQEMUDriverPtr driver,
     }
     virCgroupFree(&priv->cgroup);
 
+    qemuProcessReleaseNUMAPlacement(vm);
+
     qemuProcessRemoveDomainStatus(driver, vm);
 
     /* Remove VNC and Spice ports from port reservation bitmap, but only if
@@ -232,6 +232,9 @@ const REMOTE_DOMAIN_MIGRATE_PARAM_LIST_MAX = 64;
 /* Upper limit on number of job stats */
 const REMOTE_DOMAIN_JOB_STATS_MAX = 64;
 
+/* Upper limit on number of start times event parameters */
+const REMOTE_DOMAIN_EVENT_START_TIMES_MAX = 64;
+
 /* Upper limit on number of CPU models */
 const REMOTE_CONNECT_CPU_MODELS_MAX = 8192;
 
@@ -2928,6 +2931,19 @@ struct remote_domain_event_callback_device_removed_msg {
     remote_domain_event_device_removed_msg msg;
 };
 
+struct remote_domain_event_callback_numa_change_msg {
+    int callbackID;
+    remote_nonnull_domain dom;
+    remote_nonnull_string oldNodeset;
+    remote_nonnull_string newNodeset;
+};
+
+struct remote_domain_event_callback_start_times_msg {
+    int callbackID;
+    remote_nonnull_domain dom;
+    remote_typed_param params<REMOTE_DOMAIN_EVENT_START_TIMES_MAX>;
+};
+
 struct remote_connect_get_cpu_model_names_args {
     remote_nonnull_string arch;
     int need_results;
@@ -5275,5 +5291,17 @@ enum remote_procedure {
      * @generate: both
      * @acl: domain:core_dump
      */
-    REMOTE_PROC_DOMAIN_CORE_DUMP_WITH_FORMAT = 334
+    REMOTE_PROC_DOMAIN_CORE_DUMP_WITH_FORMAT = 334,
+
+    /**
+     * @generate: both
+     * @acl: none
+     */
+    REMOTE_PROC_DOMAIN_EVENT_CALLBACK_NUMA_CHANGE = 335,
+
+    /**
+     * @generate: both
+     * @acl: none
+     */
+    REMOTE_PROC_DOMAIN_EVENT_CALLBACK_START_TIMES = 336
 };
@@ -34,6 +34,7 @@
 #include "virstoragefile.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "intprops.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
@@ -335,11 +336,20 @@ virSecurityDACSetSecurityFileLabel(virDomainDiskDefPtr disk ATTRIBUTE_UNUSED,
     virSecurityDACDataPtr priv = virSecurityManagerGetPrivateData(mgr);
     uid_t user;
     gid_t group;
+    char label[INT_BUFSIZE_BOUND(long) * 2];
 
     if (virSecurityDACGetImageIds(def, priv, &user, &group))
         return -1;
 
-    return virSecurityDACSetOwnership(path, user, group);
+    /* Images shared with other guests are owned by them already */
+    snprintf(label, sizeof(label), "%ld:%ld", (long) user, (long) group);
+    if (virSecurityManagerLabelCacheHit(mgr, def, path, label))
+        return 0;
+
+    if (virSecurityDACSetOwnership(path, user, group) < 0)
+        return -1;
+
+    return virSecurityManagerLabelCacheAdd(mgr, def, path, label);
 }
 
 
@@ -369,7 +379,7 @@ virSecurityDACSetSecurityImageLabel(virSecurityManagerPtr mgr,
 
 static int
 virSecurityDACRestoreSecurityImageLabelInt(virSecurityManagerPtr mgr,
-                                           virDomainDefPtr def ATTRIBUTE_UNUSED,
+                                           virDomainDefPtr def,
                                            virDomainDiskDefPtr disk,
                                            int migrated)
 {
@@ -382,6 +392,10 @@ virSecurityDACRestoreSecurityImageLabelInt(virSecurityManagerPtr mgr,
     if (virDomainDiskGetType(disk) == VIR_DOMAIN_DISK_TYPE_NETWORK)
         return 0;
 
+    /* Leave the image to the other guests still using it */
+    if (virSecurityManagerLabelCacheReleaseDisk(mgr, def, disk) == 1)
+        return 0;
+
     /* Don't restore labels on readoly/shared disks, because
      * other VMs may still be accessing these
      * Alternatively we could iterate over all running
@@ -890,6 +904,19 @@ virSecurityDACSetChardevCallback(virDomainDefPtr def ATTRIBUTE_UNUSED,
 }
 
 
+static int
+virSecurityDACSetSecurityDiskLabel(virSecurityManagerPtr mgr,
+                                   virDomainDefPtr def,
+                                   virDomainDiskDefPtr disk)
+{
+    /* XXX fixme - we need to recursively label the entire tree :-( */
+    if (virDomainDiskGetType(disk) == VIR_DOMAIN_DISK_TYPE_DIR)
+        return 1;
+
+    return virSecurityDACSetSecurityImageLabel(mgr, def, disk);
+}
+
+
 static int
 virSecurityDACSetSecurityAllLabel(virSecurityManagerPtr mgr,
                                   virDomainDefPtr def,
@@ -903,15 +930,11 @@ virSecurityDACSetSecurityAllLabel(virSecurityManagerPtr mgr,
     if (!priv->dynamicOwnership)
         return 0;
 
-    for (i = 0; i < def->ndisks; i++) {
-        /* XXX fixme - we need to recursively label the entire tree :-( */
-        if (virDomainDiskGetType(def->disks[i]) == VIR_DOMAIN_DISK_TYPE_DIR)
-            continue;
-        if (virSecurityDACSetSecurityImageLabel(mgr,
-                                                def,
-                                                def->disks[i]) < 0)
-            return -1;
-    }
+    if (virSecurityManagerLabelDisks(mgr, def,
+                                     virSecurityDACSetSecurityDiskLabel,
+                                     virSecurityDACRestoreSecurityImageLabel) < 0)
+        return -1;
+
     for (i = 0; i < def->nhostdevs; i++) {
         if (virSecurityDACSetSecurityHostdevLabel(mgr,
                                                   def,
@@ -22,6 +22,7 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
 
 #include "security_driver.h"
 #include "security_stack.h"
@@ -30,6 +31,10 @@
 #include "viralloc.h"
 #include "virobject.h"
 #include "virlog.h"
+#include "virhash.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "stat-time.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
@@ -44,11 +49,35 @@ struct _virSecurityManager {
     bool requireConfined;
     const char *virtDriver;
     void *privateData;
+
+    /* Files labeled by this manager, see virSecurityManagerLabelCacheHit.
+     * Disks may be labeled concurrently, so this has its own lock */
+    virMutex labelsLock;
+    virHashTablePtr labels;
+    virSecurityManagerLabelStats labelStats;
+
+    /* How many disks of a domain may be labeled concurrently */
+    size_t labelThreads;
+};
+
+typedef struct _virSecurityManagerLabelEntry virSecurityManagerLabelEntry;
+typedef virSecurityManagerLabelEntry *virSecurityManagerLabelEntryPtr;
+struct _virSecurityManagerLabelEntry {
+    char *label;
+    /* UUIDs of the domains needing the label, VIR_UUID_BUFLEN each, so
+     * that labeling a file twice for a domain takes a single reference */
+    unsigned char *users;
+    size_t nusers;
+    /* Change time of the file once labeled, to notice it was
+     * relabeled or replaced behind our back */
+    struct timespec ctime;
 };
 
 static virClassPtr virSecurityManagerClass;
 
 static void virSecurityManagerDispose(void *obj);
+static void virSecurityManagerLabelCacheReleaseDomain(virSecurityManagerPtr mgr,
+                                                      virDomainDefPtr def);
 
 static int virSecurityManagerOnceInit(void)
 {
@@ -63,6 +92,66 @@ static int virSecurityManagerOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virSecurityManager);
 
+static void
+virSecurityManagerLabelEntryFree(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED)
+{
+    virSecurityManagerLabelEntryPtr entry = payload;
+
+    VIR_FREE(entry->label);
+    VIR_FREE(entry->users);
+    VIR_FREE(entry);
+}
+
+
+static ssize_t
+virSecurityManagerLabelEntryFindUser(virSecurityManagerLabelEntryPtr entry,
+                                     const unsigned char *uuid)
+{
+    size_t i;
+
+    for (i = 0; i < entry->nusers; i++) {
+        if (memcmp(entry->users + i * VIR_UUID_BUFLEN, uuid,
+                   VIR_UUID_BUFLEN) == 0)
+            return i;
+    }
+    return -1;
+}
+
+
+static int
+virSecurityManagerLabelEntryAddUser(virSecurityManagerLabelEntryPtr entry,
+                                    const unsigned char *uuid)
+{
+    if (virSecurityManagerLabelEntryFindUser(entry, uuid) >= 0)
+        return 0;
+
+    if (VIR_REALLOC_N(entry->users,
+                      (entry->nusers + 1) * VIR_UUID_BUFLEN) < 0)
+        return -1;
+
+    memcpy(entry->users + entry->nusers++ * VIR_UUID_BUFLEN, uuid,
+           VIR_UUID_BUFLEN);
+    return 0;
+}
+
+
+static void
+virSecurityManagerLabelEntryRemoveUser(virSecurityManagerLabelEntryPtr entry,
+                                       const unsigned char *uuid)
+{
+    ssize_t i;
+
+    if ((i = virSecurityManagerLabelEntryFindUser(entry, uuid)) < 0)
+        return;
+
+    /* Order does not matter, move the last user in place */
+    if (i != --entry->nusers)
+        memcpy(entry->users + i * VIR_UUID_BUFLEN,
+               entry->users + entry->nusers * VIR_UUID_BUFLEN,
+               VIR_UUID_BUFLEN);
+}
+
 static virSecurityManagerPtr virSecurityManagerNewDriver(virSecurityDriverPtr drv,
                                                          const char *virtDriver,
                                                          bool allowDiskFormatProbing,
@@ -89,14 +178,24 @@ static virSecurityManagerPtr virSecurityManagerNewDriver(virSecurityDriverPtr dr
         return NULL;
     }
 
+    if (virMutexInit(&mgr->labelsLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize security manager mutex"));
+        VIR_FREE(privateData);
+        virObjectUnref(mgr);
+        return NULL;
+    }
+
     mgr->drv = drv;
     mgr->allowDiskFormatProbing = allowDiskFormatProbing;
     mgr->defaultConfined = defaultConfined;
     mgr->requireConfined = requireConfined;
     mgr->virtDriver = virtDriver;
     mgr->privateData = privateData;
+    mgr->labelThreads = 1;
 
-    if (drv->open(mgr) < 0) {
+    if (!(mgr->labels = virHashCreate(32, virSecurityManagerLabelEntryFree)) ||
+        drv->open(mgr) < 0) {
         virObjectUnref(mgr);
         return NULL;
     }
@@ -235,9 +334,11 @@ static void virSecurityManagerDispose(void *obj)
 {
     virSecurityManagerPtr mgr = obj;
 
-    if (mgr->drv->close)
+    if (mgr->drv && mgr->drv->close)
         mgr->drv->close(mgr);
     VIR_FREE(mgr->privateData);
+    virHashFree(mgr->labels);
+    virMutexDestroy(&mgr->labelsLock);
 }
 
 const char *
@@ -581,6 +682,9 @@ int virSecurityManagerSetAllLabel(virSecurityManagerPtr mgr,
         int ret;
         virObjectLock(mgr);
         ret = mgr->drv->domainSetSecurityAllLabel(mgr, vm, stdin_path);
+        /* Labels of a domain failing to start are not restored */
+        if (ret < 0)
+            virSecurityManagerLabelCacheReleaseDomain(mgr, vm);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -597,6 +701,7 @@ int virSecurityManagerRestoreAllLabel(virSecurityManagerPtr mgr,
         int ret;
         virObjectLock(mgr);
         ret = mgr->drv->domainRestoreSecurityAllLabel(mgr, vm, migrated);
+        virSecurityManagerLabelCacheReleaseDomain(mgr, vm);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -754,3 +859,513 @@ int virSecurityManagerSetHugepages(virSecurityManagerPtr mgr,
 
     return 0;
 }
+
+
+/*
+ * Label cache
+ *
+ * Many guests often share the same files, typically a read-only base
+ * image on a network filesystem.  Rather than changing the label of
+ * such a file again each time another guest starts, and restoring it
+ * whenever one of them stops, security drivers record here which
+ * label each file got and how many users need it.  Files are tracked
+ * by device and inode, so different paths to the same file match.
+ *
+ * These helpers are called by the security drivers, possibly from
+ * several threads at once when labeling the disks of a domain.
+ */
+
+static char *
+virSecurityManagerLabelKey(const char *path,
+                           struct stat *sb)
+{
+    char *key;
+
+    if (stat(path, sb) < 0)
+        return NULL;
+
+    ignore_value(virAsprintf(&key, "%llu:%llu",
+                             (unsigned long long)sb->st_dev,
+                             (unsigned long long)sb->st_ino));
+    return key;
+}
+
+
+/**
+ * virSecurityManagerLabelCacheHit:
+ * @mgr: security manager
+ * @def: domain the file is labeled for
+ * @path: file to be labeled
+ * @label: label the caller needs on @path
+ *
+ * Check whether @path already carries @label on behalf of a domain,
+ * in which case @def is recorded as needing it too and the caller
+ * must not relabel the file.
+ *
+ * Returns 1 if @path is already labeled, 0 if the caller has to
+ * label it and then call virSecurityManagerLabelCacheAdd().
+ */
+int
+virSecurityManagerLabelCacheHit(virSecurityManagerPtr mgr,
+                                virDomainDefPtr def,
+                                const char *path,
+                                const char *label)
+{
+    virSecurityManagerLabelEntryPtr entry;
+    struct stat sb;
+    struct timespec changed;
+    char *key;
+    int ret = 0;
+
+    if (!(key = virSecurityManagerLabelKey(path, &sb)))
+        return 0;
+
+    changed = get_stat_ctime(&sb);
+
+    virMutexLock(&mgr->labelsLock);
+    if ((entry = virHashLookup(mgr->labels, key)) &&
+        STREQ(entry->label, label) &&
+        entry->ctime.tv_sec == changed.tv_sec &&
+        entry->ctime.tv_nsec == changed.tv_nsec &&
+        virSecurityManagerLabelEntryAddUser(entry, def->uuid) == 0) {
+        VIR_DEBUG("'%s' already labeled '%s' for %zu domains",
+                  path, label, entry->nusers);
+        mgr->labelStats.relabelSkipped++;
+        ret = 1;
+    }
+    virMutexUnlock(&mgr->labelsLock);
+
+    VIR_FREE(key);
+    return ret;
+}
+
+
+/**
+ * virSecurityManagerLabelCacheAdd:
+ * @mgr: security manager
+ * @def: domain the file was labeled for
+ * @path: file which was just labeled
+ * @label: label set on @path
+ *
+ * Record that @path was labeled with @label for @def.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virSecurityManagerLabelCacheAdd(virSecurityManagerPtr mgr,
+                                virDomainDefPtr def,
+                                const char *path,
+                                const char *label)
+{
+    virSecurityManagerLabelEntryPtr entry;
+    struct stat sb;
+    char *key;
+    int ret = -1;
+
+    /* Not worth failing over, the file just won't be cached */
+    key = virSecurityManagerLabelKey(path, &sb);
+
+    virMutexLock(&mgr->labelsLock);
+    mgr->labelStats.relabeled++;
+
+    if (!key) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(entry = virHashLookup(mgr->labels, key))) {
+        if (VIR_ALLOC(entry) < 0)
+            goto cleanup;
+
+        if (virHashAddEntry(mgr->labels, key, entry) < 0) {
+            VIR_FREE(entry);
+            goto cleanup;
+        }
+    }
+
+    VIR_FREE(entry->label);
+    if (VIR_STRDUP(entry->label, label) < 0 ||
+        virSecurityManagerLabelEntryAddUser(entry, def->uuid) < 0) {
+        ignore_value(virHashRemoveEntry(mgr->labels, key));
+        goto cleanup;
+    }
+    entry->ctime = get_stat_ctime(&sb);
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&mgr->labelsLock);
+    VIR_FREE(key);
+    return ret;
+}
+
+
+/**
+ * virSecurityManagerLabelCacheRelease:
+ * @mgr: security manager
+ * @def: domain no longer using the file
+ * @path: file no longer used
+ *
+ * Drop the reference of @def taken by virSecurityManagerLabelCacheHit()
+ * or virSecurityManagerLabelCacheAdd().
+ *
+ * Returns 1 if other domains still need the label on @path, which must
+ * then not be restored, 0 otherwise.
+ */
+int
+virSecurityManagerLabelCacheRelease(virSecurityManagerPtr mgr,
+                                    virDomainDefPtr def,
+                                    const char *path)
+{
+    virSecurityManagerLabelEntryPtr entry;
+    struct stat sb;
+    char *key;
+    int ret = 0;
+
+    if (!(key = virSecurityManagerLabelKey(path, &sb)))
+        return 0;
+
+    virMutexLock(&mgr->labelsLock);
+    if ((entry = virHashLookup(mgr->labels, key))) {
+        virSecurityManagerLabelEntryRemoveUser(entry, def->uuid);
+        if (entry->nusers > 0) {
+            VIR_DEBUG("'%s' still labeled for %zu domains",
+                      path, entry->nusers);
+            ret = 1;
+        } else {
+            ignore_value(virHashRemoveEntry(mgr->labels, key));
+        }
+    }
+    virMutexUnlock(&mgr->labelsLock);
+
+    VIR_FREE(key);
+    return ret;
+}
+
+
+struct virSecurityManagerLabelCacheReleaseData {
+    virSecurityManagerPtr mgr;
+    virDomainDefPtr def;
+    bool inuse;
+};
+
+
+static int
+virSecurityManagerLabelCacheReleasePath(virDomainDiskDefPtr disk ATTRIBUTE_UNUSED,
+                                        const char *path,
+                                        size_t depth,
+                                        void *opaque)
+{
+    struct virSecurityManagerLabelCacheReleaseData *data = opaque;
+
+    if (virSecurityManagerLabelCacheRelease(data->mgr, data->def, path) == 1 &&
+        depth == 0)
+        data->inuse = true;
+
+    return 0;
+}
+
+
+/**
+ * virSecurityManagerLabelCacheReleaseDisk:
+ * @mgr: security manager
+ * @def: domain no longer using @disk
+ * @disk: disk no longer used
+ *
+ * Drop the references of @def on every file of the backing chain of
+ * @disk.
+ *
+ * Returns 1 if other domains still need the label on the disk source,
+ * which must then not be restored, 0 otherwise.
+ */
+int
+virSecurityManagerLabelCacheReleaseDisk(virSecurityManagerPtr mgr,
+                                        virDomainDefPtr def,
+                                        virDomainDiskDefPtr disk)
+{
+    struct virSecurityManagerLabelCacheReleaseData data = { mgr, def, false };
+
+    ignore_value(virDomainDiskDefForeachPath(disk, true,
+                                             virSecurityManagerLabelCacheReleasePath,
+                                             &data));
+
+    /* Read-only and shared disks are never restored anyway */
+    if (data.inuse && !disk->readonly && !disk->shared) {
+        virMutexLock(&mgr->labelsLock);
+        mgr->labelStats.restoreSkipped++;
+        virMutexUnlock(&mgr->labelsLock);
+    }
+
+    return data.inuse ? 1 : 0;
+}
+
+
+struct virSecurityManagerLabelCacheReleaseDomainData {
+    virSecurityManagerPtr mgr;
+    virDomainDefPtr def;
+};
+
+
+static void
+virSecurityManagerLabelCacheReleaseDomainEntry(void *payload,
+                                               const void *name,
+                                               void *opaque)
+{
+    virSecurityManagerLabelEntryPtr entry = payload;
+    struct virSecurityManagerLabelCacheReleaseDomainData *data = opaque;
+
+    virSecurityManagerLabelEntryRemoveUser(entry, data->def->uuid);
+    if (entry->nusers == 0)
+        ignore_value(virHashRemoveEntry(data->mgr->labels, name));
+}
+
+
+/*
+ * Drop whatever reference @def still holds, on files it stopped using
+ * without restoring them (e.g. the old source of a pivoted block job)
+ * or labeled before failing to label all of its resources, in @mgr
+ * and all the managers nested in it.
+ */
+static void
+virSecurityManagerLabelCacheReleaseDomain(virSecurityManagerPtr mgr,
+                                          virDomainDefPtr def)
+{
+    struct virSecurityManagerLabelCacheReleaseDomainData data = { NULL, def };
+    virSecurityManagerPtr *nested;
+    size_t i;
+
+    if (!(nested = virSecurityManagerGetNested(mgr))) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; nested[i]; i++) {
+        data.mgr = nested[i];
+        virMutexLock(&nested[i]->labelsLock);
+        virHashForEach(nested[i]->labels,
+                       virSecurityManagerLabelCacheReleaseDomainEntry, &data);
+        virMutexUnlock(&nested[i]->labelsLock);
+    }
+
+    VIR_FREE(nested);
+}
+
+
+/**
+ * virSecurityManagerGetLabelStats:
+ * @mgr: security manager
+ * @stats: filled with the label cache counters
+ *
+ * Report how many files were labeled and how many relabel and
+ * restore operations were skipped because other users needed the
+ * same label, summed over the nested managers of a stack.
+ */
+void
+virSecurityManagerGetLabelStats(virSecurityManagerPtr mgr,
+                                virSecurityManagerLabelStatsPtr stats)
+{
+    virSecurityManagerPtr *nested;
+    size_t i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (!(nested = virSecurityManagerGetNested(mgr))) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; nested[i]; i++) {
+        virMutexLock(&nested[i]->labelsLock);
+        stats->relabeled += nested[i]->labelStats.relabeled;
+        stats->relabelSkipped += nested[i]->labelStats.relabelSkipped;
+        stats->restoreSkipped += nested[i]->labelStats.restoreSkipped;
+        virMutexUnlock(&nested[i]->labelsLock);
+    }
+
+    VIR_FREE(nested);
+}
+
+
+/**
+ * virSecurityManagerSetLabelThreads:
+ * @mgr: security manager
+ * @nthreads: how many disks of a domain may be labeled at once
+ *
+ * Let virSecurityManagerLabelDisks() label up to @nthreads disks
+ * concurrently, for @mgr and all the managers nested in it.
+ */
+void
+virSecurityManagerSetLabelThreads(virSecurityManagerPtr mgr,
+                                  size_t nthreads)
+{
+    virSecurityManagerPtr *nested;
+    size_t i;
+
+    if (nthreads == 0)
+        nthreads = 1;
+
+    mgr->labelThreads = nthreads;
+
+    if (!(nested = virSecurityManagerGetNested(mgr))) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; nested[i]; i++)
+        nested[i]->labelThreads = nthreads;
+
+    VIR_FREE(nested);
+}
+
+
+struct virSecurityManagerLabelDisksData {
+    virSecurityManagerPtr mgr;
+    virDomainDefPtr def;
+    virSecurityManagerDiskLabelFunc label;
+
+    virMutex lock;
+    size_t next;
+    bool failed;
+
+    /* per disk: -1 failed, 0 labeled, 1 skipped or not attempted */
+    int *results;
+    virErrorPtr *errors;
+};
+
+
+static void
+virSecurityManagerLabelDisksWorker(void *opaque)
+{
+    struct virSecurityManagerLabelDisksData *data = opaque;
+    virDomainDefPtr def = data->def;
+    size_t i;
+
+    for (;;) {
+        virMutexLock(&data->lock);
+        /* Do not start on more disks once one failed */
+        if (data->failed || data->next >= def->ndisks) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        data->results[i] = data->label(data->mgr, def, def->disks[i]);
+
+        if (data->results[i] < 0) {
+            data->errors[i] = virSaveLastError();
+            virMutexLock(&data->lock);
+            data->failed = true;
+            virMutexUnlock(&data->lock);
+        }
+    }
+}
+
+
+/**
+ * virSecurityManagerLabelDisks:
+ * @mgr: security manager
+ * @def: domain definition
+ * @label: callback labeling one disk, returning -1 on error, 0 if the
+ *         disk was labeled and 1 if it was left alone
+ * @restore: callback restoring the label of one disk
+ *
+ * Label all disks of @def, using up to the number of threads set by
+ * virSecurityManagerSetLabelThreads() since labeling files on network
+ * storage can take a while.  If any disk fails, the disks labeled so
+ * far are restored in reverse order and the error of the first failed
+ * disk is reported, whatever the order the disks were processed in.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virSecurityManagerLabelDisks(virSecurityManagerPtr mgr,
+                             virDomainDefPtr def,
+                             virSecurityManagerDiskLabelFunc label,
+                             virSecurityManagerDiskLabelFunc restore)
+{
+    struct virSecurityManagerLabelDisksData data = {
+        .mgr = mgr, .def = def, .label = label,
+    };
+    virThreadPtr threads = NULL;
+    size_t nthreads = MIN(mgr->labelThreads, def->ndisks);
+    size_t started = 0;
+    unsigned long long then = 0, now = 0;
+    virErrorPtr err = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (def->ndisks == 0)
+        return 0;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(data.results, def->ndisks) < 0 ||
+        VIR_ALLOC_N(data.errors, def->ndisks) < 0 ||
+        (nthreads > 1 && VIR_ALLOC_N(threads, nthreads - 1) < 0))
+        goto cleanup;
+
+    for (i = 0; i < def->ndisks; i++)
+        data.results[i] = 1;
+
+    ignore_value(virTimeMillisNow(&then));
+
+    /* The calling thread is a worker too, so progress is made even
+     * when no thread can be started */
+    for (started = 0; started + 1 < nthreads; started++) {
+        if (virThreadCreate(&threads[started], true,
+                            virSecurityManagerLabelDisksWorker, &data) < 0) {
+            VIR_WARN("Unable to start a thread labeling disks of %s",
+                     def->name);
+            break;
+        }
+    }
+
+    virSecurityManagerLabelDisksWorker(&data);
+
+    for (i = 0; i < started; i++)
+        virThreadJoin(&threads[i]);
+
+    ignore_value(virTimeMillisNow(&now));
+    VIR_DEBUG("Labeled %zu disks of %s using %zu threads in %llu ms",
+              def->ndisks, def->name, started + 1, now - then);
+
+    if (!data.failed) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    for (i = 0; i < def->ndisks; i++) {
+        if (data.results[i] < 0) {
+            err = data.errors[i];
+            data.errors[i] = NULL;
+            break;
+        }
+    }
+
+    i = def->ndisks;
+    while (i--) {
+        if (data.results[i] == 0 &&
+            restore(mgr, def, def->disks[i]) < 0)
+            VIR_WARN("Unable to restore label of disk %s of %s",
+                     def->disks[i]->dst, def->name);
+    }
+
+    virSetError(err);
+    virFreeError(err);
+
+ cleanup:
+    if (data.errors) {
+        for (i = 0; i < def->ndisks; i++)
+            virFreeError(data.errors[i]);
+    }
+    VIR_FREE(data.errors);
+    VIR_FREE(data.results);
+    VIR_FREE(threads);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
@@ -29,6 +29,14 @@
 typedef struct _virSecurityManager virSecurityManager;
 typedef virSecurityManager *virSecurityManagerPtr;
 
+typedef struct _virSecurityManagerLabelStats virSecurityManagerLabelStats;
+typedef virSecurityManagerLabelStats *virSecurityManagerLabelStatsPtr;
+struct _virSecurityManagerLabelStats {
+    unsigned long long relabeled;      /* files whose label was set */
+    unsigned long long relabelSkipped; /* already labeled for another user */
+    unsigned long long restoreSkipped; /* restores left to the last user */
+};
+
 virSecurityManagerPtr virSecurityManagerNew(const char *name,
                                             const char *virtDriver,
                                             bool allowDiskFormatProbing,
@@ -125,4 +133,32 @@ int virSecurityManagerSetHugepages(virSecurityManagerPtr mgr,
                                   virDomainDefPtr sec,
                                   const char *hugepages_path);
 
+int virSecurityManagerLabelCacheHit(virSecurityManagerPtr mgr,
+                                    virDomainDefPtr def,
+                                    const char *path,
+                                    const char *label);
+int virSecurityManagerLabelCacheAdd(virSecurityManagerPtr mgr,
+                                    virDomainDefPtr def,
+                                    const char *path,
+                                    const char *label);
+int virSecurityManagerLabelCacheRelease(virSecurityManagerPtr mgr,
+                                        virDomainDefPtr def,
+                                        const char *path);
+int virSecurityManagerLabelCacheReleaseDisk(virSecurityManagerPtr mgr,
+                                            virDomainDefPtr def,
+                                            virDomainDiskDefPtr disk);
+void virSecurityManagerGetLabelStats(virSecurityManagerPtr mgr,
+                                     virSecurityManagerLabelStatsPtr stats);
+
+typedef int (*virSecurityManagerDiskLabelFunc)(virSecurityManagerPtr mgr,
+                                               virDomainDefPtr def,
+                                               virDomainDiskDefPtr disk);
+
+void virSecurityManagerSetLabelThreads(virSecurityManagerPtr mgr,
+                                       size_t nthreads);
+int virSecurityManagerLabelDisks(virSecurityManagerPtr mgr,
+                                 virDomainDefPtr def,
+                                 virSecurityManagerDiskLabelFunc label,
+                                 virSecurityManagerDiskLabelFunc restore);
+
 #endif /* VIR_SECURITY_MANAGER_H__ */
@@ -73,6 +73,7 @@ struct _virSecuritySELinuxData {
 
 struct _virSecuritySELinuxCallbackData {
     virSecurityManagerPtr manager;
+    virDomainDefPtr def;
     virSecurityLabelDefPtr secdef;
 };
 
@@ -1152,6 +1153,10 @@ virSecuritySELinuxRestoreSecurityImageLabelInt(virSecurityManagerPtr mgr,
         !disk->backingChain)
         return 0;
 
+    /* Leave the image to the other guests still using it */
+    if (virSecurityManagerLabelCacheReleaseDisk(mgr, def, disk) == 1)
+        return 0;
+
     /* Don't restore labels on readoly/shared disks, because
      * other VMs may still be accessing these
      * Alternatively we could iterate over all running
@@ -1206,6 +1211,8 @@ virSecuritySELinuxSetSecurityFileLabel(virDomainDiskDefPtr disk,
     virSecuritySELinuxCallbackDataPtr cbdata = opaque;
     virSecurityLabelDefPtr secdef = cbdata->secdef;
     virSecuritySELinuxDataPtr data = virSecurityManagerGetPrivateData(cbdata->manager);
+    char *tcon;
+    bool optional = true;
 
     disk_seclabel = virDomainDiskDefGetSecurityLabelDef(disk,
                                                         SECURITY_SELINUX_NAME);
@@ -1215,21 +1222,38 @@ virSecuritySELinuxSetSecurityFileLabel(virDomainDiskDefPtr disk,
 
     if (disk_seclabel && !disk_seclabel->norelabel &&
         disk_seclabel->label) {
-        ret = virSecuritySELinuxSetFilecon(path, disk_seclabel->label);
+        tcon = disk_seclabel->label;
+        optional = false;
     } else if (depth == 0) {
 
         if (disk->shared) {
-            ret = virSecuritySELinuxSetFileconOptional(path, data->file_context);
+            tcon = data->file_context;
         } else if (disk->readonly) {
-            ret = virSecuritySELinuxSetFileconOptional(path, data->content_context);
+            tcon = data->content_context;
         } else if (secdef->imagelabel) {
-            ret = virSecuritySELinuxSetFileconOptional(path, secdef->imagelabel);
+            tcon = secdef->imagelabel;
         } else {
-            ret = 0;
+            return 0;
         }
     } else {
-        ret = virSecuritySELinuxSetFileconOptional(path, data->content_context);
+        tcon = data->content_context;
     }
+
+    /* Shared images are typically labeled already for another guest */
+    if (virSecurityManagerLabelCacheHit(cbdata->manager, cbdata->def,
+                                        path, tcon))
+        return 0;
+
+    if (optional)
+        ret = virSecuritySELinuxSetFileconOptional(path, tcon);
+    else
+        ret = virSecuritySELinuxSetFilecon(path, tcon);
+
+    if (ret == 0 &&
+        virSecurityManagerLabelCacheAdd(cbdata->manager, cbdata->def,
+                                        path, tcon) < 0)
+        return -1;
+
     if (ret == 1 && !disk_seclabel) {
         /* If we failed to set a label, but virt_use_nfs let us
          * proceed anyway, then we don't need to relabel later.  */
@@ -1255,6 +1279,7 @@ virSecuritySELinuxSetSecurityImageLabel(virSecurityManagerPtr mgr,
 {
     virSecuritySELinuxCallbackData cbdata;
     cbdata.manager = mgr;
+    cbdata.def = def;
     cbdata.secdef = virDomainDefGetSecurityLabelDef(def, SECURITY_SELINUX_NAME);
 
     if (cbdata.secdef == NULL)
@@ -2254,6 +2279,22 @@ virSecuritySELinuxSetSecuritySmartcardCallback(virDomainDefPtr def,
 }
 
 
+static int
+virSecuritySELinuxSetSecurityDiskLabel(virSecurityManagerPtr mgr,
+                                       virDomainDefPtr def,
+                                       virDomainDiskDefPtr disk)
+{
+    /* XXX fixme - we need to recursively label the entire tree :-( */
+    if (virDomainDiskGetType(disk) == VIR_DOMAIN_DISK_TYPE_DIR) {
+        VIR_WARN("Unable to relabel directory tree %s for disk %s",
+                 virDomainDiskGetSource(disk), disk->dst);
+        return 1;
+    }
+
+    return virSecuritySELinuxSetSecurityImageLabel(mgr, def, disk);
+}
+
+
 static int
 virSecuritySELinuxSetSecurityAllLabel(virSecurityManagerPtr mgr,
                                       virDomainDefPtr def,
@@ -2270,18 +2311,10 @@ virSecuritySELinuxSetSecurityAllLabel(virSecurityManagerPtr mgr,
     if (secdef->norelabel || data->skipAllLabel)
         return 0;
 
-    for (i = 0; i < def->ndisks; i++) {
-        /* XXX fixme - we need to recursively label the entire tree :-( */
-        if (virDomainDiskGetType(def->disks[i]) == VIR_DOMAIN_DISK_TYPE_DIR) {
-            VIR_WARN("Unable to relabel directory tree %s for disk %s",
-                     virDomainDiskGetSource(def->disks[i]),
-                     def->disks[i]->dst);
-            continue;
-        }
-        if (virSecuritySELinuxSetSecurityImageLabel(mgr,
-                                         def, def->disks[i]) < 0)
-            return -1;
-    }
+    if (virSecurityManagerLabelDisks(mgr, def,
+                                     virSecuritySELinuxSetSecurityDiskLabel,
+                                     virSecuritySELinuxRestoreSecurityImageLabel) < 0)
+        return -1;
     /* XXX fixme process  def->fss if relabel == true */
 
     for (i = 0; i < def->nhostdevs; i++) {
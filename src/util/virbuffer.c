@@ -32,6 +32,7 @@
 
 #include "virbuffer.h"
 #include "viralloc.h"
+#include "virthread.h"
 
 
 /* If adding more fields, ensure to edit buf.h to match
@@ -109,14 +110,17 @@ virBufferGetIndent(const virBuffer *buf, bool dynamic)
  * @buf: the buffer
  * @len: the minimum free size to allocate on top of existing used space
  *
- * Grow the available space of a buffer to at least @len bytes.
+ * Grow the available space of a buffer to at least @len bytes.  The
+ * allocation is at least doubled each time, so that building a large
+ * document piece by piece only reallocates a logarithmic number of
+ * times.
  *
  * Returns zero on success or -1 on error
  */
 static int
 virBufferGrow(virBufferPtr buf, unsigned int len)
 {
-    int size;
+    size_t size;
 
     if (buf->error)
         return -1;
@@ -124,7 +128,17 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     if ((len + buf->use) < buf->size)
         return 0;
 
-    size = buf->use + len + 1000;
+    size = (size_t) buf->use + len + 1000;
+    if (size < (size_t) buf->size * 2)
+        size = (size_t) buf->size * 2;
+
+    if (size > UINT_MAX) {
+        if ((size_t) buf->use + len >= UINT_MAX) {
+            virBufferSetError(buf, ENOMEM);
+            return -1;
+        }
+        size = UINT_MAX;
+    }
 
     if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
         virBufferSetError(buf, errno);
@@ -134,6 +148,29 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     return 0;
 }
 
+/**
+ * virBufferSizeHint:
+ * @buf: the buffer
+ * @len: expected length of the complete content
+ *
+ * Let @buf know it is going to hold about @len bytes so that it can
+ * allocate them at once instead of growing step by step.  This is
+ * only a hint: the buffer still grows past @len as needed.
+ */
+void
+virBufferSizeHint(virBufferPtr buf, unsigned int len)
+{
+    /* virBufferAdd() keeps one spare byte on top of the NUL */
+    if (!buf || buf->error || len > UINT_MAX - 2 || len + 2 <= buf->size)
+        return;
+
+    if (VIR_REALLOC_N_QUIET(buf->content, len + 2) < 0) {
+        virBufferSetError(buf, errno);
+        return;
+    }
+    buf->size = len + 2;
+}
+
 /**
  * virBufferAdd:
  * @buf: the buffer to append to
@@ -232,6 +269,83 @@ virBufferContentAndReset(virBufferPtr buf)
     return str;
 }
 
+/*
+ * Formatters which are called over and over, such as the domain XML
+ * formatter, tend to produce documents of similar sizes.  Each thread
+ * remembers how long the last such document was, so that the next
+ * buffer is allocated at once rather than grown step by step.  Hints
+ * above VIR_BUFFER_SCRATCH_MAX are not followed, to avoid allocating a
+ * lot of memory for small documents after a single huge one.
+ */
+#define VIR_BUFFER_SCRATCH_MAX (1024 * 1024)
+
+static virThreadLocal virBufferScratchHint;
+
+static int
+virBufferScratchOnceInit(void)
+{
+    return virThreadLocalInit(&virBufferScratchHint, NULL);
+}
+
+VIR_ONCE_GLOBAL_INIT(virBufferScratch)
+
+/**
+ * virBufferScratchAcquire:
+ * @buf: an empty buffer
+ *
+ * Allocate @buf as large as the last content retrieved with
+ * virBufferScratchContentAndReset() in the calling thread.  Nothing
+ * is done if @buf is not empty; failing to allocate is not an error
+ * either, @buf then simply grows as usual.
+ */
+void
+virBufferScratchAcquire(virBufferPtr buf)
+{
+    uintptr_t hint;
+
+    if (!buf || buf->error || buf->content)
+        return;
+
+    if (virBufferScratchInitialize() < 0)
+        return;
+
+    hint = (uintptr_t) virThreadLocalGet(&virBufferScratchHint);
+    if (hint == 0 || hint > VIR_BUFFER_SCRATCH_MAX)
+        return;
+
+    if (VIR_ALLOC_N_QUIET(buf->content, hint) < 0)
+        return;
+    buf->size = hint;
+}
+
+/**
+ * virBufferScratchContentAndReset:
+ * @buf: Buffer
+ *
+ * Like virBufferContentAndReset(), but remember the length of the
+ * content for the next virBufferScratchAcquire() in the same thread.
+ * The content is handed over without copying it.
+ *
+ * Returns the buffer content or NULL in case of error.
+ */
+char *
+virBufferScratchContentAndReset(virBufferPtr buf)
+{
+    if (!buf || buf->error || !buf->content)
+        return virBufferContentAndReset(buf);
+
+    if (virBufferScratchInitialize() == 0)
+        ignore_value(virThreadLocalSet(&virBufferScratchHint,
+                                       (void *)(uintptr_t)(buf->use + 1)));
+
+    /* Shrinking is done in place, give back what the hint of a larger
+     * document left unused */
+    if (buf->size / 2 > buf->use + 1)
+        ignore_value(VIR_REALLOC_N_QUIET(buf->content, buf->use + 1));
+
+    return virBufferContentAndReset(buf);
+}
+
 /**
  * virBufferFreeAndReset:
  * @buf: the buffer to free and reset
@@ -336,7 +450,7 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
     if (count >= size) {
         buf->content[buf->use] = 0;
 
-        grow_size = (count + 1 > 1000) ? count + 1 : 1000;
+        grow_size = count + 1;
         if (virBufferGrow(buf, grow_size) < 0) {
             return;
         }
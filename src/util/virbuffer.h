@@ -52,6 +52,9 @@ struct _virBuffer {
 const char *virBufferCurrentContent(virBufferPtr buf);
 char *virBufferContentAndReset(virBufferPtr buf);
 void virBufferFreeAndReset(virBufferPtr buf);
+void virBufferScratchAcquire(virBufferPtr buf);
+char *virBufferScratchContentAndReset(virBufferPtr buf);
+void virBufferSizeHint(virBufferPtr buf, unsigned int len);
 int virBufferError(const virBuffer *buf);
 unsigned int virBufferUse(const virBuffer *buf);
 void virBufferAdd(virBufferPtr buf, const char *str, int len);
@@ -38,6 +38,11 @@
 #include <sys/types.h>
 #include <signal.h>
 #include <dirent.h>
+#include <poll.h>
+#if HAVE_SETRLIMIT
+# include <sys/time.h>
+# include <sys/resource.h>
+#endif
 
 #define __VIR_CGROUP_ALLOW_INCLUDE_PRIV_H__
 #include "vircgrouppriv.h"
@@ -52,6 +57,8 @@
 #include "virstring.h"
 #include "virsystemd.h"
 #include "virtypedparam.h"
+#include "virthread.h"
+#include "viratomic.h"
 
 #include "nodeinfo.h"
 
@@ -84,6 +91,52 @@ typedef enum {
 
 
 #ifdef VIR_CGROUP_SUPPORTED
+/*
+ * The cgroup mount table is parsed once per process and shared
+ * by every virCgroupPtr created afterwards. An fd is kept open
+ * on /proc/mounts purely so that poll() can tell us when the
+ * kernel's mount table changed and the cache must be refreshed.
+ */
+static virMutex virCgroupMountLock;
+static struct virCgroupController virCgroupMounts[VIR_CGROUP_CONTROLLER_LAST];
+static bool virCgroupMountsValid;
+static int virCgroupMountsFD = -1;
+static pid_t virCgroupMountsPid;
+
+/* Upper bound on the number of controller file descriptors
+ * that may be held open by virCgroupSetStatsCache across
+ * all groups in this process. */
+static int virCgroupCachedFDsMax;
+static int virCgroupCachedFDs;
+
+static int
+virCgroupOnceInit(void)
+{
+# if HAVE_SETRLIMIT
+    struct rlimit rlim;
+# endif
+
+    if (virMutexInit(&virCgroupMountLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize cgroup mount mutex"));
+        return -1;
+    }
+
+    /* Never let cached stats files eat more than a quarter
+     * of the fds we are allowed to have open */
+    virCgroupCachedFDsMax = 256;
+# if HAVE_SETRLIMIT
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 &&
+        rlim.rlim_cur != RLIM_INFINITY)
+        virCgroupCachedFDsMax = MIN(rlim.rlim_cur / 4, INT_MAX);
+# endif
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virCgroup)
+
+
 bool
 virCgroupAvailable(void)
 {
@@ -276,32 +329,40 @@ virCgroupValidateMachineGroup(virCgroupPtr group,
 
 
 static int
-virCgroupCopyMounts(virCgroupPtr group,
-                    virCgroupPtr parent)
+virCgroupCopyMountPoints(struct virCgroupController *controllers,
+                         const struct virCgroupController *parent)
 {
     size_t i;
     for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++) {
-        if (!parent->controllers[i].mountPoint)
+        if (!parent[i].mountPoint)
             continue;
 
-        if (VIR_STRDUP(group->controllers[i].mountPoint,
-                       parent->controllers[i].mountPoint) < 0)
+        if (VIR_STRDUP(controllers[i].mountPoint,
+                       parent[i].mountPoint) < 0)
             return -1;
 
-        if (VIR_STRDUP(group->controllers[i].linkPoint,
-                       parent->controllers[i].linkPoint) < 0)
+        if (VIR_STRDUP(controllers[i].linkPoint,
+                       parent[i].linkPoint) < 0)
             return -1;
     }
     return 0;
 }
 
 
+static int
+virCgroupCopyMounts(virCgroupPtr group,
+                    virCgroupPtr parent)
+{
+    return virCgroupCopyMountPoints(group->controllers, parent->controllers);
+}
+
+
 /*
  * Process /proc/mounts figuring out what controllers are
  * mounted and where
  */
 static int
-virCgroupDetectMounts(virCgroupPtr group)
+virCgroupParseMounts(struct virCgroupController *controllers)
 {
     size_t i;
     FILE *mounts = NULL;
@@ -337,12 +398,12 @@ virCgroupDetectMounts(virCgroupPtr group)
                  * first entry only
                  */
                 if (typelen == len && STREQLEN(typestr, tmp, len) &&
-                    !group->controllers[i].mountPoint) {
+                    !controllers[i].mountPoint) {
                     char *linksrc;
                     struct stat sb;
                     char *tmp2;
 
-                    if (VIR_STRDUP(group->controllers[i].mountPoint,
+                    if (VIR_STRDUP(controllers[i].mountPoint,
                                    entry.mnt_dir) < 0)
                         goto error;
 
@@ -379,7 +440,7 @@ virCgroupDetectMounts(virCgroupPtr group)
                                 VIR_WARN("Expecting a symlink at %s for controller %s",
                                          linksrc, typestr);
                             } else {
-                                group->controllers[i].linkPoint = linksrc;
+                                controllers[i].linkPoint = linksrc;
                             }
                         }
                     }
@@ -399,6 +460,104 @@ virCgroupDetectMounts(virCgroupPtr group)
 }
 
 
+static void
+virCgroupClearMountPoints(struct virCgroupController *controllers)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++) {
+        VIR_FREE(controllers[i].mountPoint);
+        VIR_FREE(controllers[i].linkPoint);
+    }
+}
+
+
+/*
+ * Must be called with virCgroupMountLock held. Returns true if the
+ * cached mount table can still be used, ie nothing has been mounted
+ * or unmounted since it was parsed and we're not a forked child.
+ */
+static bool
+virCgroupMountCacheIsValid(void)
+{
+    struct pollfd fd = { .fd = virCgroupMountsFD, .events = POLLPRI };
+
+    if (!virCgroupMountsValid ||
+        virCgroupMountsFD < 0 ||
+        virCgroupMountsPid != getpid())
+        return false;
+
+    /* The kernel flags POLLERR|POLLPRI on a /proc/mounts fd once the
+     * mount namespace changed since the fd was opened or last polled */
+    if (poll(&fd, 1, 0) != 0)
+        return false;
+
+    return true;
+}
+
+
+/**
+ * virCgroupResetMountCache:
+ *
+ * Forget the cached cgroup mount table, forcing the next
+ * group lookup to parse /proc/mounts again.
+ */
+void
+virCgroupResetMountCache(void)
+{
+    if (virCgroupInitialize() < 0)
+        return;
+
+    virMutexLock(&virCgroupMountLock);
+    virCgroupMountsValid = false;
+    virCgroupClearMountPoints(virCgroupMounts);
+    VIR_FORCE_CLOSE(virCgroupMountsFD);
+    virMutexUnlock(&virCgroupMountLock);
+}
+
+
+static int
+virCgroupDetectMounts(virCgroupPtr group)
+{
+    int ret = -1;
+
+    if (virCgroupInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virCgroupMountLock);
+
+    if (!virCgroupMountCacheIsValid()) {
+        VIR_DEBUG("Refreshing cgroup mount table cache");
+        virCgroupMountsValid = false;
+        virCgroupClearMountPoints(virCgroupMounts);
+
+        /* Open the fd before parsing, so that any change racing
+         * with the parse will be picked up on next lookup */
+        VIR_FORCE_CLOSE(virCgroupMountsFD);
+        if ((virCgroupMountsFD = open("/proc/mounts",
+                                      O_RDONLY | O_CLOEXEC)) < 0)
+            VIR_DEBUG("Unable to open /proc/mounts, not caching mounts");
+
+        if (virCgroupParseMounts(virCgroupMounts) < 0) {
+            virCgroupClearMountPoints(virCgroupMounts);
+            goto cleanup;
+        }
+
+        virCgroupMountsValid = true;
+        virCgroupMountsPid = getpid();
+    }
+
+    if (virCgroupCopyMountPoints(group->controllers, virCgroupMounts) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virCgroupMountLock);
+    return ret;
+}
+
+
 static int
 virCgroupCopyPlacement(virCgroupPtr group,
                        const char *path,
@@ -699,6 +858,179 @@ virCgroupSetValueStr(virCgroupPtr group,
 }
 
 
+/*
+ * Read the entire contents of the cgroup file open on @fd, always
+ * starting from offset zero so that the same descriptor can be
+ * read over and over. Returns the number of bytes read, or -1
+ * with errno set.
+ */
+static int
+virCgroupReadFD(int fd, char **value)
+{
+    char *buf = NULL;
+    size_t size = 1024;
+    size_t len = 0;
+    ssize_t got;
+
+    if (VIR_ALLOC_N_QUIET(buf, size) < 0)
+        goto error;
+
+    for (;;) {
+        if (len + 1 == size) {
+            if (size >= 1024 * 1024) {
+                errno = EOVERFLOW;
+                goto error;
+            }
+            if (VIR_REALLOC_N_QUIET(buf, size * 2) < 0)
+                goto error;
+            size *= 2;
+        }
+
+        got = pread(fd, buf + len, size - len - 1, len);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            goto error;
+        }
+        if (got == 0)
+            break;
+        len += got;
+    }
+
+    buf[len] = '\0';
+    *value = buf;
+    return len;
+
+ error:
+    VIR_FREE(buf);
+    return -1;
+}
+
+
+static void
+virCgroupCloseCachedFiles(virCgroupPtr group)
+{
+    size_t i;
+
+    for (i = 0; i < group->ncachedFiles; i++) {
+        VIR_FORCE_CLOSE(group->cachedFiles[i].fd);
+        VIR_FREE(group->cachedFiles[i].key);
+        ignore_value(virAtomicIntDecAndTest(&virCgroupCachedFDs));
+    }
+    VIR_FREE(group->cachedFiles);
+    group->ncachedFiles = 0;
+}
+
+
+/* Files which are polled for statistics, and thus worth keeping open */
+static const char *virCgroupStatsFiles[] = {
+    "cpuacct.usage",
+    "cpuacct.usage_percpu",
+    "cpuacct.stat",
+    "memory.usage_in_bytes",
+    "memory.memsw.usage_in_bytes",
+    "memory.stat",
+    "blkio.throttle.io_service_bytes",
+    "blkio.throttle.io_serviced",
+};
+
+static bool
+virCgroupIsStatsFile(const char *key)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(virCgroupStatsFiles); i++) {
+        if (STREQ(key, virCgroupStatsFiles[i]))
+            return true;
+    }
+    return false;
+}
+
+
+/*
+ * Keep the statistics file @key open after the first read and serve
+ * later reads from the same fd via pread(), saving an open/close pair
+ * per call on frequently polled files.
+ */
+static int
+virCgroupGetValueStrCached(virCgroupPtr group,
+                           int controller,
+                           const char *key,
+                           char **value)
+{
+    struct virCgroupCachedFile *file = NULL;
+    char *keypath = NULL;
+    int fd = -1;
+    int ret = -1, rc;
+    size_t i;
+
+    *value = NULL;
+
+    for (i = 0; i < group->ncachedFiles; i++) {
+        if (group->cachedFiles[i].controller == controller &&
+            STREQ(group->cachedFiles[i].key, key)) {
+            file = &group->cachedFiles[i];
+            break;
+        }
+    }
+
+    if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
+        return -1;
+
+    if (!file) {
+        VIR_DEBUG("Caching fd for %s", keypath);
+        if ((fd = open(keypath, O_RDONLY | O_CLOEXEC)) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to open '%s'"), keypath);
+            goto cleanup;
+        }
+
+        if (virAtomicIntInc(&virCgroupCachedFDs) <= virCgroupCachedFDsMax) {
+            struct virCgroupCachedFile newfile = { controller, NULL, fd };
+
+            if (VIR_STRDUP(newfile.key, key) < 0 ||
+                VIR_APPEND_ELEMENT(group->cachedFiles,
+                                   group->ncachedFiles, newfile) < 0) {
+                VIR_FREE(newfile.key);
+                ignore_value(virAtomicIntDecAndTest(&virCgroupCachedFDs));
+                goto cleanup;
+            }
+            file = &group->cachedFiles[group->ncachedFiles - 1];
+            fd = -1;
+        } else {
+            /* Over budget, fall back to a one-shot read */
+            ignore_value(virAtomicIntDecAndTest(&virCgroupCachedFDs));
+        }
+    }
+
+    if ((rc = virCgroupReadFD(file ? file->fd : fd, value)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), keypath);
+        /* The group may have gone away underneath us, don't keep
+         * a stale fd around */
+        if (file) {
+            VIR_FORCE_CLOSE(file->fd);
+            VIR_FREE(file->key);
+            ignore_value(virAtomicIntDecAndTest(&virCgroupCachedFDs));
+            VIR_DELETE_ELEMENT(group->cachedFiles,
+                               file - group->cachedFiles,
+                               group->ncachedFiles);
+        }
+        goto cleanup;
+    }
+
+    if (rc > 0 && (*value)[rc - 1] == '\n')
+        (*value)[rc - 1] = '\0';
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(keypath);
+    return ret;
+}
+
+
 static int
 virCgroupGetValueStr(virCgroupPtr group,
                      int controller,
@@ -708,6 +1040,9 @@ virCgroupGetValueStr(virCgroupPtr group,
     char *keypath = NULL;
     int ret = -1, rc;
 
+    if (group->cacheStats && virCgroupIsStatsFile(key))
+        return virCgroupGetValueStrCached(group, controller, key, value);
+
     *value = NULL;
 
     if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
@@ -1715,6 +2050,8 @@ virCgroupFree(virCgroupPtr *group)
     if (*group == NULL)
         return;
 
+    virCgroupCloseCachedFiles(*group);
+
     for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++) {
         VIR_FREE((*group)->controllers[i].mountPoint);
         VIR_FREE((*group)->controllers[i].linkPoint);
@@ -1726,6 +2063,27 @@ virCgroupFree(virCgroupPtr *group)
 }
 
 
+/**
+ * virCgroupSetStatsCache:
+ *
+ * @group: The group to configure
+ * @enable: whether to keep statistics files open
+ *
+ * When enabled, frequently polled statistics files such as
+ * cpuacct.usage or blkio.throttle.io_serviced are opened once
+ * and re-read with pread() on subsequent queries, instead of
+ * being opened and closed on every call. Disabling the cache
+ * closes any file descriptors held by @group.
+ */
+void
+virCgroupSetStatsCache(virCgroupPtr group, bool enable)
+{
+    if (!enable)
+        virCgroupCloseCachedFiles(group);
+    group->cacheStats = enable;
+}
+
+
 /**
  * virCgroupHasController: query whether a cgroup controller is present
  *
@@ -2571,6 +2929,24 @@ virCgroupGetCpusetMems(virCgroupPtr group, char **mems)
 }
 
 
+/**
+ * virCgroupSetCpusetMemoryMigrate:
+ *
+ * @group: The cgroup to set cpuset.memory_migrate for
+ * @migrate: whether pages should follow changes of cpuset.mems
+ *
+ * Returns: 0 on success
+ */
+int
+virCgroupSetCpusetMemoryMigrate(virCgroupPtr group, bool migrate)
+{
+    return virCgroupSetValueStr(group,
+                                VIR_CGROUP_CONTROLLER_CPUSET,
+                                "cpuset.memory_migrate",
+                                migrate ? "1" : "0");
+}
+
+
 /**
  * virCgroupSetCpusetCpus:
  *
@@ -3124,6 +3500,10 @@ virCgroupRemove(virCgroupPtr group)
     char *grppath = NULL;
 
     VIR_DEBUG("Removing cgroup %s", group->path);
+
+    /* Cached fds would only refer to deleted files from now on */
+    virCgroupCloseCachedFiles(group);
+
     for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++) {
         /* Skip over controllers not mounted */
         if (!group->controllers[i].mountPoint)
@@ -3838,6 +4218,19 @@ virCgroupFree(virCgroupPtr *group ATTRIBUTE_UNUSED)
 }
 
 
+void
+virCgroupSetStatsCache(virCgroupPtr group ATTRIBUTE_UNUSED,
+                       bool enable ATTRIBUTE_UNUSED)
+{
+}
+
+
+void
+virCgroupResetMountCache(void)
+{
+}
+
+
 bool
 virCgroupHasController(virCgroupPtr cgroup ATTRIBUTE_UNUSED,
                        int controller ATTRIBUTE_UNUSED)
@@ -4097,6 +4490,16 @@ virCgroupGetCpusetMems(virCgroupPtr group ATTRIBUTE_UNUSED,
 }
 
 
+int
+virCgroupSetCpusetMemoryMigrate(virCgroupPtr group ATTRIBUTE_UNUSED,
+                                bool migrate ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupSetCpusetCpus(virCgroupPtr group ATTRIBUTE_UNUSED,
                        const char *cpus ATTRIBUTE_UNUSED)
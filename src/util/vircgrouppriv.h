@@ -42,10 +42,23 @@ struct virCgroupController {
     char *placement;
 };
 
+/* A controller file kept open across reads, see virCgroupSetStatsCache */
+struct virCgroupCachedFile {
+    int controller;
+    char *key;
+    int fd;
+};
+
 struct virCgroup {
     char *path;
 
     struct virCgroupController controllers[VIR_CGROUP_CONTROLLER_LAST];
+
+    bool cacheStats;
+    size_t ncachedFiles;
+    struct virCgroupCachedFile *cachedFiles;
 };
 
+void virCgroupResetMountCache(void);
+
 #endif /* __VIR_CGROUP_PRIV_H__ */
@@ -30,6 +30,10 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
 #if WITH_CAPNG
 # include <cap-ng.h>
 #endif
@@ -53,6 +57,7 @@
 #include "virbuffer.h"
 #include "virthread.h"
 #include "virstring.h"
+#include "c-ctype.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -387,6 +392,345 @@ virCommandHandshakeChild(virCommandPtr cmd)
     return 0;
 }
 
+/*
+ * virCommandNextKeptFD:
+ *
+ * Return the lowest FD from @from up which the child must keep open,
+ * or -1 if there is none.
+ */
+static int
+virCommandNextKeptFD(virCommandPtr cmd, int from,
+                     int childin, int childout, int childerr)
+{
+    int keep[3] = { childin, childout, childerr };
+    int next = -1;
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(keep); i++) {
+        if (keep[i] >= from && (next < 0 || keep[i] < next))
+            next = keep[i];
+    }
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        int fd = cmd->passfd[i].fd;
+
+        if (fd >= from && (next < 0 || fd < next))
+            next = fd;
+    }
+
+    return next;
+}
+
+static bool
+virCommandKeepFD(virCommandPtr cmd, int fd,
+                 int childin, int childout, int childerr)
+{
+    return fd == childin || fd == childout || fd == childerr ||
+        virCommandFDIsSet(cmd, fd);
+}
+
+# define VIR_COMMAND_CLOSE_QUIET(FD)                                   \
+    ignore_value(virFileClose(&(FD),                                   \
+                              VIR_FILE_CLOSE_PRESERVE_ERRNO |          \
+                              VIR_FILE_CLOSE_IGNORE_EBADF |            \
+                              VIR_FILE_CLOSE_DONT_LOG))
+
+# ifdef __linux__
+struct virCommandLinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/*
+ * Close the FDs listed in /proc/self/fd rather than every possible FD
+ * number.  Uses getdents64 directly since opendir() may allocate.
+ */
+static int
+virCommandMassCloseProc(virCommandPtr cmd,
+                        int childin, int childout, int childerr)
+{
+    uint64_t buf[1024];
+    long nread;
+    int dirfd;
+
+    if ((dirfd = open("/proc/self/fd",
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return -1;
+
+    while ((nread = syscall(SYS_getdents64, dirfd, buf, sizeof(buf))) > 0) {
+        long off = 0;
+
+        while (off < nread) {
+            struct virCommandLinuxDirent64 *ent = (void *) ((char *) buf + off);
+            const char *c = ent->d_name;
+            int fd = 0;
+
+            off += ent->d_reclen;
+
+            if (!*c)
+                continue;
+            while (c_isdigit(*c) && fd < INT_MAX / 10)
+                fd = fd * 10 + (*c++ - '0');
+            if (*c)
+                continue;
+
+            if (fd < 3 || fd == dirfd ||
+                virCommandKeepFD(cmd, fd, childin, childout, childerr))
+                continue;
+
+            VIR_COMMAND_CLOSE_QUIET(fd);
+        }
+    }
+
+    VIR_COMMAND_CLOSE_QUIET(dirfd);
+    return nread < 0 ? -1 : 0;
+}
+# endif /* __linux__ */
+
+/*
+ * Close the gaps between the FDs to keep with one close_range() call
+ * each.
+ */
+static int
+virCommandMassCloseRanges(virCommandPtr cmd,
+                          int childin, int childout, int childerr)
+{
+# if defined(__linux__) && defined(SYS_close_range)
+    unsigned int from = 3;
+    int next;
+
+    while ((next = virCommandNextKeptFD(cmd, from,
+                                        childin, childout, childerr)) >= 0) {
+        if (next > from &&
+            syscall(SYS_close_range, from, next - 1, 0) < 0)
+            return -1;
+        from = next + 1;
+    }
+
+    return syscall(SYS_close_range, from, ~0U, 0) < 0 ? -1 : 0;
+# else
+    errno = ENOSYS;
+    return -1;
+# endif
+}
+
+/*
+ * virCommandMassClose:
+ *
+ * Close every FD from 3 up which the child of @cmd is not meant to
+ * inherit and make the passed ones inheritable.  With a large
+ * RLIMIT_NOFILE, closing every possible FD number costs a syscall per
+ * number, so use close_range() or the list in /proc where available.
+ * Only async-signal-safe functions are called, so this can be used
+ * after vfork().
+ *
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+static int
+virCommandMassClose(virCommandPtr cmd,
+                    int childin, int childout, int childerr)
+{
+    long openmax;
+    int fd;
+    size_t i;
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        if (virSetInherit(cmd->passfd[i].fd, true) < 0)
+            return -1;
+    }
+
+    if (virCommandMassCloseRanges(cmd, childin, childout, childerr) == 0)
+        return 0;
+
+# ifdef __linux__
+    if (virCommandMassCloseProc(cmd, childin, childout, childerr) == 0)
+        return 0;
+# endif
+
+    if ((openmax = sysconf(_SC_OPEN_MAX)) < 0)
+        return -1;
+
+    for (fd = 3; fd < openmax; fd++) {
+        int tmpfd = fd;
+
+        if (!virCommandKeepFD(cmd, fd, childin, childout, childerr))
+            VIR_COMMAND_CLOSE_QUIET(tmpfd);
+    }
+
+    return 0;
+}
+
+/*
+ * virExecCanVfork:
+ *
+ * Commands which need no more than stdio, passed FDs, environment and
+ * working directory set up can be started with vfork(), which avoids
+ * copying the page tables of a large daemon.  Anything which runs
+ * library code in the child needs a full fork().
+ */
+static bool
+virExecCanVfork(virCommandPtr cmd)
+{
+    if (cmd->hook || cmd->handshake ||
+        (cmd->flags & (VIR_EXEC_DAEMON | VIR_EXEC_CLEAR_CAPS)) ||
+        cmd->uid != (uid_t)-1 || cmd->gid != (gid_t)-1 ||
+        cmd->capabilities ||
+        cmd->maxMemLock || cmd->maxProcesses || cmd->maxFiles)
+        return false;
+
+# if defined(WITH_SECDRIVER_SELINUX)
+    if (cmd->seLinuxLabel)
+        return false;
+# endif
+# if defined(WITH_SECDRIVER_APPARMOR)
+    if (cmd->appArmorProfile)
+        return false;
+# endif
+
+    return true;
+}
+
+/*
+ * Report a failure of the vfork()ed child on its stderr, which is all
+ * it can safely do.
+ */
+static void
+virExecVforkChildError(const char *msg, const char *arg, int err)
+{
+    char ebuf[1024];
+
+    ignore_value(safewrite(STDERR_FILENO, msg, strlen(msg)));
+    if (arg) {
+        ignore_value(safewrite(STDERR_FILENO, " ", 1));
+        ignore_value(safewrite(STDERR_FILENO, arg, strlen(arg)));
+    }
+    virStrerror(err, ebuf, sizeof(ebuf));
+    ignore_value(safewrite(STDERR_FILENO, ": ", 2));
+    ignore_value(safewrite(STDERR_FILENO, ebuf, strlen(ebuf)));
+    ignore_value(safewrite(STDERR_FILENO, "\n", 1));
+}
+
+/*
+ * Child side of virExecVfork().  It shares memory with the suspended
+ * parent until it execs, so it must neither allocate, log, nor return.
+ */
+static void ATTRIBUTE_NORETURN
+virExecVforkChild(virCommandPtr cmd,
+                  const char *binary,
+                  int childin,
+                  int childout,
+                  int childerr,
+                  volatile int *execErrno)
+{
+    struct sigaction sig_action;
+    sigset_t newmask;
+    size_t i;
+
+    sig_action.sa_handler = SIG_DFL;
+    sig_action.sa_flags = 0;
+    sigemptyset(&sig_action.sa_mask);
+    for (i = 1; i < NSIG; i++)
+        ignore_value(sigaction(i, &sig_action, NULL));
+
+    if (virCommandMassClose(cmd, childin, childout, childerr) < 0) {
+        virExecVforkChildError("failed to close file handles", NULL, errno);
+        _exit(EXIT_CANCELED);
+    }
+
+    if (prepareStdFd(childin, STDIN_FILENO) < 0 ||
+        (childout > 0 && prepareStdFd(childout, STDOUT_FILENO) < 0) ||
+        (childerr > 0 && prepareStdFd(childerr, STDERR_FILENO) < 0)) {
+        virExecVforkChildError("failed to setup standard file handles",
+                               NULL, errno);
+        _exit(EXIT_CANCELED);
+    }
+
+    if (childin > STDERR_FILENO &&
+        childin != childerr && childin != childout)
+        VIR_COMMAND_CLOSE_QUIET(childin);
+    if (childout > STDERR_FILENO && childout != childerr)
+        VIR_COMMAND_CLOSE_QUIET(childout);
+    if (childerr > STDERR_FILENO)
+        VIR_COMMAND_CLOSE_QUIET(childerr);
+
+    if (cmd->pwd && chdir(cmd->pwd) < 0) {
+        virExecVforkChildError("Unable to change to", cmd->pwd, errno);
+        _exit(EXIT_CANCELED);
+    }
+
+    sigemptyset(&newmask);
+    if (sigprocmask(SIG_SETMASK, &newmask, NULL) < 0) {
+        virExecVforkChildError("cannot unblock signals", NULL, errno);
+        _exit(EXIT_CANCELED);
+    }
+
+    if (cmd->env)
+        execve(binary, cmd->args, cmd->env);
+    else
+        execv(binary, cmd->args);
+
+    *execErrno = errno;
+    virExecVforkChildError("cannot execute binary", cmd->args[0], errno);
+    _exit(errno == ENOENT ? EXIT_ENOENT : EXIT_CANNOT_INVOKE);
+}
+
+/*
+ * virExecVfork:
+ *
+ * Start @binary for @cmd with vfork(); see virExecCanVfork().
+ * Failures after the child was created are reported through its exit
+ * status and stderr, exactly like with virFork().
+ *
+ * Returns the pid of the child, or -1 on error.
+ */
+static pid_t
+virExecVfork(virCommandPtr cmd,
+             const char *binary,
+             int childin,
+             int childout,
+             int childerr)
+{
+    sigset_t oldmask, newmask;
+    volatile int execErrno = 0;
+    int saved_errno;
+    pid_t pid;
+
+    /* As in virFork(), keep the parent's signal handlers from running
+     * in the child before they are reset */
+    sigfillset(&newmask);
+    if (pthread_sigmask(SIG_SETMASK, &newmask, &oldmask) != 0) {
+        virReportSystemError(errno,
+                             "%s", _("cannot block signals"));
+        return -1;
+    }
+
+    pid = vfork();
+    if (pid == 0)
+        virExecVforkChild(cmd, binary, childin, childout, childerr,
+                          &execErrno);
+    saved_errno = errno;
+
+    ignore_value(pthread_sigmask(SIG_SETMASK, &oldmask, NULL));
+
+    if (pid < 0) {
+        virReportSystemError(saved_errno,
+                             "%s", _("cannot fork child process"));
+        return -1;
+    }
+
+    if (execErrno) {
+        char ebuf[1024];
+        VIR_DEBUG("Child %lld could not execute %s: %s",
+                  (long long) pid, binary,
+                  virStrerror(execErrno, ebuf, sizeof(ebuf)));
+    }
+
+    return pid;
+}
+
 /*
  * virExec:
  * @cmd virCommandPtr containing all information about the program to
@@ -396,13 +740,12 @@ static int
 virExec(virCommandPtr cmd)
 {
     pid_t pid;
-    int null = -1, fd, openmax;
+    int null = -1;
     int pipeout[2] = {-1, -1};
     int pipeerr[2] = {-1, -1};
     int childin = cmd->infd;
     int childout = -1;
     int childerr = -1;
-    int tmpfd;
     char *binarystr = NULL;
     const char *binary = NULL;
     int ret;
@@ -482,7 +825,10 @@ virExec(virCommandPtr cmd)
     if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
         goto cleanup;
 
-    pid = virFork();
+    if (virExecCanVfork(cmd))
+        pid = virExecVfork(cmd, binary, childin, childout, childerr);
+    else
+        pid = virFork();
 
     if (pid < 0) {
         goto cleanup;
@@ -510,23 +856,11 @@ virExec(virCommandPtr cmd)
     /* child */
 
     ret = EXIT_CANCELED;
-    openmax = sysconf(_SC_OPEN_MAX);
-    if (openmax < 0) {
-        virReportSystemError(errno,  "%s",
-                             _("sysconf(_SC_OPEN_MAX) failed"));
+    if (virCommandMassClose(cmd, childin, childout, childerr) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("failed to close file handles"));
         goto fork_error;
     }
-    for (fd = 3; fd < openmax; fd++) {
-        if (fd == childin || fd == childout || fd == childerr)
-            continue;
-        if (!virCommandFDIsSet(cmd, fd)) {
-            tmpfd = fd;
-            VIR_MASS_CLOSE(tmpfd);
-        } else if (virSetInherit(fd, true) < 0) {
-            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
-            goto fork_error;
-        }
-    }
 
     if (prepareStdFd(childin, STDIN_FILENO) < 0) {
         virReportSystemError(errno,
@@ -1807,6 +2141,7 @@ char *
 virCommandToString(virCommandPtr cmd)
 {
     size_t i;
+    size_t len = 0;
     virBuffer buf = VIR_BUFFER_INITIALIZER;
 
     /* Cannot assume virCommandRun will be called; so report the error
@@ -1821,6 +2156,15 @@ virCommandToString(virCommandPtr cmd)
         return NULL;
     }
 
+    /* Command lines such as QEMU's run to several kilobytes, so
+     * allocate for all of it at once; quoting may need a little more. */
+    for (i = 0; i < cmd->nenv; i++)
+        len += strlen(cmd->env[i]) + 1;
+    for (i = 0; i < cmd->nargs; i++)
+        len += strlen(cmd->args[i]) + 1;
+    if (len < UINT_MAX)
+        virBufferSizeHint(&buf, len);
+
     for (i = 0; i < cmd->nenv; i++) {
         /* In shell, a='b c' has a different meaning than 'a=b c', so
          * we must determine where the '=' lives.  */
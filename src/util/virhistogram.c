@@ -0,0 +1,129 @@
+/*
+ * virhistogram.c: logarithmic histograms of measured values
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * A histogram only keeps counts in power of two sized buckets, so
+ * it has a fixed size however many values were added, and reported
+ * percentiles are accurate to within a factor of two.
+ */
+
+#include <config.h>
+
+#include "virhistogram.h"
+
+static unsigned int
+virHistogramBucket(unsigned long long value)
+{
+    unsigned int bucket = 0;
+
+    while (value) {
+        value >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+
+/**
+ * virHistogramAdd:
+ * @hist: the histogram
+ * @value: value to account
+ *
+ * Account @value in @hist.  A zero-filled histogram is empty.
+ */
+void
+virHistogramAdd(virHistogramPtr hist,
+                unsigned long long value)
+{
+    if (!hist->count || value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[virHistogramBucket(value)]++;
+}
+
+
+/**
+ * virHistogramPercentile:
+ * @hist: the histogram
+ * @percent: percentile to compute, up to 100
+ *
+ * Returns an upper bound of the value below which @percent percent of
+ * the values accounted in @hist lie, never more than twice the exact
+ * value nor more than the maximum, or 0 if @hist is empty.
+ */
+unsigned long long
+virHistogramPercentile(const virHistogram *hist,
+                       unsigned int percent)
+{
+    unsigned long long rank;
+    unsigned long long seen = 0;
+    size_t i;
+
+    if (!hist->count)
+        return 0;
+
+    if (percent > 100)
+        percent = 100;
+
+    /* Number of values at or below the percentile, rounded up */
+    rank = (hist->count * percent + 99) / 100;
+    if (!rank)
+        return hist->min;
+
+    for (i = 0; i < VIR_HISTOGRAM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank)
+            break;
+    }
+
+    if (i == 0)
+        return 0;
+    if (i >= 64 || (1ULL << i) - 1 > hist->max)
+        return hist->max;
+    return (1ULL << i) - 1;
+}
+
+
+/**
+ * virHistogramFormat:
+ * @buf: buffer to format into
+ * @hist: the histogram
+ *
+ * Format a one line summary of @hist into @buf.
+ */
+void
+virHistogramFormat(virBufferPtr buf,
+                   const virHistogram *hist)
+{
+    virBufferAsprintf(buf, "count=%llu", hist->count);
+    if (!hist->count)
+        return;
+
+    virBufferAsprintf(buf,
+                      " min=%llu mean=%llu p50=%llu p90=%llu p99=%llu max=%llu",
+                      hist->min, hist->sum / hist->count,
+                      virHistogramPercentile(hist, 50),
+                      virHistogramPercentile(hist, 90),
+                      virHistogramPercentile(hist, 99),
+                      hist->max);
+}
@@ -0,0 +1,53 @@
+/*
+ * virhistogram.h: logarithmic histograms of measured values
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_HISTOGRAM_H__
+# define __VIR_HISTOGRAM_H__
+
+# include "internal.h"
+# include "virbuffer.h"
+
+/* Bucket 0 counts zeros, bucket N counts values in [2^(N-1), 2^N) */
+# define VIR_HISTOGRAM_BUCKETS 65
+
+typedef struct _virHistogram virHistogram;
+typedef virHistogram *virHistogramPtr;
+struct _virHistogram {
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long buckets[VIR_HISTOGRAM_BUCKETS];
+};
+
+void virHistogramAdd(virHistogramPtr hist,
+                     unsigned long long value)
+    ATTRIBUTE_NONNULL(1);
+
+unsigned long long virHistogramPercentile(const virHistogram *hist,
+                                          unsigned int percent)
+    ATTRIBUTE_NONNULL(1);
+
+void virHistogramFormat(virBufferPtr buf,
+                        const virHistogram *hist)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+#endif /* __VIR_HISTOGRAM_H__ */
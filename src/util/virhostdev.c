@@ -82,6 +82,7 @@ virHostdevManagerDispose(void *obj)
     virObjectUnref(hostdevMgr->inactivePCIHostdevs);
     virObjectUnref(hostdevMgr->activeUSBHostdevs);
     virObjectUnref(hostdevMgr->activeSCSIHostdevs);
+    virObjectUnref(hostdevMgr->pooledPCIHostdevs);
     VIR_FREE(hostdevMgr->stateDir);
 }
 
@@ -106,6 +107,9 @@ virHostdevManagerNew(void)
     if ((hostdevMgr->activeSCSIHostdevs = virSCSIDeviceListNew()) == NULL)
         goto error;
 
+    if ((hostdevMgr->pooledPCIHostdevs = virPCIDeviceListNew()) == NULL)
+        goto error;
+
     if (privileged) {
         if (VIR_STRDUP(hostdevMgr->stateDir, HOSTDEV_STATE_DIR) < 0)
             goto error;
@@ -484,6 +488,43 @@ virHostdevNetConfigRestore(virDomainHostdevDefPtr hostdev,
     return ret;
 }
 
+/*
+ * Pre-condition: inactivePCIHostdevs & activePCIHostdevs
+ * are locked
+ *
+ * Returns true if @dev is pooled, and was detached and reset
+ * already for use with the same stub driver it is still bound to.
+ */
+static bool
+virHostdevIsReadyPCIDevice(virHostdevManagerPtr mgr,
+                           virPCIDevicePtr dev)
+{
+    virPCIDevicePtr pooled;
+    char *drvPath = NULL;
+    char *drvName = NULL;
+    bool ret = false;
+
+    if (!(pooled = virPCIDeviceListFind(mgr->pooledPCIHostdevs, dev)) ||
+        !virPCIDeviceListFind(mgr->inactivePCIHostdevs, dev) ||
+        STRNEQ_NULLABLE(virPCIDeviceGetStubDriver(pooled),
+                        virPCIDeviceGetStubDriver(dev)))
+        return false;
+
+    /* The device may have been rebound since it was pooled, e.g. to
+     * the stub of the other PCI backend, so check what it is bound to */
+    if (virPCIDeviceGetDriverPathAndName(dev, &drvPath, &drvName) < 0) {
+        virResetLastError();
+        goto cleanup;
+    }
+
+    ret = STREQ_NULLABLE(drvName, virPCIDeviceGetStubDriver(dev));
+
+ cleanup:
+    VIR_FREE(drvPath);
+    VIR_FREE(drvName);
+    return ret;
+}
+
 int
 virHostdevPreparePCIDevices(virHostdevManagerPtr hostdev_mgr,
                             const char *drv_name,
@@ -494,6 +535,7 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr hostdev_mgr,
                             unsigned int flags)
 {
     virPCIDeviceListPtr pcidevs = NULL;
+    virPCIDeviceListPtr resetdevs = NULL;
     int last_processed_hostdev_vf = -1;
     size_t i;
     int ret = -1;
@@ -552,9 +594,28 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr hostdev_mgr,
         }
     }
 
-    /* Loop 2: detach managed devices (i.e. bind to appropriate stub driver) */
+    /* Pooled devices were detached and reset when they were put in
+     * the pool or released by their last guest, so only the others
+     * go through loops 2 and 3. resetdevs does not own its devices.
+     */
+    if (!(resetdevs = virPCIDeviceListNew()))
+        goto cleanup;
+
     for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
         virPCIDevicePtr dev = virPCIDeviceListGet(pcidevs, i);
+
+        if (virHostdevIsReadyPCIDevice(hostdev_mgr, dev)) {
+            VIR_DEBUG("Using pooled PCI device %s", virPCIDeviceGetName(dev));
+            continue;
+        }
+
+        if (virPCIDeviceListAdd(resetdevs, dev) < 0)
+            goto cleanup;
+    }
+
+    /* Loop 2: detach managed devices (i.e. bind to appropriate stub driver) */
+    for (i = 0; i < virPCIDeviceListCount(resetdevs); i++) {
+        virPCIDevicePtr dev = virPCIDeviceListGet(resetdevs, i);
         if (virPCIDeviceGetManaged(dev) &&
             virPCIDeviceDetach(dev, hostdev_mgr->activePCIHostdevs, NULL) < 0)
             goto reattachdevs;
@@ -562,13 +623,10 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr hostdev_mgr,
 
     /* Loop 3: Now that all the PCI hostdevs have been detached, we
      * can safely reset them */
-    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
-        virPCIDevicePtr dev = virPCIDeviceListGet(pcidevs, i);
-
-        if (virPCIDeviceReset(dev, hostdev_mgr->activePCIHostdevs,
-                              hostdev_mgr->inactivePCIHostdevs) < 0)
-            goto reattachdevs;
-    }
+    if (virPCIDeviceListReset(resetdevs, hostdev_mgr->activePCIHostdevs,
+                              hostdev_mgr->inactivePCIHostdevs,
+                              !!(flags & VIR_HOSTDEV_PARALLEL_RESET)) < 0)
+        goto reattachdevs;
 
     /* Loop 4: For SRIOV network devices, Now that we have detached the
      * the network device, set the netdev config */
@@ -679,6 +737,11 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr hostdev_mgr,
     }
 
  cleanup:
+    if (resetdevs) {
+        while (virPCIDeviceListCount(resetdevs) > 0)
+            virPCIDeviceListStealIndex(resetdevs, 0);
+        virObjectUnref(resetdevs);
+    }
     virObjectUnlock(hostdev_mgr->activePCIHostdevs);
     virObjectUnlock(hostdev_mgr->inactivePCIHostdevs);
     virObjectUnref(pcidevs);
@@ -692,10 +755,12 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr hostdev_mgr,
 static void
 virHostdevReattachPCIDevice(virPCIDevicePtr dev, virHostdevManagerPtr mgr)
 {
+    bool pooled = !!virPCIDeviceListFind(mgr->pooledPCIHostdevs, dev);
+
     /* If the device is not managed and was attached to guest
      * successfully, it must have been inactive.
      */
-    if (!virPCIDeviceGetManaged(dev)) {
+    if (!virPCIDeviceGetManaged(dev) && !pooled) {
         if (virPCIDeviceListAdd(mgr->inactivePCIHostdevs, dev) < 0)
             virPCIDeviceFree(dev);
         return;
@@ -711,6 +776,14 @@ virHostdevReattachPCIDevice(virPCIDevicePtr dev, virHostdevManagerPtr mgr)
         }
     }
 
+    /* Pooled devices were reset already and stay bound to the stub
+     * driver, ready for the next guest */
+    if (pooled) {
+        if (virPCIDeviceListAdd(mgr->inactivePCIHostdevs, dev) < 0)
+            virPCIDeviceFree(dev);
+        return;
+    }
+
     if (virPCIDeviceReattach(dev, mgr->activePCIHostdevs,
                              mgr->inactivePCIHostdevs) < 0) {
         virErrorPtr err = virGetLastError();
@@ -799,6 +872,9 @@ virHostdevReAttachPCIDevices(virHostdevManagerPtr hostdev_mgr,
             VIR_ERROR(_("Failed to reset PCI device: %s"),
                       err ? err->message : _("unknown error"));
             virResetError(err);
+
+            /* The next guest must not get a device in unknown state */
+            virPCIDeviceListDel(hostdev_mgr->pooledPCIHostdevs, dev);
         }
     }
 
@@ -1507,6 +1583,9 @@ virHostdevPCINodeDeviceReAttach(virHostdevManagerPtr hostdev_mgr,
                              hostdev_mgr->inactivePCIHostdevs) < 0)
         goto out;
 
+    /* Back to the host for good */
+    virPCIDeviceListDel(hostdev_mgr->pooledPCIHostdevs, pci);
+
     ret = 0;
  out:
     virObjectUnlock(hostdev_mgr->inactivePCIHostdevs);
@@ -1533,6 +1612,70 @@ virHostdevPCINodeDeviceReset(virHostdevManagerPtr hostdev_mgr,
     return ret;
 }
 
+/**
+ * virHostdevPCIPoolAdd:
+ * @hostdev_mgr: hostdev manager
+ * @pci: device to pool, with its stub driver set
+ *
+ * Detach @pci from its host driver and reset it, then keep it bound to
+ * the stub driver between guests: starting a guest with a pooled
+ * device skips both steps, and the device is reset when the guest
+ * using it stops instead of being given back to the host.
+ *
+ * A device already bound to the stub driver may be in use by a guest
+ * not known to be running yet, so it is left alone until released.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virHostdevPCIPoolAdd(virHostdevManagerPtr hostdev_mgr,
+                     virPCIDevicePtr pci)
+{
+    char *drvPath = NULL;
+    char *drvName = NULL;
+    bool bound;
+    int ret = -1;
+
+    virObjectLock(hostdev_mgr->activePCIHostdevs);
+    virObjectLock(hostdev_mgr->inactivePCIHostdevs);
+
+    if (virPCIDeviceListFind(hostdev_mgr->pooledPCIHostdevs, pci)) {
+        ret = 0;
+        goto out;
+    }
+
+    if (virPCIDeviceGetDriverPathAndName(pci, &drvPath, &drvName) < 0)
+        goto out;
+
+    bound = STREQ_NULLABLE(drvName, virPCIDeviceGetStubDriver(pci));
+
+    if (!bound || virPCIDeviceListFind(hostdev_mgr->inactivePCIHostdevs, pci)) {
+        if (virPCIDeviceDetach(pci, hostdev_mgr->activePCIHostdevs,
+                               hostdev_mgr->inactivePCIHostdevs) < 0)
+            goto out;
+
+        if (virPCIDeviceReset(pci, hostdev_mgr->activePCIHostdevs,
+                              hostdev_mgr->inactivePCIHostdevs) < 0) {
+            if (!bound)
+                ignore_value(virPCIDeviceReattach(pci,
+                                                  hostdev_mgr->activePCIHostdevs,
+                                                  hostdev_mgr->inactivePCIHostdevs));
+            goto out;
+        }
+    }
+
+    if (virPCIDeviceListAddCopy(hostdev_mgr->pooledPCIHostdevs, pci) < 0)
+        goto out;
+
+    ret = 0;
+ out:
+    virObjectUnlock(hostdev_mgr->inactivePCIHostdevs);
+    virObjectUnlock(hostdev_mgr->activePCIHostdevs);
+    VIR_FREE(drvPath);
+    VIR_FREE(drvName);
+    return ret;
+}
+
 int
 virHostdevPrepareDomainDevices(virHostdevManagerPtr mgr,
                                const char *driver,
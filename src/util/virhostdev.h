@@ -35,6 +35,7 @@
 typedef enum {
     VIR_HOSTDEV_STRICT_ACS_CHECK     = (1 << 0), /* strict acs check */
     VIR_HOSTDEV_COLD_BOOT            = (1 << 1), /* cold boot */
+    VIR_HOSTDEV_PARALLEL_RESET       = (1 << 2), /* reset PCI buses concurrently */
 
     VIR_HOSTDEV_SP_PCI               = (1 << 8), /* support pci passthrough */
     VIR_HOSTDEV_SP_USB               = (1 << 9), /* support usb passthrough */
@@ -53,6 +54,11 @@ struct _virHostdevManager {
     virPCIDeviceListPtr inactivePCIHostdevs;
     virUSBDeviceListPtr activeUSBHostdevs;
     virSCSIDeviceListPtr activeSCSIHostdevs;
+
+    /* PCI devices kept bound to their stub driver between guests.
+     * Those also on inactivePCIHostdevs are reset and ready to be
+     * assigned. Only used with both PCI lists above locked. */
+    virPCIDeviceListPtr pooledPCIHostdevs;
 };
 
 virHostdevManagerPtr virHostdevManagerGetDefault(void);
@@ -154,5 +160,8 @@ int virHostdevPCINodeDeviceReAttach(virHostdevManagerPtr mgr,
 int virHostdevPCINodeDeviceReset(virHostdevManagerPtr mgr,
                                  virPCIDevicePtr pci)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+int virHostdevPCIPoolAdd(virHostdevManagerPtr mgr,
+                         virPCIDevicePtr pci)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
 #endif /* __VIR_HOSTDEV_H__ */
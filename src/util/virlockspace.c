@@ -30,6 +30,7 @@
 #include "virhash.h"
 #include "virthread.h"
 #include "virstring.h"
+#include "intprops.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -59,8 +60,14 @@ struct _virLockSpace {
     virMutex lock;
 
     virHashTablePtr resources;
+    /* Index of the resources held by each owner: maps the owner pid
+     * to a table of resource name -> number of times it is held, so
+     * that releasing an owner does not have to scan every resource */
+    virHashTablePtr owners;
 };
 
+#define VIR_LOCKSPACE_OWNER_KEY_LEN INT_BUFSIZE_BOUND(long long)
+
 
 static char *virLockSpaceGetResourcePath(virLockSpacePtr lockspace,
                                          const char *resname)
@@ -239,6 +246,69 @@ static void virLockSpaceResourceDataFree(void *opaque, const void *name ATTRIBUT
 }
 
 
+static void virLockSpaceOwnerDataFree(void *opaque, const void *name ATTRIBUTE_UNUSED)
+{
+    virHashFree(opaque);
+}
+
+
+static void virLockSpaceOwnerKey(pid_t owner,
+                                 char key[VIR_LOCKSPACE_OWNER_KEY_LEN])
+{
+    snprintf(key, VIR_LOCKSPACE_OWNER_KEY_LEN, "%lld", (long long)owner);
+}
+
+
+static int virLockSpaceOwnerAdd(virLockSpacePtr lockspace,
+                                pid_t owner,
+                                const char *resname)
+{
+    char key[VIR_LOCKSPACE_OWNER_KEY_LEN];
+    virHashTablePtr held;
+    size_t count;
+
+    virLockSpaceOwnerKey(owner, key);
+
+    if (!(held = virHashLookup(lockspace->owners, key))) {
+        if (!(held = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE, NULL)))
+            return -1;
+
+        if (virHashAddEntry(lockspace->owners, key, held) < 0) {
+            virHashFree(held);
+            return -1;
+        }
+    }
+
+    count = (size_t)virHashLookup(held, resname);
+
+    return virHashUpdateEntry(held, resname, (void *)(count + 1));
+}
+
+
+static void virLockSpaceOwnerRemove(virLockSpacePtr lockspace,
+                                    pid_t owner,
+                                    const char *resname)
+{
+    char key[VIR_LOCKSPACE_OWNER_KEY_LEN];
+    virHashTablePtr held;
+    size_t count;
+
+    virLockSpaceOwnerKey(owner, key);
+
+    if (!(held = virHashLookup(lockspace->owners, key)) ||
+        !(count = (size_t)virHashLookup(held, resname)))
+        return;
+
+    if (count > 1)
+        ignore_value(virHashUpdateEntry(held, resname, (void *)(count - 1)));
+    else
+        ignore_value(virHashRemoveEntry(held, resname));
+
+    if (virHashSize(held) == 0)
+        ignore_value(virHashRemoveEntry(lockspace->owners, key));
+}
+
+
 virLockSpacePtr virLockSpaceNew(const char *directory)
 {
     virLockSpacePtr lockspace;
@@ -262,6 +332,10 @@ virLockSpacePtr virLockSpaceNew(const char *directory)
                                                virLockSpaceResourceDataFree)))
         goto error;
 
+    if (!(lockspace->owners = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
+                                            virLockSpaceOwnerDataFree)))
+        goto error;
+
     if (directory) {
         if (virFileExists(directory)) {
             if (!virFileIsDir(directory)) {
@@ -312,6 +386,10 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
                                                virLockSpaceResourceDataFree)))
         goto error;
 
+    if (!(lockspace->owners = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
+                                            virLockSpaceOwnerDataFree)))
+        goto error;
+
     if (virJSONValueObjectHasKey(object, "directory")) {
         const char *dir = virJSONValueObjectGetString(object, "directory");
         if (VIR_STRDUP(lockspace->dir, dir) < 0)
@@ -427,6 +505,11 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
             virLockSpaceResourceFree(res);
             goto error;
         }
+
+        for (j = 0; j < res->nOwners; j++) {
+            if (virLockSpaceOwnerAdd(lockspace, res->owners[j], res->name) < 0)
+                goto error;
+        }
     }
 
     return lockspace;
@@ -527,6 +610,7 @@ void virLockSpaceFree(virLockSpacePtr lockspace)
     if (!lockspace)
         return;
 
+    virHashFree(lockspace->owners);
     virHashFree(lockspace->resources);
     VIR_FREE(lockspace->dir);
     virMutexDestroy(&lockspace->lock);
@@ -633,6 +717,11 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
                 goto cleanup;
             res->owners[res->nOwners-1] = owner;
 
+            if (virLockSpaceOwnerAdd(lockspace, owner, resname) < 0) {
+                VIR_SHRINK_N(res->owners, res->nOwners, 1);
+                goto cleanup;
+            }
+
             goto done;
         }
         virReportError(VIR_ERR_RESOURCE_BUSY,
@@ -649,6 +738,11 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
         goto cleanup;
     }
 
+    if (virLockSpaceOwnerAdd(lockspace, owner, resname) < 0) {
+        ignore_value(virHashRemoveEntry(lockspace->resources, resname));
+        goto cleanup;
+    }
+
  done:
     ret = 0;
 
@@ -692,6 +786,7 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
     }
 
     VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
+    virLockSpaceOwnerRemove(lockspace, owner, resname);
 
     if ((res->nOwners == 0) &&
         virHashRemoveEntry(lockspace->resources, resname) < 0)
@@ -705,69 +800,145 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
 }
 
 
+/**
+ * virLockSpaceAcquireResources:
+ * @lockspaces: the lockspace of each resource
+ * @resnames: the name of each resource
+ * @flags: the virLockSpaceAcquireFlags of each resource
+ * @nresources: the number of resources
+ * @owner: the process acquiring the resources
+ *
+ * Acquire all the resources for @owner, or none of them: if one of
+ * them cannot be acquired, the ones acquired before are released.
+ *
+ * Returns 0 on success, -1 on error with the error of the resource
+ * which could not be acquired reported
+ */
+int virLockSpaceAcquireResources(virLockSpacePtr *lockspaces,
+                                 const char **resnames,
+                                 const unsigned int *flags,
+                                 size_t nresources,
+                                 pid_t owner)
+{
+    virErrorPtr err;
+    size_t i;
+
+    for (i = 0; i < nresources; i++) {
+        if (virLockSpaceAcquireResource(lockspaces[i], resnames[i],
+                                        owner, flags[i]) < 0)
+            goto rollback;
+    }
+
+    return 0;
+
+ rollback:
+    err = virSaveLastError();
+    while (i > 0) {
+        i--;
+        if (virLockSpaceReleaseResource(lockspaces[i], resnames[i], owner) < 0)
+            VIR_WARN("Unable to release resource %s", resnames[i]);
+    }
+    virSetError(err);
+    virFreeError(err);
+    return -1;
+}
+
+
+/**
+ * virLockSpaceReleaseResources:
+ * @lockspaces: the lockspace of each resource
+ * @resnames: the name of each resource
+ * @nresources: the number of resources
+ * @owner: the process releasing the resources
+ *
+ * Release as many of the resources held by @owner as possible.
+ *
+ * Returns 0 on success, -1 on error with the error of the first
+ * resource which could not be released reported
+ */
+int virLockSpaceReleaseResources(virLockSpacePtr *lockspaces,
+                                 const char **resnames,
+                                 size_t nresources,
+                                 pid_t owner)
+{
+    virErrorPtr err = NULL;
+    size_t i;
+
+    for (i = 0; i < nresources; i++) {
+        if (virLockSpaceReleaseResource(lockspaces[i], resnames[i],
+                                        owner) < 0 && !err)
+            err = virSaveLastError();
+    }
+
+    if (!err)
+        return 0;
+
+    virSetError(err);
+    virFreeError(err);
+    return -1;
+}
+
+
 struct virLockSpaceRemoveData {
+    virLockSpacePtr lockspace;
     pid_t owner;
     size_t count;
 };
 
 
-static int
-virLockSpaceRemoveResourcesForOwner(const void *payload,
-                                    const void *name ATTRIBUTE_UNUSED,
-                                    const void *opaque)
+static void
+virLockSpaceRemoveResourcesForOwner(void *payload ATTRIBUTE_UNUSED,
+                                    const void *name,
+                                    void *opaque)
 {
-    virLockSpaceResourcePtr res = (virLockSpaceResourcePtr)payload;
-    struct virLockSpaceRemoveData *data = (struct virLockSpaceRemoveData *)opaque;
+    struct virLockSpaceRemoveData *data = opaque;
+    virLockSpaceResourcePtr res;
     size_t i;
 
+    if (!(res = virHashLookup(data->lockspace->resources, name)))
+        return;
+
     VIR_DEBUG("res %s owner %lld", res->name, (unsigned long long)data->owner);
 
-    for (i = 0; i < res->nOwners; i++) {
-        if (res->owners[i] == data->owner) {
-            break;
-        }
+    /* The owner may hold a shared resource more than once */
+    i = res->nOwners;
+    while (i--) {
+        if (res->owners[i] == data->owner)
+            VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
     }
 
-    if (i == res->nOwners)
-        return 0;
-
     data->count++;
 
-    VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
-
     if (res->nOwners) {
         VIR_DEBUG("Other shared owners remain");
-        return 0;
+        return;
     }
 
     VIR_DEBUG("No more owners, remove it");
-    return 1;
+    ignore_value(virHashRemoveEntry(data->lockspace->resources, name));
 }
 
 
 int virLockSpaceReleaseResourcesForOwner(virLockSpacePtr lockspace,
                                          pid_t owner)
 {
-    int ret = 0;
+    char key[VIR_LOCKSPACE_OWNER_KEY_LEN];
+    virHashTablePtr held;
     struct virLockSpaceRemoveData data = {
-        owner, 0
+        lockspace, owner, 0
     };
 
     VIR_DEBUG("lockspace=%p owner=%lld", lockspace, (unsigned long long)owner);
 
     virMutexLock(&lockspace->lock);
 
-    if (virHashRemoveSet(lockspace->resources,
-                         virLockSpaceRemoveResourcesForOwner,
-                         &data) < 0)
-        goto error;
-
-    ret = data.count;
-
-    virMutexUnlock(&lockspace->lock);
-    return ret;
+    /* Only visit the resources this owner holds */
+    virLockSpaceOwnerKey(owner, key);
+    if ((held = virHashSteal(lockspace->owners, key))) {
+        virHashForEach(held, virLockSpaceRemoveResourcesForOwner, &data);
+        virHashFree(held);
+    }
 
- error:
     virMutexUnlock(&lockspace->lock);
-    return -1;
+    return data.count;
 }
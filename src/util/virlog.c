@@ -32,6 +32,8 @@
 #include <unistd.h>
 #include <execinfo.h>
 #include <regex.h>
+#include <signal.h>
+#include <sys/uio.h>
 #if HAVE_SYSLOG_H
 # include <syslog.h>
 #endif
@@ -46,6 +48,7 @@
 #include "virutil.h"
 #include "virbuffer.h"
 #include "virthread.h"
+#include "viratomic.h"
 #include "virfile.h"
 #include "virtime.h"
 #include "intprops.h"
@@ -85,7 +88,7 @@ struct _virLogFilter {
 typedef struct _virLogFilter virLogFilter;
 typedef virLogFilter *virLogFilterPtr;
 
-static int virLogFiltersSerial = 1;
+int virLogFiltersSerial = 1;
 static virLogFilterPtr virLogFilters = NULL;
 static int virLogNbFilters = 0;
 
@@ -95,6 +98,7 @@ static int virLogNbFilters = 0;
  */
 struct _virLogOutput {
     bool logVersion;
+    bool async;
     void *data;
     virLogOutputFunc f;
     virLogCloseFunc c;
@@ -219,6 +223,7 @@ virLogReset(void)
     virLogResetFilters();
     virLogResetOutputs();
     virLogDefaultPriority = VIR_LOG_DEFAULT;
+    virLogFiltersSerial++;
     virLogUnlock();
     return 0;
 }
@@ -243,7 +248,10 @@ virLogSetDefaultPriority(virLogPriority priority)
     if (virLogInitialize() < 0)
         return -1;
 
+    virLogLock();
     virLogDefaultPriority = priority;
+    virLogFiltersSerial++;
+    virLogUnlock();
     return 0;
 }
 
@@ -360,10 +368,12 @@ virLogResetOutputs(void)
  * @priority: minimal priority for this filter, use 0 for none
  * @dest: where to send output of this priority
  * @name: optional name data associated with an output
- * @flags: extra flag, currently unused
+ * @flags: bitwise-OR of virLogOutputFlags
  *
  * Defines an output function for log messages. Each message once
  * gone though filtering is emitted through each registered output.
+ * VIR_LOG_OUTPUT_ASYNC only records that @f hands messages over to
+ * the asynchronous writer, so that virLogGetOutputs() reports it.
  *
  * Returns -1 in case of failure or the output number if successful
  */
@@ -379,7 +389,7 @@ virLogDefineOutput(virLogOutputFunc f,
     int ret = -1;
     char *ndup = NULL;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_LOG_OUTPUT_ASYNC, -1);
 
     if (virLogInitialize() < 0)
         return -1;
@@ -403,6 +413,7 @@ virLogDefineOutput(virLogOutputFunc f,
     }
     ret = virLogNbOutputs++;
     virLogOutputs[ret].logVersion = true;
+    virLogOutputs[ret].async = !!(flags & VIR_LOG_OUTPUT_ASYNC);
     virLogOutputs[ret].f = f;
     virLogOutputs[ret].c = c;
     virLogOutputs[ret].data = data;
@@ -466,9 +477,20 @@ virLogVersionString(const char **rawmsg,
 }
 
 
-static void
+/**
+ * virLogSourceUpdate:
+ * @source: the log source
+ *
+ * Compute the priority and flags of @source from the current default
+ * priority and filters.  The result is cached in @source until
+ * virLogFiltersSerial changes.
+ */
+void
 virLogSourceUpdate(virLogSourcePtr source)
 {
+    if (virLogInitialize() < 0)
+        return;
+
     virLogLock();
     if (source->serial < virLogFiltersSerial) {
         unsigned int priority = virLogDefaultPriority;
@@ -699,11 +721,383 @@ virLogCloseFd(void *data)
 }
 
 
+/*
+ * Asynchronous outputs
+ *
+ * Writing to a file or stderr while holding virLogLock serializes
+ * every logging thread on disk I/O, which hurts badly with debug
+ * filters enabled.  Asynchronous outputs instead append the formatted
+ * message to a ring buffer which a writer thread drains with
+ * writev().  Messages are appended from virLogVMessage() with
+ * virLogLock held, so there is a single producer and a single
+ * consumer at any time and the ring positions only need atomic
+ * accesses.  When the ring is full messages are dropped, and the
+ * number of dropped messages is logged once there is room again.
+ */
+#define VIR_LOG_ASYNC_RING_SIZE (4 * 1024 * 1024)
+#define VIR_LOG_ASYNC_MAX_IOV 64
+
+typedef struct _virLogAsyncRecord virLogAsyncRecord;
+typedef virLogAsyncRecord *virLogAsyncRecordPtr;
+struct _virLogAsyncRecord {
+    int fd; /* -1 for padding up to the end of the ring */
+    int len; /* length of the message following the record */
+};
+
+#define VIR_LOG_ASYNC_RECORD_SIZE(len) \
+    VIR_ROUND_UP(sizeof(virLogAsyncRecord) + (len), sizeof(virLogAsyncRecord))
+
+static char *virLogAsyncRing;
+/* Positions are free running and only taken modulo the ring size */
+static int virLogAsyncHead; /* advanced by the producer */
+static int virLogAsyncTail; /* advanced by the consumer */
+static unsigned long long virLogAsyncDropped; /* under virLogLock */
+static pid_t virLogAsyncPid;
+static virMutex virLogAsyncDrainLock;
+static virMutex virLogAsyncWaitLock;
+static virCond virLogAsyncCond;
+static virThread virLogAsyncThread;
+
+static virLogAsyncRecordPtr
+virLogAsyncRecordAt(unsigned int pos)
+{
+    return (virLogAsyncRecordPtr) (virLogAsyncRing +
+                                   pos % VIR_LOG_ASYNC_RING_SIZE);
+}
+
+
+/* Write all of @iov, giving up on errors as synchronous outputs do */
+static void
+virLogAsyncWritev(int fd, struct iovec *iov, int niov)
+{
+    while (niov > 0) {
+        ssize_t done = writev(fd, iov, niov);
+
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        while (niov > 0 && done >= (ssize_t) iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if (niov > 0) {
+            iov->iov_base = (char *) iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+
+/* Write out everything queued, batching consecutive messages for the
+ * same FD.  Must be called with virLogAsyncDrainLock held. */
+static void
+virLogAsyncDrain(void)
+{
+    struct iovec iov[VIR_LOG_ASYNC_MAX_IOV];
+    unsigned int head = virAtomicIntGet(&virLogAsyncHead);
+    unsigned int tail = virAtomicIntGet(&virLogAsyncTail);
+    int niov = 0;
+    int fd = -1;
+
+    while (tail != head) {
+        virLogAsyncRecordPtr rec = virLogAsyncRecordAt(tail);
+
+        if (rec->fd >= 0) {
+            if (niov && (rec->fd != fd || niov == VIR_LOG_ASYNC_MAX_IOV)) {
+                virLogAsyncWritev(fd, iov, niov);
+                niov = 0;
+                /* Give the space back as soon as possible */
+                virAtomicIntSet(&virLogAsyncTail, tail);
+            }
+            fd = rec->fd;
+            iov[niov].iov_base = rec + 1;
+            iov[niov].iov_len = rec->len;
+            niov++;
+        }
+
+        tail += VIR_LOG_ASYNC_RECORD_SIZE(rec->len);
+    }
+
+    if (niov)
+        virLogAsyncWritev(fd, iov, niov);
+    virAtomicIntSet(&virLogAsyncTail, tail);
+}
+
+
+/**
+ * virLogFlush:
+ *
+ * Write out all messages queued for asynchronous outputs.  A child
+ * process which inherited the queue discards it instead, as the
+ * messages belong to its parent.
+ */
+void
+virLogFlush(void)
+{
+    if (!virLogAsyncRing)
+        return;
+
+    if (getpid() != virLogAsyncPid) {
+        virAtomicIntSet(&virLogAsyncTail, virAtomicIntGet(&virLogAsyncHead));
+        return;
+    }
+
+    virMutexLock(&virLogAsyncDrainLock);
+    virLogAsyncDrain();
+    virMutexUnlock(&virLogAsyncDrainLock);
+}
+
+
+static void
+virLogAsyncWriter(void *opaque ATTRIBUTE_UNUSED)
+{
+    for (;;) {
+        virMutexLock(&virLogAsyncWaitLock);
+        while (virAtomicIntGet(&virLogAsyncHead) ==
+               virAtomicIntGet(&virLogAsyncTail)) {
+            unsigned long long now;
+
+            if (virTimeMillisNow(&now) < 0)
+                now = 0;
+            ignore_value(virCondWaitUntil(&virLogAsyncCond,
+                                          &virLogAsyncWaitLock, now + 1000));
+        }
+        virMutexUnlock(&virLogAsyncWaitLock);
+
+        virLogFlush();
+    }
+}
+
+
+/*
+ * Last chance to get the queued messages out when the process is
+ * about to die.  This can race with the writer thread and duplicate a
+ * few messages, which is better than losing the ones explaining the
+ * crash.  Only async-signal-safe calls here.
+ */
+static void
+virLogAsyncFatalSignal(int sig)
+{
+    unsigned int head = virAtomicIntGet(&virLogAsyncHead);
+    unsigned int tail = virAtomicIntGet(&virLogAsyncTail);
+
+    if (getpid() == virLogAsyncPid) {
+        while (tail != head) {
+            virLogAsyncRecordPtr rec = virLogAsyncRecordAt(tail);
+
+            if (rec->fd >= 0)
+                ignore_value(safewrite(rec->fd, rec + 1, rec->len));
+            tail += VIR_LOG_ASYNC_RECORD_SIZE(rec->len);
+        }
+        virAtomicIntSet(&virLogAsyncTail, tail);
+    }
+
+    /* SA_RESETHAND restored the default action */
+    raise(sig);
+}
+
+
+static void
+virLogAsyncAtExit(void)
+{
+    virLogFlush();
+}
+
+
 static int
-virLogAddOutputToStderr(virLogPriority priority)
+virLogAsyncOnceInit(void)
 {
-    if (virLogDefineOutput(virLogOutputToFd, NULL, (void *)2L, priority,
-                           VIR_LOG_TO_STDERR, NULL, 0) < 0)
+    int fatal[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV };
+    struct sigaction sa;
+    size_t i;
+
+    if (VIR_ALLOC_N_QUIET(virLogAsyncRing, VIR_LOG_ASYNC_RING_SIZE) < 0)
+        return -1;
+
+    if (virMutexInit(&virLogAsyncDrainLock) < 0 ||
+        virMutexInit(&virLogAsyncWaitLock) < 0 ||
+        virCondInit(&virLogAsyncCond) < 0)
+        goto error;
+
+    virLogAsyncPid = getpid();
+
+    if (virThreadCreate(&virLogAsyncThread, false,
+                        virLogAsyncWriter, NULL) < 0)
+        goto error;
+
+    ignore_value(atexit(virLogAsyncAtExit));
+
+    /* Don't override handlers the application installed itself */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = virLogAsyncFatalSignal;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for (i = 0; i < ARRAY_CARDINALITY(fatal); i++) {
+        struct sigaction old;
+
+        if (sigaction(fatal[i], NULL, &old) == 0 &&
+            !(old.sa_flags & SA_SIGINFO) && old.sa_handler == SIG_DFL)
+            ignore_value(sigaction(fatal[i], &sa, NULL));
+    }
+
+    return 0;
+
+ error:
+    VIR_FREE(virLogAsyncRing);
+    return -1;
+}
+
+VIR_ONCE_GLOBAL_INIT(virLogAsync)
+
+
+/*
+ * Queue "@timestamp: @str" for @fd.  Called with virLogLock held.
+ * Returns -1 if there is no room for it.
+ */
+static int
+virLogAsyncAppend(int fd, const char *timestamp, const char *str)
+{
+    size_t tslen = strlen(timestamp);
+    size_t len = strlen(str);
+    unsigned int head = virAtomicIntGet(&virLogAsyncHead);
+    unsigned int used = head - virAtomicIntGet(&virLogAsyncTail);
+    unsigned int offset = head % VIR_LOG_ASYNC_RING_SIZE;
+    unsigned int pad = 0;
+    virLogAsyncRecordPtr rec;
+    size_t need;
+    char *text;
+
+    if (tslen + 2 + len > VIR_LOG_ASYNC_RING_SIZE)
+        return -1;
+    need = VIR_LOG_ASYNC_RECORD_SIZE(tslen + 2 + len);
+
+    /* Records are contiguous; skip the end of the ring if necessary */
+    if (offset + need > VIR_LOG_ASYNC_RING_SIZE)
+        pad = VIR_LOG_ASYNC_RING_SIZE - offset;
+
+    if (pad + need > VIR_LOG_ASYNC_RING_SIZE - used)
+        return -1;
+
+    if (pad) {
+        rec = virLogAsyncRecordAt(head);
+        rec->fd = -1;
+        rec->len = pad - sizeof(*rec);
+        head += pad;
+    }
+
+    rec = virLogAsyncRecordAt(head);
+    rec->fd = fd;
+    rec->len = tslen + 2 + len;
+    text = (char *) (rec + 1);
+    memcpy(text, timestamp, tslen);
+    memcpy(text + tslen, ": ", 2);
+    memcpy(text + tslen + 2, str, len);
+
+    virAtomicIntSet(&virLogAsyncHead, head + need);
+
+    /* Wake the writer up if it may be waiting for messages */
+    if (used == 0) {
+        virMutexLock(&virLogAsyncWaitLock);
+        virCondSignal(&virLogAsyncCond);
+        virMutexUnlock(&virLogAsyncWaitLock);
+    }
+
+    return 0;
+}
+
+
+static void
+virLogOutputToFdAsync(virLogSourcePtr source,
+                      virLogPriority priority,
+                      const char *filename,
+                      int linenr,
+                      const char *funcname,
+                      const char *timestamp,
+                      virLogMetadataPtr metadata,
+                      unsigned int flags,
+                      const char *rawstr,
+                      const char *str,
+                      void *data)
+{
+    int fd = (intptr_t) data;
+
+    if (fd < 0)
+        return;
+
+    /* The stack trace is written directly, keep it in order */
+    if (flags & VIR_LOG_STACK_TRACE) {
+        virLogFlush();
+        virLogOutputToFd(source, priority, filename, linenr, funcname,
+                         timestamp, metadata, flags, rawstr, str, data);
+        return;
+    }
+
+    if (virLogAsyncDropped) {
+        char *notice;
+
+        if (virAsprintfQuiet(&notice,
+                             "%llu: warning : %llu log messages dropped\n",
+                             virThreadSelfID(), virLogAsyncDropped) < 0 ||
+            virLogAsyncAppend(fd, timestamp, notice) < 0) {
+            VIR_FREE(notice);
+            virLogAsyncDropped++;
+            return;
+        }
+        VIR_FREE(notice);
+        virLogAsyncDropped = 0;
+    }
+
+    if (virLogAsyncAppend(fd, timestamp, str) < 0)
+        virLogAsyncDropped++;
+}
+
+
+static void
+virLogCloseFdAsync(void *data)
+{
+    int fd = (intptr_t) data;
+
+    virLogFlush();
+    if (fd > STDERR_FILENO)
+        VIR_LOG_CLOSE(fd);
+}
+
+
+/*
+ * Define an output writing to @fd, through the asynchronous writer
+ * if @async is true and it can be used.
+ */
+static int
+virLogDefineOutputToFd(int fd,
+                       bool async,
+                       virLogPriority priority,
+                       virLogDestination dest,
+                       const char *name)
+{
+    virLogCloseFunc closefn = fd > STDERR_FILENO ? virLogCloseFd : NULL;
+
+    /* A child process has no writer thread */
+    if (async &&
+        virLogAsyncInitialize() == 0 &&
+        getpid() == virLogAsyncPid)
+        return virLogDefineOutput(virLogOutputToFdAsync, virLogCloseFdAsync,
+                                  (void *)(intptr_t)fd, priority, dest, name,
+                                  VIR_LOG_OUTPUT_ASYNC);
+
+    return virLogDefineOutput(virLogOutputToFd, closefn,
+                              (void *)(intptr_t)fd, priority, dest, name, 0);
+}
+
+
+static int
+virLogAddOutputToStderr(virLogPriority priority, bool async)
+{
+    if (virLogDefineOutputToFd(STDERR_FILENO, async, priority,
+                               VIR_LOG_TO_STDERR, NULL) < 0)
         return -1;
     return 0;
 }
@@ -711,16 +1105,16 @@ virLogAddOutputToStderr(virLogPriority priority)
 
 static int
 virLogAddOutputToFile(virLogPriority priority,
-                      const char *file)
+                      const char *file,
+                      bool async)
 {
     int fd;
 
     fd = open(file, O_CREAT | O_APPEND | O_WRONLY, S_IRUSR | S_IWUSR);
     if (fd < 0)
         return -1;
-    if (virLogDefineOutput(virLogOutputToFd, virLogCloseFd,
-                           (void *)(intptr_t)fd,
-                           priority, VIR_LOG_TO_FILE, file, 0) < 0) {
+    if (virLogDefineOutputToFd(fd, async, priority,
+                               VIR_LOG_TO_FILE, file) < 0) {
         VIR_FORCE_CLOSE(fd);
         return -1;
     }
@@ -1074,6 +1468,10 @@ int virLogPriorityFromSyslog(int priority ATTRIBUTE_UNUSED)
  *       use syslog for the output and use the given name as the ident
  *    x:file:file_path
  *       output to a file, with the given filepath
+ *    x:async:stderr
+ *    x:async:file:file_path
+ *       same as above, but the messages are written out by a separate
+ *       thread instead of the logging one
  * In all case the x prefix is the minimal level, acting as a filter
  *    1: DEBUG
  *    2: INFO
@@ -1098,6 +1496,7 @@ virLogParseOutputs(const char *outputs)
     int ret = -1;
     int count = 0;
     bool isSUID = virIsSUID();
+    bool async;
 
     if (cur == NULL)
         return -1;
@@ -1112,9 +1511,16 @@ virLogParseOutputs(const char *outputs)
         if (*cur != ':')
             goto cleanup;
         cur++;
+        async = false;
+        if (STREQLEN(cur, "async:", 6)) {
+            cur += 6;
+            async = true;
+            if (!STREQLEN(cur, "stderr", 6) && !STREQLEN(cur, "file", 4))
+                goto cleanup;
+        }
         if (STREQLEN(cur, "stderr", 6)) {
             cur += 6;
-            if (virLogAddOutputToStderr(prio) == 0)
+            if (virLogAddOutputToStderr(prio, async) == 0)
                 count++;
         } else if (STREQLEN(cur, "syslog", 6)) {
             if (isSUID)
@@ -1153,7 +1559,7 @@ virLogParseOutputs(const char *outputs)
                 VIR_FREE(name);
                 return -1; /* skip warning here because setting was fine */
             }
-            if (virLogAddOutputToFile(prio, abspath) == 0)
+            if (virLogAddOutputToFile(prio, abspath, async) == 0)
                 count++;
             VIR_FREE(name);
             VIR_FREE(abspath);
@@ -1308,14 +1714,16 @@ virLogGetOutputs(void)
         switch (dest) {
             case VIR_LOG_TO_SYSLOG:
             case VIR_LOG_TO_FILE:
-                virBufferAsprintf(&outputbuf, "%d:%s:%s",
+                virBufferAsprintf(&outputbuf, "%d:%s%s:%s",
                                   virLogOutputs[i].priority,
+                                  virLogOutputs[i].async ? "async:" : "",
                                   virLogOutputString(dest),
                                   virLogOutputs[i].name);
                 break;
             default:
-                virBufferAsprintf(&outputbuf, "%d:%s",
+                virBufferAsprintf(&outputbuf, "%d:%s%s",
                                   virLogOutputs[i].priority,
+                                  virLogOutputs[i].async ? "async:" : "",
                                   virLogOutputString(dest));
         }
     }
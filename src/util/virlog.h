@@ -67,6 +67,37 @@ struct _virLogSource {
         .flags = 0,                                     \
     };
 
+/* Bumped whenever the priority of a source may have changed */
+extern int virLogFiltersSerial;
+
+extern void virLogSourceUpdate(virLogSourcePtr source);
+
+/**
+ * virLogSourceEnabled:
+ * @source: where the message would come from
+ * @priority: the priority of the message
+ *
+ * Check whether a message of @priority from @source would be logged,
+ * using the priority cached in @source.  This is cheap enough to be
+ * done at every call site before the message arguments get evaluated.
+ *
+ * As for virLogVMessage(), the reads are not thread safe, the worst
+ * case is a message being dropped or emitted while filters change.
+ */
+static inline bool
+virLogSourceEnabled(virLogSourcePtr source, virLogPriority priority)
+{
+    if (source->serial < virLogFiltersSerial)
+        virLogSourceUpdate(source);
+    return priority >= source->priority;
+}
+
+# define VIR_LOG_MESSAGE_INT(src, priority, filename, linenr, funcname, ...) \
+    (virLogSourceEnabled(src, priority) ?                               \
+     virLogMessage(src, priority, filename, linenr, funcname, NULL,     \
+                   __VA_ARGS__) :                                       \
+     (void) 0)
+
 /*
  * If configured with --enable-debug=yes then library calls
  * are printed to stderr for debugging or to an appropriate channel
@@ -74,7 +105,7 @@ struct _virLogSource {
  */
 # ifdef ENABLE_DEBUG
 #  define VIR_DEBUG_INT(src, filename, linenr, funcname, ...)           \
-    virLogMessage(src, VIR_LOG_DEBUG, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_MESSAGE_INT(src, VIR_LOG_DEBUG, filename, linenr, funcname, __VA_ARGS__)
 # else
 /**
  * virLogEatParams:
@@ -91,11 +122,11 @@ static inline void virLogEatParams(virLogSourcePtr unused, ...)
 # endif /* !ENABLE_DEBUG */
 
 # define VIR_INFO_INT(src, filename, linenr, funcname, ...)             \
-    virLogMessage(src, VIR_LOG_INFO, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_MESSAGE_INT(src, VIR_LOG_INFO, filename, linenr, funcname, __VA_ARGS__)
 # define VIR_WARN_INT(src, filename, linenr, funcname, ...)             \
-    virLogMessage(src, VIR_LOG_WARN, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_MESSAGE_INT(src, VIR_LOG_WARN, filename, linenr, funcname, __VA_ARGS__)
 # define VIR_ERROR_INT(src, filename, linenr, funcname, ...)            \
-    virLogMessage(src, VIR_LOG_ERROR, filename, linenr, funcname, NULL, __VA_ARGS__)
+    VIR_LOG_MESSAGE_INT(src, VIR_LOG_ERROR, filename, linenr, funcname, __VA_ARGS__)
 
 # define VIR_DEBUG(...)                                                 \
     VIR_DEBUG_INT(&virLogSelf, __FILE__, __LINE__, __func__, __VA_ARGS__)
@@ -156,6 +187,10 @@ typedef enum {
     VIR_LOG_STACK_TRACE = (1 << 0),
 } virLogFlags;
 
+typedef enum {
+    VIR_LOG_OUTPUT_ASYNC = (1 << 0), /* messages are written by a thread */
+} virLogOutputFlags;
+
 extern int virLogGetNbFilters(void);
 extern int virLogGetNbOutputs(void);
 extern char *virLogGetFilters(void);
@@ -182,6 +217,7 @@ extern void virLogLock(void);
 extern void virLogUnlock(void);
 extern int virLogReset(void);
 extern int virLogParseDefaultPriority(const char *priority);
+extern void virLogFlush(void);
 extern int virLogParseFilters(const char *filters);
 extern int virLogParseOutputs(const char *output);
 extern int virLogPriorityFromSyslog(int priority);
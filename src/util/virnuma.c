@@ -34,12 +34,19 @@
 
 #endif /* WITH_NUMACTL */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "virnuma.h"
 #include "vircommand.h"
 #include "virerror.h"
 #include "virlog.h"
 #include "viralloc.h"
 #include "virbitmap.h"
+#include "virthread.h"
+#include "virfile.h"
+#include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -57,6 +64,32 @@ VIR_ENUM_IMPL(virNumaTuneMemPlacementMode,
               "static",
               "auto");
 
+VIR_ENUM_IMPL(virNumaPlacementPolicy,
+              VIR_NUMA_PLACEMENT_POLICY_LAST,
+              "numad",
+              "pack",
+              "spread",
+              "memory-first");
+
+/* vCPUs placed by libvirt on each NUMA node, indexed by node id */
+static virMutex virNumaPlacementLock;
+static unsigned int *virNumaPlacementPinned;
+static size_t virNumaPlacementNnodes;
+
+static int
+virNumaPlacementOnceInit(void)
+{
+    if (virMutexInit(&virNumaPlacementLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize NUMA placement mutex"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNumaPlacement)
+
 #if HAVE_NUMAD
 char *
 virNumaGetAutoPlacementAdvice(unsigned short vcpus,
@@ -90,6 +123,384 @@ virNumaGetAutoPlacementAdvice(unsigned short vcpus ATTRIBUTE_UNUSED,
 }
 #endif
 
+
+/* Spare CPU capacity of @node in percent of one CPU. Whichever is
+ * higher of the measured load and the vCPUs already pinned there
+ * counts as used, so an idle but fully pinned node looks busy. */
+static long long
+virNumaNodeLoadIdle(const virNumaNodeLoad *node)
+{
+    long long used = MAX((long long) node->load, 100LL * node->pinned);
+
+    return 100LL * node->ncpus - used;
+}
+
+#define VIR_NUMA_CMP(a, b) ((a) < (b) ? -1 : (a) > (b))
+
+/* Most spare CPU capacity first, then most free memory */
+static int
+virNumaPlacementCmpSpread(const void *a, const void *b)
+{
+    const virNumaNodeLoad *na = *(const virNumaNodeLoad *const *)a;
+    const virNumaNodeLoad *nb = *(const virNumaNodeLoad *const *)b;
+    int ret;
+
+    if ((ret = VIR_NUMA_CMP(virNumaNodeLoadIdle(nb), virNumaNodeLoadIdle(na))))
+        return ret;
+    if ((ret = VIR_NUMA_CMP(nb->memFree, na->memFree)))
+        return ret;
+    return VIR_NUMA_CMP(na->node, nb->node);
+}
+
+/* Most free memory first, then most spare CPU capacity */
+static int
+virNumaPlacementCmpMemoryFirst(const void *a, const void *b)
+{
+    const virNumaNodeLoad *na = *(const virNumaNodeLoad *const *)a;
+    const virNumaNodeLoad *nb = *(const virNumaNodeLoad *const *)b;
+    int ret;
+
+    if ((ret = VIR_NUMA_CMP(nb->memFree, na->memFree)))
+        return ret;
+    if ((ret = VIR_NUMA_CMP(virNumaNodeLoadIdle(nb), virNumaNodeLoadIdle(na))))
+        return ret;
+    return VIR_NUMA_CMP(na->node, nb->node);
+}
+
+/* Least free memory first, then least spare CPU capacity */
+static int
+virNumaPlacementCmpPack(const void *a, const void *b)
+{
+    const virNumaNodeLoad *na = *(const virNumaNodeLoad *const *)a;
+    const virNumaNodeLoad *nb = *(const virNumaNodeLoad *const *)b;
+    int ret;
+
+    if ((ret = VIR_NUMA_CMP(na->memFree, nb->memFree)))
+        return ret;
+    if ((ret = VIR_NUMA_CMP(virNumaNodeLoadIdle(na), virNumaNodeLoadIdle(nb))))
+        return ret;
+    return VIR_NUMA_CMP(na->node, nb->node);
+}
+
+#undef VIR_NUMA_CMP
+
+
+/**
+ * virNumaPlacementChoose:
+ * @nodes: load of each host NUMA node
+ * @nnodes: number of items in @nodes
+ * @policy: placement policy to apply
+ * @vcpus: number of vCPUs of the guest
+ * @memory: memory of the guest in KiB
+ * @nodeset: returns the chosen nodes
+ *
+ * Pick the NUMA nodes a new guest should be confined to. A single node
+ * which can hold all of @memory and has at least @vcpus CPUs is always
+ * preferred, chosen in the order given by @policy: 'pack' takes the
+ * tightest fit, 'spread' the node with most spare CPU capacity and
+ * 'memory-first' the node with most free memory. If no single node
+ * fits, nodes are added in order until the guest fits ('pack' then
+ * adds the largest nodes first to keep the set small). Ties are
+ * broken by node id, so the result only depends on the input.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaPlacementChoose(const virNumaNodeLoad *nodes,
+                       size_t nnodes,
+                       virNumaPlacementPolicy policy,
+                       unsigned int vcpus,
+                       unsigned long long memory,
+                       virBitmapPtr *nodeset)
+{
+    const virNumaNodeLoad **order = NULL;
+    int (*cmp)(const void *, const void *);
+    virBitmapPtr set = NULL;
+    unsigned long long memFree = 0;
+    unsigned int ncpus = 0;
+    int maxnode = 0;
+    size_t i;
+    int ret = -1;
+
+    *nodeset = NULL;
+
+    switch (policy) {
+    case VIR_NUMA_PLACEMENT_POLICY_PACK:
+        cmp = virNumaPlacementCmpPack;
+        break;
+    case VIR_NUMA_PLACEMENT_POLICY_SPREAD:
+        cmp = virNumaPlacementCmpSpread;
+        break;
+    case VIR_NUMA_PLACEMENT_POLICY_MEMORY_FIRST:
+        cmp = virNumaPlacementCmpMemoryFirst;
+        break;
+    case VIR_NUMA_PLACEMENT_POLICY_NUMAD:
+    case VIR_NUMA_PLACEMENT_POLICY_LAST:
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unsupported NUMA placement policy %d"), policy);
+        return -1;
+    }
+
+    if (nnodes == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("no NUMA nodes available for placement"));
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(order, nnodes) < 0)
+        return -1;
+
+    for (i = 0; i < nnodes; i++) {
+        order[i] = &nodes[i];
+        maxnode = MAX(maxnode, nodes[i].node);
+    }
+
+    if (!(set = virBitmapNew(maxnode + 1)))
+        goto cleanup;
+
+    qsort(order, nnodes, sizeof(*order), cmp);
+
+    for (i = 0; i < nnodes; i++) {
+        if (order[i]->memFree >= memory && order[i]->ncpus >= vcpus) {
+            ignore_value(virBitmapSetBit(set, order[i]->node));
+            goto done;
+        }
+    }
+
+    if (policy == VIR_NUMA_PLACEMENT_POLICY_PACK)
+        qsort(order, nnodes, sizeof(*order), virNumaPlacementCmpMemoryFirst);
+
+    for (i = 0; i < nnodes && (memFree < memory || ncpus < vcpus); i++) {
+        ignore_value(virBitmapSetBit(set, order[i]->node));
+        memFree += order[i]->memFree;
+        ncpus += order[i]->ncpus;
+    }
+
+    if (memFree < memory || ncpus < vcpus)
+        VIR_WARN("Host NUMA nodes cannot fit %u vCPUs and %llu KiB, "
+                 "using all of them", vcpus, memory);
+
+ done:
+    *nodeset = set;
+    set = NULL;
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(order);
+    virBitmapFree(set);
+    return ret;
+}
+
+
+/**
+ * virNumaPlacementReserve:
+ * @nodeset: nodes the guest has been confined to
+ * @vcpus: number of vCPUs of the guest
+ *
+ * Record that @vcpus are now running on @nodeset, split evenly
+ * across the nodes, so that later placement decisions account for
+ * them via virNumaPlacementGetPinned. Every reservation must be
+ * undone by virNumaPlacementRelease with the same arguments.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaPlacementReserve(virBitmapPtr nodeset, unsigned int vcpus)
+{
+    size_t nnodes;
+    size_t i = 0;
+    ssize_t node = -1;
+    int ret = -1;
+
+    if (!nodeset || !(nnodes = virBitmapCountBits(nodeset)))
+        return 0;
+
+    if (virNumaPlacementInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virNumaPlacementLock);
+
+    if (virBitmapSize(nodeset) > virNumaPlacementNnodes &&
+        VIR_EXPAND_N(virNumaPlacementPinned, virNumaPlacementNnodes,
+                     virBitmapSize(nodeset) - virNumaPlacementNnodes) < 0)
+        goto cleanup;
+
+    while ((node = virBitmapNextSetBit(nodeset, node)) >= 0)
+        virNumaPlacementPinned[node] += vcpus / nnodes + (i++ < vcpus % nnodes);
+
+    ret = 0;
+ cleanup:
+    virMutexUnlock(&virNumaPlacementLock);
+    return ret;
+}
+
+
+/**
+ * virNumaPlacementRelease:
+ * @nodeset: nodes the guest was confined to
+ * @vcpus: number of vCPUs of the guest
+ *
+ * Undo a virNumaPlacementReserve call.
+ */
+void
+virNumaPlacementRelease(virBitmapPtr nodeset, unsigned int vcpus)
+{
+    size_t nnodes;
+    size_t i = 0;
+    ssize_t node = -1;
+
+    if (!nodeset || !(nnodes = virBitmapCountBits(nodeset)))
+        return;
+
+    if (virNumaPlacementInitialize() < 0)
+        return;
+
+    virMutexLock(&virNumaPlacementLock);
+
+    while ((node = virBitmapNextSetBit(nodeset, node)) >= 0 &&
+           node < virNumaPlacementNnodes) {
+        unsigned int share = vcpus / nnodes + (i++ < vcpus % nnodes);
+
+        if (virNumaPlacementPinned[node] < share)
+            virNumaPlacementPinned[node] = 0;
+        else
+            virNumaPlacementPinned[node] -= share;
+    }
+
+    virMutexUnlock(&virNumaPlacementLock);
+}
+
+
+/**
+ * virNumaPlacementGetPinned:
+ * @node: NUMA node id
+ *
+ * Returns the number of vCPUs currently reserved on @node.
+ */
+unsigned int
+virNumaPlacementGetPinned(int node)
+{
+    unsigned int ret = 0;
+
+    if (node < 0 || virNumaPlacementInitialize() < 0)
+        return 0;
+
+    virMutexLock(&virNumaPlacementLock);
+    if (node < virNumaPlacementNnodes)
+        ret = virNumaPlacementPinned[node];
+    virMutexUnlock(&virNumaPlacementLock);
+
+    return ret;
+}
+
+
+/**
+ * virNumaParseProcessMemory:
+ * @path: path to a numa_maps file
+ * @memory: returns the memory resident on each node in KiB, indexed by node
+ * @nnodes: returns the number of items in @memory
+ *
+ * Sum up the per-node page counts ("N<node>=<pages>") of all mappings
+ * listed in @path, taking the page size of each mapping into account.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaParseProcessMemory(const char *path,
+                          unsigned long long **memory,
+                          size_t *nnodes)
+{
+    FILE *fp = NULL;
+    char *line = NULL;
+    size_t linelen = 0;
+    unsigned long long *mem = NULL;
+    size_t nmem = 0;
+    unsigned long long pagekb = sysconf(_SC_PAGESIZE) >> 10;
+    int ret = -1;
+
+    *memory = NULL;
+    *nnodes = 0;
+
+    if (!(fp = fopen(path, "r"))) {
+        virReportSystemError(errno, _("Unable to open %s"), path);
+        return -1;
+    }
+
+    while (getline(&line, &linelen, fp) > 0) {
+        unsigned long long kb = pagekb;
+        char *tok;
+        char *end;
+
+        if ((tok = strstr(line, " kernelpagesize_kB=")) &&
+            virStrToLong_ull(tok + strlen(" kernelpagesize_kB="),
+                             &end, 10, &kb) < 0)
+            kb = pagekb;
+
+        tok = line;
+        while ((tok = strstr(tok, " N"))) {
+            unsigned long long pages;
+            unsigned int node;
+
+            tok += 2;
+            if (virStrToLong_ui(tok, &end, 10, &node) < 0 || *end != '=' ||
+                virStrToLong_ull(end + 1, &end, 10, &pages) < 0)
+                continue;
+
+            if (node >= nmem &&
+                VIR_EXPAND_N(mem, nmem, node + 1 - nmem) < 0)
+                goto cleanup;
+
+            mem[node] += pages * kb;
+        }
+    }
+
+    if (ferror(fp)) {
+        virReportSystemError(errno, _("Unable to read %s"), path);
+        goto cleanup;
+    }
+
+    *memory = mem;
+    *nnodes = nmem;
+    mem = NULL;
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(line);
+    VIR_FREE(mem);
+    VIR_FORCE_FCLOSE(fp);
+    return ret;
+}
+
+
+/**
+ * virNumaGetProcessMemory:
+ * @pid: process to inspect
+ * @memory: returns the memory resident on each node in KiB, indexed by node
+ * @nnodes: returns the number of items in @memory
+ *
+ * Report where the memory of @pid currently lives, as seen in
+ * /proc/@pid/numa_maps.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNumaGetProcessMemory(pid_t pid,
+                        unsigned long long **memory,
+                        size_t *nnodes)
+{
+    char *path = NULL;
+    int ret;
+
+    if (virAsprintf(&path, "/proc/%lld/numa_maps", (long long) pid) < 0)
+        return -1;
+
+    ret = virNumaParseProcessMemory(path, memory, nnodes);
+    VIR_FREE(path);
+    return ret;
+}
+
+
 #if WITH_NUMACTL
 int
 virNumaSetupMemoryPolicy(virNumaTuneDef numatune,
@@ -50,9 +50,60 @@ struct _virNumaTuneDef {
     /* Future NUMA tuning related stuff should go here. */
 };
 
+/* Which of the nodes able to hold the whole guest is picked, see
+ * virNumaPlacementChoose */
+typedef enum {
+    VIR_NUMA_PLACEMENT_POLICY_NUMAD = 0, /* ask numad for advice */
+    VIR_NUMA_PLACEMENT_POLICY_PACK,      /* the one with least free RAM */
+    VIR_NUMA_PLACEMENT_POLICY_SPREAD,    /* most spare CPU capacity */
+    VIR_NUMA_PLACEMENT_POLICY_MEMORY_FIRST, /* most free RAM */
+
+    VIR_NUMA_PLACEMENT_POLICY_LAST
+} virNumaPlacementPolicy;
+
+VIR_ENUM_DECL(virNumaPlacementPolicy)
+
+# if HAVE_NUMAD
+#  define VIR_NUMA_PLACEMENT_POLICY_DEFAULT VIR_NUMA_PLACEMENT_POLICY_NUMAD
+# else
+#  define VIR_NUMA_PLACEMENT_POLICY_DEFAULT VIR_NUMA_PLACEMENT_POLICY_MEMORY_FIRST
+# endif
+
+typedef struct _virNumaNodeLoad virNumaNodeLoad;
+typedef virNumaNodeLoad *virNumaNodeLoadPtr;
+struct _virNumaNodeLoad {
+    int node;                    /* NUMA node id */
+    unsigned int ncpus;          /* online CPUs in the node */
+    unsigned int load;           /* busy CPU time, in percent of one CPU */
+    unsigned int pinned;         /* vCPUs libvirt has already placed here */
+    unsigned long long memTotal; /* in KiB */
+    unsigned long long memFree;  /* in KiB */
+};
+
 char *virNumaGetAutoPlacementAdvice(unsigned short vcups,
                                     unsigned long long balloon);
 
+int virNumaPlacementChoose(const virNumaNodeLoad *nodes,
+                           size_t nnodes,
+                           virNumaPlacementPolicy policy,
+                           unsigned int vcpus,
+                           unsigned long long memory,
+                           virBitmapPtr *nodeset)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(6);
+
+int virNumaPlacementReserve(virBitmapPtr nodeset, unsigned int vcpus);
+void virNumaPlacementRelease(virBitmapPtr nodeset, unsigned int vcpus);
+unsigned int virNumaPlacementGetPinned(int node);
+
+int virNumaParseProcessMemory(const char *path,
+                              unsigned long long **memory,
+                              size_t *nnodes)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+int virNumaGetProcessMemory(pid_t pid,
+                            unsigned long long **memory,
+                            size_t *nnodes)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
 int virNumaSetupMemoryPolicy(virNumaTuneDef numatune,
                              virBitmapPtr nodemask);
 
@@ -44,6 +44,8 @@
 #include "virfile.h"
 #include "virkmod.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 #include "virutil.h"
 
 VIR_LOG_INIT("util.pci");
@@ -980,6 +982,196 @@ virPCIDeviceReset(virPCIDevicePtr dev,
 }
 
 
+/* Upper bound on the threads virPCIDeviceListReset() uses */
+#define VIR_PCI_RESET_MAX_THREADS 8
+
+struct virPCIDeviceListResetData {
+    virPCIDeviceListPtr devs;
+    virPCIDeviceListPtr activeDevs;
+    virPCIDeviceListPtr inactiveDevs;
+
+    /* per device: index of the first device on the same bus */
+    size_t *buses;
+
+    virMutex lock;
+    size_t next;
+    bool failed;
+
+    /* per device: -1 failed, 0 reset, 1 not attempted */
+    int *results;
+    virErrorPtr *errors;
+};
+
+
+static void
+virPCIDeviceListResetWorker(void *opaque)
+{
+    struct virPCIDeviceListResetData *data = opaque;
+    size_t ndevs = virPCIDeviceListCount(data->devs);
+    size_t bus;
+    size_t i;
+
+    for (;;) {
+        virMutexLock(&data->lock);
+        while (data->next < ndevs && data->buses[data->next] != data->next)
+            data->next++;
+        /* Do not start on more buses once one device failed */
+        if (data->failed || data->next >= ndevs) {
+            virMutexUnlock(&data->lock);
+            return;
+        }
+        bus = data->next++;
+        virMutexUnlock(&data->lock);
+
+        /* A secondary bus reset hits every device on the bus, so the
+         * devices sharing one are still reset one after the other */
+        for (i = bus; i < ndevs; i++) {
+            if (data->buses[i] != bus)
+                continue;
+
+            data->results[i] = virPCIDeviceReset(virPCIDeviceListGet(data->devs, i),
+                                                 data->activeDevs,
+                                                 data->inactiveDevs);
+            if (data->results[i] < 0) {
+                data->errors[i] = virSaveLastError();
+                virMutexLock(&data->lock);
+                data->failed = true;
+                virMutexUnlock(&data->lock);
+                break;
+            }
+        }
+    }
+}
+
+
+/**
+ * virPCIDeviceListReset:
+ * @devs: devices to reset
+ * @activeDevs: devices in use by a domain
+ * @inactiveDevs: devices detached from the host but not in use
+ * @parallel: whether to reset devices on different buses concurrently
+ *
+ * Reset every device of @devs as virPCIDeviceReset() does.  Since a
+ * secondary bus reset alone takes 400ms, with @parallel the devices
+ * sitting on different buses are reset at the same time, while the
+ * ones sharing a bus are still reset in turn.  Once a device failed
+ * no other bus is started on, and the error of the first failed
+ * device of @devs is reported.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virPCIDeviceListReset(virPCIDeviceListPtr devs,
+                      virPCIDeviceListPtr activeDevs,
+                      virPCIDeviceListPtr inactiveDevs,
+                      bool parallel)
+{
+    struct virPCIDeviceListResetData data = {
+        .devs = devs, .activeDevs = activeDevs, .inactiveDevs = inactiveDevs,
+    };
+    size_t ndevs = virPCIDeviceListCount(devs);
+    size_t nbuses = 0;
+    size_t nthreads;
+    virThreadPtr threads = NULL;
+    size_t started = 0;
+    unsigned long long then = 0, now = 0;
+    virErrorPtr err = NULL;
+    size_t i, j;
+    int ret = -1;
+
+    if (!parallel) {
+        for (i = 0; i < ndevs; i++) {
+            if (virPCIDeviceReset(virPCIDeviceListGet(devs, i),
+                                  activeDevs, inactiveDevs) < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    if (ndevs == 0)
+        return 0;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(data.buses, ndevs) < 0 ||
+        VIR_ALLOC_N(data.results, ndevs) < 0 ||
+        VIR_ALLOC_N(data.errors, ndevs) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndevs; i++) {
+        virPCIDevicePtr dev = virPCIDeviceListGet(devs, i);
+
+        for (j = 0; j < i; j++) {
+            virPCIDevicePtr other = virPCIDeviceListGet(devs, j);
+
+            if (other->domain == dev->domain && other->bus == dev->bus)
+                break;
+        }
+        data.buses[i] = j;
+        data.results[i] = 1;
+        if (j == i)
+            nbuses++;
+    }
+
+    nthreads = MIN(nbuses, VIR_PCI_RESET_MAX_THREADS);
+    if (nthreads > 1 && VIR_ALLOC_N(threads, nthreads - 1) < 0)
+        goto cleanup;
+
+    ignore_value(virTimeMillisNow(&then));
+
+    /* The calling thread is a worker too, so progress is made even
+     * when no thread can be started */
+    for (started = 0; started + 1 < nthreads; started++) {
+        if (virThreadCreate(&threads[started], true,
+                            virPCIDeviceListResetWorker, &data) < 0) {
+            VIR_WARN("Unable to start a thread resetting PCI devices");
+            break;
+        }
+    }
+
+    virPCIDeviceListResetWorker(&data);
+
+    for (i = 0; i < started; i++)
+        virThreadJoin(&threads[i]);
+
+    ignore_value(virTimeMillisNow(&now));
+    VIR_DEBUG("Reset %zu PCI devices on %zu buses using %zu threads in %llu ms",
+              ndevs, nbuses, started + 1, now - then);
+
+    if (!data.failed) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    for (i = 0; i < ndevs; i++) {
+        if (data.results[i] < 0) {
+            err = data.errors[i];
+            data.errors[i] = NULL;
+            break;
+        }
+    }
+
+    virSetError(err);
+    virFreeError(err);
+
+ cleanup:
+    if (data.errors) {
+        for (i = 0; i < ndevs; i++)
+            virFreeError(data.errors[i]);
+    }
+    VIR_FREE(data.errors);
+    VIR_FREE(data.results);
+    VIR_FREE(data.buses);
+    VIR_FREE(threads);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
 static int
 virPCIProbeStubDriver(const char *driver)
 {
@@ -58,6 +58,10 @@ int virPCIDeviceReattach(virPCIDevicePtr dev,
 int virPCIDeviceReset(virPCIDevicePtr dev,
                       virPCIDeviceListPtr activeDevs,
                       virPCIDeviceListPtr inactiveDevs);
+int virPCIDeviceListReset(virPCIDeviceListPtr devs,
+                          virPCIDeviceListPtr activeDevs,
+                          virPCIDeviceListPtr inactiveDevs,
+                          bool parallel);
 
 void virPCIDeviceSetManaged(virPCIDevice *dev,
                             bool managed);
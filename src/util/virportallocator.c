@@ -37,7 +37,11 @@
 
 struct _virPortAllocator {
     virObjectLockable parent;
-    virBitmapPtr bitmap;
+    virBitmapPtr bitmap; /* ports handed out or claimed by a caller */
+    virBitmapPtr busy;   /* ports found bound by someone else */
+
+    /* No clear bit in @bitmap is below this index */
+    size_t next;
 
     char *name;
 
@@ -53,6 +57,7 @@ virPortAllocatorDispose(void *obj)
     virPortAllocatorPtr pa = obj;
 
     virBitmapFree(pa->bitmap);
+    virBitmapFree(pa->busy);
     VIR_FREE(pa->name);
 }
 
@@ -91,6 +96,7 @@ virPortAllocatorPtr virPortAllocatorNew(const char *name,
     pa->end = end;
 
     if (!(pa->bitmap = virBitmapNew((end-start)+1)) ||
+        !(pa->busy = virBitmapNew((end-start)+1)) ||
         VIR_STRDUP(pa->name, name) < 0) {
         virObjectUnref(pa);
         return NULL;
@@ -173,50 +179,84 @@ static int virPortAllocatorBindToPort(bool *used,
     return ret;
 }
 
+/*
+ * Ports which were found bound by another process stay marked so that
+ * later scans skip them without repeating the bind() checks. Once the
+ * range is exhausted give them another chance, as they may have been
+ * freed in the meantime. Returns false if there were none.
+ */
+static bool
+virPortAllocatorForgetBusy(virPortAllocatorPtr pa)
+{
+    ssize_t i = -1;
+    bool found = false;
+
+    while ((i = virBitmapNextSetBit(pa->busy, i)) >= 0) {
+        ignore_value(virBitmapClearBit(pa->bitmap, i));
+        pa->next = MIN(pa->next, (size_t) i);
+        found = true;
+    }
+    virBitmapClearAll(pa->busy);
+
+    return found;
+}
+
 int virPortAllocatorAcquire(virPortAllocatorPtr pa,
                             unsigned short *port)
 {
     int ret = -1;
-    size_t i;
+    bool retried = false;
 
     *port = 0;
     virObjectLock(pa);
 
-    for (i = pa->start; i <= pa->end && !*port; i++) {
+    while (!*port) {
         bool used = false, v6used = false;
+        unsigned short candidate;
+        ssize_t i;
+        int rc;
 
-        if (virBitmapGetBit(pa->bitmap,
-                            i - pa->start, &used) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Failed to query port %zu"), i);
-            goto cleanup;
+        if ((i = virBitmapNextClearBit(pa->bitmap,
+                                       (ssize_t) pa->next - 1)) < 0) {
+            if (retried || !virPortAllocatorForgetBusy(pa)) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Unable to find an unused port in range '%s' (%d-%d)"),
+                               pa->name, pa->start, pa->end);
+                goto cleanup;
+            }
+            retried = true;
+            continue;
         }
 
-        if (used)
-            continue;
+        /* Claim the port before dropping the lock, so that concurrent
+         * callers do not serialize on each other's bind() checks */
+        ignore_value(virBitmapSetBit(pa->bitmap, i));
+        pa->next = i + 1;
+        candidate = pa->start + i;
+        virObjectUnlock(pa);
+
+        rc = 0;
+        if (virPortAllocatorBindToPort(&v6used, candidate, AF_INET6) < 0 ||
+            virPortAllocatorBindToPort(&used, candidate, AF_INET) < 0)
+            rc = -1;
 
-        if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
-            virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
+        virObjectLock(pa);
+
+        if (rc < 0) {
+            ignore_value(virBitmapClearBit(pa->bitmap, i));
+            pa->next = MIN(pa->next, (size_t) i);
             goto cleanup;
+        }
 
-        if (!used && !v6used) {
-            /* Add port to bitmap of reserved ports */
-            if (virBitmapSetBit(pa->bitmap,
-                                i - pa->start) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Failed to reserve port %zu"), i);
-                goto cleanup;
-            }
-            *port = i;
-            ret = 0;
+        if (used || v6used) {
+            ignore_value(virBitmapSetBit(pa->busy, i));
+            continue;
         }
-    }
 
-    if (*port == 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unable to find an unused port in range '%s' (%d-%d)"),
-                       pa->name, pa->start, pa->end);
+        *port = candidate;
     }
+
+    ret = 0;
  cleanup:
     virObjectUnlock(pa);
     return ret;
@@ -246,6 +286,8 @@ int virPortAllocatorRelease(virPortAllocatorPtr pa,
                        port);
         goto cleanup;
     }
+    ignore_value(virBitmapClearBit(pa->busy, port - pa->start));
+    pa->next = MIN(pa->next, (size_t) (port - pa->start));
 
     ret = 0;
  cleanup:
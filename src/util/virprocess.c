@@ -44,7 +44,8 @@
 #endif
 
 #include "viratomic.h"
-#include "virprocess.h"
+#define __VIR_PROCESS_PRIV_H_ALLOW__
+#include "virprocesspriv.h"
 #include "virerror.h"
 #include "viralloc.h"
 #include "virfile.h"
@@ -902,6 +903,239 @@ int virProcessGetStartTime(pid_t pid,
 #endif
 
 
+#ifdef __linux__
+/*
+ * Advance *str past @nfields space separated fields of a
+ * /proc/<pid>/stat line.
+ */
+static int
+virProcessStatSkipFields(const char **str, size_t nfields)
+{
+    const char *p = *str;
+
+    while (nfields--) {
+        while (*p && *p != ' ')
+            p++;
+        if (!*p)
+            return -1;
+        p++;
+    }
+
+    *str = p;
+    return 0;
+}
+
+
+/*
+ * Parse a (possibly negative) decimal integer at *str, leaving *str
+ * at the following separator. This avoids the locale and stdio
+ * overhead of sscanf on what is a very hot path for stats polling.
+ */
+static int
+virProcessStatScanLL(const char **str, long long *val)
+{
+    const char *p = *str;
+    bool negative = false;
+    unsigned long long v = 0;
+
+    if (*p == '-') {
+        negative = true;
+        p++;
+    }
+
+    if (*p < '0' || *p > '9')
+        return -1;
+
+    while (*p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+
+    *val = negative ? -(long long)v : (long long)v;
+    *str = p;
+    return 0;
+}
+
+
+/* See 'man proc' for the layout of /proc/<pid>/stat. Field numbers
+ * below are 1-based, as in the man page. */
+# define VIR_PROCESS_STAT_UTIME 14
+# define VIR_PROCESS_STAT_RSS 24
+# define VIR_PROCESS_STAT_PROCESSOR 39
+
+static int
+virProcessParseStatInfo(const char *buf,
+                        virProcessStatInfoPtr info)
+{
+    static long long ticks_per_sec;
+    static long long pagesize_kb;
+    const char *p;
+    long long utime, stime, rss, cpu;
+
+    if (!ticks_per_sec) {
+        ticks_per_sec = sysconf(_SC_CLK_TCK);
+        pagesize_kb = sysconf(_SC_PAGESIZE) >> 10;
+    }
+
+    /* The command name may contain spaces and ')', so start
+     * from the last ')', which is followed by field 3 */
+    if (!(p = strrchr(buf, ')')) || p[1] != ' ')
+        return -1;
+    p += 2;
+
+    if (virProcessStatSkipFields(&p, VIR_PROCESS_STAT_UTIME - 3) < 0 ||
+        virProcessStatScanLL(&p, &utime) < 0 ||
+        virProcessStatSkipFields(&p, 1) < 0 ||
+        virProcessStatScanLL(&p, &stime) < 0 ||
+        virProcessStatSkipFields(&p, VIR_PROCESS_STAT_RSS -
+                                     (VIR_PROCESS_STAT_UTIME + 1)) < 0 ||
+        virProcessStatScanLL(&p, &rss) < 0 ||
+        virProcessStatSkipFields(&p, VIR_PROCESS_STAT_PROCESSOR -
+                                     VIR_PROCESS_STAT_RSS) < 0 ||
+        virProcessStatScanLL(&p, &cpu) < 0)
+        return -1;
+
+    /* We got jiffies, we want nanoseconds */
+    info->cpuTime = 1000ull * 1000ull * 1000ull * (utime + stime) /
+        ticks_per_sec;
+    info->lastCpu = cpu;
+    /* We got pages, we want kiloBytes */
+    info->vmRSS = rss * pagesize_kb;
+
+    return 0;
+}
+
+
+/**
+ * virProcessGetTasksStatInfoInternal:
+ * @procdir: location of procfs, normally "/proc"
+ * @pid: the process to query
+ * @tids: thread IDs within @pid, or NULL to query @pid itself
+ * @ntids: number of elements in @tids and @info
+ * @info: filled with the statistics of each thread
+ *
+ * Read the scheduler statistics of many threads of a process in
+ * one sweep, reusing a single path and read buffer. Threads which
+ * have exited get zeroed statistics rather than causing an error.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virProcessGetTasksStatInfoInternal(const char *procdir,
+                                   pid_t pid,
+                                   const pid_t *tids,
+                                   size_t ntids,
+                                   virProcessStatInfoPtr info)
+{
+    char path[PATH_MAX];
+    char buf[1024];
+    size_t i;
+    ssize_t len;
+    int fd;
+
+    for (i = 0; i < ntids; i++) {
+        /* In general, we cannot assume pid_t fits in int; but /proc
+         * parsing is specific to Linux where int works fine.  */
+        if (tids)
+            len = snprintf(path, sizeof(path), "%s/%d/task/%d/stat",
+                           procdir, (int) pid, (int) tids[i]);
+        else
+            len = snprintf(path, sizeof(path), "%s/%d/stat",
+                           procdir, (int) pid);
+        if (len < 0 || len >= sizeof(path)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Path for stats of process %d is too long"),
+                           (int) pid);
+            return -1;
+        }
+
+        memset(&info[i], 0, sizeof(info[i]));
+
+        if ((fd = open(path, O_RDONLY)) < 0) {
+            /* Process probably went away, so fake 0 */
+            if (errno == ENOENT || errno == ESRCH)
+                continue;
+            virReportSystemError(errno, _("Unable to open '%s'"), path);
+            return -1;
+        }
+
+        len = saferead(fd, buf, sizeof(buf) - 1);
+        VIR_FORCE_CLOSE(fd);
+        if (len < 0) {
+            if (errno == ESRCH)
+                continue;
+            virReportSystemError(errno, _("Unable to read '%s'"), path);
+            return -1;
+        }
+        buf[len] = '\0';
+
+        if (virProcessParseStatInfo(buf, &info[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Cannot parse process status data in '%s'"),
+                           path);
+            return -1;
+        }
+
+        VIR_DEBUG("Got status for %d/%d cpuTime=%llu cpu=%d rss=%ld",
+                  (int) pid, tids ? (int) tids[i] : 0,
+                  info[i].cpuTime, info[i].lastCpu, info[i].vmRSS);
+    }
+
+    return 0;
+}
+#else
+int
+virProcessGetTasksStatInfoInternal(const char *procdir ATTRIBUTE_UNUSED,
+                                   pid_t pid ATTRIBUTE_UNUSED,
+                                   const pid_t *tids ATTRIBUTE_UNUSED,
+                                   size_t ntids ATTRIBUTE_UNUSED,
+                                   virProcessStatInfoPtr info ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Process statistics are not supported on this platform"));
+    return -1;
+}
+#endif
+
+
+/**
+ * virProcessGetTasksStatInfo:
+ * @pid: the process to query
+ * @tids: thread IDs within @pid
+ * @ntids: number of elements in @tids and @info
+ * @info: filled with the statistics of each thread
+ *
+ * Fetch CPU time, last CPU and RSS of several threads of @pid,
+ * for example all vCPU threads of a guest, in a single call.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virProcessGetTasksStatInfo(pid_t pid,
+                           const pid_t *tids,
+                           size_t ntids,
+                           virProcessStatInfoPtr info)
+{
+    return virProcessGetTasksStatInfoInternal("/proc", pid, tids, ntids, info);
+}
+
+
+/**
+ * virProcessGetStatInfo:
+ * @pid: the process to query
+ * @tid: a thread ID within @pid, or 0 for the whole process
+ * @info: filled with the statistics
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virProcessGetStatInfo(pid_t pid,
+                      pid_t tid,
+                      virProcessStatInfoPtr info)
+{
+    return virProcessGetTasksStatInfoInternal("/proc", pid,
+                                              tid ? &tid : NULL, 1, info);
+}
+
+
 #ifdef HAVE_SETNS
 static int virProcessNamespaceHelper(int errfd,
                                      pid_t pid,
@@ -52,6 +52,25 @@ int virProcessGetAffinity(pid_t pid,
 int virProcessGetStartTime(pid_t pid,
                            unsigned long long *timestamp);
 
+typedef struct _virProcessStatInfo virProcessStatInfo;
+typedef virProcessStatInfo *virProcessStatInfoPtr;
+struct _virProcessStatInfo {
+    unsigned long long cpuTime; /* user + system time, in nanoseconds */
+    int lastCpu;                /* host CPU the task last ran on */
+    long vmRSS;                 /* resident set size, in KiB */
+};
+
+int virProcessGetStatInfo(pid_t pid,
+                          pid_t tid,
+                          virProcessStatInfoPtr info)
+    ATTRIBUTE_NONNULL(3);
+
+int virProcessGetTasksStatInfo(pid_t pid,
+                               const pid_t *tids,
+                               size_t ntids,
+                               virProcessStatInfoPtr info)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4);
+
 int virProcessGetNamespaces(pid_t pid,
                             size_t *nfdlist,
                             int **fdlist);
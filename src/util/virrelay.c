@@ -0,0 +1,340 @@
+/*
+ * virrelay.c: buffering of data relayed between file descriptors
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Where possible the data is held in a pipe and moved with splice(),
+ * so that it never gets copied to user space. For file descriptors
+ * which do not support splice(), the relay falls back to a plain
+ * buffer. Either way, the relay grows while the writer is faster than
+ * the reader, up to VIR_RELAY_MAX_SIZE.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "virrelay.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.relay");
+
+#define VIR_RELAY_MIN_SIZE (4 * 1024)
+#define VIR_RELAY_MAX_SIZE (1024 * 1024)
+
+#if defined(SPLICE_F_MOVE) && defined(F_GETPIPE_SZ) && defined(F_SETPIPE_SZ)
+# define VIR_RELAY_SPLICE 1
+#endif
+
+struct _virRelay {
+    int pipefd[2];  /* holds the data while splice() can be used */
+    char *buf;      /* holds the data otherwise */
+    size_t len;
+    size_t size;
+    bool full;      /* the pipe cannot take more, even below size */
+    unsigned long long total;
+};
+
+
+/**
+ * virRelayNew:
+ *
+ * Create an empty relay.
+ *
+ * Returns the relay, or NULL on error.
+ */
+virRelayPtr
+virRelayNew(void)
+{
+    virRelayPtr relay;
+
+    if (VIR_ALLOC(relay) < 0)
+        return NULL;
+
+    relay->pipefd[0] = relay->pipefd[1] = -1;
+
+#ifdef VIR_RELAY_SPLICE
+    {
+        int size;
+
+        if (pipe2(relay->pipefd, O_CLOEXEC | O_NONBLOCK) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create relay pipe"));
+            VIR_FREE(relay);
+            return NULL;
+        }
+
+        if ((size = fcntl(relay->pipefd[0], F_GETPIPE_SZ)) < 0)
+            size = VIR_RELAY_MIN_SIZE;
+        relay->size = size;
+    }
+#else
+    if (VIR_ALLOC_N(relay->buf, VIR_RELAY_MIN_SIZE) < 0) {
+        VIR_FREE(relay);
+        return NULL;
+    }
+    relay->size = VIR_RELAY_MIN_SIZE;
+#endif
+
+    return relay;
+}
+
+
+void
+virRelayFree(virRelayPtr relay)
+{
+    if (!relay)
+        return;
+
+    VIR_FORCE_CLOSE(relay->pipefd[0]);
+    VIR_FORCE_CLOSE(relay->pipefd[1]);
+    VIR_FREE(relay->buf);
+    VIR_FREE(relay);
+}
+
+
+/*
+ * Stop using splice(), moving the data held in the pipe to a buffer.
+ */
+static int
+virRelayUseBuffer(virRelayPtr relay)
+{
+    size_t got = 0;
+    ssize_t done;
+
+    VIR_DEBUG("Relay %p falling back to copies, len=%zu", relay, relay->len);
+
+    if (VIR_ALLOC_N_QUIET(relay->buf, MAX(relay->size, VIR_RELAY_MIN_SIZE)) < 0)
+        return -1;
+    relay->size = MAX(relay->size, VIR_RELAY_MIN_SIZE);
+
+    while (got < relay->len) {
+        done = read(relay->pipefd[0], relay->buf + got, relay->len - got);
+        if (done < 0 && errno == EINTR)
+            continue;
+        if (done <= 0) {
+            VIR_FREE(relay->buf);
+            if (done == 0)
+                errno = EIO;
+            return -1;
+        }
+        got += done;
+    }
+
+    VIR_FORCE_CLOSE(relay->pipefd[0]);
+    VIR_FORCE_CLOSE(relay->pipefd[1]);
+    relay->full = false;
+    return 0;
+}
+
+
+/*
+ * Double the capacity of the relay, if allowed. Done whenever the relay
+ * gets full, so that it adapts to bursts the reader cannot keep up with.
+ */
+static void
+virRelayGrow(virRelayPtr relay)
+{
+    size_t size = relay->size * 2;
+
+    if (size > VIR_RELAY_MAX_SIZE)
+        return;
+
+    if (relay->buf) {
+        if (VIR_REALLOC_N_QUIET(relay->buf, size) < 0)
+            return;
+    } else {
+#ifdef VIR_RELAY_SPLICE
+        int ret;
+
+        /* Unprivileged processes are limited by fs.pipe-max-size */
+        if ((ret = fcntl(relay->pipefd[0], F_SETPIPE_SZ, (int)size)) < 0)
+            return;
+        size = ret;
+#endif
+    }
+
+    VIR_DEBUG("Relay %p grown from %zu to %zu bytes", relay, relay->size, size);
+    relay->size = size;
+    relay->full = false;
+}
+
+
+/**
+ * virRelayFill:
+ * @relay: the relay
+ * @fd: non-blocking file descriptor to read from
+ *
+ * Read as much data as the relay can take from @fd.
+ *
+ * Returns the number of bytes read, 0 on end of file, or -1 with
+ * errno set on error, which is EAGAIN if no data was available or the
+ * relay is full.
+ */
+ssize_t
+virRelayFill(virRelayPtr relay, int fd)
+{
+    ssize_t done;
+
+    if (virRelayIsFull(relay)) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+#ifdef VIR_RELAY_SPLICE
+    if (!relay->buf) {
+        do {
+            done = splice(fd, NULL, relay->pipefd[1], NULL,
+                          relay->size - relay->len,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } while (done < 0 && errno == EINTR);
+
+        if (done >= 0)
+            goto done;
+
+        /* With spliced pages, the pipe can run out of slots before
+         * reaching its size */
+        if (errno == EAGAIN && relay->len) {
+            relay->full = true;
+            virRelayGrow(relay);
+            errno = EAGAIN;
+        }
+
+        if (errno != EINVAL)
+            return -1;
+
+        if (virRelayUseBuffer(relay) < 0)
+            return -1;
+    }
+#endif
+
+    do {
+        done = read(fd, relay->buf + relay->len, relay->size - relay->len);
+    } while (done < 0 && errno == EINTR);
+
+    if (done < 0)
+        return -1;
+
+#ifdef VIR_RELAY_SPLICE
+ done:
+#endif
+    relay->len += done;
+    if (virRelayIsFull(relay))
+        virRelayGrow(relay);
+    return done;
+}
+
+
+/**
+ * virRelayFlush:
+ * @relay: the relay
+ * @fd: non-blocking file descriptor to write to
+ *
+ * Write as much of the data held by the relay as possible to @fd.
+ *
+ * Returns the number of bytes written, or -1 with errno set on error.
+ */
+ssize_t
+virRelayFlush(virRelayPtr relay, int fd)
+{
+    ssize_t done;
+
+    if (!relay->len)
+        return 0;
+
+#ifdef VIR_RELAY_SPLICE
+    if (!relay->buf) {
+        do {
+            done = splice(relay->pipefd[0], NULL, fd, NULL, relay->len,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } while (done < 0 && errno == EINTR);
+
+        if (done >= 0)
+            goto done;
+
+        if (errno != EINVAL)
+            return -1;
+
+        if (virRelayUseBuffer(relay) < 0)
+            return -1;
+    }
+#endif
+
+    do {
+        done = write(fd, relay->buf, relay->len);
+    } while (done < 0 && errno == EINTR);
+
+    if (done < 0)
+        return -1;
+
+    memmove(relay->buf, relay->buf + done, relay->len - done);
+
+#ifdef VIR_RELAY_SPLICE
+ done:
+#endif
+    relay->len -= done;
+    relay->total += done;
+    if (done)
+        relay->full = false;
+    return done;
+}
+
+
+/**
+ * virRelayGetLength:
+ * @relay: the relay
+ *
+ * Returns the number of bytes held by the relay.
+ */
+size_t
+virRelayGetLength(virRelayPtr relay)
+{
+    return relay->len;
+}
+
+
+/**
+ * virRelayIsFull:
+ * @relay: the relay
+ *
+ * Returns true if the relay cannot take more data until some is
+ * flushed.
+ */
+bool
+virRelayIsFull(virRelayPtr relay)
+{
+    return relay->full || relay->len >= relay->size;
+}
+
+
+/**
+ * virRelayGetTotal:
+ * @relay: the relay
+ *
+ * Returns the number of bytes which went through the relay.
+ */
+unsigned long long
+virRelayGetTotal(virRelayPtr relay)
+{
+    return relay->total;
+}
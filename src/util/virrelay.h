@@ -0,0 +1,45 @@
+/*
+ * virrelay.h: buffering of data relayed between file descriptors
+ *
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_RELAY_H__
+# define __VIR_RELAY_H__
+
+# include "internal.h"
+
+typedef struct _virRelay virRelay;
+typedef virRelay *virRelayPtr;
+
+virRelayPtr virRelayNew(void);
+void virRelayFree(virRelayPtr relay);
+
+ssize_t virRelayFill(virRelayPtr relay, int fd)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+ssize_t virRelayFlush(virRelayPtr relay, int fd)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+size_t virRelayGetLength(virRelayPtr relay)
+    ATTRIBUTE_NONNULL(1);
+bool virRelayIsFull(virRelayPtr relay)
+    ATTRIBUTE_NONNULL(1);
+unsigned long long virRelayGetTotal(virRelayPtr relay)
+    ATTRIBUTE_NONNULL(1);
+
+#endif /* __VIR_RELAY_H__ */
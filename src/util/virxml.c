@@ -37,6 +37,8 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
 
@@ -56,6 +58,88 @@ struct virParserData {
  *									*
  ************************************************************************/
 
+/*
+ * Parsing a domain evaluates a couple hundred XPath expressions, nearly
+ * all of them constant strings, and compiling them costs more than
+ * evaluating them against the small documents we deal with.  Compiled
+ * expressions are thus kept per thread, keyed by their text, as libxml2
+ * caches function lookups in them while evaluating.  Expressions built
+ * at runtime are only cached until VIR_XPATH_CACHE_MAX are known.
+ */
+#define VIR_XPATH_CACHE_MAX 4096
+
+static virThreadLocal virXPathCache;
+
+static void
+virXPathCacheFreeExpr(void *payload, const void *name ATTRIBUTE_UNUSED)
+{
+    xmlXPathFreeCompExpr(payload);
+}
+
+static void
+virXPathCacheFree(void *opaque)
+{
+    virHashFree(opaque);
+}
+
+static int
+virXPathCacheOnceInit(void)
+{
+    return virThreadLocalInit(&virXPathCache, virXPathCacheFree);
+}
+
+VIR_ONCE_GLOBAL_INIT(virXPathCache)
+
+static xmlXPathCompExprPtr
+virXPathCompile(const char *xpath)
+{
+    virHashTablePtr cache;
+    xmlXPathCompExprPtr comp;
+
+    if (virXPathCacheInitialize() < 0)
+        return NULL;
+
+    if (!(cache = virThreadLocalGet(&virXPathCache))) {
+        if (!(cache = virHashCreate(256, virXPathCacheFreeExpr)))
+            return NULL;
+        if (virThreadLocalSet(&virXPathCache, cache) < 0) {
+            virHashFree(cache);
+            return NULL;
+        }
+    }
+
+    if ((comp = virHashLookup(cache, xpath)))
+        return comp;
+
+    if (virHashSize(cache) >= VIR_XPATH_CACHE_MAX ||
+        !(comp = xmlXPathCompile(BAD_CAST xpath)))
+        return NULL;
+
+    if (virHashAddEntry(cache, xpath, comp) < 0) {
+        xmlXPathFreeCompExpr(comp);
+        return NULL;
+    }
+
+    return comp;
+}
+
+/*
+ * Evaluate @xpath in @ctxt, from its compiled form if possible.  The
+ * expressions which cannot be cached are evaluated directly, so that
+ * libxml2 reports the same errors about invalid ones.
+ */
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    xmlXPathCompExprPtr comp;
+
+    if (!(comp = virXPathCompile(xpath)))
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    return xmlXPathCompiledEval(comp, ctxt);
+}
+
 /**
  * virXPathString:
  * @xpath: the XPath string to evaluate
@@ -80,7 +164,7 @@ virXPathString(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
@@ -147,7 +231,7 @@ virXPathNumber(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
@@ -176,7 +260,7 @@ virXPathLongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -282,7 +366,7 @@ virXPathULongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -399,7 +483,7 @@ virXPathULongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -446,7 +530,7 @@ virXPathLongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -506,7 +590,7 @@ virXPathBoolean(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
@@ -543,7 +627,7 @@ virXPathNode(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
@@ -587,7 +671,7 @@ virXPathNodeSet(const char *xpath,
         *list = NULL;
 
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if (obj == NULL)
         return 0;
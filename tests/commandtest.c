@@ -40,6 +40,7 @@
 #include "virthread.h"
 #include "virstring.h"
 #include "virprocess.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -1021,6 +1022,118 @@ test23(const void *unused ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int
+testNoopHook(void *opaque ATTRIBUTE_UNUSED)
+{
+    return 0;
+}
+
+/*
+ * Run program, no args, inherit all ENV, keep CWD.
+ * stdin/out/err + one high passed FD open, with unrelated FDs left
+ * open below, between and above it.  Both the plain spawn and the one
+ * which needs a full fork for the pre-exec hook must close them.
+ */
+static int
+test24(const void *unused ATTRIBUTE_UNUSED)
+{
+    int fds[] = { 99, 100, 101, 200 };
+    virCommandPtr cmd = NULL;
+    int nullfd = -1;
+    int ret = -1;
+    size_t i;
+
+    if ((nullfd = open("/dev/null", O_RDONLY)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(fds); i++) {
+        if (dup2(nullfd, fds[i]) < 0) {
+            printf("Cannot duplicate to fd %d\n", fds[i]);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < 2; i++) {
+        cmd = virCommandNew(abs_builddir "/commandhelper");
+        virCommandPassFD(cmd, 100, 0);
+        if (i == 1)
+            virCommandSetPreExecHook(cmd, testNoopHook, NULL);
+
+        if (virCommandRun(cmd, NULL) < 0) {
+            virErrorPtr err = virGetLastError();
+            printf("Cannot run child %s\n", err->message);
+            goto cleanup;
+        }
+
+        if (checkoutput("test24") < 0)
+            goto cleanup;
+
+        virCommandFree(cmd);
+        cmd = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCommandFree(cmd);
+    for (i = 0; i < ARRAY_CARDINALITY(fds); i++) {
+        int fd = fds[i];
+        VIR_FORCE_CLOSE(fd);
+    }
+    VIR_FORCE_CLOSE(nullfd);
+    return ret;
+}
+
+/*
+ * Report how long a spawn takes, for a simple command and for one
+ * with a pre-exec hook.
+ */
+static int
+test25(const void *unused ATTRIBUTE_UNUSED)
+{
+    const char *binary = "/bin/true";
+    size_t iterations = virTestGetExpensive() ? 2000 : 50;
+    unsigned long long start, end;
+    unsigned long long elapsed[2];
+    virCommandPtr cmd;
+    size_t i, j;
+
+    if (!virFileIsExecutable(binary))
+        return EXIT_AM_SKIP;
+
+    for (j = 0; j < 2; j++) {
+        if (virTimeMillisNow(&start) < 0)
+            return -1;
+
+        for (i = 0; i < iterations; i++) {
+            int rc;
+
+            cmd = virCommandNew(binary);
+            if (j == 1)
+                virCommandSetPreExecHook(cmd, testNoopHook, NULL);
+            rc = virCommandRun(cmd, NULL);
+            virCommandFree(cmd);
+            if (rc < 0) {
+                virErrorPtr err = virGetLastError();
+                printf("Cannot run child %s\n", err->message);
+                return -1;
+            }
+        }
+
+        if (virTimeMillisNow(&end) < 0)
+            return -1;
+        elapsed[j] = end - start;
+    }
+
+    if (virTestGetDebug())
+        fprintf(stderr,
+                "\n%zu spawns: %llu us each, %llu us each with a hook\n",
+                iterations, elapsed[0] * 1000 / iterations,
+                elapsed[1] * 1000 / iterations);
+
+    return 0;
+}
+
 static void virCommandThreadWorker(void *opaque)
 {
     virCommandTestDataPtr test = opaque;
@@ -1170,6 +1283,8 @@ mymain(void)
     DO_TEST(test21);
     DO_TEST(test22);
     DO_TEST(test23);
+    DO_TEST(test24);
+    DO_TEST(test25);
 
     virMutexLock(&test->lock);
     if (test->running) {
@@ -131,6 +131,144 @@ testCompareXMLToXMLFiles(const char *inxml,
     return ret;
 }
 
+/*
+ * Load many snapshots of one domain, with one disk moved to a new
+ * external overlay by each of them, and check that the devices which
+ * did not change are shared rather than duplicated.
+ */
+static int
+testSnapshotSharedDevices(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainSnapshotObjListPtr snapshots = NULL;
+    virDomainSnapshotDefPtr def = NULL;
+    virDomainSnapshotObjPtr snap;
+    virDomainSnapshotObjPtr *snaps = NULL;
+    virDomainDefPtr first;
+    size_t nsnaps = virTestGetExpensive() ? 1000 : 100;
+    size_t refs = 0, distinct = 0, bytes = 0, sharedBytes = 0;
+    char *inXmlData = NULL;
+    char *xml = NULL;
+    char *expected = NULL;
+    char *actual = NULL;
+    size_t i, j;
+    int ret = -1;
+
+    if (virtTestLoadFile(abs_srcdir
+                         "/domainsnapshotxml2xmlout/disk_snapshot_redefine.xml",
+                         &inXmlData) < 0)
+        goto cleanup;
+
+    if (!(snapshots = virDomainSnapshotObjListNew()) ||
+        VIR_ALLOC_N(snaps, nsnaps) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nsnaps; i++) {
+        char newdev[64];
+
+        snprintf(newdev, sizeof(newdev), "/dev/HostVG/QEMUGuest6-%zu", i);
+        if (!(xml = virStringReplace(inXmlData, "/dev/HostVG/QEMUGuest6",
+                                     newdev)))
+            goto cleanup;
+
+        if (!(def = virDomainSnapshotDefParseString(xml, driver.caps,
+                                                    driver.xmlopt,
+                                                    QEMU_EXPECTED_VIRT_TYPES,
+                                                    VIR_DOMAIN_SNAPSHOT_PARSE_DISKS |
+                                                    VIR_DOMAIN_SNAPSHOT_PARSE_REDEFINE)))
+            goto cleanup;
+        VIR_FREE(xml);
+
+        VIR_FREE(def->name);
+        if (virAsprintf(&def->name, "snap%zu", i) < 0)
+            goto cleanup;
+
+        /* Keep the expected output of one snapshot, formatted before
+         * its devices get shared */
+        if (i == nsnaps / 2 &&
+            !(expected = virDomainSnapshotDefFormat(NULL, def,
+                                                    VIR_DOMAIN_XML_SECURE,
+                                                    false)))
+            goto cleanup;
+
+        if (!(snaps[i] = virDomainSnapshotAssignDef(snapshots, def)))
+            goto cleanup;
+        def = NULL;
+    }
+
+    first = snaps[0]->def->dom;
+    for (i = 0; i < nsnaps; i++) {
+        virDomainDefPtr dom = snaps[i]->def->dom;
+
+        for (j = 0; j < dom->ndisks; j++) {
+            bool changed = STREQ(dom->disks[j]->dst, "hdf");
+
+            refs++;
+            bytes += sizeof(virDomainDiskDef);
+            if (i == 0 || changed) {
+                distinct++;
+                sharedBytes += sizeof(virDomainDiskDef);
+            }
+
+            if (i > 0 && changed == (dom->disks[j] == first->disks[j])) {
+                fprintf(stderr, "\nsnap%zu: disk %s is %s\n", i,
+                        dom->disks[j]->dst,
+                        changed ? "shared" : "not shared");
+                goto cleanup;
+            }
+        }
+
+        for (j = 0; j < dom->ncontrollers; j++) {
+            refs++;
+            bytes += sizeof(virDomainControllerDef);
+            if (i == 0) {
+                distinct++;
+                sharedBytes += sizeof(virDomainControllerDef);
+            } else if (dom->controllers[j] != first->controllers[j]) {
+                fprintf(stderr, "\nsnap%zu: controller %zu is not shared\n",
+                        i, j);
+                goto cleanup;
+            }
+        }
+    }
+
+    if (virTestGetDebug())
+        fprintf(stderr,
+                "\n%zu snapshots: %zu device references to %zu devices, "
+                "%zu bytes of device structures instead of %zu\n",
+                nsnaps, refs, distinct, sharedBytes, bytes);
+
+    /* Dropping snapshots must leave the devices of the others alone */
+    for (i = 0; i < nsnaps; i++) {
+        if (i == nsnaps / 2)
+            continue;
+        virDomainSnapshotObjListRemove(snapshots, snaps[i]);
+    }
+
+    snap = virDomainSnapshotFindByName(snapshots, snaps[nsnaps / 2]->def->name);
+    if (!snap ||
+        !(actual = virDomainSnapshotDefFormat(NULL, snap->def,
+                                              VIR_DOMAIN_XML_SECURE, false)))
+        goto cleanup;
+
+    if (STRNEQ(expected, actual)) {
+        virtTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainSnapshotDefFree(def);
+    virDomainSnapshotObjListFree(snapshots);
+    VIR_FREE(snaps);
+    VIR_FREE(inXmlData);
+    VIR_FREE(xml);
+    VIR_FREE(expected);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
 struct testInfo {
     const char *inxml;
     const char *outxml;
@@ -226,6 +364,10 @@ mymain(void)
     DO_TEST_IN("description_only", NULL);
     DO_TEST_IN("name_only", NULL);
 
+    if (virtTestRun("SNAPSHOT shared devices", testSnapshotSharedDevices,
+                    NULL) < 0)
+        ret = -1;
+
  cleanup:
     if (testSnapshotXMLVariableLineRegex)
         regfree(testSnapshotXMLVariableLineRegex);
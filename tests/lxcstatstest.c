@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "lxc/lxc_statspriv.h"
+#include "viratomic.h"
+#include "virfile.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/lxcstatsdir-XXXXXX"
+
+/* Number of samples the concurrent writer publishes */
+#define WRITER_SAMPLES 100000
+
+
+/* A sample whose fields all derive from @value, so that a sample
+ * mixing two of them is detected */
+static void
+testFillSample(virLXCStatsSamplePtr sample,
+               unsigned long long stamp,
+               unsigned long long value)
+{
+    memset(sample, 0, sizeof(*sample));
+    sample->stamp = stamp;
+    sample->cpuTime = value;
+    sample->memory = true;
+    sample->memUsage = value;
+    sample->swap = true;
+    sample->swapUsage = value;
+    sample->blkio = true;
+    sample->rdBytes = value;
+    sample->wrBytes = value;
+    sample->rdReq = value;
+    sample->wrReq = value;
+}
+
+
+static int
+testCheckSample(const virLXCStatsSample *sample)
+{
+    unsigned long long value = sample->cpuTime;
+
+    if (!sample->memory || !sample->swap || !sample->blkio ||
+        sample->memUsage != value || sample->swapUsage != value ||
+        sample->rdBytes != value || sample->wrBytes != value ||
+        sample->rdReq != value || sample->wrReq != value) {
+        fprintf(stderr, "Torn sample for value %llu\n", value);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testStatsPublishRead(const void *opaque)
+{
+    const char *dir = opaque;
+    virLXCStatsPtr writer = NULL;
+    virLXCStatsPtr reader = NULL;
+    virLXCStatsSample sample;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    if (!(writer = virLXCStatsCreate(dir, "publish")) ||
+        !(reader = virLXCStatsOpen(dir, "publish")))
+        goto cleanup;
+
+    if (virLXCStatsRead(reader, &sample) == 0) {
+        fprintf(stderr, "Sample read before any was published\n");
+        goto cleanup;
+    }
+
+    /* Go around the ring more than once */
+    for (i = 1; i <= 2 * VIR_LXC_STATS_SLOTS + 1; i++) {
+        if (virLXCStatsNow(&now) < 0)
+            goto cleanup;
+
+        testFillSample(&sample, now, i);
+        virLXCStatsPublish(writer, &sample);
+
+        memset(&sample, 0, sizeof(sample));
+        if (virLXCStatsRead(reader, &sample) < 0 ||
+            testCheckSample(&sample) < 0 ||
+            sample.cpuTime != i || sample.stamp != now) {
+            fprintf(stderr, "Sample %zu not read back\n", i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virLXCStatsFree(reader);
+    virLXCStatsFree(writer);
+    virLXCStatsDelete(dir, "publish");
+    return ret;
+}
+
+
+static int
+testStatsStale(const void *opaque)
+{
+    const char *dir = opaque;
+    virLXCStatsPtr writer = NULL;
+    virLXCStatsPtr reader = NULL;
+    virLXCStatsSample sample;
+    unsigned long long now;
+    int ret = -1;
+
+    if (!(writer = virLXCStatsCreate(dir, "stale")) ||
+        !(reader = virLXCStatsOpen(dir, "stale")) ||
+        virLXCStatsNow(&now) < 0)
+        goto cleanup;
+
+    /* The controller is assumed to be stuck past the maximum age */
+    testFillSample(&sample, now - VIR_LXC_STATS_MAX_AGE - 1, 1);
+    virLXCStatsPublish(writer, &sample);
+
+    if (virLXCStatsRead(reader, &sample) == 0) {
+        fprintf(stderr, "Stale sample was read\n");
+        goto cleanup;
+    }
+
+    /* A fresh sample replaces it */
+    testFillSample(&sample, now, 2);
+    virLXCStatsPublish(writer, &sample);
+
+    if (virLXCStatsRead(reader, &sample) < 0 || sample.cpuTime != 2) {
+        fprintf(stderr, "Fresh sample was not read\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virLXCStatsFree(reader);
+    virLXCStatsFree(writer);
+    virLXCStatsDelete(dir, "stale");
+    return ret;
+}
+
+
+typedef struct _testWriterData testWriterData;
+struct _testWriterData {
+    virLXCStatsPtr writer;
+    unsigned long long stamp;
+    int done;
+};
+
+static void
+testStatsWriter(void *opaque)
+{
+    testWriterData *data = opaque;
+    virLXCStatsSample sample;
+    size_t i;
+
+    for (i = 1; i <= WRITER_SAMPLES; i++) {
+        testFillSample(&sample, data->stamp, i);
+        virLXCStatsPublish(data->writer, &sample);
+    }
+
+    virAtomicIntSet(&data->done, 1);
+}
+
+
+static int
+testStatsTornRead(const void *opaque)
+{
+    const char *dir = opaque;
+    testWriterData data = { 0 };
+    virLXCStatsPtr reader = NULL;
+    virLXCStatsSample sample;
+    virLXCStatsSlot *slot;
+    virThread thread;
+    bool running = false;
+    size_t reads = 0;
+    int ret = -1;
+
+    if (!(data.writer = virLXCStatsCreate(dir, "torn")) ||
+        !(reader = virLXCStatsOpen(dir, "torn")) ||
+        virLXCStatsNow(&data.stamp) < 0)
+        goto cleanup;
+
+    testFillSample(&sample, data.stamp, 0);
+    virLXCStatsPublish(data.writer, &sample);
+
+    /* A reader finding the slot being written gives up after retrying */
+    slot = &data.writer->shm->slots[data.writer->shm->head];
+    slot->seq++;
+    if (virLXCStatsRead(reader, &sample) == 0) {
+        fprintf(stderr, "Sample read while it was being written\n");
+        goto cleanup;
+    }
+    slot->seq++;
+    if (virLXCStatsRead(reader, &sample) < 0) {
+        fprintf(stderr, "Sample not read once written\n");
+        goto cleanup;
+    }
+
+    /* Whatever the interleaving, no sample read mixes two of them */
+    if (virThreadCreate(&thread, true, testStatsWriter, &data) < 0)
+        goto cleanup;
+    running = true;
+
+    while (!virAtomicIntGet(&data.done)) {
+        if (virLXCStatsRead(reader, &sample) < 0)
+            continue;
+        if (testCheckSample(&sample) < 0)
+            goto cleanup;
+        reads++;
+    }
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu consistent reads\n", reads);
+
+    ret = 0;
+
+ cleanup:
+    if (running)
+        virThreadJoin(&thread);
+    virLXCStatsFree(reader);
+    virLXCStatsFree(data.writer);
+    virLXCStatsDelete(dir, "torn");
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create %s\n", scratchdir);
+        return EXIT_FAILURE;
+    }
+
+    if (virtTestRun("Stats publish/read", testStatsPublishRead,
+                    scratchdir) < 0)
+        ret = -1;
+    if (virtTestRun("Stats stale", testStatsStale, scratchdir) < 0)
+        ret = -1;
+    if (virtTestRun("Stats torn read", testStatsTornRead, scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "node_device_conf.h"
+#include "viralloc.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Fixture every device of the list is made from, renamed */
+#define TEMPLATE "pci_8086_10c9_sriov_pf"
+
+static char *templateXML;
+
+
+static const char *
+testSysfsPath(size_t i, bool moved)
+{
+    static char path[128];
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/pci0000:%02zx/0000:%02zx:%02zx.%zx%s",
+             i >> 16, (i >> 8) & 0xff, (i >> 3) & 0x1f, i & 0x7,
+             moved ? "/moved" : "");
+    return path;
+}
+
+
+static int
+testAssignDevice(virNodeDeviceObjListPtr devs, size_t i,
+                 const char *sysfs_path)
+{
+    virNodeDeviceDefPtr def;
+    virNodeDeviceObjPtr dev;
+
+    if (!(def = virNodeDeviceDefParseString(templateXML, EXISTING_DEVICE,
+                                            NULL)))
+        return -1;
+
+    VIR_FREE(def->name);
+    if (virAsprintf(&def->name, "pci_vf_%zu", i) < 0 ||
+        VIR_STRDUP(def->sysfs_path, sysfs_path) < 0 ||
+        !(dev = virNodeDeviceAssignDef(devs, def))) {
+        virNodeDeviceDefFree(def);
+        return -1;
+    }
+
+    virNodeDeviceObjUnlock(dev);
+    return 0;
+}
+
+
+/* Check device @i can be found, and only where it is expected */
+static int
+testCheckDevice(virNodeDeviceObjListPtr devs, size_t i,
+                bool present, bool moved)
+{
+    virNodeDeviceObjPtr byName, byPath, byOldPath;
+    char *name = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&name, "pci_vf_%zu", i) < 0)
+        return -1;
+
+    if ((byName = virNodeDeviceFindByName(devs, name)))
+        virNodeDeviceObjUnlock(byName);
+    if ((byPath = virNodeDeviceFindBySysfsPath(devs,
+                                               testSysfsPath(i, moved))))
+        virNodeDeviceObjUnlock(byPath);
+    if ((byOldPath = virNodeDeviceFindBySysfsPath(devs,
+                                                  testSysfsPath(i, !moved))))
+        virNodeDeviceObjUnlock(byOldPath);
+
+    if (!present) {
+        if (byName || byPath || byOldPath) {
+            fprintf(stderr, "Removed device %s still found\n", name);
+            goto cleanup;
+        }
+    } else if (!byName || byPath != byName || byOldPath ||
+               STRNEQ(byName->def->name, name)) {
+        fprintf(stderr, "Device %s not found as expected\n", name);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(name);
+    return ret;
+}
+
+
+static int
+testObjListLookups(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNodeDeviceObjList devs = { 0 };
+    virNodeDeviceObjPtr dev;
+    size_t ndevs = virTestGetExpensive() ? 20000 : 2000;
+    unsigned long long start, assigned, looked;
+    size_t i;
+    int ret = -1;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndevs; i++) {
+        if (testAssignDevice(&devs, i, testSysfsPath(i, false)) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&assigned) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndevs; i++) {
+        if (testCheckDevice(&devs, i, true, false) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&looked) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu devices assigned in %llu ms, "
+                "looked up in %llu ms\n",
+                ndevs, assigned - start, looked - assigned);
+
+    /* A change event may move a device to another sysfs path */
+    for (i = 0; i < ndevs; i += 3) {
+        if (testAssignDevice(&devs, i, testSysfsPath(i, true)) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < ndevs; i += 2) {
+        if (!(dev = virNodeDeviceFindBySysfsPath(&devs,
+                                                 testSysfsPath(i, i % 3 == 0))))
+            goto cleanup;
+        virNodeDeviceObjRemove(&devs, dev);
+    }
+
+    if (devs.count != ndevs - (ndevs + 1) / 2) {
+        fprintf(stderr, "%zu devices left instead of %zu\n",
+                devs.count, ndevs - (ndevs + 1) / 2);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ndevs; i++) {
+        if (testCheckDevice(&devs, i, i % 2 != 0, i % 3 == 0) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virNodeDeviceObjListFree(&devs);
+    return ret;
+}
+
+
+/* Devices sharing a sysfs path are found by it in the order they were
+ * added, whichever of them goes away */
+static int
+testObjListSharedPath(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNodeDeviceObjList devs = { 0 };
+    virNodeDeviceObjPtr dev;
+    const char *path = testSysfsPath(0, false);
+    /* Device removed in turn, and device expected to be found before */
+    const char *removed[] = { "pci_vf_1", "pci_vf_0", "pci_vf_2" };
+    const char *found[] = { "pci_vf_0", "pci_vf_0", "pci_vf_2" };
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(removed); i++) {
+        if (testAssignDevice(&devs, i, path) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(removed); i++) {
+        if (!(dev = virNodeDeviceFindBySysfsPath(&devs, path))) {
+            fprintf(stderr, "No device found instead of %s\n", found[i]);
+            goto cleanup;
+        }
+        if (STRNEQ(dev->def->name, found[i])) {
+            fprintf(stderr, "Found %s instead of %s\n",
+                    dev->def->name, found[i]);
+            virNodeDeviceObjUnlock(dev);
+            goto cleanup;
+        }
+        virNodeDeviceObjUnlock(dev);
+
+        if (!(dev = virNodeDeviceFindByName(&devs, removed[i])))
+            goto cleanup;
+        virNodeDeviceObjRemove(&devs, dev);
+    }
+
+    if ((dev = virNodeDeviceFindBySysfsPath(&devs, path))) {
+        fprintf(stderr, "Found %s after all devices were removed\n",
+                dev->def->name);
+        virNodeDeviceObjUnlock(dev);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virNodeDeviceObjListFree(&devs);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char *path = NULL;
+
+    if (virAsprintf(&path, "%s/nodedevschemadata/%s.xml",
+                    abs_srcdir, TEMPLATE) < 0 ||
+        virtTestLoadFile(path, &templateXML) < 0) {
+        VIR_FREE(path);
+        return EXIT_FAILURE;
+    }
+
+    if (virtTestRun("Node device list lookups", testObjListLookups, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Node device list shared sysfs path",
+                    testObjListSharedPath, NULL) < 0)
+        ret = -1;
+
+    VIR_FREE(path);
+    VIR_FREE(templateXML);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
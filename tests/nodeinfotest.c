@@ -229,6 +229,196 @@ linuxTestNodeCPUStats(const void *data)
     return result;
 }
 
+struct nodeNUMAPlacementData {
+    const char *topology;
+    const char *name;
+    unsigned int vcpus;
+    unsigned long long memory;
+};
+
+static int
+linuxTestNodeNUMAPlacement(const void *data)
+{
+    const struct nodeNUMAPlacementData *testData = data;
+    int result = -1;
+    char *nodesfile = NULL;
+    char *outfile = NULL;
+    char *nodesData = NULL;
+    char *expectData = NULL;
+    char *actualData = NULL;
+    char **lines = NULL;
+    virNumaNodeLoadPtr nodes = NULL;
+    size_t nnodes = 0;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+    int policy;
+
+    if (virAsprintf(&nodesfile, "%s/nodeinfodata/linux-numa-%s.nodes",
+                    abs_srcdir, testData->topology) < 0 ||
+        virAsprintf(&outfile, "%s/nodeinfodata/linux-numa-%s.expected",
+                    abs_srcdir, testData->name) < 0)
+        goto fail;
+
+    if (virtTestLoadFile(nodesfile, &nodesData) < 0 ||
+        virtTestLoadFile(outfile, &expectData) < 0)
+        goto fail;
+
+    if (!(lines = virStringSplit(nodesData, "\n", 0)))
+        goto fail;
+
+    for (i = 0; lines[i]; i++) {
+        virNumaNodeLoad node;
+
+        if (lines[i][0] == '#' || lines[i][0] == '\0')
+            continue;
+
+        if (sscanf(lines[i], "%d %u %u %u %llu %llu",
+                   &node.node, &node.ncpus, &node.load, &node.pinned,
+                   &node.memTotal, &node.memFree) != 6) {
+            fprintf(stderr, "malformed line '%s' in %s\n",
+                    lines[i], nodesfile);
+            goto fail;
+        }
+
+        if (VIR_APPEND_ELEMENT(nodes, nnodes, node) < 0)
+            goto fail;
+    }
+
+    for (policy = VIR_NUMA_PLACEMENT_POLICY_PACK;
+         policy < VIR_NUMA_PLACEMENT_POLICY_LAST; policy++) {
+        virBitmapPtr nodeset = NULL;
+        char *str;
+
+        if (virNumaPlacementChoose(nodes, nnodes, policy, testData->vcpus,
+                                   testData->memory, &nodeset) < 0)
+            goto fail;
+
+        str = virBitmapFormat(nodeset);
+        virBitmapFree(nodeset);
+        if (!str)
+            goto fail;
+
+        virBufferAsprintf(&buf, "%s: %s\n",
+                          virNumaPlacementPolicyTypeToString(policy), str);
+        VIR_FREE(str);
+    }
+
+    if (!(actualData = virBufferContentAndReset(&buf))) {
+        virReportOOMError();
+        goto fail;
+    }
+
+    if (STRNEQ(actualData, expectData)) {
+        virtTestDifference(stderr, expectData, actualData);
+        goto fail;
+    }
+
+    result = 0;
+
+ fail:
+    virBufferFreeAndReset(&buf);
+    virStringFreeList(lines);
+    VIR_FREE(nodes);
+    VIR_FREE(nodesfile);
+    VIR_FREE(outfile);
+    VIR_FREE(nodesData);
+    VIR_FREE(expectData);
+    VIR_FREE(actualData);
+    return result;
+}
+
+
+static int
+linuxTestNodeNUMAPlacementReserve(const void *data ATTRIBUTE_UNUSED)
+{
+    virBitmapPtr nodeset = NULL;
+    int result = -1;
+
+    if (virBitmapParse("1-2", 0, &nodeset, 8) < 0)
+        goto fail;
+
+    /* 5 vCPUs split over two nodes, the first one takes the extra */
+    if (virNumaPlacementReserve(nodeset, 5) < 0)
+        goto fail;
+
+    if (virNumaPlacementGetPinned(0) != 0 ||
+        virNumaPlacementGetPinned(1) != 3 ||
+        virNumaPlacementGetPinned(2) != 2) {
+        fprintf(stderr, "unexpected vCPU reservation %u/%u/%u\n",
+                virNumaPlacementGetPinned(0),
+                virNumaPlacementGetPinned(1),
+                virNumaPlacementGetPinned(2));
+        goto fail;
+    }
+
+    virNumaPlacementRelease(nodeset, 5);
+
+    if (virNumaPlacementGetPinned(1) != 0 ||
+        virNumaPlacementGetPinned(2) != 0) {
+        fprintf(stderr, "vCPU reservation not released\n");
+        goto fail;
+    }
+
+    result = 0;
+
+ fail:
+    virBitmapFree(nodeset);
+    return result;
+}
+
+
+static int
+linuxTestNodeNUMAMaps(const void *data)
+{
+    const char *name = data;
+    int result = -1;
+    char *mapsfile = NULL;
+    char *outfile = NULL;
+    char *expectData = NULL;
+    char *actualData = NULL;
+    unsigned long long *memory = NULL;
+    size_t nnodes = 0;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    if (virAsprintf(&mapsfile, "%s/nodeinfodata/linux-numa-maps-%s.numa_maps",
+                    abs_srcdir, name) < 0 ||
+        virAsprintf(&outfile, "%s/nodeinfodata/linux-numa-maps-%s.expected",
+                    abs_srcdir, name) < 0)
+        goto fail;
+
+    if (virtTestLoadFile(outfile, &expectData) < 0)
+        goto fail;
+
+    if (virNumaParseProcessMemory(mapsfile, &memory, &nnodes) < 0)
+        goto fail;
+
+    for (i = 0; i < nnodes; i++)
+        virBufferAsprintf(&buf, "node%zu: %llu\n", i, memory[i]);
+
+    if (!(actualData = virBufferContentAndReset(&buf))) {
+        virReportOOMError();
+        goto fail;
+    }
+
+    if (STRNEQ(actualData, expectData)) {
+        virtTestDifference(stderr, expectData, actualData);
+        goto fail;
+    }
+
+    result = 0;
+
+ fail:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(memory);
+    VIR_FREE(mapsfile);
+    VIR_FREE(outfile);
+    VIR_FREE(expectData);
+    VIR_FREE(actualData);
+    return result;
+}
+
+
 
 static int
 mymain(void)
@@ -265,6 +455,28 @@ mymain(void)
 
     DO_TEST_CPU_STATS("24cpu", 24);
 
+# define DO_TEST_NUMA_PLACEMENT(topology, name, vcpus, memory) \
+    do { \
+        static struct nodeNUMAPlacementData data = { \
+            topology, topology "-" name, vcpus, memory \
+        }; \
+        if (virtTestRun("NUMA placement " topology "-" name, \
+                        linuxTestNodeNUMAPlacement, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_NUMA_PLACEMENT("4node", "small", 4, 4 * 1024 * 1024);
+    DO_TEST_NUMA_PLACEMENT("4node", "large", 16, 40 * 1024 * 1024);
+    DO_TEST_NUMA_PLACEMENT("4node", "huge", 8, 200 * 1024 * 1024);
+    DO_TEST_NUMA_PLACEMENT("memoryless", "small", 2, 2 * 1024 * 1024);
+
+    if (virtTestRun("NUMA placement reservation",
+                    linuxTestNodeNUMAPlacementReserve, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("NUMA maps qemu", linuxTestNodeNUMAMaps, "qemu") < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -22,6 +22,7 @@
 #include "testutils.h"
 #include "testutilsqemu.h"
 #include "qemumonitortestutils.h"
+#include "qemu/qemu_capspriv.h"
 
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -160,6 +161,59 @@ testQemuCapsCompare(virQEMUCapsPtr capsProvided,
     return ret;
 }
 
+/*
+ * Check that @qemuCaps survives a trip through the on-disk cache, by
+ * saving it, loading it back and saving it again.
+ */
+static int
+testQemuCapsCache(virQEMUCapsPtr qemuCaps, const char *base)
+{
+    char *cacheFile = NULL, *resavedFile = NULL;
+    char *cache = NULL, *resaved = NULL;
+    virQEMUCapsPtr loaded = NULL;
+    time_t qemuctime, selfctime;
+    int ret = -1;
+
+    if (virAsprintf(&cacheFile, "%s/qemucapabilitiestest-%s.cache",
+                    abs_builddir, base) < 0 ||
+        virAsprintf(&resavedFile, "%s/qemucapabilitiestest-%s.resaved",
+                    abs_builddir, base) < 0)
+        goto cleanup;
+
+    if (virQEMUCapsSaveCache(qemuCaps, cacheFile) < 0)
+        goto cleanup;
+
+    if (!(loaded = virQEMUCapsNew()) ||
+        virQEMUCapsLoadCache(loaded, cacheFile, &qemuctime, &selfctime) < 0)
+        goto cleanup;
+
+    if (testQemuCapsCompare(qemuCaps, loaded) < 0)
+        goto cleanup;
+
+    if (virQEMUCapsSaveCache(loaded, resavedFile) < 0 ||
+        virtTestLoadFile(cacheFile, &cache) < 0 ||
+        virtTestLoadFile(resavedFile, &resaved) < 0)
+        goto cleanup;
+
+    if (STRNEQ(cache, resaved)) {
+        virtTestDifference(stderr, cache, resaved);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (cacheFile)
+        unlink(cacheFile);
+    if (resavedFile)
+        unlink(resavedFile);
+    VIR_FREE(cacheFile);
+    VIR_FREE(resavedFile);
+    VIR_FREE(cache);
+    VIR_FREE(resaved);
+    virObjectUnref(loaded);
+    return ret;
+}
+
 static int
 testQemuCaps(const void *opaque)
 {
@@ -202,6 +256,9 @@ testQemuCaps(const void *opaque)
     if (testQemuCapsCompare(capsProvided, capsComputed) < 0)
         goto cleanup;
 
+    if (testQemuCapsCache(capsComputed, data->base) < 0)
+        goto cleanup;
+
     ret = 0;
  cleanup:
     VIR_FREE(repliesFile);
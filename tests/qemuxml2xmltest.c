@@ -17,6 +17,7 @@
 # include "qemu/qemu_domain.h"
 # include "testutilsqemu.h"
 # include "virstring.h"
+# include "virtime.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -110,6 +111,77 @@ testCompareXMLToXMLHelper(const void *data)
 }
 
 
+
+/*
+ * Parse every definition of the qemuxml2argvdata corpus and report the
+ * time taken, to catch regressions in define throughput.
+ */
+static int
+testParseBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    size_t iterations = virTestGetExpensive() ? 100 : 2;
+    unsigned long long start, end;
+    char **names = NULL;
+    char **corpus = NULL;
+    size_t ncorpus = 0;
+    size_t nparsed = 0;
+    char *path = NULL;
+    char *xml = NULL;
+    virDomainDefPtr def;
+    size_t i, j;
+    int ret = -1;
+
+    if (virtTestListFiles(abs_srcdir "/qemuxml2argvdata", ".xml",
+                          &names) < 0)
+        goto cleanup;
+
+    for (i = 0; names[i]; i++) {
+        VIR_FREE(path);
+        if (virAsprintf(&path, "%s/qemuxml2argvdata/%s",
+                        abs_srcdir, names[i]) < 0 ||
+            virtTestLoadFile(path, &xml) < 0 ||
+            VIR_APPEND_ELEMENT(corpus, ncorpus, xml) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < ncorpus; j++) {
+            /* Some inputs are deliberately invalid */
+            if (!(def = virDomainDefParseString(corpus[j], driver.caps,
+                                                driver.xmlopt,
+                                                QEMU_EXPECTED_VIRT_TYPES,
+                                                VIR_DOMAIN_XML_INACTIVE))) {
+                virResetLastError();
+                continue;
+            }
+            virDomainDefFree(def);
+            nparsed++;
+        }
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu x %zu definitions (%zu parsed): %llu ms\n",
+                iterations, ncorpus, nparsed / iterations, end - start);
+
+    ret = 0;
+
+ cleanup:
+    virStringFreeList(names);
+    for (i = 0; i < ncorpus; i++)
+        VIR_FREE(corpus[i]);
+    VIR_FREE(corpus);
+    VIR_FREE(path);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -335,6 +407,9 @@ mymain(void)
 
     DO_TEST("panic");
 
+    if (virtTestRun("QEMU XML parse benchmark", testParseBench, NULL) < 0)
+        ret = -1;
+
     virObjectUnref(driver.caps);
     virObjectUnref(driver.xmlopt);
 
@@ -0,0 +1,237 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <fcntl.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "qemu/qemu_conf.h"
+# include "qemu/qemu_domain.h"
+# include "testutilsqemu.h"
+# include "virstring.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+static virQEMUDriver driver;
+
+/* Definitions which passed the comparison, used for the benchmark */
+static virDomainDefPtr *corpus;
+static size_t ncorpus;
+static size_t nfallback;
+
+/*
+ * Copy @def both ways and check the results are the same definition.
+ * Definitions which cannot be cloned must still be copied by
+ * virDomainDefCopy(), through XML.
+ */
+static int
+testCompareCopy(const char *name, virDomainDefPtr def)
+{
+    virDomainDefPtr viaXML = NULL;
+    virDomainDefPtr clone = NULL;
+    char *expected = NULL;
+    char *actual = NULL;
+    int ret = -1;
+
+    if (!(viaXML = virDomainDefCopyXML(def, driver.caps, driver.xmlopt, false)))
+        goto cleanup;
+
+    if (!virDomainDefCanClone(def)) {
+        if (!(clone = virDomainDefCopy(def, driver.caps, driver.xmlopt, false)))
+            goto cleanup;
+        nfallback++;
+    } else if (!(clone = virDomainDefClone(def))) {
+        goto cleanup;
+    }
+
+    if (!(expected = virDomainDefFormat(viaXML, VIR_DOMAIN_XML_SECURE)) ||
+        !(actual = virDomainDefFormat(clone, VIR_DOMAIN_XML_SECURE)))
+        goto cleanup;
+
+    if (STRNEQ(expected, actual)) {
+        fprintf(stderr, "\n%s: clone differs from XML copy\n", name);
+        virtTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    if (!virDomainDefCheckABIStability(viaXML, clone)) {
+        fprintf(stderr, "\n%s: clone is not ABI compatible\n", name);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(expected);
+    VIR_FREE(actual);
+    virDomainDefFree(viaXML);
+    virDomainDefFree(clone);
+    return ret;
+}
+
+
+static int
+testCompareCopyHelper(const void *data)
+{
+    const char *name = data;
+    char *path = NULL;
+    char *xml = NULL;
+    virDomainDefPtr def = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&path, "%s/qemuxml2argvdata/%s", abs_srcdir, name) < 0 ||
+        virtTestLoadFile(path, &xml) < 0)
+        goto cleanup;
+
+    /* Some inputs are deliberately invalid */
+    if (!(def = virDomainDefParseString(xml, driver.caps, driver.xmlopt,
+                                        QEMU_EXPECTED_VIRT_TYPES,
+                                        VIR_DOMAIN_XML_INACTIVE))) {
+        virResetLastError();
+        ret = EXIT_AM_SKIP;
+        goto cleanup;
+    }
+
+    if (testCompareCopy(name, def) < 0)
+        goto cleanup;
+
+    /* Parse the live view as well and pretend it is running, so that
+     * live-only state gets formatted and has to be dropped.  Inactive
+     * configs lacking live state such as dynamic labels stop here. */
+    virDomainDefFree(def);
+    if (!(def = virDomainDefParseString(xml, driver.caps, driver.xmlopt,
+                                        QEMU_EXPECTED_VIRT_TYPES, 0))) {
+        virResetLastError();
+        ret = 0;
+        goto cleanup;
+    }
+    def->id = 1;
+
+    if (testCompareCopy(name, def) < 0)
+        goto cleanup;
+
+    if (virDomainDefCanClone(def) &&
+        VIR_APPEND_ELEMENT(corpus, ncorpus, def) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virDomainDefFree(def);
+    VIR_FREE(path);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+/*
+ * Copy every cloneable definition of the corpus both ways and report
+ * the time taken.
+ */
+static int
+testCopyBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned long long start, viaXMLTime, cloneTime;
+    size_t iterations = virTestGetExpensive() ? 100 : 2;
+    virDomainDefPtr copy;
+    size_t i, j;
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < ncorpus; j++) {
+            if (!(copy = virDomainDefCopyXML(corpus[j], driver.caps,
+                                             driver.xmlopt, false)))
+                return -1;
+            virDomainDefFree(copy);
+        }
+    }
+
+    if (virTimeMillisNow(&viaXMLTime) < 0)
+        return -1;
+    viaXMLTime -= start;
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < ncorpus; j++) {
+            if (!(copy = virDomainDefClone(corpus[j])))
+                return -1;
+            virDomainDefFree(copy);
+        }
+    }
+
+    if (virTimeMillisNow(&cloneTime) < 0)
+        return -1;
+    cloneTime -= start;
+
+    if (virTestGetDebug())
+        fprintf(stderr,
+                "\n%zu x %zu definitions (%zu copied through XML only): "
+                "XML round trip %llu ms, clone %llu ms\n",
+                iterations, ncorpus, nfallback, viaXMLTime, cloneTime);
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char **names = NULL;
+    size_t i;
+
+    if ((driver.caps = testQemuCapsInit()) == NULL)
+        return EXIT_FAILURE;
+
+    if (!(driver.xmlopt = virQEMUDriverCreateXMLConf(&driver)))
+        return EXIT_FAILURE;
+
+    if (virtTestListFiles(abs_srcdir "/qemuxml2argvdata", ".xml",
+                          &names) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; names[i]; i++) {
+        if (virtTestRun(names[i], testCompareCopyHelper, names[i]) < 0)
+            ret = -1;
+    }
+
+    if (virtTestRun("Copy benchmark", testCopyBench, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    virStringFreeList(names);
+    for (i = 0; i < ncorpus; i++)
+        virDomainDefFree(corpus[i]);
+    VIR_FREE(corpus);
+    virObjectUnref(driver.caps);
+    virObjectUnref(driver.xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
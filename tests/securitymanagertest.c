@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "security/security_manager.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_SECURITY
+
+#define NDISKS 16
+
+/* Disk the fake driver leaves alone */
+#define SKIPPED_DISK 1
+
+struct testLabelDisksData {
+    size_t nthreads;
+    /* Disks failing to be labeled, -1 for none */
+    int fail[2];
+};
+
+/* What the fake driver did, in order */
+static virMutex lock;
+static int labeled[NDISKS];
+static size_t nlabeled;
+static int restored[NDISKS];
+static size_t nrestored;
+
+
+static int
+testDiskIndex(virDomainDefPtr def, virDomainDiskDefPtr disk)
+{
+    size_t i;
+
+    for (i = 0; i < def->ndisks; i++) {
+        if (def->disks[i] == disk)
+            break;
+    }
+    return i;
+}
+
+
+static const struct testLabelDisksData *testData;
+
+static int
+testLabelDisk(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+              virDomainDefPtr def,
+              virDomainDiskDefPtr disk)
+{
+    int i = testDiskIndex(def, disk);
+
+    /* Give the other threads a chance to pick disks meanwhile */
+    usleep(1000);
+
+    if (i == testData->fail[0] || i == testData->fail[1]) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "unable to label %s", disk->dst);
+        return -1;
+    }
+
+    if (i == SKIPPED_DISK)
+        return 1;
+
+    virMutexLock(&lock);
+    labeled[nlabeled++] = i;
+    virMutexUnlock(&lock);
+    return 0;
+}
+
+
+static int
+testRestoreDisk(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+                virDomainDefPtr def,
+                virDomainDiskDefPtr disk)
+{
+    restored[nrestored++] = testDiskIndex(def, disk);
+    return 0;
+}
+
+
+static virDomainDefPtr
+testDomainNew(void)
+{
+    virDomainDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0 ||
+        VIR_STRDUP(def->name, "guest") < 0 ||
+        VIR_ALLOC_N(def->disks, NDISKS) < 0)
+        goto error;
+
+    for (i = 0; i < NDISKS; i++) {
+        if (VIR_ALLOC(def->disks[i]) < 0)
+            goto error;
+        def->ndisks++;
+        if (virAsprintf(&def->disks[i]->dst, "vd%c", (char)('a' + i)) < 0)
+            goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainDefFree(def);
+    return NULL;
+}
+
+
+static int
+testLabelDisks(const void *opaque)
+{
+    const struct testLabelDisksData *data = opaque;
+    virSecurityManagerPtr mgr = NULL;
+    virDomainDefPtr def = NULL;
+    int first = -1;
+    char *msg = NULL;
+    size_t i, j;
+    int rc;
+    int ret = -1;
+
+    testData = data;
+    nlabeled = nrestored = 0;
+
+    if (!(mgr = virSecurityManagerNew("none", "QEMU", false, true, false)) ||
+        !(def = testDomainNew()))
+        goto cleanup;
+
+    virSecurityManagerSetLabelThreads(mgr, data->nthreads);
+
+    virResetLastError();
+    rc = virSecurityManagerLabelDisks(mgr, def, testLabelDisk,
+                                      testRestoreDisk);
+
+    for (i = 0; i < ARRAY_CARDINALITY(data->fail); i++) {
+        if (data->fail[i] >= 0 && (first < 0 || data->fail[i] < first))
+            first = data->fail[i];
+    }
+
+    if (first < 0) {
+        if (rc < 0 || nlabeled != NDISKS - 1 || nrestored != 0) {
+            fprintf(stderr, "Expected %d disks labeled and none restored, "
+                    "got rc=%d labeled=%zu restored=%zu\n",
+                    NDISKS - 1, rc, nlabeled, nrestored);
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (rc == 0) {
+        fprintf(stderr, "Labeling succeeded despite disk %d failing\n", first);
+        goto cleanup;
+    }
+
+    /* The error of the lowest failed disk is reported, even if another
+     * thread failed first */
+    if (virAsprintf(&msg, "unable to label vd%c", (char)('a' + first)) < 0)
+        goto cleanup;
+    if (!virGetLastError() || !strstr(virGetLastErrorMessage(), msg)) {
+        fprintf(stderr, "Expected error '%s', got '%s'\n",
+                msg, virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    /* Each disk labeled is restored exactly once, in reverse order */
+    if (nrestored != nlabeled) {
+        fprintf(stderr, "%zu disks labeled but %zu restored\n",
+                nlabeled, nrestored);
+        goto cleanup;
+    }
+
+    for (i = 0; i < nrestored; i++) {
+        if (i > 0 && restored[i] >= restored[i - 1]) {
+            fprintf(stderr, "Disk %d restored after disk %d\n",
+                    restored[i], restored[i - 1]);
+            goto cleanup;
+        }
+        for (j = 0; j < nlabeled; j++) {
+            if (labeled[j] == restored[i])
+                break;
+        }
+        if (j == nlabeled) {
+            fprintf(stderr, "Disk %d restored but not labeled\n", restored[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virResetLastError();
+    VIR_FREE(msg);
+    virDomainDefFree(def);
+    virObjectUnref(mgr);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virMutexInit(&lock) < 0)
+        return EXIT_FAILURE;
+
+#define DO_TEST(name, threads, fail1, fail2)                                \
+    do {                                                                    \
+        static struct testLabelDisksData data = {                           \
+            threads, { fail1, fail2 },                                      \
+        };                                                                  \
+        if (virtTestRun("Label disks " name, testLabelDisks, &data) < 0)   \
+            ret = -1;                                                       \
+    } while (0)
+
+    DO_TEST("sequential", 1, -1, -1);
+    DO_TEST("sequential failure", 1, 5, -1);
+    DO_TEST("sequential first failure", 1, 0, -1);
+    DO_TEST("concurrent", 4, -1, -1);
+    DO_TEST("concurrent failure", 4, 5, -1);
+    DO_TEST("concurrent first failure", 4, 0, -1);
+    DO_TEST("concurrent last failure", 4, NDISKS - 1, -1);
+    DO_TEST("concurrent failures", 4, 9, 6);
+    DO_TEST("more threads than disks", NDISKS * 2, 7, 8);
+
+    virMutexDestroy(&lock);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
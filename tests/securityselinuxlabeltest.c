@@ -316,6 +316,149 @@ testSELinuxLabeling(const void *opaque)
 }
 
 
+/*
+ * Two guests sharing the same images: the second one must find them
+ * labeled already, and the first one to stop must leave them alone.
+ */
+static int
+testSELinuxLabelingShared(const void *opaque)
+{
+    const char *testname = opaque;
+    int ret = -1;
+    testSELinuxFile *files = NULL;
+    size_t nfiles = 0;
+    size_t i;
+    virDomainDefPtr def1 = NULL;
+    virDomainDefPtr def2 = NULL;
+    virSecurityManagerLabelStats start, labeled, restored;
+
+    if (testSELinuxLoadFileList(testname, &files, &nfiles) < 0)
+        goto cleanup;
+
+    if (testSELinuxCreateDisks(files, nfiles) < 0)
+        goto cleanup;
+
+    if (!(def1 = testSELinuxLoadDef(testname)) ||
+        !(def2 = testSELinuxLoadDef(testname)))
+        goto cleanup;
+    def2->uuid[0] ^= 0xff;
+
+    virSecurityManagerGetLabelStats(mgr, &start);
+
+    if (virSecurityManagerSetAllLabel(mgr, def1, NULL) < 0 ||
+        virSecurityManagerSetAllLabel(mgr, def2, NULL) < 0)
+        goto cleanup;
+
+    virSecurityManagerGetLabelStats(mgr, &labeled);
+
+    if (labeled.relabeled == start.relabeled ||
+        labeled.relabelSkipped - start.relabelSkipped !=
+        labeled.relabeled - start.relabeled) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "Labeled %llu files, skipped %llu for the second guest",
+                       labeled.relabeled - start.relabeled,
+                       labeled.relabelSkipped - start.relabelSkipped);
+        goto cleanup;
+    }
+
+    if (virSecurityManagerRestoreAllLabel(mgr, def1, false) < 0)
+        goto cleanup;
+
+    virSecurityManagerGetLabelStats(mgr, &restored);
+
+    if (restored.restoreSkipped == labeled.restoreSkipped) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "No restore was left to the second guest");
+        goto cleanup;
+    }
+
+    if (testSELinuxCheckLabels(files, nfiles) < 0)
+        goto cleanup;
+
+    if (virSecurityManagerRestoreAllLabel(mgr, def2, false) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (testSELinuxDeleteDisks(files, nfiles) < 0)
+        VIR_WARN("unable to fully clean up");
+
+    virDomainDefFree(def1);
+    virDomainDefFree(def2);
+    for (i = 0; i < nfiles; i++) {
+        VIR_FREE(files[i].file);
+        VIR_FREE(files[i].context);
+    }
+    VIR_FREE(files);
+    if (ret < 0 && virTestGetVerbose()) {
+        virErrorPtr err = virGetLastError();
+        fprintf(stderr, "%s\n", err ? err->message : "<unknown>");
+    }
+    return ret;
+}
+
+
+/*
+ * A guest labeling its images twice, as block jobs do, must still
+ * restore them when it stops.
+ */
+static int
+testSELinuxLabelingTwice(const void *opaque)
+{
+    const char *testname = opaque;
+    int ret = -1;
+    testSELinuxFile *files = NULL;
+    size_t nfiles = 0;
+    size_t i;
+    virDomainDefPtr def = NULL;
+    virSecurityManagerLabelStats labeled, restored;
+
+    if (testSELinuxLoadFileList(testname, &files, &nfiles) < 0)
+        goto cleanup;
+
+    if (testSELinuxCreateDisks(files, nfiles) < 0)
+        goto cleanup;
+
+    if (!(def = testSELinuxLoadDef(testname)))
+        goto cleanup;
+
+    if (virSecurityManagerSetAllLabel(mgr, def, NULL) < 0 ||
+        virSecurityManagerSetAllLabel(mgr, def, NULL) < 0)
+        goto cleanup;
+
+    virSecurityManagerGetLabelStats(mgr, &labeled);
+
+    if (virSecurityManagerRestoreAllLabel(mgr, def, false) < 0)
+        goto cleanup;
+
+    virSecurityManagerGetLabelStats(mgr, &restored);
+
+    if (restored.restoreSkipped != labeled.restoreSkipped) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Restore skipped for images labeled twice");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (testSELinuxDeleteDisks(files, nfiles) < 0)
+        VIR_WARN("unable to fully clean up");
+
+    virDomainDefFree(def);
+    for (i = 0; i < nfiles; i++) {
+        VIR_FREE(files[i].file);
+        VIR_FREE(files[i].context);
+    }
+    VIR_FREE(files);
+    if (ret < 0 && virTestGetVerbose()) {
+        virErrorPtr err = virGetLastError();
+        fprintf(stderr, "%s\n", err ? err->message : "<unknown>");
+    }
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -346,6 +489,13 @@ mymain(void)
     DO_TEST_LABELING("chardev");
     DO_TEST_LABELING("nfs");
 
+    if (virtTestRun("Labelling shared disks", testSELinuxLabelingShared,
+                    "disks") < 0)
+        ret = -1;
+    if (virtTestRun("Labelling disks twice", testSELinuxLabelingTwice,
+                    "disks") < 0)
+        ret = -1;
+
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
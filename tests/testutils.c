@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <dirent.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -359,6 +360,49 @@ virtTestLoadFile(const char *file, char **buf)
     return strlen(*buf);
 }
 
+/* Fill NAMES with the NULL terminated list of the files of DIR whose
+   name ends with SUFFIX, sorted so that tests always run in the same
+   order.  NAMES is to be freed with virStringFreeList.  Upon failure,
+   diagnose it and return -1.  Otherwise, return the number of names. */
+int
+virtTestListFiles(const char *dir, const char *suffix, char ***names)
+{
+    struct dirent **ents = NULL;
+    int nents;
+    size_t nnames = 0;
+    size_t i;
+    int ret = -1;
+
+    *names = NULL;
+
+    if ((nents = scandir(dir, &ents, NULL, alphasort)) < 0) {
+        fprintf(stderr, "%s: failed to list: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(*names, nents + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nents; i++) {
+        if (!virFileHasSuffix(ents[i]->d_name, suffix))
+            continue;
+        if (VIR_STRDUP((*names)[nnames], ents[i]->d_name) < 0) {
+            virStringFreeList(*names);
+            *names = NULL;
+            goto cleanup;
+        }
+        nnames++;
+    }
+
+    ret = nnames;
+
+ cleanup:
+    for (i = 0; i < nents; i++)
+        VIR_FREE(ents[i]);
+    VIR_FREE(ents);
+    return ret;
+}
+
 #ifndef WIN32
 static
 void virtTestCaptureProgramExecChild(const char *const argv[],
@@ -54,6 +54,7 @@ int virtTestRun(const char *title,
                 int (*body)(const void *data),
                 const void *data);
 int virtTestLoadFile(const char *file, char **buf);
+int virtTestListFiles(const char *dir, const char *suffix, char ***names);
 int virtTestCaptureProgramOutput(const char *const argv[], char **buf, int maxlen);
 
 int virtTestClearLineRegex(const char *pattern,
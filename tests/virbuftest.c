@@ -9,6 +9,7 @@
 #include "virbuffer.h"
 #include "viralloc.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -200,6 +201,240 @@ static int testBufTrim(const void *data ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testBufGrowth(const void *data ATTRIBUTE_UNUSED)
+{
+    virBuffer bufinit = VIR_BUFFER_INITIALIZER;
+    virBufferPtr buf = &bufinit;
+    unsigned int lastSize = 0;
+    size_t nresize = 0;
+    char *result = NULL;
+    int ret = -1;
+    size_t i;
+
+    /* Append 200 KB in small pieces as a formatter would */
+    for (i = 0; i < 10000; i++) {
+        virBufferAsprintf(buf, "<disk index='%05zu'/>\n", i);
+        if (buf->a != lastSize) {
+            lastSize = buf->a;
+            nresize++;
+        }
+    }
+
+    if (virBufferError(buf)) {
+        TEST_ERROR("Buffer had error");
+        goto cleanup;
+    }
+
+    if (virBufferUse(buf) != 10000 * strlen("<disk index='00000'/>\n")) {
+        TEST_ERROR("Unexpected length %u\n", virBufferUse(buf));
+        goto cleanup;
+    }
+
+    if (nresize > 20) {
+        TEST_ERROR("Buffer was resized %zu times\n", nresize);
+        goto cleanup;
+    }
+
+    result = virBufferContentAndReset(buf);
+    if (!result ||
+        !STRPREFIX(result, "<disk index='00000'/>\n<disk index='00001'/>\n") ||
+        !strstr(result, "<disk index='09999'/>\n")) {
+        TEST_ERROR("Wrong content");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(buf);
+    VIR_FREE(result);
+    return ret;
+}
+
+static int testBufSizeHint(const void *data ATTRIBUTE_UNUSED)
+{
+    virBuffer bufinit = VIR_BUFFER_INITIALIZER;
+    virBufferPtr buf = &bufinit;
+    unsigned int size;
+    char *result = NULL;
+    int ret = -1;
+    size_t i;
+
+    virBufferAddLit(buf, "abc");
+    virBufferSizeHint(buf, 64 * 1024);
+    size = buf->a;
+
+    if (size <= 64 * 1024) {
+        TEST_ERROR("Hint was not applied\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 64 * 1024 - 3; i++)
+        virBufferAddChar(buf, 'x');
+
+    if (buf->a != size) {
+        TEST_ERROR("Buffer was resized despite the hint\n");
+        goto cleanup;
+    }
+
+    /* Hinting less than what is there already does nothing */
+    virBufferSizeHint(buf, 10);
+    if (buf->a != size || virBufferUse(buf) != 64 * 1024) {
+        TEST_ERROR("Smaller hint changed the buffer\n");
+        goto cleanup;
+    }
+
+    result = virBufferContentAndReset(buf);
+    if (!result || !STRPREFIX(result, "abcxxx") ||
+        strlen(result) != 64 * 1024) {
+        TEST_ERROR("Wrong content");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(buf);
+    VIR_FREE(result);
+    return ret;
+}
+
+static int testBufScratch(const void *data ATTRIBUTE_UNUSED)
+{
+    virBuffer outer = VIR_BUFFER_INITIALIZER;
+    virBuffer inner = VIR_BUFFER_INITIALIZER;
+    char *outerResult = NULL;
+    char *innerResult = NULL;
+    char *content;
+    int ret = -1;
+    size_t i;
+
+    /* Leave a size hint for the next buffer */
+    virBufferScratchAcquire(&outer);
+    for (i = 0; i < 64 * 1024; i++)
+        virBufferAddChar(&outer, 'x');
+    /* The content is handed over as is, unless most of the allocation
+     * is unused and gets shrunk */
+    content = outer.a / 2 > outer.b + 1 ? NULL : outer.e;
+    if (!(outerResult = virBufferScratchContentAndReset(&outer)) ||
+        strlen(outerResult) != 64 * 1024) {
+        TEST_ERROR("Wrong content of first use");
+        goto cleanup;
+    }
+    if (content && outerResult != content) {
+        TEST_ERROR("Content was copied");
+        goto cleanup;
+    }
+    VIR_FREE(outerResult);
+
+    virBufferScratchAcquire(&outer);
+    if (!outer.e || outer.a < 64 * 1024 + 1 || virBufferUse(&outer) != 0 ||
+        STRNEQ(virBufferCurrentContent(&outer), "")) {
+        TEST_ERROR("Size hint was not followed");
+        goto cleanup;
+    }
+    virBufferAsprintf(&outer, "%s", "outer");
+
+    /* A nested user gets its own allocation */
+    virBufferScratchAcquire(&inner);
+    if (inner.e && inner.e == outer.e) {
+        TEST_ERROR("Allocation handed out twice");
+        goto cleanup;
+    }
+    virBufferAddLit(&inner, "inner");
+    innerResult = virBufferScratchContentAndReset(&inner);
+    outerResult = virBufferScratchContentAndReset(&outer);
+
+    if (!innerResult || STRNEQ(innerResult, "inner") ||
+        !outerResult || STRNEQ(outerResult, "outer")) {
+        TEST_ERROR("Wrong nested content");
+        goto cleanup;
+    }
+
+    if (outer.e || inner.e) {
+        TEST_ERROR("Buffers were not reset");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&outer);
+    virBufferFreeAndReset(&inner);
+    VIR_FREE(outerResult);
+    VIR_FREE(innerResult);
+    return ret;
+}
+
+/*
+ * Build a document about the size of the XML of a big domain, the way
+ * the formatters do, and report the throughput with a fresh buffer
+ * each time and with the size hint of the thread.
+ */
+static char *
+testBufBenchFormat(bool scratch)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    if (scratch)
+        virBufferScratchAcquire(&buf);
+
+    virBufferAddLit(&buf, "<domain type='kvm'>\n");
+    virBufferAdjustIndent(&buf, 2);
+    for (i = 0; i < 2000; i++) {
+        virBufferAddLit(&buf, "<disk type='file' device='disk'>\n");
+        virBufferAdjustIndent(&buf, 2);
+        virBufferEscapeString(&buf, "<source file='%s'/>\n",
+                              "/var/lib/libvirt/images/guest.qcow2");
+        virBufferAsprintf(&buf, "<target dev='vd%zu' bus='virtio'/>\n", i);
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</disk>\n");
+    }
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</domain>\n");
+
+    if (scratch)
+        return virBufferScratchContentAndReset(&buf);
+    return virBufferContentAndReset(&buf);
+}
+
+static int testBufBench(const void *data ATTRIBUTE_UNUSED)
+{
+    unsigned long long start, end;
+    unsigned long long elapsed[2];
+    size_t iterations = virTestGetExpensive() ? 2000 : 20;
+    size_t length = 0;
+    char *result;
+    size_t i, j;
+
+    for (j = 0; j < 2; j++) {
+        if (virTimeMillisNow(&start) < 0)
+            return -1;
+
+        for (i = 0; i < iterations; i++) {
+            if (!(result = testBufBenchFormat(j == 1))) {
+                TEST_ERROR("Formatting failed");
+                return -1;
+            }
+            length = strlen(result);
+            VIR_FREE(result);
+        }
+
+        if (virTimeMillisNow(&end) < 0)
+            return -1;
+        elapsed[j] = end - start;
+    }
+
+    if (virTestGetDebug())
+        fprintf(stderr,
+                "\n%zu documents of %zu bytes: %llu ms, "
+                "%llu ms with size hint\n",
+                iterations, length, elapsed[0], elapsed[1]);
+
+    return 0;
+}
+
 
 static int
 mymain(void)
@@ -218,6 +453,10 @@ mymain(void)
     DO_TEST("VSprintf infinite loop", testBufInfiniteLoop, 0);
     DO_TEST("Auto-indentation", testBufAutoIndent, 0);
     DO_TEST("Trim", testBufTrim, 0);
+    DO_TEST("Growth", testBufGrowth, 0);
+    DO_TEST("Size hint", testBufSizeHint, 0);
+    DO_TEST("Scratch", testBufScratch, 0);
+    DO_TEST("Benchmark", testBufBench, 0);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -449,6 +449,11 @@ FILE *fopen(const char *path, const char *mode)
     }
 
     if (STREQ(path, "/proc/mounts")) {
+        /* Lets the test suite check the mount table is cached */
+        if (getenv("VIR_CGROUP_MOCK_NO_MOUNTS")) {
+            errno = EACCES;
+            return NULL;
+        }
         if (STREQ(mode, "r")) {
             if (allinone)
                 return fmemopen((void *)procmountsallinone,
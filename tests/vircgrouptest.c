@@ -627,6 +627,107 @@ static int testCgroupGetMemoryUsage(const void *args ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testCgroupStatsCache(const void *args ATTRIBUTE_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    char *path = NULL;
+    int rv, ret = -1;
+    unsigned long kb;
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    (1 << VIR_CGROUP_CONTROLLER_MEMORY),
+                                    &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    virCgroupSetStatsCache(cgroup, true);
+
+    if (virCgroupGetMemoryUsage(cgroup, &kb) < 0 || kb != 1421212UL) {
+        fprintf(stderr, "Wrong value from cached virCgroupGetMemoryUsage\n");
+        goto cleanup;
+    }
+
+    if (cgroup->ncachedFiles != 1) {
+        fprintf(stderr, "Expected 1 cached file, got %zu\n",
+                cgroup->ncachedFiles);
+        goto cleanup;
+    }
+
+    /* The file changing underneath the cached fd must be noticed */
+    if (virCgroupPathOfController(cgroup, VIR_CGROUP_CONTROLLER_MEMORY,
+                                  "memory.usage_in_bytes", &path) < 0 ||
+        virFileWriteStr(path, "2097152\n", 0) < 0) {
+        fprintf(stderr, "Cannot update memory.usage_in_bytes\n");
+        goto cleanup;
+    }
+
+    if (virCgroupGetMemoryUsage(cgroup, &kb) < 0 || kb != 2048UL) {
+        fprintf(stderr, "Cached fd returned stale memory usage %lu\n", kb);
+        goto cleanup;
+    }
+
+    if (cgroup->ncachedFiles != 1) {
+        fprintf(stderr, "Expected cached fd to be reused, got %zu files\n",
+                cgroup->ncachedFiles);
+        goto cleanup;
+    }
+
+    virCgroupSetStatsCache(cgroup, false);
+    if (cgroup->ncachedFiles != 0) {
+        fprintf(stderr, "Cached files not closed when disabling cache\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (path)
+        ignore_value(virFileWriteStr(path, "1455321088\n", 0));
+    VIR_FREE(path);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+static int testCgroupMountCache(const void *args ATTRIBUTE_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    int ret = -1;
+
+    virCgroupResetMountCache();
+
+    if (virCgroupNewSelf(&cgroup) < 0) {
+        fprintf(stderr, "Cannot create cgroup for self\n");
+        goto cleanup;
+    }
+    virCgroupFree(&cgroup);
+
+    /* With /proc/mounts unreadable, lookups must be served from cache */
+    setenv("VIR_CGROUP_MOCK_NO_MOUNTS", "1", 1);
+
+    if (virCgroupNewSelf(&cgroup) < 0) {
+        fprintf(stderr, "Mount table was not served from cache\n");
+        goto cleanup;
+    }
+    virCgroupFree(&cgroup);
+
+    /* ... until the cache is dropped */
+    virCgroupResetMountCache();
+
+    if (virCgroupNewSelf(&cgroup) == 0) {
+        fprintf(stderr, "Mount table was not re-read after reset\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    unsetenv("VIR_CGROUP_MOCK_NO_MOUNTS");
+    virCgroupResetMountCache();
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
 static int testCgroupGetBlkioIoServiced(const void *args ATTRIBUTE_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -803,7 +904,14 @@ mymain(void)
     if (virtTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
 
+    if (virtTestRun("Cgroup stats file cache", testCgroupStatsCache, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Cgroup mount table cache", testCgroupMountCache, NULL) < 0)
+        ret = -1;
+
     setenv("VIR_CGROUP_MOCK_MODE", "allinone", 1);
+    virCgroupResetMountCache();
     if (virtTestRun("New cgroup for self (allinone)", testCgroupNewForSelfAllInOne, NULL) < 0)
         ret = -1;
     if (virtTestRun("Cgroup available", testCgroupAvailable, (void*)0x1) < 0)
@@ -811,11 +919,13 @@ mymain(void)
     unsetenv("VIR_CGROUP_MOCK_MODE");
 
     setenv("VIR_CGROUP_MOCK_MODE", "logind", 1);
+    virCgroupResetMountCache();
     if (virtTestRun("New cgroup for self (logind)", testCgroupNewForSelfLogind, NULL) < 0)
         ret = -1;
     if (virtTestRun("Cgroup available", testCgroupAvailable, (void*)0x0) < 0)
         ret = -1;
     unsetenv("VIR_CGROUP_MOCK_MODE");
+    virCgroupResetMountCache();
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(fakesysfsdir);
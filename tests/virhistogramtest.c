@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+#include "viralloc.h"
+#include "virhistogram.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+struct testPercentileData {
+    unsigned int percent;
+    unsigned long long expect;
+};
+
+/* 1, 2, ..., 1000 */
+static virHistogram linear;
+
+static int
+testPercentile(const void *opaque)
+{
+    const struct testPercentileData *data = opaque;
+    unsigned long long got = virHistogramPercentile(&linear, data->percent);
+
+    if (got != data->expect) {
+        fprintf(stderr, "p%u: expected %llu, got %llu\n",
+                data->percent, data->expect, got);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testPercentileBound(const void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned int percent;
+
+    /* The exact percentile of 1..1000 is 10 * percent */
+    for (percent = 1; percent <= 100; percent++) {
+        unsigned long long exact = 10 * percent;
+        unsigned long long got = virHistogramPercentile(&linear, percent);
+
+        if (got < exact || got >= 2 * exact) {
+            fprintf(stderr, "p%u: %llu is not within [%llu, %llu)\n",
+                    percent, got, exact, 2 * exact);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testEmpty(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virHistogram hist;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *str = NULL;
+    int ret = -1;
+
+    memset(&hist, 0, sizeof(hist));
+
+    if (virHistogramPercentile(&hist, 50) != 0)
+        goto cleanup;
+
+    virHistogramFormat(&buf, &hist);
+    if (!(str = virBufferContentAndReset(&buf)) ||
+        STRNEQ(str, "count=0"))
+        goto cleanup;
+
+    virHistogramAdd(&hist, 0);
+    virHistogramAdd(&hist, 0);
+    if (hist.count != 2 || hist.buckets[0] != 2 ||
+        virHistogramPercentile(&hist, 100) != 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(str);
+    return ret;
+}
+
+
+static int
+testFormat(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    const char *expect =
+        "count=1000 min=1 mean=500 p50=511 p90=1000 p99=1000 max=1000";
+    char *str = NULL;
+    int ret = -1;
+
+    virHistogramFormat(&buf, &linear);
+    if (!(str = virBufferContentAndReset(&buf)))
+        goto cleanup;
+
+    if (STRNEQ(str, expect)) {
+        virtTestDifference(stderr, expect, str);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(str);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t i;
+
+    for (i = 1; i <= 1000; i++)
+        virHistogramAdd(&linear, i);
+
+#define TEST_PERCENTILE(percent, expect)                                \
+    do {                                                                \
+        struct testPercentileData data = { percent, expect };           \
+        if (virtTestRun("Percentile " #percent, testPercentile,         \
+                        &data) < 0)                                     \
+            ret = -1;                                                   \
+    } while (0)
+
+    TEST_PERCENTILE(0, 1);
+    TEST_PERCENTILE(1, 15);
+    TEST_PERCENTILE(25, 255);
+    TEST_PERCENTILE(50, 511);
+    TEST_PERCENTILE(52, 1000);
+    TEST_PERCENTILE(100, 1000);
+
+    if (virtTestRun("Percentile bound", testPercentileBound, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Empty", testEmpty, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Format", testFormat, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -68,6 +68,8 @@ myCleanup(void)
         virObjectUnref(mgr->activePCIHostdevs);
         virObjectUnref(mgr->inactivePCIHostdevs);
         virObjectUnref(mgr->activeUSBHostdevs);
+        virObjectUnref(mgr->activeSCSIHostdevs);
+        virObjectUnref(mgr->pooledPCIHostdevs);
         VIR_FREE(mgr->stateDir);
         VIR_FREE(mgr);
     }
@@ -109,6 +111,8 @@ myInit(void)
         goto cleanup;
     if ((mgr->activeSCSIHostdevs = virSCSIDeviceListNew()) == NULL)
         goto cleanup;
+    if ((mgr->pooledPCIHostdevs = virPCIDeviceListNew()) == NULL)
+        goto cleanup;
     if (VIR_STRDUP(mgr->stateDir, TEST_STATE_DIR) < 0)
         goto cleanup;
     if (virFileMakePath(mgr->stateDir) < 0)
@@ -381,6 +385,158 @@ testVirHostdevReAttachPCINodeDevice(const void *oaque ATTRIBUTE_UNUSED)
 
 }
 
+static int
+testVirHostdevCheckStubDriver(void)
+{
+    char *path = NULL;
+    char *driver = NULL;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < nhostdevs; i++) {
+        if (virPCIDeviceGetDriverPathAndName(dev[i], &path, &driver) < 0)
+            goto cleanup;
+
+        if (STRNEQ_NULLABLE(driver, "pci-stub")) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           "PCI device %s driver mismatch: %s, "
+                           "expecting pci-stub",
+                           virPCIDeviceGetName(dev[i]), NULLSTR(driver));
+            goto cleanup;
+        }
+        VIR_FREE(path);
+        VIR_FREE(driver);
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(path);
+    VIR_FREE(driver);
+    return ret;
+}
+
+static int
+testVirHostdevPCIPoolAdd(const void *oaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    size_t i;
+    int count, count1;
+
+    /* The last device is bound to the stub driver behind the manager's
+     * back, as if it was assigned to a guest we did not reconnect to
+     * yet: it must not be reset or made available */
+    if (virPCIDeviceDetach(dev[nhostdevs - 1], NULL, NULL) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nhostdevs; i++) {
+        count1 = virPCIDeviceListCount(mgr->inactivePCIHostdevs);
+        if (virHostdevPCIPoolAdd(mgr, dev[i]) < 0)
+            goto cleanup;
+        if (i < nhostdevs - 1) {
+            CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count1 + 1);
+        } else {
+            CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count1);
+        }
+        CHECK_LIST_COUNT(mgr->pooledPCIHostdevs, i + 1);
+    }
+
+    VIR_DEBUG("Test: add pooled hostdevs again\n");
+    count1 = virPCIDeviceListCount(mgr->inactivePCIHostdevs);
+    if (virHostdevPCIPoolAdd(mgr, dev[0]) < 0)
+        goto cleanup;
+    CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count1);
+    CHECK_LIST_COUNT(mgr->pooledPCIHostdevs, nhostdevs);
+
+    ret = testVirHostdevCheckStubDriver();
+
+ cleanup:
+    return ret;
+}
+
+static int
+testVirHostdevPreparePCIHostdevs_pooled(const void *oaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    size_t i;
+    int count, count1, count2;
+
+    for (i = 0; i < nhostdevs; i++)
+        hostdevs[i]->managed = true;
+
+    count1 = virPCIDeviceListCount(mgr->activePCIHostdevs);
+    count2 = virPCIDeviceListCount(mgr->inactivePCIHostdevs);
+
+    /* Ready devices are taken out of the inactive list, the last one
+     * is detached and reset as usual */
+    if (virHostdevPreparePCIDevices(mgr, drv_name, dom_name, uuid,
+                                    hostdevs, nhostdevs,
+                                    VIR_HOSTDEV_PARALLEL_RESET) < 0)
+        goto cleanup;
+    CHECK_LIST_COUNT(mgr->activePCIHostdevs, count1 + 3);
+    CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count2 - 2);
+
+    /* All of them are reset and kept detached once released */
+    virHostdevReAttachPCIDevices(mgr, drv_name, dom_name,
+                                 hostdevs, nhostdevs, NULL);
+    CHECK_LIST_COUNT(mgr->activePCIHostdevs, count1);
+    CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count2 + 1);
+    CHECK_LIST_COUNT(mgr->pooledPCIHostdevs, nhostdevs);
+
+    if (testVirHostdevCheckStubDriver() < 0)
+        goto cleanup;
+
+    /* A pooled device unbound from its stub behind the manager's back
+     * is not ready anymore and gets detached again */
+    if (virPCIDeviceUnbind(dev[0], false) < 0)
+        goto cleanup;
+
+    count2 = virPCIDeviceListCount(mgr->inactivePCIHostdevs);
+    if (virHostdevPreparePCIDevices(mgr, drv_name, dom_name, uuid,
+                                    hostdevs, nhostdevs, 0) < 0)
+        goto cleanup;
+    CHECK_LIST_COUNT(mgr->activePCIHostdevs, count1 + 3);
+    CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count2 - 3);
+
+    if (testVirHostdevCheckStubDriver() < 0)
+        goto cleanup;
+
+    virHostdevReAttachPCIDevices(mgr, drv_name, dom_name,
+                                 hostdevs, nhostdevs, NULL);
+    CHECK_LIST_COUNT(mgr->activePCIHostdevs, count1);
+    CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count2);
+    CHECK_LIST_COUNT(mgr->pooledPCIHostdevs, nhostdevs);
+
+    ret = testVirHostdevCheckStubDriver();
+
+ cleanup:
+    return ret;
+}
+
+static int
+testVirHostdevPCIPoolRemove(const void *oaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+    size_t i;
+    int count, count1;
+
+    for (i = 0; i < nhostdevs; i++) {
+        bool inactive = !!virPCIDeviceListFind(mgr->inactivePCIHostdevs,
+                                               dev[i]);
+
+        count1 = virPCIDeviceListCount(mgr->inactivePCIHostdevs);
+        if (virHostdevPCINodeDeviceReAttach(mgr, dev[i]) < 0)
+            goto cleanup;
+        CHECK_LIST_COUNT(mgr->inactivePCIHostdevs, count1 - inactive);
+        CHECK_LIST_COUNT(mgr->pooledPCIHostdevs, nhostdevs - i - 1);
+    }
+
+    ret = 0;
+
+ cleanup:
+    return ret;
+}
+
 static int
 testVirHostdevUpdateActivePCIHostdevs(const void *oaque ATTRIBUTE_UNUSED)
 {
@@ -450,6 +606,10 @@ mymain(void)
         DO_TEST(testVirHostdevPreparePCIHostdevs_managed);
         DO_TEST(testVirHostdevReAttachPCIHostdevs_managed);
     }
+    DO_TEST(testVirHostdevPCIPoolAdd);
+    if (virHostdevHostSupportsPassthroughKVM())
+        DO_TEST(testVirHostdevPreparePCIHostdevs_pooled);
+    DO_TEST(testVirHostdevPCIPoolRemove);
     DO_TEST(testVirHostdevUpdateActivePCIHostdevs);
 
     myCleanup();
@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * Checks the lockd lock manager plugin against a fake virtlockd,
+ * which knows the batch procedures to acquire and release resources
+ * or not.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virutil.h"
+#include "rpc/virnetmessage.h"
+#include "locking/lock_manager.h"
+#include "locking/lock_protocol.h"
+
+#define VIR_FROM_THIS VIR_FROM_LOCKING
+
+VIR_LOG_INIT("tests.lockdtest");
+
+#define TEST_LOCKD_MAX_CLIENTS 32
+#define TEST_LOCKD_NPROCS (VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES + 1)
+
+typedef enum {
+    TEST_LOCKD_BATCH,       /* knows the batch procedures */
+    TEST_LOCKD_NO_BATCH,    /* predates the batch procedures */
+    TEST_LOCKD_BATCH_FAIL,  /* knows them, but they fail */
+} testLockdMode;
+
+struct testLockdInfo {
+    const char *name;
+    testLockdMode mode;
+    bool acquired;          /* whether acquiring is expected to succeed */
+    int nbatch;             /* batch calls expected for each operation */
+    int nsingle;            /* per resource calls expected for each one */
+};
+
+static int testMode;
+static int testCalls[TEST_LOCKD_NPROCS];
+static int testQuit[2] = { -1, -1 };
+
+static const char *testLeases[] = { "vm-disk-1", "vm-disk-2", "vm-disk-3" };
+
+
+/* Read one call from a client and reply to it */
+static int
+testLockdHandle(int fd)
+{
+    virNetMessagePtr msg;
+    virNetMessageError rerr;
+    char *errmsg = NULL;
+    int proc;
+    int ret = -1;
+
+    memset(&rerr, 0, sizeof(rerr));
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+
+    msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
+    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0 ||
+        saferead(fd, msg->buffer, msg->bufferLength) != msg->bufferLength ||
+        virNetMessageDecodeLength(msg) < 0 ||
+        saferead(fd, msg->buffer + msg->bufferOffset,
+                 msg->bufferLength - msg->bufferOffset) !=
+        msg->bufferLength - msg->bufferOffset ||
+        virNetMessageDecodeHeader(msg) < 0)
+        goto cleanup;
+
+    proc = msg->header.proc;
+    if (proc < 0 || proc >= TEST_LOCKD_NPROCS)
+        goto cleanup;
+    virAtomicIntInc(&testCalls[proc]);
+
+    if (proc == VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES ||
+        proc == VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES) {
+        switch ((testLockdMode) virAtomicIntGet(&testMode)) {
+        case TEST_LOCKD_BATCH:
+            break;
+        case TEST_LOCKD_NO_BATCH:
+            /* As virNetServerProgramDispatch reports it */
+            if (virAsprintf(&errmsg, "unknown procedure: %d", proc) < 0)
+                goto cleanup;
+            break;
+        case TEST_LOCKD_BATCH_FAIL:
+            if (VIR_STRDUP(errmsg, "Unable to decode message payload") < 0)
+                goto cleanup;
+            break;
+        }
+    }
+
+    msg->header.type = VIR_NET_REPLY;
+    if (errmsg) {
+        msg->header.status = VIR_NET_ERROR;
+        rerr.code = VIR_ERR_RPC;
+        rerr.domain = VIR_FROM_RPC;
+        rerr.level = VIR_ERR_ERROR;
+        rerr.message = &errmsg;
+    } else {
+        msg->header.status = VIR_NET_OK;
+    }
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (errmsg ?
+        virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError,
+                                   &rerr) < 0 :
+        virNetMessageEncodePayloadEmpty(msg) < 0)
+        goto cleanup;
+
+    if (safewrite(fd, msg->buffer, msg->bufferLength) != msg->bufferLength)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(errmsg);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+static void
+testLockdServe(void *opaque)
+{
+    int *lfd = opaque;
+    struct pollfd fds[TEST_LOCKD_MAX_CLIENTS + 2];
+    size_t nfds = 2;
+    size_t i;
+
+    memset(fds, 0, sizeof(fds));
+    fds[0].fd = testQuit[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = *lfd;
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[0].revents)
+            break;
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(*lfd, NULL, NULL);
+
+            if (fd >= 0 && nfds < ARRAY_CARDINALITY(fds)) {
+                fds[nfds].fd = fd;
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                nfds++;
+            } else {
+                VIR_FORCE_CLOSE(fd);
+            }
+        }
+
+        for (i = 2; i < nfds; i++) {
+            if (!fds[i].revents)
+                continue;
+
+            if (testLockdHandle(fds[i].fd) < 0) {
+                VIR_FORCE_CLOSE(fds[i].fd);
+                fds[i] = fds[--nfds];
+                i--;
+            }
+        }
+    }
+
+    for (i = 2; i < nfds; i++)
+        VIR_FORCE_CLOSE(fds[i].fd);
+}
+
+
+static int
+testLockdCheckCalls(const char *op,
+                    int batchProc, int nbatch,
+                    int singleProc, int nsingle)
+{
+    int batch = virAtomicIntGet(&testCalls[batchProc]);
+    int single = virAtomicIntGet(&testCalls[singleProc]);
+
+    if (batch != nbatch || single != nsingle) {
+        fprintf(stderr, "%s: %d batch and %d single calls, expected %d and %d\n",
+                op, batch, single, nbatch, nsingle);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLockdAcquireRelease(const void *opaque)
+{
+    const struct testLockdInfo *info = opaque;
+    static int id = 1;
+    virLockManagerPluginPtr plugin = NULL;
+    virLockManagerPtr lock = NULL;
+    virLockManagerParam params[4];
+    virLockManagerParam leaseParams[3];
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    memset(testCalls, 0, sizeof(testCalls));
+    virAtomicIntSet(&testMode, info->mode);
+
+    /* The configuration file does not exist, the defaults are fine */
+    if (!(plugin = virLockManagerPluginNew("lockd", "test",
+                                           abs_builddir "/virlockddata", 0)))
+        goto cleanup;
+
+    memset(params, 0, sizeof(params));
+    params[0].type = VIR_LOCK_MANAGER_PARAM_TYPE_UUID;
+    params[0].key = "uuid";
+    for (i = 0; i < VIR_UUID_BUFLEN; i++)
+        params[0].value.uuid[i] = i + 1;
+    params[1].type = VIR_LOCK_MANAGER_PARAM_TYPE_CSTRING;
+    params[1].key = "name";
+    params[1].value.cstr = info->name;
+    params[2].type = VIR_LOCK_MANAGER_PARAM_TYPE_INT;
+    params[2].key = "id";
+    params[2].value.iv = id;
+    params[3].type = VIR_LOCK_MANAGER_PARAM_TYPE_INT;
+    params[3].key = "pid";
+    params[3].value.iv = getpid() + id++;
+
+    if (!(lock = virLockManagerNew(virLockManagerPluginGetDriver(plugin),
+                                   VIR_LOCK_MANAGER_OBJECT_TYPE_DOMAIN,
+                                   ARRAY_CARDINALITY(params), params, 0)))
+        goto cleanup;
+
+    memset(leaseParams, 0, sizeof(leaseParams));
+    leaseParams[0].type = VIR_LOCK_MANAGER_PARAM_TYPE_CSTRING;
+    leaseParams[0].key = "path";
+    leaseParams[0].value.cstr = "/var/lib/libvirt/lockd";
+    leaseParams[1].type = VIR_LOCK_MANAGER_PARAM_TYPE_CSTRING;
+    leaseParams[1].key = "lockspace";
+    leaseParams[1].value.cstr = "leases";
+    leaseParams[2].type = VIR_LOCK_MANAGER_PARAM_TYPE_ULONG;
+    leaseParams[2].key = "offset";
+    leaseParams[2].value.ul = 0;
+
+    for (i = 0; i < ARRAY_CARDINALITY(testLeases); i++) {
+        if (virLockManagerAddResource(lock,
+                                      VIR_LOCK_MANAGER_RESOURCE_TYPE_LEASE,
+                                      testLeases[i],
+                                      ARRAY_CARDINALITY(leaseParams),
+                                      leaseParams, 0) < 0)
+            goto cleanup;
+    }
+
+    rc = virLockManagerAcquire(lock, NULL, 0,
+                               VIR_DOMAIN_LOCK_FAILURE_DEFAULT, NULL);
+    if ((rc == 0) != info->acquired) {
+        fprintf(stderr, "Acquiring %s unexpectedly\n",
+                rc == 0 ? "succeeded" : "failed");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    if (testLockdCheckCalls("acquire",
+                            VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES,
+                            info->nbatch,
+                            VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCE,
+                            info->nsingle) < 0)
+        goto cleanup;
+
+    if (info->acquired) {
+        if (virLockManagerRelease(lock, NULL, 0) < 0)
+            goto cleanup;
+
+        if (testLockdCheckCalls("release",
+                                VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES,
+                                info->nbatch,
+                                VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCE,
+                                info->nsingle) < 0)
+            goto cleanup;
+
+        /* The connection of the acquisition is kept for the release */
+        if (virAtomicIntGet(&testCalls[VIR_LOCK_SPACE_PROTOCOL_PROC_REGISTER]) != 1) {
+            fprintf(stderr, "Registered %d times, expected once\n",
+                    virAtomicIntGet(&testCalls[VIR_LOCK_SPACE_PROTOCOL_PROC_REGISTER]));
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (lock)
+        virLockManagerFree(lock);
+    if (plugin)
+        virLockManagerPluginUnref(plugin);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char template[] = "/tmp/libvirt_XXXXXX";
+    char *tmpdir = NULL;
+    char *rundir = NULL;
+    char *sockpath = NULL;
+    struct sockaddr_un addr;
+    int lfd = -1;
+    virThread server;
+    bool serving = false;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    virLockManagerSetPluginDir(abs_builddir "/../src/.libs");
+    if (!virFileExists(abs_builddir "/../src/.libs/lockd.so"))
+        return EXIT_AM_SKIP;
+
+    if (!(tmpdir = mkdtemp(template))) {
+        fprintf(stderr, "Unable to create temporary directory\n");
+        return EXIT_FAILURE;
+    }
+
+    /* The plugin connects to the unprivileged virtlockd, whose
+     * socket lives in the runtime directory of the user */
+    if (setenv("XDG_RUNTIME_DIR", tmpdir, 1) < 0 ||
+        virAsprintf(&rundir, "%s/libvirt", tmpdir) < 0 ||
+        virAsprintf(&sockpath, "%s/virtlockd-sock", rundir) < 0 ||
+        virFileMakePath(rundir) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (virStrcpyStatic(addr.sun_path, sockpath) == NULL ||
+        (lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(lfd, TEST_LOCKD_MAX_CLIENTS) < 0 ||
+        pipe(testQuit) < 0 ||
+        virThreadCreate(&server, true, testLockdServe, &lfd) < 0) {
+        fprintf(stderr, "Unable to start the fake virtlockd\n");
+        ret = -1;
+        goto cleanup;
+    }
+    serving = true;
+
+#define DO_TEST(name, mode, acquired, nbatch, nsingle)                  \
+    do {                                                                \
+        struct testLockdInfo info = {                                   \
+            name, mode, acquired, nbatch, nsingle,                      \
+        };                                                              \
+        if (virtTestRun("lockd " name, testLockdAcquireRelease,         \
+                        &info) < 0)                                     \
+            ret = -1;                                                   \
+    } while (0)
+
+    /* One call for all the resources */
+    DO_TEST("batch", TEST_LOCKD_BATCH, true, 1, 0);
+
+    /* Unknown batch procedures make the plugin fall back to one call
+     * for each resource */
+    DO_TEST("no batch", TEST_LOCKD_NO_BATCH, true,
+            1, ARRAY_CARDINALITY(testLeases));
+
+    /* Other errors of the batch procedures are final */
+    DO_TEST("batch failure", TEST_LOCKD_BATCH_FAIL, false, 1, 0);
+
+#undef DO_TEST
+
+ cleanup:
+    if (serving) {
+        ignore_value(safewrite(testQuit[1], "q", 1));
+        virThreadJoin(&server);
+    }
+    VIR_FORCE_CLOSE(testQuit[0]);
+    VIR_FORCE_CLOSE(testQuit[1]);
+    VIR_FORCE_CLOSE(lfd);
+    if (sockpath)
+        unlink(sockpath);
+    if (rundir)
+        rmdir(rundir);
+    rmdir(tmpdir);
+    VIR_FREE(sockpath);
+    VIR_FREE(rundir);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virlockdmock.so")
@@ -30,6 +30,8 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virstring.h"
+#include "virtime.h"
 
 #include "virlockspace.h"
 
@@ -339,6 +341,171 @@ static int testLockSpaceResourceLockPath(const void *args ATTRIBUTE_UNUSED)
 }
 
 
+/*
+ * Resources acquired in a batch, as virtlockd does for the
+ * ACQUIRE_RESOURCES procedure: a resource which cannot be acquired
+ * must leave none of the batch held.
+ */
+static int testLockSpaceResourceBatch(const void *args ATTRIBUTE_UNUSED)
+{
+    virLockSpacePtr lockspace;
+    virLockSpacePtr lockspaces[3];
+    const char *resnames[] = { "foo", "bar", "baz" };
+    unsigned int flags[] = {
+        VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE,
+        VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE,
+        VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE,
+    };
+    size_t i;
+    int ret = -1;
+
+    rmdir(LOCKSPACE_DIR);
+
+    if (!(lockspace = virLockSpaceNew(LOCKSPACE_DIR)))
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(lockspaces); i++)
+        lockspaces[i] = lockspace;
+
+    if (virLockSpaceAcquireResource(lockspace, "bar", 2000,
+                                    VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+        goto cleanup;
+
+    if (virLockSpaceAcquireResources(lockspaces, resnames, flags,
+                                     ARRAY_CARDINALITY(resnames), 1000) == 0)
+        goto cleanup;
+
+    /* The resource acquired before the failure must be released */
+    if (virLockSpaceAcquireResource(lockspace, "foo", 3000,
+                                    VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+        goto cleanup;
+
+    if (virLockSpaceReleaseResource(lockspace, "foo", 3000) < 0)
+        goto cleanup;
+
+    if (virLockSpaceReleaseResource(lockspace, "bar", 2000) < 0)
+        goto cleanup;
+
+    if (virLockSpaceAcquireResources(lockspaces, resnames, flags,
+                                     ARRAY_CARDINALITY(resnames), 1000) < 0)
+        goto cleanup;
+
+    if (virLockSpaceReleaseResource(lockspace, "bar", 1000) < 0)
+        goto cleanup;
+
+    /* A resource not held any more does not prevent releasing others */
+    if (virLockSpaceReleaseResources(lockspaces, resnames,
+                                     ARRAY_CARDINALITY(resnames), 1000) == 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(resnames); i++) {
+        if (virLockSpaceAcquireResource(lockspace, resnames[i], 3000,
+                                        VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+            goto cleanup;
+    }
+
+    if (virLockSpaceReleaseResources(lockspaces, resnames,
+                                     ARRAY_CARDINALITY(resnames), 3000) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virLockSpaceFree(lockspace);
+    rmdir(LOCKSPACE_DIR);
+    return ret;
+}
+
+
+
+/*
+ * Many owners sharing a pool of resources, as virtlockd sees with a
+ * host full of guests: check every owner gets all its leases back
+ * on release and report how long acquiring and releasing takes.
+ */
+static int testLockSpaceManyOwners(const void *args ATTRIBUTE_UNUSED)
+{
+    virLockSpacePtr lockspace;
+    size_t nresources = virTestGetExpensive() ? 500 : 100;
+    size_t nowners = virTestGetExpensive() ? 5000 : 200;
+    size_t perowner = 5;
+    unsigned long long start, acquired, released;
+    char *resname = NULL;
+    size_t i, j;
+    int ret = -1;
+
+    rmdir(LOCKSPACE_DIR);
+
+    if (!(lockspace = virLockSpaceNew(LOCKSPACE_DIR)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nowners; i++) {
+        for (j = 0; j < perowner; j++) {
+            size_t res = (i + j * nresources / perowner) % nresources;
+
+            if (virAsprintf(&resname, "res%zu", res) < 0)
+                goto cleanup;
+
+            if (virLockSpaceAcquireResource(lockspace, resname, 1000 + i,
+                                            VIR_LOCK_SPACE_ACQUIRE_SHARED |
+                                            VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+                goto cleanup;
+            VIR_FREE(resname);
+        }
+    }
+
+    /* A shared resource can be held more than once by one owner */
+    if (virLockSpaceAcquireResource(lockspace, "res0", 1000,
+                                    VIR_LOCK_SPACE_ACQUIRE_SHARED |
+                                    VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+        goto cleanup;
+
+    if (virTimeMillisNow(&acquired) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nowners; i++) {
+        int n = virLockSpaceReleaseResourcesForOwner(lockspace, 1000 + i);
+
+        if (n != perowner) {
+            fprintf(stderr, "Owner %zu released %d resources, expected %zu\n",
+                    1000 + i, n, perowner);
+            goto cleanup;
+        }
+    }
+
+    if (virTimeMillisNow(&released) < 0)
+        goto cleanup;
+
+    if (virLockSpaceReleaseResourcesForOwner(lockspace, 1000) != 0)
+        goto cleanup;
+
+    /* Nothing may be left behind */
+    if (virLockSpaceAcquireResource(lockspace, "res0", geteuid(),
+                                    VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) < 0)
+        goto cleanup;
+
+    if (virLockSpaceReleaseResource(lockspace, "res0", geteuid()) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr,
+                "\n%zu owners x %zu of %zu resources: "
+                "acquire %llu ms, release %llu ms\n",
+                nowners, perowner, nresources,
+                acquired - start, released - acquired);
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(resname);
+    virLockSpaceFree(lockspace);
+    rmdir(LOCKSPACE_DIR);
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -368,6 +535,12 @@ mymain(void)
     if (virtTestRun("Lockspace res full path", testLockSpaceResourceLockPath, NULL) < 0)
         ret = -1;
 
+    if (virtTestRun("Lockspace res batch", testLockSpaceResourceBatch, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Lockspace many owners", testLockSpaceManyOwners, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
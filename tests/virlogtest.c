@@ -21,7 +21,20 @@
 
 #include "testutils.h"
 
+#include <unistd.h>
+
 #include "virlog.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.virlogtest");
+
+#define TEST_LOG_THREADS 4
+#define TEST_LOG_MESSAGES 2000
 
 struct testLogMatchData {
     const char *str;
@@ -43,6 +56,222 @@ testLogMatch(const void *opaque)
 }
 
 
+static void
+testLogWorker(void *opaque)
+{
+    size_t n = *(size_t *) opaque;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        virLogMessage(&virLogSelf, VIR_LOG_INFO, __FILE__, __LINE__,
+                      __func__, NULL, "test message %zu", i);
+}
+
+
+/*
+ * Log @n messages from each of TEST_LOG_THREADS threads to a file
+ * output defined by @fmt, and return the number of messages in it.
+ */
+static int
+testLogToFile(const char *fmt, size_t n, unsigned long long *elapsed)
+{
+    virThread threads[TEST_LOG_THREADS];
+    unsigned long long start, end;
+    char *path = NULL;
+    char *outputs = NULL;
+    char *expected = NULL;
+    char *content = NULL;
+    char *tmp;
+    int ret = -1;
+    size_t i;
+
+    if (virAsprintf(&path, "%s/virlogtest.log", abs_builddir) < 0 ||
+        virAsprintf(&outputs, fmt, path) < 0 ||
+        virAsprintf(&expected, "1:%s", outputs) < 0)
+        goto cleanup;
+    unlink(path);
+
+    virLogReset();
+    if (virLogParseOutputs(expected) != 1 ||
+        virLogSetDefaultPriority(VIR_LOG_DEBUG) < 0)
+        goto cleanup;
+
+    VIR_FREE(outputs);
+    if (!(outputs = virLogGetOutputs()))
+        goto cleanup;
+    if (STRNEQ(outputs, expected)) {
+        fprintf(stderr, "Expected outputs '%s' but got '%s'\n",
+                expected, outputs);
+        goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+    for (i = 0; i < TEST_LOG_THREADS; i++) {
+        if (virThreadCreate(&threads[i], true, testLogWorker, &n) < 0)
+            goto cleanup;
+    }
+    for (i = 0; i < TEST_LOG_THREADS; i++)
+        virThreadJoin(&threads[i]);
+    virLogFlush();
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+    *elapsed = end - start;
+
+    if (virFileReadAll(path, 64 * 1024 * 1024, &content) < 0)
+        goto cleanup;
+
+    ret = 0;
+    for (tmp = content; (tmp = strstr(tmp, ": test message ")); tmp++)
+        ret++;
+
+ cleanup:
+    virLogReset();
+    if (path)
+        unlink(path);
+    VIR_FREE(path);
+    VIR_FREE(outputs);
+    VIR_FREE(expected);
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static int
+testLogAsync(const void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned long long elapsed;
+    int count;
+
+    if ((count = testLogToFile("async:file:%s", TEST_LOG_MESSAGES,
+                               &elapsed)) < 0)
+        return -1;
+
+    /* The queue is large enough for all of them */
+    if (count != TEST_LOG_THREADS * TEST_LOG_MESSAGES) {
+        fprintf(stderr, "Expected %d messages but got %d\n",
+                TEST_LOG_THREADS * TEST_LOG_MESSAGES, count);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLogAsyncBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    size_t n = virTestGetExpensive() ? 100000 : TEST_LOG_MESSAGES;
+    unsigned long long syncTime, asyncTime;
+    int syncCount, asyncCount;
+
+    if ((syncCount = testLogToFile("file:%s", n, &syncTime)) < 0 ||
+        (asyncCount = testLogToFile("async:file:%s", n, &asyncTime)) < 0)
+        return -1;
+
+    if (virTestGetDebug())
+        fprintf(stderr,
+                "\n%d x %zu messages: file %llu ms, async file %llu ms "
+                "(%d written)\n",
+                TEST_LOG_THREADS, n, syncTime, asyncTime, asyncCount);
+
+    return syncCount == TEST_LOG_THREADS * n ? 0 : -1;
+}
+
+
+static int
+testLogSourceEnabled(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int ret = -1;
+
+    virLogReset();
+    if (virLogSourceEnabled(&virLogSelf, VIR_LOG_INFO) ||
+        !virLogSourceEnabled(&virLogSelf, VIR_LOG_WARN)) {
+        fprintf(stderr, "Default priority not applied\n");
+        goto cleanup;
+    }
+
+    if (virLogParseFilters("1:tests.virlog 4:tests") != 2 ||
+        !virLogSourceEnabled(&virLogSelf, VIR_LOG_DEBUG)) {
+        fprintf(stderr, "Filter not applied\n");
+        goto cleanup;
+    }
+
+    virLogReset();
+    if (virLogParseFilters("4:virlogtest") != 1 ||
+        virLogSourceEnabled(&virLogSelf, VIR_LOG_WARN)) {
+        fprintf(stderr, "Filter not applied\n");
+        goto cleanup;
+    }
+
+    virLogReset();
+    if (virLogSetDefaultPriority(VIR_LOG_INFO) < 0 ||
+        !virLogSourceEnabled(&virLogSelf, VIR_LOG_INFO)) {
+        fprintf(stderr, "Default priority change not applied\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virLogReset();
+    return ret;
+}
+
+
+static int testLogArgCalls;
+
+static int
+testLogArg(void)
+{
+    return testLogArgCalls++;
+}
+
+
+/*
+ * Disabled log statements are everywhere on hot paths, so report what
+ * one costs compared to calling into the logger to find out.
+ */
+static int
+testLogDisabledBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    size_t n = virTestGetExpensive() ? 100000000 : 1000000;
+    unsigned long long start, inlineTime, callTime;
+    size_t i;
+
+    virLogReset();
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+    for (i = 0; i < n; i++)
+        VIR_INFO("disabled %zu %d", i, testLogArg());
+    if (virTimeMillisNow(&inlineTime) < 0)
+        return -1;
+    inlineTime -= start;
+
+    /* Arguments must not be evaluated for disabled messages */
+    if (testLogArgCalls != 0) {
+        fprintf(stderr, "Arguments of disabled message evaluated\n");
+        return -1;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+    for (i = 0; i < n; i++)
+        virLogMessage(&virLogSelf, VIR_LOG_INFO, __FILE__, __LINE__,
+                      __func__, NULL, "disabled %zu %d", i, testLogArg());
+    if (virTimeMillisNow(&callTime) < 0)
+        return -1;
+    callTime -= start;
+
+    if (virTestGetDebug())
+        fprintf(stderr,
+                "\n%zu disabled messages: VIR_INFO %llu ms, "
+                "virLogMessage %llu ms\n", n, inlineTime, callTime);
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -61,6 +290,16 @@ mymain(void)
 
     TEST_LOG_MATCH("libvirt:  error : cannot execute binary /usr/libexec/libvirt_lxc: No such file or directory", false);
 
+    if (virtTestRun("Async output", testLogAsync, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Async output benchmark", testLogAsyncBench, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Source priority", testLogSourceEnabled, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Disabled message benchmark",
+                    testLogDisabledBench, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
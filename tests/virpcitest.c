@@ -31,6 +31,8 @@
 # include <fcntl.h>
 # include <virpci.h>
 
+# include "virtime.h"
+
 # define VIR_FROM_THIS VIR_FROM_NONE
 
 static int
@@ -164,6 +166,72 @@ testVirPCIDeviceReset(const void *opaque ATTRIBUTE_UNUSED)
     return ret;
 }
 
+/* Devices on three different buses, two of them sharing one */
+static const char *resetDevs[] = {
+    "0000:00:01.0", "0000:00:02.0", "0001:01:00.0", "0005:90:01.0",
+};
+
+static int
+testVirPCIDeviceListReset(const void *opaque)
+{
+    bool parallel = *(const bool *) opaque;
+    int ret = -1;
+    virPCIDeviceListPtr devs = NULL;
+    virPCIDeviceListPtr activeDevs = NULL, inactiveDevs = NULL;
+    virPCIDevicePtr dev = NULL;
+    unsigned long long start, end;
+    size_t i;
+
+    if (!(devs = virPCIDeviceListNew()) ||
+        !(activeDevs = virPCIDeviceListNew()) ||
+        !(inactiveDevs = virPCIDeviceListNew()))
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(resetDevs); i++) {
+        virPCIDeviceAddress addr;
+        char *name = (char *) resetDevs[i];
+
+        if (virPCIDeviceAddressParse(name, &addr) < 0 ||
+            !(dev = virPCIDeviceNew(addr.domain, addr.bus,
+                                    addr.slot, addr.function)) ||
+            virPCIDeviceSetStubDriver(dev, "pci-stub") < 0 ||
+            virPCIDeviceListAddCopy(inactiveDevs, dev) < 0 ||
+            virPCIDeviceListAdd(devs, dev) < 0)
+            goto cleanup;
+        dev = NULL;
+    }
+
+    if (virTimeMillisNow(&start) < 0 ||
+        virPCIDeviceListReset(devs, activeDevs, inactiveDevs, parallel) < 0 ||
+        virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\nReset %zu devices %s in %llu ms\n",
+                virPCIDeviceListCount(devs),
+                parallel ? "concurrently" : "serially", end - start);
+
+    /* An active device must not be reset, whichever way */
+    if (virPCIDeviceListAddCopy(activeDevs,
+                                virPCIDeviceListGet(devs, 2)) < 0)
+        goto cleanup;
+
+    if (virPCIDeviceListReset(devs, activeDevs, inactiveDevs, parallel) == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Resetting an active device should have failed");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    ret = 0;
+ cleanup:
+    virPCIDeviceFree(dev);
+    virObjectUnref(devs);
+    virObjectUnref(activeDevs);
+    virObjectUnref(inactiveDevs);
+    return ret;
+}
+
 static int
 testVirPCIDeviceReattach(const void *opaque ATTRIBUTE_UNUSED)
 {
@@ -357,6 +425,8 @@ mymain(void)
 {
     int ret = 0;
     char *fakesysfsdir;
+    bool serial = false;
+    bool parallel = true;
 
     if (VIR_STRDUP_QUIET(fakesysfsdir, FAKESYSFSDIRTEMPLATE) < 0) {
         fprintf(stderr, "Out of memory\n");
@@ -417,6 +487,12 @@ mymain(void)
     DO_TEST(testVirPCIDeviceNew);
     DO_TEST(testVirPCIDeviceDetach);
     DO_TEST(testVirPCIDeviceReset);
+    if (virtTestRun("testVirPCIDeviceListReset(serial)",
+                    testVirPCIDeviceListReset, &serial) < 0)
+        ret = -1;
+    if (virtTestRun("testVirPCIDeviceListReset(parallel)",
+                    testVirPCIDeviceListReset, &parallel) < 0)
+        ret = -1;
     DO_TEST(testVirPCIDeviceReattach);
     DO_TEST_PCI(testVirPCIDeviceIsAssignable, 5, 0x90, 1, 0);
     DO_TEST_PCI(testVirPCIDeviceIsAssignable, 1, 1, 0, 0);
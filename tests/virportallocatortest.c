@@ -115,6 +115,9 @@ int bind(int sockfd ATTRIBUTE_UNUSED,
 #  include "virlog.h"
 #  include "virportallocator.h"
 #  include "virstring.h"
+#  include "virthread.h"
+#  include "virbitmap.h"
+#  include "virtime.h"
 
 #  define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -243,6 +246,166 @@ static int testAllocReuse(const void *args ATTRIBUTE_UNUSED)
 }
 
 
+#  define CONTENTION_START 20000
+#  define CONTENTION_THREADS 8
+#  define CONTENTION_PORTS 100
+
+struct testContentionData {
+    virPortAllocatorPtr alloc;
+    unsigned short ports[CONTENTION_PORTS];
+    int ret;
+};
+
+static void testAllocContentionThread(void *opaque)
+{
+    struct testContentionData *data = opaque;
+    size_t i;
+
+    data->ret = 0;
+    for (i = 0; i < CONTENTION_PORTS; i++) {
+        if (virPortAllocatorAcquire(data->alloc, &data->ports[i]) < 0) {
+            data->ret = -1;
+            return;
+        }
+    }
+}
+
+/*
+ * Many threads acquiring ports at the same time must never be handed
+ * the same port, and once everything is released the whole range has
+ * to be available again.
+ */
+static int testAllocContention(const void *args ATTRIBUTE_UNUSED)
+{
+    virPortAllocatorPtr alloc;
+    struct testContentionData data[CONTENTION_THREADS];
+    virThread threads[CONTENTION_THREADS];
+    virBitmapPtr seen = NULL;
+    unsigned short end = CONTENTION_START +
+        CONTENTION_THREADS * CONTENTION_PORTS - 1;
+    unsigned short port;
+    bool dup;
+    size_t i, j;
+    int ret = -1;
+
+    if (!(alloc = virPortAllocatorNew("test", CONTENTION_START, end)))
+        return -1;
+
+    if (!(seen = virBitmapNew(CONTENTION_THREADS * CONTENTION_PORTS)))
+        goto cleanup;
+
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        data[i].alloc = alloc;
+        if (virThreadCreate(&threads[i], true,
+                            testAllocContentionThread, &data[i]) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < CONTENTION_THREADS; i++)
+        virThreadJoin(&threads[i]);
+
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        if (data[i].ret < 0)
+            goto cleanup;
+
+        for (j = 0; j < CONTENTION_PORTS; j++) {
+            port = data[i].ports[j];
+            if (port < CONTENTION_START || port > end ||
+                virBitmapGetBit(seen, port - CONTENTION_START, &dup) < 0 ||
+                dup) {
+                if (virTestGetDebug())
+                    fprintf(stderr, "Port %d handed out twice", port);
+                goto cleanup;
+            }
+            ignore_value(virBitmapSetBit(seen, port - CONTENTION_START));
+        }
+    }
+
+    if (virPortAllocatorAcquire(alloc, &port) == 0) {
+        if (virTestGetDebug())
+            fprintf(stderr, "Expected error, got %d", port);
+        goto cleanup;
+    }
+
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        for (j = 0; j < CONTENTION_PORTS; j++) {
+            if (virPortAllocatorRelease(alloc, data[i].ports[j]) < 0)
+                goto cleanup;
+        }
+    }
+
+    if (virPortAllocatorAcquire(alloc, &port) < 0)
+        goto cleanup;
+    if (port != CONTENTION_START) {
+        if (virTestGetDebug())
+            fprintf(stderr, "Expected %d, got %d", CONTENTION_START, port);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBitmapFree(seen);
+    virObjectUnref(alloc);
+    return ret;
+}
+
+
+/*
+ * Filling up a large range and hitting exhaustion is what a host with
+ * thousands of consoles does, so report how long that takes.
+ */
+static int testAllocExhaustion(const void *args ATTRIBUTE_UNUSED)
+{
+    virPortAllocatorPtr alloc;
+    unsigned short port;
+    unsigned long long then, now;
+    size_t iterations = virTestGetExpensive() ? 10 : 1;
+    size_t i, j;
+    int ret = -1;
+
+    if (!(alloc = virPortAllocatorNew("test", 20000, 29999)))
+        return -1;
+
+    if (virTimeMillisNow(&then) < 0)
+        goto cleanup;
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < 10000; j++) {
+            if (virPortAllocatorAcquire(alloc, &port) < 0)
+                goto cleanup;
+            if (port != 20000 + j) {
+                if (virTestGetDebug())
+                    fprintf(stderr, "Expected %zu, got %d", 20000 + j, port);
+                goto cleanup;
+            }
+        }
+
+        if (virPortAllocatorAcquire(alloc, &port) == 0) {
+            if (virTestGetDebug())
+                fprintf(stderr, "Expected error, got %d", port);
+            goto cleanup;
+        }
+
+        for (j = 0; j < 10000; j++) {
+            if (virPortAllocatorRelease(alloc, 20000 + j) < 0)
+                goto cleanup;
+        }
+    }
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu fills of 10000 ports took %llu ms\n",
+                iterations, now - then);
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(alloc);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -254,6 +417,12 @@ mymain(void)
     if (virtTestRun("Test alloc reuse", testAllocReuse, NULL) < 0)
         ret = -1;
 
+    if (virtTestRun("Test alloc contention", testAllocContention, NULL) < 0)
+        ret = -1;
+
+    if (virtTestRun("Test alloc exhaustion", testAllocExhaustion, NULL) < 0)
+        ret = -1;
+
     setenv("LIBVIRT_TEST_IPV4ONLY", "really", 1);
 
     if (virtTestRun("Test IPv4-only alloc all", testAllocAll, NULL) < 0)
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef __linux__
+
+# include <stdlib.h>
+# include <unistd.h>
+# include <sys/stat.h>
+
+# define __VIR_PROCESS_PRIV_H_ALLOW__
+# include "virprocesspriv.h"
+# include "virfile.h"
+# include "virstring.h"
+# include "virtime.h"
+# include "viralloc.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define FAKEPROCDIRTEMPLATE abs_builddir "/fakeprocdir-XXXXXX"
+
+/* A big guest: one emulator thread plus this many vCPU threads */
+# define TEST_PID 4242
+# define TEST_NTASKS 240
+
+static char *fakeprocdir;
+static pid_t tids[TEST_NTASKS];
+
+/*
+ * Write a /proc/<pid>/task/<tid>/stat file. utime and stime are
+ * derived from @tid so every thread has distinct, checkable values.
+ * The command name deliberately contains spaces and ')'.
+ */
+static int
+testWriteTaskStat(pid_t tid)
+{
+    char *dir = NULL;
+    char *path = NULL;
+    char *content = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&dir, "%s/%d/task/%d", fakeprocdir, TEST_PID, tid) < 0 ||
+        virAsprintf(&path, "%s/stat", dir) < 0 ||
+        virAsprintf(&content,
+                    "%d (qemu) (CPU %d/KVM) S 1 %d %d 0 -1 4202816 1 0 0 0 "
+                    "%d %d 0 0 20 0 %d 0 1234 1048576 %d "
+                    "18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 -1 %d "
+                    "0 0 0 0 0\n",
+                    tid, tid, TEST_PID, TEST_PID,
+                    tid * 10, tid, TEST_NTASKS + 1,
+                    tid * 2, tid % 8) < 0)
+        goto cleanup;
+
+    if (virFileMakePath(dir) < 0 ||
+        virFileWriteStr(path, content, 0644) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(dir);
+    VIR_FREE(path);
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static int
+testCheckStats(virProcessStatInfoPtr stats, size_t nstats)
+{
+    long long hz = sysconf(_SC_CLK_TCK);
+    long pagekb = sysconf(_SC_PAGESIZE) >> 10;
+    size_t i;
+
+    for (i = 0; i < nstats; i++) {
+        unsigned long long cpuTime = 1000ull * 1000ull * 1000ull *
+            (tids[i] * 11) / hz;
+
+        if (stats[i].cpuTime != cpuTime ||
+            stats[i].lastCpu != tids[i] % 8 ||
+            stats[i].vmRSS != tids[i] * 2 * pagekb) {
+            fprintf(stderr,
+                    "Task %d: got cpuTime=%llu cpu=%d rss=%ld, "
+                    "expected cpuTime=%llu cpu=%d rss=%ld\n",
+                    tids[i], stats[i].cpuTime, stats[i].lastCpu,
+                    stats[i].vmRSS, cpuTime, tids[i] % 8,
+                    tids[i] * 2 * pagekb);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testTasksStatInfo(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virProcessStatInfo stats[TEST_NTASKS];
+
+    if (virProcessGetTasksStatInfoInternal(fakeprocdir, TEST_PID,
+                                           tids, TEST_NTASKS, stats) < 0)
+        return -1;
+
+    return testCheckStats(stats, TEST_NTASKS);
+}
+
+
+static int
+testTasksStatInfoExited(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virProcessStatInfo stats[2];
+    pid_t gone[2] = { tids[0], 999999 };
+
+    if (virProcessGetTasksStatInfoInternal(fakeprocdir, TEST_PID,
+                                           gone, 2, stats) < 0)
+        return -1;
+
+    if (testCheckStats(stats, 1) < 0)
+        return -1;
+
+    /* A thread which exited is reported with zeroed stats */
+    if (stats[1].cpuTime != 0 || stats[1].lastCpu != 0 ||
+        stats[1].vmRSS != 0) {
+        fprintf(stderr, "Exited task did not get zeroed stats\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Sweeping all threads of a large guest is what stats polling does
+ * on every call, so report how long that takes on the synthetic tree.
+ */
+static int
+testTasksStatInfoBench(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virProcessStatInfo stats[TEST_NTASKS];
+    unsigned long long start, end;
+    size_t i;
+    size_t iterations = virTestGetExpensive() ? 10000 : 100;
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    for (i = 0; i < iterations; i++) {
+        if (virProcessGetTasksStatInfoInternal(fakeprocdir, TEST_PID,
+                                               tids, TEST_NTASKS, stats) < 0)
+            return -1;
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        return -1;
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\n%zu sweeps of %d tasks took %llu ms\n",
+                iterations, TEST_NTASKS, end - start);
+
+    return testCheckStats(stats, TEST_NTASKS);
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t i;
+
+    if (VIR_STRDUP_QUIET(fakeprocdir, FAKEPROCDIRTEMPLATE) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        abort();
+    }
+
+    if (!mkdtemp(fakeprocdir)) {
+        fprintf(stderr, "Cannot create fakeprocdir");
+        abort();
+    }
+
+    for (i = 0; i < TEST_NTASKS; i++) {
+        tids[i] = TEST_PID + 1 + i;
+        if (testWriteTaskStat(tids[i]) < 0) {
+            fprintf(stderr, "Cannot populate fakeprocdir");
+            ret = -1;
+            goto cleanup;
+        }
+    }
+
+    if (virtTestRun("Tasks stat info", testTasksStatInfo, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Tasks stat info exited", testTasksStatInfoExited, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Tasks stat info benchmark", testTasksStatInfoBench, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(fakeprocdir);
+
+    VIR_FREE(fakeprocdir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+#else
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
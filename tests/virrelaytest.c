@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2014 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef __linux__
+
+# include <fcntl.h>
+# include <poll.h>
+# include <stdlib.h>
+# include <unistd.h>
+
+# include "virrelay.h"
+# include "virfile.h"
+# include "virstring.h"
+# include "virtime.h"
+# include "viralloc.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define CHUNK_SIZE 4096
+
+/* Byte @i of the relayed stream */
+static char
+testPattern(unsigned long long i)
+{
+    return (i * 7 + i / 4093) & 0xff;
+}
+
+
+static void
+testFillChunk(char *buf, size_t len, unsigned long long offset)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        buf[i] = testPattern(offset + i);
+}
+
+
+static int
+testCheckChunk(const char *buf, size_t len, unsigned long long offset)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (buf[i] != testPattern(offset + i)) {
+            fprintf(stderr, "Byte %llu differs\n", offset + i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*
+ * Fill a relay without flushing it until it is full, then check all the
+ * data comes out.
+ */
+static int
+testRelayStalled(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virRelayPtr relay = NULL;
+    int in[2] = { -1, -1 };
+    int out[2] = { -1, -1 };
+    char buf[CHUNK_SIZE];
+    unsigned long long written = 0;
+    unsigned long long nread = 0;
+    ssize_t done;
+    int ret = -1;
+
+    if (!(relay = virRelayNew()))
+        goto cleanup;
+
+    if (pipe2(in, O_NONBLOCK) < 0 || pipe2(out, O_NONBLOCK) < 0)
+        goto cleanup;
+
+    while (!virRelayIsFull(relay)) {
+        testFillChunk(buf, sizeof(buf), written);
+        if ((done = write(in[1], buf, sizeof(buf))) < 0) {
+            if (errno != EAGAIN)
+                goto cleanup;
+            done = 0;
+        }
+        written += done;
+
+        if (virRelayFill(relay, in[0]) < 0 && errno != EAGAIN)
+            goto cleanup;
+    }
+
+    if (virRelayGetLength(relay) < sizeof(buf)) {
+        fprintf(stderr, "Relay full with %zu bytes only\n",
+                virRelayGetLength(relay));
+        goto cleanup;
+    }
+
+    if (virRelayFill(relay, in[0]) != -1 || errno != EAGAIN) {
+        fprintf(stderr, "Full relay accepted more data\n");
+        goto cleanup;
+    }
+
+    while (virRelayGetLength(relay) ||
+           virRelayFill(relay, in[0]) > 0) {
+        if (virRelayFlush(relay, out[1]) < 0 && errno != EAGAIN)
+            goto cleanup;
+
+        while ((done = read(out[0], buf, sizeof(buf))) > 0) {
+            if (testCheckChunk(buf, done, nread) < 0)
+                goto cleanup;
+            nread += done;
+        }
+    }
+
+    if (nread != written || virRelayGetTotal(relay) != written) {
+        fprintf(stderr, "Wrote %llu bytes, read %llu, relayed %llu\n",
+                written, nread, virRelayGetTotal(relay));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(in[0]);
+    VIR_FORCE_CLOSE(in[1]);
+    VIR_FORCE_CLOSE(out[0]);
+    VIR_FORCE_CLOSE(out[1]);
+    virRelayFree(relay);
+    return ret;
+}
+
+
+/*
+ * Relay data from one pty to another the way the LXC controller does
+ * for consoles, and report the throughput.
+ */
+static int
+testRelayPty(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virRelayPtr relay = NULL;
+    int srcMaster = -1, dstMaster = -1;
+    int srcSlave = -1, dstSlave = -1;
+    char *srcName = NULL, *dstName = NULL;
+    char buf[CHUNK_SIZE];
+    unsigned long long total = virTestGetExpensive() ? 256 << 20 : 16 << 20;
+    unsigned long long written = 0;
+    unsigned long long nread = 0;
+    unsigned long long start, end;
+    ssize_t done;
+    int ret = -1;
+
+    if (!(relay = virRelayNew()))
+        goto cleanup;
+
+    if (virFileOpenTty(&srcMaster, &srcName, 1) < 0 ||
+        virFileOpenTty(&dstMaster, &dstName, 1) < 0 ||
+        (srcSlave = open(srcName, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0 ||
+        (dstSlave = open(dstName, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+        ret = EXIT_AM_SKIP;
+        goto cleanup;
+    }
+
+    if (virTimeMillisNow(&start) < 0)
+        goto cleanup;
+
+    while (nread < total) {
+        struct pollfd fds[] = {
+            { .fd = srcSlave, .events = written < total ? POLLOUT : 0 },
+            { .fd = srcMaster,
+              .events = virRelayIsFull(relay) ? 0 : POLLIN },
+            { .fd = dstMaster,
+              .events = virRelayGetLength(relay) ? POLLOUT : 0 },
+            { .fd = dstSlave, .events = POLLIN },
+        };
+
+        if (poll(fds, ARRAY_CARDINALITY(fds), 10 * 1000) <= 0) {
+            fprintf(stderr, "Relay stalled after %llu bytes\n", nread);
+            goto cleanup;
+        }
+
+        if (fds[0].revents & POLLOUT) {
+            size_t len = MIN(sizeof(buf), total - written);
+            testFillChunk(buf, len, written);
+            if ((done = write(srcSlave, buf, len)) < 0 && errno != EAGAIN)
+                goto cleanup;
+            if (done > 0)
+                written += done;
+        }
+
+        if (fds[1].revents & POLLIN &&
+            virRelayFill(relay, srcMaster) < 0 && errno != EAGAIN)
+            goto cleanup;
+
+        if (fds[2].revents & POLLOUT &&
+            virRelayFlush(relay, dstMaster) < 0 && errno != EAGAIN)
+            goto cleanup;
+
+        if (fds[3].revents & POLLIN) {
+            if ((done = read(dstSlave, buf, sizeof(buf))) < 0 &&
+                errno != EAGAIN)
+                goto cleanup;
+            if (done > 0) {
+                if (testCheckChunk(buf, done, nread) < 0)
+                    goto cleanup;
+                nread += done;
+            }
+        }
+    }
+
+    if (virTimeMillisNow(&end) < 0)
+        goto cleanup;
+
+    if (virRelayGetTotal(relay) != total) {
+        fprintf(stderr, "Relayed %llu bytes instead of %llu\n",
+                virRelayGetTotal(relay), total);
+        goto cleanup;
+    }
+
+    if (virTestGetDebug())
+        fprintf(stderr, "\nRelayed %llu MiB between ptys in %llu ms\n",
+                total >> 20, end - start);
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(srcMaster);
+    VIR_FORCE_CLOSE(dstMaster);
+    VIR_FORCE_CLOSE(srcSlave);
+    VIR_FORCE_CLOSE(dstSlave);
+    VIR_FREE(srcName);
+    VIR_FREE(dstName);
+    virRelayFree(relay);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virtTestRun("Relay stalled", testRelayStalled, NULL) < 0)
+        ret = -1;
+    if (virtTestRun("Relay pty", testRelayPty, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
+#else
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
@@ -72,6 +72,29 @@ static int testTimeFields(const void *args)
 }
 
 
+static int
+testTimeMonotonic(const void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned long long then, now;
+    size_t i;
+
+    if (virTimeMicrosMonotonicRaw(&then) < 0)
+        return -1;
+
+    for (i = 0; i < 1000; i++) {
+        if (virTimeMicrosMonotonicRaw(&now) < 0)
+            return -1;
+        if (now < then) {
+            fprintf(stderr, "Monotonic time went back from %llu to %llu\n",
+                    then, now);
+            return -1;
+        }
+        then = now;
+    }
+
+    return 0;
+}
+
 static int
 mymain(void)
 {
@@ -119,6 +142,9 @@ mymain(void)
 
     TEST_FIELDS(2147483648000ull, 2038,  1, 19,  3, 14,  8);
 
+    if (virtTestRun("Test monotonic time", testTimeMonotonic, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -369,6 +369,10 @@ cmdDomMemStat(vshControl *ctl, const vshCmd *cmd)
             vshPrint(ctl, "actual %llu\n", stats[i].val);
         if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_RSS)
             vshPrint(ctl, "rss %llu\n", stats[i].val);
+        if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_NUMA_MOVES)
+            vshPrint(ctl, "numa_moves %llu\n", stats[i].val);
+        if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_NUMA_LOCALITY)
+            vshPrint(ctl, "numa_locality %llu\n", stats[i].val);
     }
 
     ret = true;
@@ -11064,6 +11064,50 @@ vshEventDeviceRemovedPrint(virConnectPtr conn ATTRIBUTE_UNUSED,
         vshEventDone(data->ctl);
 }
 
+static void
+vshEventNumaChangePrint(virConnectPtr conn ATTRIBUTE_UNUSED,
+                        virDomainPtr dom,
+                        const char *oldNodeset,
+                        const char *newNodeset,
+                        void *opaque)
+{
+    vshDomEventData *data = opaque;
+
+    if (!data->loop && *data->count)
+        return;
+    vshPrint(data->ctl,
+             _("event 'numa-change' for domain %s: %s -> %s\n"),
+             virDomainGetName(dom), oldNodeset, newNodeset);
+    (*data->count)++;
+    if (!data->loop)
+        vshEventDone(data->ctl);
+}
+
+static void
+vshEventStartTimesPrint(virConnectPtr conn ATTRIBUTE_UNUSED,
+                        virDomainPtr dom,
+                        virTypedParameterPtr params,
+                        int nparams,
+                        void *opaque)
+{
+    vshDomEventData *data = opaque;
+    size_t i;
+    char *value;
+
+    if (!data->loop && *data->count)
+        return;
+    vshPrint(data->ctl, _("event 'start-times' for domain %s:\n"),
+             virDomainGetName(dom));
+    for (i = 0; i < nparams; i++) {
+        value = vshGetTypedParamValue(data->ctl, &params[i]);
+        vshPrint(data->ctl, "\t%s: %s\n", params[i].field, value);
+        VIR_FREE(value);
+    }
+    (*data->count)++;
+    if (!data->loop)
+        vshEventDone(data->ctl);
+}
+
 static vshEventCallback vshEventCallbacks[] = {
     { "lifecycle",
       VIR_DOMAIN_EVENT_CALLBACK(vshEventLifecyclePrint), },
@@ -11095,6 +11139,10 @@ static vshEventCallback vshEventCallbacks[] = {
       VIR_DOMAIN_EVENT_CALLBACK(vshEventPMChangePrint), },
     { "device-removed",
       VIR_DOMAIN_EVENT_CALLBACK(vshEventDeviceRemovedPrint), },
+    { "numa-change",
+      VIR_DOMAIN_EVENT_CALLBACK(vshEventNumaChangePrint), },
+    { "start-times",
+      VIR_DOMAIN_EVENT_CALLBACK(vshEventStartTimesPrint), },
 };
 verify(VIR_DOMAIN_EVENT_ID_LAST == ARRAY_CARDINALITY(vshEventCallbacks));
 